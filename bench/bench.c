@@ -0,0 +1,802 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jansson.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include "../include/tmj.h"
+#include "../src/decode.h"
+#include "../tools/mapgen.h"
+
+/*
+ * libtmj benchmark suite
+ *
+ * Measures throughput of the load and decode entry points over synthetic
+ * inputs of several sizes. Results are printed as a table, and can also be
+ * written as JSON (--json) so that they can be tracked between releases.
+ *
+ * MB/s is always computed on the uncompressed side: JSON bytes for loads,
+ * decoded bytes for the decoders. tiles/s counts 32-bit global tile IDs. Peak
+ * memory is the high-water mark of libtmj's own allocations during one
+ * operation, as reported by tmj_load_stats.
+ *
+ * With --baseline, results are compared against a previous --json run, and
+ * the exit status reports whether any case regressed. This is what the perf_*
+ * ctest cases do; set LIBTMJ_SKIP_PERF in the environment to skip them on
+ * noisy machines.
+ *
+ * Every run starts and ends with a reference case that parses a map with
+ * jansson alone. Throughput is compared relative to it, so a baseline recorded on one
+ * machine still holds on a faster or slower one. Peak memory is compared with
+ * a fixed allowance on top of the percentage, since a few hundred bytes of
+ * bookkeeping growing by 10% says nothing.
+ */
+
+// Exit status telling ctest that a test was skipped
+#define EXIT_SKIPPED 77
+
+typedef struct bench_result {
+    char name[64];
+    char variant[32];
+    size_t size; // Bytes processed per operation
+    size_t tiles; // Tiles processed per operation
+    size_t iterations;
+    double ns_per_op;
+    double mb_per_s;
+    double tiles_per_s;
+    size_t peak_bytes;
+} bench_result;
+
+typedef struct bench_config {
+    double min_time; // Seconds spent measuring each case
+    bool quick;
+    const char* filter;
+    const char* suite; // "load", "decode" or NULL for both
+    const char* json_path;
+    const char* baseline_path;
+    double tolerance; // Allowed throughput drop against the baseline, in percent
+    double memory_tolerance; // Allowed peak memory growth against the baseline, in percent
+    size_t memory_slack; // Peak memory growth allowed whatever the percentage, in bytes
+    bool check_throughput;
+} bench_config;
+
+bench_config config = {0.5, false, NULL, NULL, NULL, NULL, 30.0, 10.0, 65536, true};
+
+// Name of the case throughput is compared relative to
+#define REFERENCE_NAME "reference"
+
+bench_result* results = NULL;
+size_t result_count = 0;
+
+/*
+ * Helpers
+ */
+
+double now_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+
+    return (double)now.QuadPart * 1e9 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+/*
+ * Measurement
+ */
+
+typedef void (*bench_fn)(void* ctx);
+
+bool bench_selected(const char* name) {
+    return config.filter == NULL || strstr(name, config.filter) != NULL;
+}
+
+/**
+ * Runs fn repeatedly for about config.min_time seconds, and records the median
+ * of five timed batches.
+ */
+void bench_run(const char* name, const char* variant, size_t size, size_t tiles, bench_fn fn, void* ctx) {
+    const int BATCHES = 5;
+
+    // Allocation counts don't vary between runs, so one untimed run is enough
+    tmj_load_stats stats = {0};
+
+    tmj_load_stats_attach(&stats);
+    fn(ctx);
+    tmj_load_stats_attach(NULL);
+
+    // Calibrate the batch size so that each batch takes about min_time / BATCHES
+    size_t iters = 1;
+    double batch_target = config.min_time * 1e9 / BATCHES;
+
+    for (;;) {
+        double start = now_ns();
+
+        for (size_t i = 0; i < iters; i++) {
+            fn(ctx);
+        }
+
+        double elapsed = now_ns() - start;
+
+        if (elapsed >= batch_target / 4 || iters >= ((size_t)1 << 30)) {
+            iters = (size_t)(iters * batch_target / (elapsed > 1 ? elapsed : 1));
+            iters = iters ? iters : 1;
+            break;
+        }
+
+        iters *= 4;
+    }
+
+    double samples[5];
+
+    for (int b = 0; b < BATCHES; b++) {
+        double start = now_ns();
+
+        for (size_t i = 0; i < iters; i++) {
+            fn(ctx);
+        }
+
+        samples[b] = (now_ns() - start) / (double)iters;
+    }
+
+    // Median of five
+    for (int i = 1; i < BATCHES; i++) {
+        for (int j = i; j > 0 && samples[j - 1] > samples[j]; j--) {
+            double tmp = samples[j];
+            samples[j] = samples[j - 1];
+            samples[j - 1] = tmp;
+        }
+    }
+
+    results = realloc(results, sizeof(bench_result) * (result_count + 1));
+
+    bench_result* r = &results[result_count++];
+
+    memset(r, 0, sizeof(bench_result));
+
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    snprintf(r->variant, sizeof(r->variant), "%s", variant);
+
+    r->size = size;
+    r->tiles = tiles;
+    r->iterations = iters * BATCHES;
+    r->ns_per_op = samples[BATCHES / 2];
+    r->mb_per_s = (double)size / r->ns_per_op * 1e9 / (1024.0 * 1024.0);
+    r->tiles_per_s = (double)tiles / r->ns_per_op * 1e9;
+    r->peak_bytes = stats.peak_bytes;
+
+    printf("%-22s %-18s %12zu %14.1f %10.1f %14.0f %12zu\n",
+            r->name,
+            r->variant,
+            r->size,
+            r->ns_per_op,
+            r->mb_per_s,
+            r->tiles_per_s,
+            r->peak_bytes);
+    fflush(stdout);
+}
+
+/*
+ * Cases
+ */
+
+typedef struct load_ctx {
+    const char* json;
+} load_ctx;
+
+void run_map_load(void* ctx) {
+    load_ctx* c = ctx;
+
+    Map* m = tmj_map_load(c->json, "bench");
+
+    if (m == NULL) {
+        fprintf(stderr, "tmj_map_load failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    tmj_map_free(m);
+}
+
+// Parses without libtmj, the yardstick for how fast this machine is
+void run_reference(void* ctx) {
+    load_ctx* c = ctx;
+
+    json_t* root = json_loads(c->json, 0, NULL);
+
+    if (root == NULL) {
+        fprintf(stderr, "json_loads failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    json_decref(root);
+}
+
+void run_tileset_load(void* ctx) {
+    load_ctx* c = ctx;
+
+    Tileset* t = tmj_tileset_load(c->json);
+
+    if (t == NULL) {
+        fprintf(stderr, "tmj_tileset_load failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    tmj_tileset_free(t);
+}
+
+typedef struct decode_ctx {
+    const char* b64; // Base64 string
+    const uint8_t* raw; // Encoded bytes
+    size_t raw_size;
+    const char* compression;
+} decode_ctx;
+
+void run_b64_decode(void* ctx) {
+    decode_ctx* c = ctx;
+    size_t size = 0;
+
+    free(tmj_b64_decode(c->b64, &size));
+}
+
+#ifdef LIBTMJ_ZLIB
+void run_zlib_decompress(void* ctx) {
+    decode_ctx* c = ctx;
+    size_t size = 0;
+
+    free(tmj_zlib_decompress(c->raw, c->raw_size, &size));
+}
+#endif
+
+#ifdef LIBTMJ_ZSTD
+void run_zstd_decompress(void* ctx) {
+    decode_ctx* c = ctx;
+    size_t size = 0;
+
+    free(tmj_zstd_decompress(c->raw, c->raw_size, &size));
+}
+#endif
+
+void run_decode_layer(void* ctx) {
+    decode_ctx* c = ctx;
+    size_t size = 0;
+
+    uint32_t* tiles = tmj_decode_layer(c->b64, "base64", c->compression, &size);
+
+    if (tiles == NULL) {
+        fprintf(stderr, "tmj_decode_layer failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    free(tiles);
+}
+
+typedef struct split_ctx {
+    const uint32_t* gids;
+    size_t count;
+    uint32_t* ids;
+    uint8_t* flags;
+} split_ctx;
+
+void run_gids_split(void* ctx) {
+    split_ctx* c = ctx;
+
+    tmj_gids_split(c->gids, c->count, c->ids, c->flags);
+}
+
+// The per-tile loop consumers write by hand, for comparison
+void run_gids_split_scalar(void* ctx) {
+    split_ctx* c = ctx;
+
+    for (size_t i = 0; i < c->count; i++) {
+        c->ids[i] = c->gids[i] & TMJ_GID_MASK;
+        c->flags[i] = (uint8_t)(c->gids[i] >> TMJ_GID_FLAGS_SHIFT);
+    }
+}
+
+typedef struct map_case {
+    const char* variant;
+    int size; // Width and height in tiles
+    int tile_layers;
+    int object_layers;
+    int objects;
+    int properties;
+    bool infinite;
+    mapgen_encoding encoding;
+    mapgen_compression compression;
+    bool large; // Skipped with --quick
+} map_case;
+
+const map_case map_cases[] = {
+        {"csv/32x32x4", 32, 4, 0, 0, 0, false, MAPGEN_CSV, MAPGEN_NONE, false},
+        {"csv/128x128x4", 128, 4, 0, 0, 0, false, MAPGEN_CSV, MAPGEN_NONE, false},
+        {"csv/512x512x4", 512, 4, 0, 0, 0, false, MAPGEN_CSV, MAPGEN_NONE, true},
+        {"csv-inf/128x128x4", 128, 4, 0, 0, 0, true, MAPGEN_CSV, MAPGEN_NONE, false},
+        {"base64/256x256x4", 256, 4, 0, 0, 0, false, MAPGEN_BASE64, MAPGEN_NONE, false},
+        {"zlib/256x256x4", 256, 4, 0, 0, 0, false, MAPGEN_BASE64, MAPGEN_ZLIB, false},
+        {"zstd/256x256x4", 256, 4, 0, 0, 0, false, MAPGEN_BASE64, MAPGEN_ZSTD, false},
+        {"objects/4x500", 32, 1, 4, 500, 2, false, MAPGEN_CSV, MAPGEN_NONE, false},
+        {"objects/4x5000", 32, 1, 4, 5000, 2, false, MAPGEN_CSV, MAPGEN_NONE, true},
+};
+
+/**
+ * Times the reference case. It runs at both ends of a run, so that the scale
+ * follows a machine whose speed drifts while it runs.
+ */
+void bench_reference(const char* variant) {
+    mapgen_config gen;
+
+    mapgen_default_config(&gen);
+    gen.width = 128;
+    gen.height = 128;
+    gen.tile_layers = 4;
+
+    size_t size = 0;
+    load_ctx ctx = {mapgen_map(&gen, &size)};
+
+    bench_run(REFERENCE_NAME, variant, size, 0, run_reference, &ctx);
+
+    free((char*)ctx.json);
+}
+
+void bench_loads(void) {
+    const int tileset_sizes[] = {16, 256, 4096};
+    const size_t count = config.quick ? 2 : 3;
+
+    if (bench_selected("tmj_map_load")) {
+        for (size_t i = 0; i < sizeof(map_cases) / sizeof(map_cases[0]); i++) {
+            const map_case* c = &map_cases[i];
+
+            if ((config.quick && c->large) || !mapgen_compression_supported(c->compression)) {
+                continue;
+            }
+
+            mapgen_config gen;
+
+            mapgen_default_config(&gen);
+            gen.width = c->size;
+            gen.height = c->size;
+            gen.tile_layers = c->tile_layers;
+            gen.object_layers = c->object_layers;
+            gen.objects = c->objects;
+            gen.properties = c->properties;
+            gen.infinite = c->infinite;
+            gen.encoding = c->encoding;
+            gen.compression = c->compression;
+
+            size_t size = 0;
+            load_ctx ctx = {mapgen_map(&gen, &size)};
+
+            bench_run("tmj_map_load", c->variant, size, (size_t)c->size * c->size * c->tile_layers, run_map_load, &ctx);
+
+            free((char*)ctx.json);
+        }
+    }
+
+    if (bench_selected("tmj_tileset_load")) {
+        for (size_t i = 0; i < count; i++) {
+            char variant[32];
+
+            snprintf(variant, sizeof(variant), "%dtiles", tileset_sizes[i]);
+
+            mapgen_config gen;
+
+            mapgen_default_config(&gen);
+            gen.tiles = tileset_sizes[i];
+
+            size_t size = 0;
+            load_ctx ctx = {mapgen_tileset(&gen, 0, &size)};
+
+            bench_run("tmj_tileset_load", variant, size, 0, run_tileset_load, &ctx);
+
+            free((char*)ctx.json);
+        }
+    }
+}
+
+void bench_decoders(void) {
+    const int layer_sizes[] = {64, 256, 1024};
+    const size_t count = config.quick ? 2 : 3;
+
+    for (size_t i = 0; i < count; i++) {
+        size_t tiles = (size_t)layer_sizes[i] * layer_sizes[i];
+        size_t bytes = tiles * sizeof(uint32_t);
+
+        char variant[32];
+        snprintf(variant, sizeof(variant), "%zutiles", tiles);
+
+        uint32_t* data = malloc(bytes);
+
+        mapgen_config gen;
+
+        mapgen_default_config(&gen);
+        gen.width = layer_sizes[i];
+        gen.height = layer_sizes[i];
+
+        mapgen_layer_tiles(&gen, 0, data);
+
+        char* b64 = tmj_b64_encode((uint8_t*)data, bytes);
+
+        if (bench_selected("tmj_gids_split")) {
+            split_ctx ctx = {data, tiles, malloc(bytes), malloc(tiles)};
+            char v[48];
+
+            bench_run("tmj_gids_split", variant, bytes, tiles, run_gids_split, &ctx);
+
+            snprintf(v, sizeof(v), "%s/scalar", variant);
+            bench_run("tmj_gids_split", v, bytes, tiles, run_gids_split_scalar, &ctx);
+
+            free(ctx.ids);
+            free(ctx.flags);
+        }
+
+        if (bench_selected("tmj_b64_decode")) {
+            decode_ctx ctx = {b64, NULL, 0, ""};
+
+            bench_run("tmj_b64_decode", variant, bytes, tiles, run_b64_decode, &ctx);
+        }
+
+        if (bench_selected("tmj_decode_layer")) {
+            decode_ctx ctx = {b64, NULL, 0, ""};
+            char v[48];
+
+            snprintf(v, sizeof(v), "%s/none", variant);
+            bench_run("tmj_decode_layer", v, bytes, tiles, run_decode_layer, &ctx);
+        }
+
+#ifdef LIBTMJ_ZLIB
+        size_t zsize = 0;
+        uint8_t* z = tmj_zlib_compress((uint8_t*)data, bytes, -1, &zsize);
+        char* zb64 = tmj_b64_encode(z, zsize);
+
+        if (bench_selected("tmj_zlib_decompress")) {
+            decode_ctx ctx = {NULL, z, zsize, "zlib"};
+
+            bench_run("tmj_zlib_decompress", variant, bytes, tiles, run_zlib_decompress, &ctx);
+        }
+
+        if (bench_selected("tmj_decode_layer")) {
+            decode_ctx ctx = {zb64, NULL, 0, "zlib"};
+            char v[48];
+
+            snprintf(v, sizeof(v), "%s/zlib", variant);
+            bench_run("tmj_decode_layer", v, bytes, tiles, run_decode_layer, &ctx);
+        }
+
+        free(zb64);
+        free(z);
+#endif
+
+#ifdef LIBTMJ_ZSTD
+        size_t cap = ZSTD_compressBound(bytes);
+        uint8_t* zs = malloc(cap);
+        size_t zssize = ZSTD_compress(zs, cap, data, bytes, 3);
+        char* zsb64 = tmj_b64_encode(zs, zssize);
+
+        if (bench_selected("tmj_zstd_decompress")) {
+            decode_ctx ctx = {NULL, zs, zssize, "zstd"};
+
+            bench_run("tmj_zstd_decompress", variant, bytes, tiles, run_zstd_decompress, &ctx);
+        }
+
+        if (bench_selected("tmj_decode_layer")) {
+            decode_ctx ctx = {zsb64, NULL, 0, "zstd"};
+            char v[48];
+
+            snprintf(v, sizeof(v), "%s/zstd", variant);
+            bench_run("tmj_decode_layer", v, bytes, tiles, run_decode_layer, &ctx);
+        }
+
+        free(zsb64);
+        free(zs);
+#endif
+
+        free(b64);
+        free(data);
+    }
+}
+
+/*
+ * Output
+ */
+
+int write_json(const char* path) {
+    FILE* f = fopen(path, "w");
+
+    if (f == NULL) {
+        fprintf(stderr, "Unable to open '%s' for writing\n", path);
+
+        return -1;
+    }
+
+    fprintf(f, "{\n  \"libtmj_version\": \"%s\",\n  \"min_time\": %.3f,\n  \"results\": [\n", TMJ_VERSION, config.min_time);
+
+    for (size_t i = 0; i < result_count; i++) {
+        bench_result* r = &results[i];
+
+        fprintf(f,
+                "    {\"name\": \"%s\", \"variant\": \"%s\", \"bytes\": %zu, \"tiles\": %zu, \"iterations\": %zu, "
+                "\"ns_per_op\": %.1f, \"mb_per_s\": %.3f, \"tiles_per_s\": %.0f, \"peak_bytes\": %zu}%s\n",
+                r->name,
+                r->variant,
+                r->size,
+                r->tiles,
+                r->iterations,
+                r->ns_per_op,
+                r->mb_per_s,
+                r->tiles_per_s,
+                r->peak_bytes,
+                i + 1 < result_count ? "," : "");
+    }
+
+    fprintf(f, "  ]\n}\n");
+
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/**
+ * Returns the mean throughput of the reference cases recorded in a baseline,
+ * or 0 if it has none.
+ */
+double baseline_reference(json_t* baseline) {
+    size_t idx;
+    json_t* entry;
+    double total = 0;
+    size_t count = 0;
+
+    json_array_foreach(baseline, idx, entry) {
+        const char* name = NULL;
+        double mb_per_s = 0;
+
+        if (json_unpack(entry, "{s:s, s:F}", "name", &name, "mb_per_s", &mb_per_s) == 0 && strcmp(name, REFERENCE_NAME) == 0) {
+            total += mb_per_s;
+            count++;
+        }
+    }
+
+    return count > 0 ? total / (double)count : 0;
+}
+
+/**
+ * Compares the results against a baseline written by --json, and returns the
+ * number of regressions. Cases missing from either side are ignored, so the
+ * baseline may cover more or fewer cases than this run.
+ *
+ * Throughput is scaled by how fast the reference case ran here compared to
+ * the baseline, and isn't checked if either side lacks it.
+ */
+int compare_baseline(const char* path) {
+    json_error_t error;
+    json_t* root = json_load_file(path, 0, &error);
+
+    if (root == NULL) {
+        fprintf(stderr, "Unable to load baseline '%s', %s at line %d column %d\n", path, error.text, error.line, error.column);
+
+        return -1;
+    }
+
+    json_t* baseline = json_object_get(root, "results");
+
+    if (!json_is_array(baseline)) {
+        fprintf(stderr, "Baseline '%s' has no results array\n", path);
+        json_decref(root);
+
+        return -1;
+    }
+
+    double base_reference = baseline_reference(baseline);
+    double reference = 0;
+    size_t reference_count = 0;
+
+    for (size_t i = 0; i < result_count; i++) {
+        if (strcmp(results[i].name, REFERENCE_NAME) == 0) {
+            reference += results[i].mb_per_s;
+            reference_count++;
+        }
+    }
+
+    reference = reference_count > 0 ? reference / (double)reference_count : 0;
+
+    bool check_throughput = config.check_throughput && base_reference > 0 && reference > 0;
+    double scale = check_throughput ? reference / base_reference : 1.0;
+
+    if (config.check_throughput && !check_throughput) {
+        printf("\nNo reference case on both sides, throughput is not compared\n");
+    }
+
+    printf("\nComparing against %s (throughput -%.0f%%%s, peak memory +%.0f%% or +%zu bytes)\n",
+            path,
+            config.tolerance,
+            check_throughput ? "" : " not checked",
+            config.memory_tolerance,
+            config.memory_slack);
+
+    if (check_throughput) {
+        printf("This machine runs the reference at %.2fx the baseline's speed\n", scale);
+    }
+
+    printf("\n");
+
+    int regressions = 0;
+    size_t compared = 0;
+
+    for (size_t i = 0; i < result_count; i++) {
+        bench_result* r = &results[i];
+
+        size_t idx;
+        json_t* entry;
+
+        json_array_foreach(baseline, idx, entry) {
+            const char* name = NULL;
+            const char* variant = NULL;
+            double mb_per_s = 0;
+            json_int_t peak_bytes = 0;
+
+            if (json_unpack(entry, "{s:s, s:s, s:F, s?I}", "name", &name, "variant", &variant, "mb_per_s", &mb_per_s, "peak_bytes", &peak_bytes) == -1) {
+                continue;
+            }
+
+            if (strcmp(name, r->name) != 0 || strcmp(variant, r->variant) != 0) {
+                continue;
+            }
+
+            // The reference only sets the scale, it can't regress against itself
+            if (strcmp(name, REFERENCE_NAME) == 0) {
+                break;
+            }
+
+            compared++;
+
+            double expected = mb_per_s * scale;
+
+            if (check_throughput && r->mb_per_s < expected * (1.0 - config.tolerance / 100.0)) {
+                printf("REGRESSION %-22s %-18s %10.1f MB/s, baseline %.1f MB/s scaled to %.1f MB/s (%+.1f%%)\n",
+                        r->name,
+                        r->variant,
+                        r->mb_per_s,
+                        mb_per_s,
+                        expected,
+                        (r->mb_per_s / expected - 1.0) * 100.0);
+                regressions++;
+            }
+
+            double memory_limit = (double)peak_bytes * (1.0 + config.memory_tolerance / 100.0);
+
+            if ((double)peak_bytes + (double)config.memory_slack > memory_limit) {
+                memory_limit = (double)peak_bytes + (double)config.memory_slack;
+            }
+
+            if (peak_bytes > 0 && (double)r->peak_bytes > memory_limit) {
+                printf("REGRESSION %-22s %-18s %10zu peak bytes, baseline %lld (%+.1f%%)\n",
+                        r->name,
+                        r->variant,
+                        r->peak_bytes,
+                        (long long)peak_bytes,
+                        ((double)r->peak_bytes / (double)peak_bytes - 1.0) * 100.0);
+                regressions++;
+            }
+
+            break;
+        }
+    }
+
+    json_decref(root);
+
+    printf("%zu of %zu cases compared, %d regression(s)\n", compared, result_count - reference_count, regressions);
+
+    return regressions;
+}
+
+void usage(const char* argv0) {
+    printf("Usage: %s [options]\n"
+           "\n"
+           "Options:\n"
+           "  --filter STR            Only run benchmarks whose name contains STR\n"
+           "  --suite load|decode     Only run the load or the decode benchmarks\n"
+           "  --json FILE             Also write results to FILE as JSON\n"
+           "  --min-time SEC          Time spent measuring each case (default 0.5)\n"
+           "  --quick                 Skip the largest input sizes\n"
+           "  --baseline FILE         Fail if results regress against FILE, from an earlier --json run\n"
+           "  --tolerance PCT         Allowed throughput drop against the baseline (default 30)\n"
+           "  --memory-tolerance PCT  Allowed peak memory growth against the baseline (default 10)\n"
+           "  --memory-slack BYTES    Peak memory growth allowed whatever the percentage (default 65536)\n"
+           "  --no-throughput         Only compare peak memory against the baseline\n"
+           "  --help                  Show this message\n"
+           "\n"
+           "Throughput is compared relative to the reference case, which always runs.\n"
+           "Baseline comparisons are skipped (exit status 77) if LIBTMJ_SKIP_PERF is set.\n",
+            argv0);
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            config.filter = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            config.json_path = argv[++i];
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            config.min_time = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--suite") == 0 && i + 1 < argc) {
+            config.suite = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            config.baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            config.tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--memory-tolerance") == 0 && i + 1 < argc) {
+            config.memory_tolerance = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--memory-slack") == 0 && i + 1 < argc) {
+            config.memory_slack = (size_t)strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--no-throughput") == 0) {
+            config.check_throughput = false;
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            config.quick = true;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            usage(argv[0]);
+
+            return EXIT_SUCCESS;
+        } else {
+            usage(argv[0]);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (config.suite && strcmp(config.suite, "load") != 0 && strcmp(config.suite, "decode") != 0) {
+        usage(argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    const char* skip = getenv("LIBTMJ_SKIP_PERF");
+
+    if (config.baseline_path && skip && *skip && strcmp(skip, "0") != 0) {
+        printf("LIBTMJ_SKIP_PERF is set, skipping performance comparison\n");
+
+        return EXIT_SKIPPED;
+    }
+
+    printf("libtmj %s benchmarks\n\n", TMJ_VERSION);
+    printf("%-22s %-18s %12s %14s %10s %14s %12s\n", "name", "variant", "bytes", "ns/op", "MB/s", "tiles/s", "peak");
+
+    bench_reference("json_loads/start");
+
+    if (config.suite == NULL || strcmp(config.suite, "load") == 0) {
+        bench_loads();
+    }
+
+    if (config.suite == NULL || strcmp(config.suite, "decode") == 0) {
+        bench_decoders();
+    }
+
+    bench_reference("json_loads/end");
+
+    if (config.json_path && write_json(config.json_path) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    int regressions = config.baseline_path ? compare_baseline(config.baseline_path) : 0;
+
+    free(results);
+
+    return regressions == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -33,10 +33,75 @@ typedef struct Property {
         bool value_bool;
         char* value_color;
         char* value_file;
-        int value_object;
+        int value_object; // Resolved by tmj_map_property_object()
     };
 } Property;
 
+/**
+ * Flags stored in the high bits of global tile IDs, see
+ * https://doc.mapeditor.org/en/stable/reference/global-tile-ids/
+ */
+#define TMJ_FLIPPED_HORIZONTALLY 0x80000000u
+#define TMJ_FLIPPED_VERTICALLY 0x40000000u
+#define TMJ_FLIPPED_DIAGONALLY 0x20000000u
+#define TMJ_ROTATED_HEXAGONAL_120 0x10000000u
+#define TMJ_GID_MASK 0x0FFFFFFFu // The tile ID bits of a global tile ID
+#define TMJ_GID_FLAGS_SHIFT 28 // Shifts the flags of a global tile ID down to its lowest four bits
+
+/**
+ * The number of flag bitplanes of a compact tile array, one per flag above,
+ * from the highest bit down.
+ */
+#define TMJ_TILE_FLAG_PLANES 4
+
+/**
+ * A run of non-empty tiles on one row of sparse tmj_tiles.
+ */
+typedef struct tmj_tile_run {
+    uint32_t x; // Column of the first tile of the run
+    uint32_t length; // In tiles
+    uint32_t first; // Index of the first tile of the run among the stored tiles
+} tmj_tile_run;
+
+/**
+ * Compact storage for an array of global tile IDs. Tile IDs are stored with
+ * their flags stripped, in the smallest of 1, 2 or 4 bytes that fits the
+ * largest of them. Flags are kept apart, in one bitplane per flag, so arrays
+ * without any flipped tiles carry no flags at all.
+ *
+ * Sparse tiles only store the non-empty tiles, as runs along each row, and
+ * are meant for layers that are mostly empty. Their rows member is non-NULL.
+ *
+ * Read tiles through tmj_tiles_get() and tmj_tiles_read(), which hide the
+ * width and the layout.
+ */
+typedef struct tmj_tiles {
+    size_t size; // Bytes taken, this structure included
+    size_t count; // All tiles, empty ones included
+    uint8_t id_bytes; // 1, 2 or 4
+
+    size_t stored; // Tiles held in ids, count unless sparse
+    const void* ids; // stored tile IDs of id_bytes each, without flags
+
+    /**
+     * NULL if no tile has any flag set. Otherwise TMJ_TILE_FLAG_PLANES
+     * bitplanes of (stored + 7) / 8 bytes each, bit i % 8 of byte i / 8 of a
+     * plane holding that flag for stored tile i.
+     */
+    const uint8_t* flags;
+
+    int width; // Tiles per row, sparse tiles only
+    int height; // Rows, sparse tiles only
+
+    /**
+     * NULL unless sparse. Otherwise height + 1 offsets into runs, the runs of
+     * row y being runs[rows[y]] up to, but not including, runs[rows[y + 1]].
+     * Runs are sorted by x.
+     */
+    const uint32_t* rows;
+    const tmj_tile_run* runs;
+} tmj_tiles;
+
 /**
  * https://doc.mapeditor.org/en/stable/reference/json-map-format/#chunk
  */
@@ -53,6 +118,8 @@ typedef struct Chunk {
         char* data_str;
         unsigned int* data_uint;
     };
+
+    tmj_tiles* data_compact; // Set instead of data_uint by compact loads
 } Chunk;
 
 /**
@@ -106,13 +173,14 @@ typedef struct Object {
 
     bool is_polygon;
 
+    size_t point_first; // Index of the first polygon or polyline point in Layer.points
     union {
         size_t polygon_point_count;
         size_t polyline_point_count;
     };
     union {
-        Point* polygon;
-        Point* polyline;
+        Point* polygon; // Points into Layer.points
+        Point* polyline; // Points into Layer.points
     };
 
     size_t property_count;
@@ -147,6 +215,8 @@ typedef struct Layer {
         char* data_str;
     }; // tilelayer only
 
+    tmj_tiles* data_compact; // Set instead of data_uint by compact loads
+
     int height; // tilelayer only
     int id;
     int imageheight; // imagelayer only
@@ -172,8 +242,20 @@ typedef struct Layer {
     size_t object_count;
     Object* objects; // objectgroup only
 
+    size_t point_count;
+    Point* points; // objectgroup only, every polygon and polyline point of the objects, in object order
+
     size_t property_count;
     Property* properties;
+
+    bool filtered; // Excluded by a layer filter; data, chunks and objects were not loaded
+
+    /**
+     * The layer's objects, when a lazy load deferred unpacking them. This
+     * field is internal state and should not be tampered with; use
+     * tmj_layer_objects() to reach the objects.
+     */
+    json_t* lazy_objects;
 } Layer;
 
 /**
@@ -297,6 +379,34 @@ typedef struct TileOffset {
     int y;
 } TileOffset;
 
+/**
+ * Where a tile's image comes from, and where it is drawn, precomputed by
+ * tmj_tileset_build_rects().
+ */
+typedef struct tmj_tile_rect {
+    const char* image; // The tileset's image, or the tile's own image in image collections. NULL if there is no such tile.
+
+    int x; // Source rectangle in the image, in pixels
+    int y;
+    int width;
+    int height;
+
+    float u0; // The source rectangle normalized to the size of the image
+    float v0;
+    float u1;
+    float v1;
+
+    /**
+     * The rectangle the tile is drawn to, in pixels, relative to the top-left
+     * corner of its map cell. Accounts for the tileset's tilerendersize,
+     * fillmode and tileoffset.
+     */
+    float draw_x;
+    float draw_y;
+    float draw_width;
+    float draw_height;
+} tmj_tile_rect;
+
 /**
  * https://doc.mapeditor.org/en/stable/reference/json-map-format/#tileset
  *
@@ -349,8 +459,52 @@ typedef struct Tileset {
     TileOffset* tileoffset; // Optional
 
     Transformations* transformations; // Optional
+
+    size_t rect_count;
+    tmj_tile_rect* rects; // Optional, indexed by tile ID, see tmj_tileset_build_rects()
+    int rect_grid_width; // The grid the rects were built for
+    int rect_grid_height;
+
+    /**
+     * The embedded tileset, when a lazy load deferred unpacking it. This field
+     * is internal state and should not be tampered with; use tmj_map_tileset()
+     * to reach the tileset.
+     */
+    json_t* lazy_tileset;
 } Tileset;
 
+/**
+ * @ingroup tmj
+ * The parent of top-level entries of Map.flat_layers.
+ */
+#define TMJ_NO_PARENT SIZE_MAX
+
+/**
+ * @ingroup tmj
+ * An entry of Map.flat_layers: a layer, where it sits in the layer tree, and
+ * its state with every enclosing group applied.
+ *
+ * Under TMJ_LOAD_HEADLESS, layer tints and parallax factors aren't loaded,
+ * so every entry has a white tint and parallax factors of 1.
+ */
+typedef struct tmj_flat_layer {
+    Layer* layer;
+
+    size_t parent; // Index of the enclosing group, or TMJ_NO_PARENT
+    size_t end; // Index just past the layer's descendants, so a scan can skip a group
+    size_t depth; // 0 at the top level
+
+    bool visible; // The layer and every enclosing group are visible
+
+    double offsetx; // Summed
+    double offsety; // Summed
+    double opacity; // Multiplied
+    double parallaxx; // Multiplied
+    double parallaxy; // Multiplied
+
+    uint32_t tint; // 0xAARRGGBB, the tint colors multiplied channel by channel, white where unset
+} tmj_flat_layer;
+
 /**
  * https://doc.mapeditor.org/en/stable/reference/json-map-format/#json-map-format
  */
@@ -389,11 +543,31 @@ typedef struct Map {
     size_t layer_count;
     Layer* layers;
 
+    // Layer tree in pre-order, groups before their children
+    size_t flat_layer_count;
+    tmj_flat_layer* flat_layers;
+
+    /**
+     * Loaded objects by ID. These fields are internal state and should not be
+     * tampered with; use tmj_map_object() to look objects up.
+     */
+    bool object_index_dense;
+    size_t object_index_size;
+    Object** object_index;
+
+    // Loaded objects by type and by name, if tmj_load_options.object_lookup was set
+    struct tmj_object_lookup* object_types;
+    struct tmj_object_lookup* object_names;
+
     size_t property_count;
     Property* properties;
 
     size_t tileset_count;
     Tileset* tilesets;
+
+    bool headless; // Loaded with the TMJ_LOAD_HEADLESS profile
+    bool tile_rects; // Loaded with tmj_load_options.tile_rects set
+    bool object_lookup; // Loaded with tmj_load_options.object_lookup set
 } Map;
 
 /**
@@ -412,6 +586,98 @@ typedef struct ObjectTemplate {
  * Public API for loading JSON-formatted Tiled maps and tilesets.
  */
 
+/**
+ * @ingroup tmj
+ * What a load unpacks.
+ */
+typedef enum tmj_load_profile {
+    TMJ_LOAD_FULL = 0, // Everything
+    /**
+     * Skip structures that only matter for drawing the map: Text objects, the
+     * image, imagewidth, imageheight, repeatx, repeaty and transparentcolor
+     * fields of image layers, layer tintcolor, layer parallaxx/parallaxy and
+     * the map's parallax origin, tileset terrains, and tile animations. The
+     * skipped fields are left zeroed. Layers, objects (including their shapes
+     * and polygons), properties and tile data load as usual.
+     */
+    TMJ_LOAD_HEADLESS
+} tmj_load_profile;
+
+/**
+ * @ingroup tmj
+ * Options for tmj_map_loadf_ex(), tmj_map_load_ex(), tmj_tileset_loadf_ex()
+ * and tmj_tileset_load_ex(). Zero-initialize the
+ * structure and set only the fields you need; a zeroed structure loads maps
+ * exactly like tmj_map_loadf() and tmj_map_load().
+ *
+ * The layer filter decides which layers have their tile data, chunks and
+ * objects loaded. A layer is included if it passes the predicate (when one is
+ * set) and matches at least one entry of the non-empty name, ID and type
+ * lists (when any are set). Excluded layers stay in the layer tree with their
+ * scalar fields and properties, so layer_count and the shape of the tree
+ * don't change, but they have the filtered flag set and no data, chunks or
+ * objects. Group layers are never excluded themselves; their nested layers
+ * are filtered individually.
+ */
+typedef struct tmj_load_options {
+    /**
+     * Returns true to include the given layer. The layer's scalar fields and
+     * properties are already loaded when this is called; its data, chunks,
+     * objects and nested layers are not.
+     */
+    bool (*layer_filter)(const Layer* layer, void* userdata);
+    void* layer_filter_userdata;
+
+    const char* const* layer_names;
+    size_t layer_name_count;
+
+    const int* layer_ids;
+    size_t layer_id_count;
+
+    const char* const* layer_types; // "tilelayer", "objectgroup" or "imagelayer"
+    size_t layer_type_count;
+
+    tmj_load_profile profile;
+
+    /**
+     * Defer unpacking the objects of object layers and embedded tilesets until
+     * they are first reached through tmj_layer_objects() and
+     * tmj_map_tileset(). Until then, Layer.objects and Layer.object_count stay
+     * zeroed, and deferred tilesets only have their firstgid filled in.
+     */
+    bool lazy;
+
+    /**
+     * Store CSV tile data as tmj_tiles in Layer.data_compact and
+     * Chunk.data_compact, instead of in data_uint, wherever that takes less
+     * memory. Base64 data is left encoded as usual; tmj_tiles_compact() packs
+     * it once decoded.
+     */
+    bool compact_tiles;
+
+    /**
+     * Store CSV tile data as sparse tmj_tiles, wherever that takes less memory
+     * than data_uint, or than packed tiles if compact_tiles is also set. Suits
+     * decoration and collision layers that are mostly empty.
+     * tmj_tiles_sparse() does the same for decoded base64 data.
+     */
+    bool sparse_tiles;
+
+    /**
+     * Build the Tileset.rects table of every tileset unpacked, with
+     * tmj_tileset_build_rects(). Tilesets embedded in maps use the map's tile
+     * size as their grid size; tilesets loaded on their own use their own
+     * tile size. Ignored by headless loads.
+     */
+    bool tile_rects;
+
+    /**
+     * Index loaded objects by type and by name, for
+     * tmj_map_objects_of_type() and tmj_map_objects_named().
+     */
+    bool object_lookup;
+} tmj_load_options;
+
 /**
  * @ingroup tmj
  * Loads the Tiled map from the file at the given path.
@@ -445,6 +711,36 @@ Map* tmj_map_loadf(const char* path, bool check_extension);
 
 Map* tmj_map_load(const char* map, const char* name);
 
+/**
+ * @ingroup tmj
+ * Loads the Tiled map from the file at the given path, as tmj_map_loadf()
+ * does, with the given load options.
+ *
+ * @param path A relative or absolute filesystem path.
+ * @param check_extension If true, validates that the file extension equals ".tmj" or ".json".
+ * @param options Load options, or NULL for the defaults.
+ *
+ * @return On success, returns a pointer to a map. The map is
+ * dynamically-allocated, and must be freed by the caller using map_free(). On
+ * failure, returns NULL.
+ */
+Map* tmj_map_loadf_ex(const char* path, bool check_extension, const tmj_load_options* options);
+
+/**
+ * @ingroup tmj
+ * Loads the Tiled map from the given JSON object string, as tmj_map_load()
+ * does, with the given load options.
+ *
+ * @param map A JSON string containing a Tiled map object.
+ * @param name A name to use to reference this map in log messages.
+ * @param options Load options, or NULL for the defaults.
+ *
+ * @return On success, returns a pointer to a map. The map is
+ * dynamically-allocated, and must be freed by the caller using map_free(). On
+ * failure, returns NULL.
+ */
+Map* tmj_map_load_ex(const char* map, const char* name, const tmj_load_options* options);
+
 /**
  * @ingroup tmj
  * Loads the Tiled tileset at the given path. The tileset object returned by
@@ -472,6 +768,158 @@ Tileset* tmj_tileset_loadf(const char* path, bool check_extension);
  */
 Tileset* tmj_tileset_load(const char* tileset);
 
+/**
+ * @ingroup tmj
+ * Loads the Tiled tileset at the given path, as tmj_tileset_loadf() does,
+ * with the given load options. The layer filter does not apply to tilesets.
+ *
+ * @param path A relative or absolute filesystem path.
+ * @param check_extension If true, validates that the file extension equals ".tsj" or ".json".
+ * @param options Load options, or NULL for the defaults.
+ *
+ * @return On success, returns a pointer to a tileset. The tileset is
+ * dynamically-allocated, and must be freed by the caller using tileset_free().
+ * On failure, returns NULL.
+ */
+Tileset* tmj_tileset_loadf_ex(const char* path, bool check_extension, const tmj_load_options* options);
+
+/**
+ * @ingroup tmj
+ * Loads the Tiled tileset from the given JSON object string, as
+ * tmj_tileset_load() does, with the given load options. The layer filter does
+ * not apply to tilesets.
+ *
+ * @param tileset A JSON string containing a Tiled tileset object.
+ * @param options Load options, or NULL for the defaults.
+ *
+ * @return On success, returns a pointer to a tileset. The tileset is
+ * dynamically-allocated, and must be freed by the caller using tileset_free().
+ * On failure, returns NULL.
+ */
+Tileset* tmj_tileset_load_ex(const char* tileset, const tmj_load_options* options);
+
+/**
+ * @ingroup tmj
+ * Returns the objects of the given object layer, unpacking them first if a
+ * lazy load deferred them. Later calls return the same objects.
+ *
+ * Unpacking modifies the map, so this function must not be called
+ * concurrently on the same map.
+ *
+ * @param map The map the layer belongs to.
+ * @param layer An object layer of the map, at any depth of the layer tree.
+ * @param[out] count The number of objects. May be NULL.
+ *
+ * @return The layer's objects, which are freed along with the map. Returns
+ * NULL if the layer has no objects or they could not be unpacked.
+ */
+Object* tmj_layer_objects(Map* map, Layer* layer, size_t* count);
+
+/**
+ * @ingroup tmj
+ * Looks up a loaded object by ID. Objects of layers whose objects a lazy load
+ * deferred are found once tmj_layer_objects() has unpacked them.
+ *
+ * If loaded objects share an ID, the one in the first layer in pre-order
+ * (groups before their children), and first in that layer, is returned,
+ * whatever order the layers were unpacked in. Negative IDs are never found.
+ *
+ * @param map A map.
+ * @param id An object ID.
+ *
+ * @return The object, which is freed along with the map. Returns NULL if no
+ * loaded object has the given ID, or if the ID is negative.
+ */
+Object* tmj_map_object(const Map* map, int id);
+
+/**
+ * @ingroup tmj
+ * Resolves an object property of the map, one of its layers or one of their
+ * objects to the object it refers to, with tmj_map_object().
+ *
+ * @param map A map.
+ * @param property A property.
+ *
+ * @return The object, which is freed along with the map. Returns NULL if the
+ * property isn't an object property, or no loaded object has its ID.
+ */
+Object* tmj_map_property_object(const Map* map, const Property* property);
+
+/**
+ * @ingroup tmj
+ * Interns an object type, for tmj_map_objects_of_type(). Objects unpacked
+ * later, by tmj_layer_objects(), don't change the handles of types already
+ * seen.
+ *
+ * @param map A map loaded with tmj_load_options.object_lookup set.
+ * @param type An object type, or class.
+ *
+ * @return The type's handle. Returns 0 if no loaded object has the type, or
+ * the map has no lookup indexes.
+ */
+uint32_t tmj_map_object_type(const Map* map, const char* type);
+
+/**
+ * @ingroup tmj
+ * Interns an object name, for tmj_map_objects_named(). Handles are stable in
+ * the same way as those of tmj_map_object_type().
+ *
+ * @param map A map loaded with tmj_load_options.object_lookup set.
+ * @param name An object name.
+ *
+ * @return The name's handle. Returns 0 if no loaded object has the name, or
+ * the map has no lookup indexes.
+ */
+uint32_t tmj_map_object_name(const Map* map, const char* name);
+
+/**
+ * @ingroup tmj
+ * Returns the loaded objects of the given type, layers in pre-order and
+ * objects in layer order. Objects of deferred layers follow, in the order
+ * tmj_layer_objects() unpacked their layers. The span is owned by the map and
+ * stays valid until the next call to tmj_layer_objects() unpacks a deferred
+ * layer.
+ *
+ * @param map A map loaded with tmj_load_options.object_lookup set.
+ * @param type A handle returned by tmj_map_object_type().
+ * @param[out] count The number of objects.
+ *
+ * @return The objects of the given type. Returns NULL, with a count of 0, for
+ * unknown handles.
+ */
+Object* const* tmj_map_objects_of_type(const Map* map, uint32_t type, size_t* count);
+
+/**
+ * @ingroup tmj
+ * Returns the loaded objects with the given name, in the same order and with
+ * the same lifetime as tmj_map_objects_of_type().
+ *
+ * @param map A map loaded with tmj_load_options.object_lookup set.
+ * @param name A handle returned by tmj_map_object_name().
+ * @param[out] count The number of objects.
+ *
+ * @return The objects with the given name. Returns NULL, with a count of 0,
+ * for unknown handles.
+ */
+Object* const* tmj_map_objects_named(const Map* map, uint32_t name, size_t* count);
+
+/**
+ * @ingroup tmj
+ * Returns the tileset at the given index of the map's tileset array,
+ * unpacking it first if a lazy load deferred it. Later calls return the same
+ * tileset. Tilesets referenced by source are returned as they are.
+ *
+ * Unpacking modifies the map, so this function must not be called
+ * concurrently on the same map.
+ *
+ * @param map A map.
+ * @param index An index less than map->tileset_count.
+ *
+ * @return The tileset, which is freed along with the map. Returns NULL if
+ * the index is out of range or the tileset could not be unpacked.
+ */
+Tileset* tmj_map_tileset(Map* map, size_t index);
+
 /**
  * @ingroup tmj
  * Frees the memory associated with the given map.
@@ -492,6 +940,27 @@ void tmj_map_free(Map* map);
  */
 void tmj_tileset_free(Tileset* tileset);
 
+/**
+ * @ingroup tmj
+ * Builds the Tileset.rects table, which holds the source rectangle, UVs and
+ * draw rectangle of every tile of a tileset, indexed by tile ID. Replaces any
+ * table built before, so it can be called again once the grid size of an
+ * external tileset is known.
+ *
+ * Tiles of a sheet are cut from the tileset image using its columns, margin
+ * and spacing. Tiles of an image collection use their own image, cropped to
+ * their x, y, width and height if those are set; IDs no tile uses have a NULL
+ * image.
+ *
+ * @param tileset A tileset.
+ * @param grid_width The width of a map cell in pixels, the map's tilewidth.
+ * @param grid_height The height of a map cell in pixels, the map's
+ * tileheight.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int tmj_tileset_build_rects(Tileset* tileset, int grid_width, int grid_height);
+
 /**
  * @ingroup tmj
  */
@@ -514,6 +983,123 @@ typedef enum TMJ_LOG_PRIORITY {
  */
 void tmj_log_regcb(bool debug, void (*callback)(tmj_log_priority, const char*));
 
+/**
+ * @ingroup tmj
+ * Registers a callback function to handle logging events, along with a
+ * pointer that is passed back to the callback with every message.
+ *
+ * The callback, userdata pointer, and debug flag are replaced together, so a
+ * message logged concurrently with this call is delivered either entirely to
+ * the previous registration or entirely to the new one. Replaces any callback
+ * registered with tmj_log_regcb().
+ *
+ * The callback may be invoked from any thread that calls into libtmj, and may
+ * be invoked concurrently from several threads. The message string is only
+ * valid for the duration of the call.
+ *
+ * @param debug If set to true, the given callback function will receive debug
+ * messages and information in addition to the higher-priority messages.
+ * @param callback A function that takes a TMJ_LOG_PRIORITY, a char*, and the
+ * given userdata pointer, and returns nothing. NULL unregisters logging.
+ * @param userdata An arbitrary pointer passed through to the callback.
+ */
+void tmj_log_regcb_userdata(bool debug, void (*callback)(tmj_log_priority, const char*, void*), void* userdata);
+
+/**
+ * @ingroup tmj
+ * Timing and memory statistics for load and decode work, filled in by
+ * tmj_map_load(), tmj_map_loadf(), tmj_tileset_load(), tmj_tileset_loadf(),
+ * tmj_decode_layer() and the decoding routines while attached to the calling
+ * thread with tmj_load_stats_attach().
+ *
+ * Every field accumulates across calls, so zero the structure before
+ * attaching it to measure a single load. Times are wall-clock nanoseconds.
+ *
+ * Allocation figures cover memory allocated by libtmj itself. Memory
+ * allocated internally by jansson while parsing is not included.
+ */
+typedef struct tmj_load_stats {
+    uint64_t io_ns; // Reading map and tileset files
+    uint64_t parse_ns; // Parsing JSON, excluding file reads
+    uint64_t unpack_ns; // Unpacking parsed JSON into libtmj structures
+    uint64_t b64_ns; // Base64 decoding
+    uint64_t zlib_ns; // zlib/gzip decompression
+    uint64_t zstd_ns; // zstd decompression
+
+    size_t bytes_read; // JSON input consumed, from files or strings
+    size_t bytes_b64; // Bytes produced by base64 decoding
+    size_t bytes_zlib; // Bytes produced by zlib/gzip decompression
+    size_t bytes_zstd; // Bytes produced by zstd decompression
+
+    size_t alloc_count; // Number of allocations
+    size_t alloc_bytes; // Total bytes allocated
+    size_t live_bytes; // Bytes allocated and not yet released, as seen by the attached calls
+    size_t peak_bytes; // High-water mark of live_bytes
+
+    size_t maps_loaded;
+    size_t tilesets_loaded;
+} tmj_load_stats;
+
+/**
+ * @ingroup tmj
+ * Attaches a statistics structure to the calling thread. Until it is
+ * detached, every load and decode call made on this thread adds to it.
+ * Statistics collection is off by default and costs nothing while nothing is
+ * attached.
+ *
+ * A structure must not be attached to more than one thread at a time.
+ *
+ * @param stats The structure to fill in, or NULL to detach.
+ *
+ * @return The structure previously attached to this thread, or NULL.
+ */
+tmj_load_stats* tmj_load_stats_attach(tmj_load_stats* stats);
+
+/**
+ * @ingroup tmj
+ * Registers instrumentation hooks which are called at the beginning and end
+ * of each traced scope of load and decode work, for display on a timeline
+ * profiler.
+ *
+ * The traced scopes are "map_load_json", "unpack_layers" (once per level of
+ * the layer tree), "unpack_tileset", "tmj_b64_decode", "tmj_zlib_decompress"
+ * and "tmj_zstd_decompress". Scopes nest, and each end call is made on the
+ * same thread, with the same name and userdata, as its begin call.
+ *
+ * Hooks may be called concurrently from every thread that calls into
+ * libtmj. The name strings are static and may be kept.
+ *
+ * @param begin Called when a scope begins. May be NULL.
+ * @param end Called when a scope ends. May be NULL.
+ * @param userdata An arbitrary pointer passed through to both hooks.
+ */
+void tmj_set_trace_hooks(void (*begin)(const char* name, void* userdata), void (*end)(const char* name, void* userdata), void* userdata);
+
+/**
+ * @ingroup tmj
+ * Installs the built-in trace hooks, which write every traced scope to the
+ * given file in Chrome's trace-event JSON format. Load the file in
+ * chrome://tracing or https://ui.perfetto.dev for offline analysis.
+ *
+ * Replaces any hooks registered with tmj_set_trace_hooks().
+ *
+ * @param path The file to write. It is truncated if it already exists.
+ *
+ * @return 0 on success, or -1 if the file could not be opened or a Chrome
+ * trace is already open.
+ */
+int tmj_trace_chrome_open(const char* path);
+
+/**
+ * @ingroup tmj
+ * Removes the built-in trace hooks and finishes writing the trace file. Must
+ * not be called while other threads are still inside libtmj calls.
+ *
+ * @return 0 on success, or -1 if no Chrome trace was open or the file could
+ * not be written.
+ */
+int tmj_trace_chrome_close(void);
+
 ///**
 // * @defgroup util Util
 // *
@@ -571,6 +1157,1072 @@ extern const char* const TMJ_VERSION;
  */
 uint32_t* tmj_decode_layer(const char* data, const char* encoding, const char* compression, size_t* size);
 
+/**
+ * @ingroup tmj
+ * A cache of decoded chunk data, bounded by a memory budget. Lets programs
+ * work with infinite maps that are too large to decode up front, without
+ * decoding chunks again on every access.
+ *
+ * All chunk cache functions may be called concurrently from several threads,
+ * as long as the maps the chunks belong to are not freed in the meantime.
+ */
+typedef struct tmj_chunk_cache tmj_chunk_cache;
+
+/**
+ * @ingroup tmj
+ * Counters for a chunk cache.
+ */
+typedef struct tmj_chunk_cache_stats {
+    size_t hits; // Lookups answered from the cache
+    size_t misses; // Lookups that had to decode the chunk
+    size_t evictions; // Chunks dropped to stay within the budget
+
+    size_t resident_chunks; // Chunks currently cached
+    size_t resident_bytes; // Decoded tile data currently cached
+} tmj_chunk_cache_stats;
+
+/**
+ * @ingroup tmj
+ * Creates an empty chunk cache.
+ *
+ * @param budget The number of bytes of decoded tile data to keep resident.
+ * When a new chunk would exceed it, the least-recently-used chunks are
+ * evicted.
+ *
+ * @return On success, returns a cache which must be freed by the caller using
+ * tmj_chunk_cache_free(). On failure, returns NULL.
+ */
+tmj_chunk_cache* tmj_chunk_cache_create(size_t budget);
+
+/**
+ * @ingroup tmj
+ * Frees a chunk cache along with every chunk it holds. No chunk may still be
+ * in use.
+ *
+ * @param cache A cache returned by tmj_chunk_cache_create(), or NULL.
+ */
+void tmj_chunk_cache_free(tmj_chunk_cache* cache);
+
+/**
+ * @ingroup tmj
+ * Returns the decoded global tile IDs of a chunk, decoding it with
+ * tmj_decode_layer() if it isn't cached.
+ *
+ * The returned chunk is pinned, and will not be evicted until it is handed
+ * back with tmj_chunk_cache_release(). Each call must be paired with a
+ * release. Pinned chunks can push the cache over its budget; it shrinks back
+ * as they are released.
+ *
+ * Chunks of CSV-encoded layers are already decoded, so their data is returned
+ * directly, without being cached or counted. Compact CSV chunks are unpacked
+ * and cached like encoded ones.
+ *
+ * @param cache A chunk cache.
+ * @param layer The tile layer the chunk belongs to.
+ * @param chunk A chunk of the layer. Chunks are cached by address.
+ * @param[out] size The number of tiles in the chunk. May be NULL.
+ *
+ * @return On success, returns width * height global tile IDs, row by row. The
+ * array must not be modified or freed by the caller. On failure, returns NULL.
+ */
+const uint32_t* tmj_chunk_cache_get(tmj_chunk_cache* cache, const Layer* layer, const Chunk* chunk, size_t* size);
+
+/**
+ * @ingroup tmj
+ * Unpins a chunk returned by tmj_chunk_cache_get(), making it available for
+ * eviction once no other caller holds it.
+ *
+ * @param cache A chunk cache.
+ * @param chunk The chunk passed to tmj_chunk_cache_get().
+ */
+void tmj_chunk_cache_release(tmj_chunk_cache* cache, const Chunk* chunk);
+
+/**
+ * @ingroup tmj
+ * Reads a consistent snapshot of the counters of a chunk cache.
+ *
+ * @param cache A chunk cache.
+ * @param[out] stats Filled in with the counters.
+ */
+void tmj_chunk_cache_read_stats(tmj_chunk_cache* cache, tmj_chunk_cache_stats* stats);
+
+/**
+ * @ingroup tmj
+ * Packs an array of global tile IDs into compact storage.
+ *
+ * @param gids The global tile IDs, flags included.
+ * @param count The number of tiles.
+ *
+ * @return On success, returns the packed tiles, which must be freed by the
+ * caller using tmj_tiles_free(). On failure, returns NULL.
+ */
+tmj_tiles* tmj_tiles_compact(const uint32_t* gids, size_t count);
+
+/**
+ * @ingroup tmj
+ * Packs a grid of global tile IDs into sparse storage, keeping only the
+ * non-empty tiles.
+ *
+ * @param gids The global tile IDs, flags included, row by row.
+ * @param width The number of tiles per row.
+ * @param height The number of rows.
+ *
+ * @return On success, returns the sparse tiles, which must be freed by the
+ * caller using tmj_tiles_free(). On failure, returns NULL.
+ */
+tmj_tiles* tmj_tiles_sparse(const uint32_t* gids, int width, int height);
+
+/**
+ * @ingroup tmj
+ * Frees tiles returned by tmj_tiles_compact() or tmj_tiles_sparse().
+ *
+ * @param tiles The packed tiles, or NULL.
+ */
+void tmj_tiles_free(tmj_tiles* tiles);
+
+/**
+ * @ingroup tmj
+ * Reads one global tile ID, flags included, from packed tiles. Sparse tiles
+ * take a binary search over the runs of the tile's row.
+ *
+ * @param tiles Packed tiles.
+ * @param index The index of the tile, less than tiles->count.
+ *
+ * @return The global tile ID.
+ */
+uint32_t tmj_tiles_get(const tmj_tiles* tiles, size_t index);
+
+/**
+ * @ingroup tmj
+ * Unpacks a run of tiles, such as a row, into global tile IDs with their
+ * flags. Much faster per tile than tmj_tiles_get().
+ *
+ * @param tiles Packed tiles.
+ * @param start The index of the first tile.
+ * @param count The number of tiles. start + count must not exceed
+ * tiles->count.
+ * @param[out] gids A buffer of at least count global tile IDs.
+ */
+void tmj_tiles_read(const tmj_tiles* tiles, size_t start, size_t count, uint32_t* gids);
+
+/**
+ * @ingroup tmj
+ * Splits global tile IDs, such as a decoded layer or chunk, into their tile
+ * IDs and their flags. Uses SSE2 or NEON where the target has them.
+ *
+ * @param gids The global tile IDs.
+ * @param count The number of tiles.
+ * @param[out] ids A buffer of at least count tile IDs, which receives the
+ * global tile IDs with their flags cleared. May be NULL.
+ * @param[out] flags A buffer of at least count bytes, which receives the flags
+ * of each tile shifted down by TMJ_GID_FLAGS_SHIFT, so that
+ * TMJ_FLIPPED_HORIZONTALLY becomes bit 3 and TMJ_ROTATED_HEXAGONAL_120 bit 0.
+ * May be NULL.
+ */
+void tmj_gids_split(const uint32_t* gids, size_t count, uint32_t* ids, uint8_t* flags);
+
+/**
+ * @ingroup tmj
+ * Reads one tile of a finite tile layer, whichever way its data is stored.
+ *
+ * @param layer A tile layer.
+ * @param x The column of the tile.
+ * @param y The row of the tile.
+ *
+ * @return The global tile ID at (x, y), flags included. Returns 0 if (x, y)
+ * is outside the layer, or the layer data is still base64-encoded.
+ */
+uint32_t tmj_layer_tile(const Layer* layer, int x, int y);
+
+/**
+ * @ingroup tmj
+ * Reads one tile of a chunk, whichever way its data is stored.
+ *
+ * @param chunk A chunk.
+ * @param x The column of the tile, relative to the chunk.
+ * @param y The row of the tile, relative to the chunk.
+ *
+ * @return The global tile ID at (x, y), flags included. Returns 0 if (x, y)
+ * is outside the chunk, or the chunk data is still base64-encoded.
+ */
+uint32_t tmj_chunk_tile(const Chunk* chunk, int x, int y);
+
+/**
+ * @ingroup tmj
+ * The most tiles a view reports in one run when it has to unpack them.
+ */
+#define TMJ_VIEW_RUN_MAX 64
+
+/**
+ * @ingroup tmj
+ * A run of consecutive non-empty tiles along one row, reported by
+ * tmj_view_next().
+ */
+typedef struct tmj_view_run {
+    int x; // Of the first tile, in tiles
+    int y; // In tiles
+    int length; // In tiles
+
+    const uint32_t* gids; // length global tile IDs, flags included, valid until the next call
+} tmj_view_run;
+
+/**
+ * @ingroup tmj
+ * Iterates over the non-empty tiles of a tile layer that fall inside a
+ * rectangle, a run at a time. Set up with tmj_view_begin(), and advanced with
+ * tmj_view_next(). The members are private.
+ *
+ * Plain tile data is scanned for non-empty runs in place. Sparse tiles go
+ * straight from one stored run to the next, so empty stretches cost nothing.
+ */
+typedef struct tmj_view {
+    const Layer* layer;
+
+    int left; // In tiles
+    int top; // In tiles
+    int right; // Exclusive
+    int bottom; // Exclusive
+
+    size_t next_chunk; // Of infinite layers
+
+    // The layer data or chunk being walked, with the rectangle clipped to it
+    const uint32_t* data;
+    const tmj_tiles* tiles;
+    int origin_x;
+    int origin_y;
+    int width;
+    int x0;
+    int x1; // Exclusive
+    int y1; // Exclusive
+
+    int row; // Relative to the origin, y1 when done with the data
+    int col; // Relative to the origin
+    uint32_t run; // Next run of the row, sparse tiles only
+
+    int buffer_col; // Column of buffer[0], packed tiles only
+    int buffer_length;
+    uint32_t buffer[TMJ_VIEW_RUN_MAX];
+} tmj_view;
+
+/**
+ * @ingroup tmj
+ * Starts iterating over the non-empty tiles of a tile layer inside a
+ * rectangle. Rows are reported top to bottom, and runs left to right within
+ * a row. Infinite layers are walked chunk by chunk, in the order of
+ * Layer.chunks.
+ *
+ * Data still base64-encoded yields no tiles, and should be decoded first.
+ *
+ * @param[out] view The view to set up.
+ * @param layer A tile layer.
+ * @param x The left edge of the rectangle, in tiles.
+ * @param y The top edge of the rectangle, in tiles.
+ * @param width The width of the rectangle, in tiles.
+ * @param height The height of the rectangle, in tiles.
+ */
+void tmj_view_begin(tmj_view* view, const Layer* layer, int x, int y, int width, int height);
+
+/**
+ * @ingroup tmj
+ * Reports the next run of non-empty tiles of a view.
+ *
+ * @param view A view set up by tmj_view_begin().
+ * @param[out] run Filled in with the run.
+ *
+ * @return True if a run was reported, false once the view is exhausted.
+ */
+bool tmj_view_next(tmj_view* view, tmj_view_run* run);
+
+/**
+ * @ingroup tmj
+ * One tile quad of a draw batch.
+ */
+typedef struct tmj_tile_instance {
+    float x; // Left edge of the quad, in map pixels, layer offsets included
+    float y; // Top edge of the quad, in map pixels, layer offsets included
+    float width; // In pixels
+    float height; // In pixels
+
+    float u0; // Source rectangle in the texture, before the tile's flips
+    float v0;
+    float u1;
+    float v1;
+
+    uint32_t tint; // 0xAARRGGBB, the tints of the layer and its groups multiplied, with their opacity in alpha
+    uint8_t flags; // The tile's flip flags, shifted down by TMJ_GID_FLAGS_SHIFT
+} tmj_tile_instance;
+
+/**
+ * @ingroup tmj
+ * A run of tile instances of one layer that share a texture.
+ */
+typedef struct tmj_batch {
+    const Layer* layer;
+    size_t tileset; // Index into Map.tilesets
+    const char* image; // The texture, the tileset's image or, in image collections, the tile's
+
+    size_t first; // Index of the first instance
+    size_t count;
+
+    /**
+     * How far parallax scrolling moves the layer for the current view, in
+     * pixels. Add it to the instance positions.
+     */
+    float parallax_x;
+    float parallax_y;
+} tmj_batch;
+
+/**
+ * @ingroup tmj
+ * Builds the tile quads of the visible part of an orthogonal map, grouped
+ * into batches that share a texture. See tmj_batch_builder_update().
+ */
+typedef struct tmj_batch_builder tmj_batch_builder;
+
+/**
+ * @ingroup tmj
+ * Creates a batch builder for the given map. The offsets, opacity,
+ * visibility, tint and parallax factors of each tile layer, with its groups
+ * applied, are taken from Map.flat_layers.
+ *
+ * Tilesets deferred by a lazy load are unpacked, and tilesets without a
+ * Tileset.rects table built for the map's grid get one. External tilesets
+ * must be handed over with tmj_batch_builder_set_tileset(); until then,
+ * their tiles are left out.
+ *
+ * The map must outlive the builder, and must not be changed while it exists.
+ *
+ * @param map An orthogonal map, not loaded with TMJ_LOAD_HEADLESS.
+ *
+ * @return On success, returns a batch builder, which must be freed by the
+ * caller using tmj_batch_builder_free(). On failure, returns NULL.
+ */
+tmj_batch_builder* tmj_batch_builder_create(Map* map);
+
+/**
+ * @ingroup tmj
+ * Frees a batch builder.
+ *
+ * @param builder A batch builder, or NULL.
+ */
+void tmj_batch_builder_free(tmj_batch_builder* builder);
+
+/**
+ * @ingroup tmj
+ * Supplies an external tileset of the map, loaded by the caller. Its
+ * Tileset.rects table is built for the map's grid, unless it already was;
+ * a table built for the tileset's own tile size is replaced. The tileset
+ * must outlive the builder.
+ *
+ * @param builder A batch builder.
+ * @param index The index of the tileset in Map.tilesets.
+ * @param tileset The loaded tileset.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int tmj_batch_builder_set_tileset(tmj_batch_builder* builder, size_t index, Tileset* tileset);
+
+/**
+ * @ingroup tmj
+ * Rebuilds the batches for a view of the map.
+ *
+ * Tiles are built a block at a time, a block being a chunk of an infinite
+ * map or 16x16 tiles otherwise, and blocks are kept while they stay in view.
+ * A view that moved less than a block usually covers the same blocks, and
+ * costs nothing but updating the parallax shifts of the batches.
+ *
+ * Batches follow the layers in draw order; within a layer, tiles are grouped
+ * by texture, which is safe as tiles of one layer don't overlap. Instances
+ * cover every block touching the view, so some fall outside it.
+ *
+ * Parallax scrolling follows Tiled: a layer with parallax factor p is moved
+ * by (view - parallax origin) * (1 - p).
+ *
+ * @param builder A batch builder.
+ * @param x The left edge of the view, in map pixels.
+ * @param y The top edge of the view, in map pixels.
+ * @param width The width of the view, in pixels.
+ * @param height The height of the view, in pixels.
+ *
+ * @return 1 if the instances changed, 0 if only the parallax shifts did, -1
+ * on failure.
+ */
+int tmj_batch_builder_update(tmj_batch_builder* builder, float x, float y, float width, float height);
+
+/**
+ * @ingroup tmj
+ * Returns the tile instances built by the last update, valid until the next
+ * update.
+ *
+ * @param builder A batch builder.
+ * @param[out] count The number of instances.
+ *
+ * @return The instances, batch by batch.
+ */
+const tmj_tile_instance* tmj_batch_builder_instances(const tmj_batch_builder* builder, size_t* count);
+
+/**
+ * @ingroup tmj
+ * Returns the batches built by the last update, valid until the next update.
+ *
+ * @param builder A batch builder.
+ * @param[out] count The number of batches.
+ *
+ * @return The batches, in draw order.
+ */
+const tmj_batch* tmj_batch_builder_batches(const tmj_batch_builder* builder, size_t* count);
+
+/**
+ * @ingroup tmj
+ * A tile on the map whose tile ID is animated.
+ */
+typedef struct tmj_animated_tile {
+    const Layer* layer;
+    int x; // In tiles
+    int y; // In tiles
+    uint32_t gid; // As placed on the map, flip flags included
+} tmj_animated_tile;
+
+/**
+ * @ingroup tmj
+ * Plays the tile animations of a map from one clock. See tmj_animator_tick().
+ */
+typedef struct tmj_animator tmj_animator;
+
+/**
+ * @ingroup tmj
+ * Creates an animator for the given map. Builds a timeline of cumulative
+ * frame times for every animated tile of the map's tilesets, and collects
+ * the positions of animated tiles in every tile layer, hidden ones included.
+ * The clock starts at 0.
+ *
+ * Tilesets deferred by a lazy load are unpacked. External tilesets must be
+ * handed over with tmj_animator_set_tileset(); until then, their tiles don't
+ * animate. Maps loaded with TMJ_LOAD_HEADLESS have no animations.
+ *
+ * The map must outlive the animator, and must not be changed while it exists.
+ *
+ * @param map A map.
+ *
+ * @return On success, returns an animator, which must be freed by the caller
+ * using tmj_animator_free(). On failure, returns NULL.
+ */
+tmj_animator* tmj_animator_create(Map* map);
+
+/**
+ * @ingroup tmj
+ * Frees an animator.
+ *
+ * @param animator An animator, or NULL.
+ */
+void tmj_animator_free(tmj_animator* animator);
+
+/**
+ * @ingroup tmj
+ * Supplies an external tileset of the map, loaded by the caller, and rebuilds
+ * the timelines and positions. The clock keeps running; the dirty list is
+ * cleared. The tileset must outlive the animator.
+ *
+ * @param animator An animator.
+ * @param index The index of the tileset in Map.tilesets.
+ * @param tileset The loaded tileset.
+ *
+ * @return 0 on success, -1 on failure, after which the animator has no
+ * animations.
+ */
+int tmj_animator_set_tileset(tmj_animator* animator, size_t index, Tileset* tileset);
+
+/**
+ * @ingroup tmj
+ * Advances the clock, moves every timeline to its frame for the new time,
+ * and collects the positions whose tile now shows a different frame. See
+ * tmj_animator_dirty().
+ *
+ * The cost is one frame lookup per animated tile ID, plus a copy of each
+ * changed position; positions whose frame didn't change aren't visited. See
+ * tmj_animator_frame() for the cost of a lookup.
+ *
+ * @param animator An animator.
+ * @param elapsed The time since the last tick, in milliseconds.
+ *
+ * @return The number of positions that changed.
+ */
+size_t tmj_animator_tick(tmj_animator* animator, uint32_t elapsed);
+
+/**
+ * @ingroup tmj
+ * Looks up the frame a tile shows at the animator's current time.
+ *
+ * A lookup takes constant time when the animation loops over at most 65536
+ * steps of the greatest common divisor of its frame durations. Animations of
+ * more than 256 frames, longer ones, and any past 4 MiB of step tables for the
+ * whole map, take a binary search over their frames instead.
+ *
+ * @param animator An animator.
+ * @param gid A global tile ID, flip flags included.
+ *
+ * @return The global tile ID of the current frame, with the flip flags of
+ * gid, or gid itself if it isn't animated.
+ */
+uint32_t tmj_animator_frame(const tmj_animator* animator, uint32_t gid);
+
+/**
+ * @ingroup tmj
+ * Returns the positions of every animated tile, grouped by tile ID.
+ *
+ * @param animator An animator.
+ * @param[out] count The number of positions.
+ *
+ * @return The positions, valid until the animator is freed or given a
+ * tileset.
+ */
+const tmj_animated_tile* tmj_animator_tiles(const tmj_animator* animator, size_t* count);
+
+/**
+ * @ingroup tmj
+ * Returns the positions whose frame changed in the last tick.
+ *
+ * @param animator An animator.
+ * @param[out] count The number of positions.
+ *
+ * @return The positions, valid until the next tick.
+ */
+const tmj_animated_tile* tmj_animator_dirty(const tmj_animator* animator, size_t* count);
+
+/**
+ * @ingroup tmj
+ * The arrays of a tmj_object_soa are padded to a multiple of this many
+ * entries, so vector loops can run past the last object. Padding entries have
+ * empty bounds and are never culled in.
+ */
+#define TMJ_OBJECT_SOA_PAD 8
+
+/**
+ * @ingroup tmj
+ * The objects of an object layer as parallel arrays, for scans that touch a
+ * few fields of many objects. Entry i mirrors objects[i]. Positions and sizes
+ * are in layer pixels, without layer offsets.
+ */
+typedef struct tmj_object_soa {
+    size_t count;
+    const Object* objects; // The layer's objects
+
+    float* x;
+    float* y;
+    float* width;
+    float* height;
+    float* rotation; // In degrees, clockwise
+
+    /**
+     * The bounding box of each object, rotation included. Tile objects extend
+     * up from their position, and polygons and polylines cover their points.
+     */
+    float* min_x;
+    float* min_y;
+    float* max_x;
+    float* max_y;
+
+    int32_t* ids;
+    uint32_t* gids; // 0 for objects that aren't tiles
+    uint32_t* types; // Index into type_names
+    uint8_t* visible; // 1 or 0
+
+    size_t type_count;
+    const char** type_names; // The distinct Object.type strings; entry 0 is NULL, for objects without a type
+
+    void* block; // Internal, the allocation holding the arrays
+} tmj_object_soa;
+
+/**
+ * @ingroup tmj
+ * Builds the structure-of-arrays view of an object layer. Objects deferred by
+ * a lazy load are unpacked first.
+ *
+ * The view points into the map, which must outlive it, and is not updated if
+ * the objects change.
+ *
+ * @param map The map the layer belongs to.
+ * @param layer An object layer.
+ *
+ * @return On success, returns the view, which must be freed by the caller
+ * using tmj_object_soa_free(). On failure, returns NULL.
+ */
+tmj_object_soa* tmj_object_soa_build(Map* map, Layer* layer);
+
+/**
+ * @ingroup tmj
+ * Frees an object view.
+ *
+ * @param soa An object view, or NULL.
+ */
+void tmj_object_soa_free(tmj_object_soa* soa);
+
+/**
+ * @ingroup tmj
+ * Finds the boxes that overlap a rectangle, edges included. Runs four boxes
+ * at a time with SSE2 or NEON where available.
+ *
+ * @param min_x The left edges of the boxes.
+ * @param min_y The top edges of the boxes.
+ * @param max_x The right edges of the boxes.
+ * @param max_y The bottom edges of the boxes.
+ * @param count The number of boxes.
+ * @param left The left edge of the rectangle.
+ * @param top The top edge of the rectangle.
+ * @param right The right edge of the rectangle.
+ * @param bottom The bottom edge of the rectangle.
+ * @param[out] indices Receives the indices of the overlapping boxes, in
+ * ascending order. Must have room for count indices.
+ *
+ * @return The number of overlapping boxes.
+ */
+size_t tmj_aabb_cull(const float* min_x,
+        const float* min_y,
+        const float* max_x,
+        const float* max_y,
+        size_t count,
+        float left,
+        float top,
+        float right,
+        float bottom,
+        uint32_t* indices);
+
+/**
+ * @ingroup tmj
+ * Finds the objects of a view whose bounding boxes overlap a rectangle, using
+ * tmj_aabb_cull(). Hidden objects are included; check tmj_object_soa.visible.
+ *
+ * @param soa An object view.
+ * @param left The left edge of the rectangle, in layer pixels.
+ * @param top The top edge of the rectangle, in layer pixels.
+ * @param right The right edge of the rectangle, in layer pixels.
+ * @param bottom The bottom edge of the rectangle, in layer pixels.
+ * @param[out] indices Receives the indices of the overlapping objects, in
+ * ascending order. Must have room for soa->count indices.
+ *
+ * @return The number of overlapping objects.
+ */
+size_t tmj_object_soa_cull(const tmj_object_soa* soa, float left, float top, float right, float bottom, uint32_t* indices);
+
+/**
+ * @ingroup tmj
+ * A tile on the map, as reported by a tmj_gid_index.
+ */
+typedef struct tmj_tile_position {
+    const Layer* layer;
+    int x; // In tiles
+    int y; // In tiles
+    uint32_t gid; // As placed on the map, flip flags included
+} tmj_tile_position;
+
+/**
+ * @ingroup tmj
+ * Selects tiles of a tileset by their definition, usually their properties.
+ */
+typedef bool (*tmj_tile_predicate)(const Tileset* tileset, const Tile* tile, void* userdata);
+
+/**
+ * @ingroup tmj
+ * An inverted index from global tile ID to the positions of the map's tile
+ * layers that hold it, for placing entities from marker tiles.
+ *
+ * The tile layers are split into parts, one per finite layer and one per
+ * chunk, which are scanned independently with tmj_gid_index_scan(), then
+ * merged by tmj_gid_index_finish(). tmj_gid_index_build() does both in turn.
+ * Each position takes 8 bytes.
+ */
+typedef struct tmj_gid_index tmj_gid_index;
+
+/**
+ * @ingroup tmj
+ * Creates an empty index of the positions of the given tile IDs in every tile
+ * layer of a map, hidden ones included. Flip flags are ignored, so a tile is
+ * found however it is flipped. Memory for the lookup table grows with the
+ * largest tile ID.
+ *
+ * The map must outlive the index, and must not be changed while it exists.
+ *
+ * @param map A map.
+ * @param gids The global tile IDs to index.
+ * @param gid_count The number of tile IDs.
+ *
+ * @return On success, returns an index, which must be freed by the caller
+ * using tmj_gid_index_free(). On failure, returns NULL.
+ */
+tmj_gid_index* tmj_gid_index_create(const Map* map, const uint32_t* gids, size_t gid_count);
+
+/**
+ * @ingroup tmj
+ * Creates an empty index of the positions of the tiles that match a
+ * predicate, as tmj_gid_index_create() does. The predicate is called once per
+ * tile definition in Tileset.tiles of every embedded tileset; tilesets
+ * deferred by a lazy load are unpacked, and external tilesets are skipped.
+ *
+ * @param map A map.
+ * @param match Returns true for the tiles to index.
+ * @param userdata Passed to match.
+ *
+ * @return On success, returns an index, which must be freed by the caller
+ * using tmj_gid_index_free(). On failure, returns NULL.
+ */
+tmj_gid_index* tmj_gid_index_create_matching(Map* map, tmj_tile_predicate match, void* userdata);
+
+/**
+ * @ingroup tmj
+ * Frees an index.
+ *
+ * @param index An index, or NULL.
+ */
+void tmj_gid_index_free(tmj_gid_index* index);
+
+/**
+ * @ingroup tmj
+ * Returns the number of parts an index scans.
+ *
+ * @param index An index.
+ *
+ * @return The number of parts.
+ */
+size_t tmj_gid_index_part_count(const tmj_gid_index* index);
+
+/**
+ * @ingroup tmj
+ * Scans one part of the map for the indexed tiles, decoding it first if its
+ * tile data is still base64-encoded. Different parts of the same index may be
+ * scanned concurrently from several threads. Scanning a part again replaces
+ * its earlier results.
+ *
+ * @param index An index that isn't finished.
+ * @param part A part number, less than tmj_gid_index_part_count().
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int tmj_gid_index_scan(tmj_gid_index* index, size_t part);
+
+/**
+ * @ingroup tmj
+ * Merges the scanned parts into the index, grouping positions by tile ID, in
+ * layer pre-order and chunk order, then row-major order. Every part must be
+ * scanned first.
+ *
+ * @param index An index.
+ *
+ * @return 0 on success, or if the index is already finished. -1 on failure.
+ */
+int tmj_gid_index_finish(tmj_gid_index* index);
+
+/**
+ * @ingroup tmj
+ * Scans every part not yet scanned, then finishes the index.
+ *
+ * @param index An index.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int tmj_gid_index_build(tmj_gid_index* index);
+
+/**
+ * @ingroup tmj
+ * Counts the positions of a tile ID in a finished index.
+ *
+ * @param index An index.
+ * @param gid A global tile ID, flip flags ignored, or 0 for every indexed
+ * tile ID.
+ *
+ * @return The number of positions.
+ */
+size_t tmj_gid_index_count(const tmj_gid_index* index, uint32_t gid);
+
+/**
+ * @ingroup tmj
+ * Copies positions of a tile ID out of a finished index.
+ *
+ * @param index An index.
+ * @param gid A global tile ID, flip flags ignored, or 0 for every indexed
+ * tile ID, grouped by tile ID in the order they were given.
+ * @param first The number of positions to skip.
+ * @param[out] positions Filled in with the positions.
+ * @param max The capacity of positions.
+ *
+ * @return The number of positions copied.
+ */
+size_t tmj_gid_index_positions(const tmj_gid_index* index, uint32_t gid, size_t first, tmj_tile_position* positions, size_t max);
+
+/**
+ * @ingroup tmj
+ * The storage of a tile property column.
+ */
+typedef enum tmj_column_type {
+    TMJ_COLUMN_BOOL, // One bit per tile ID
+    TMJ_COLUMN_INT, // One int32_t per tile ID
+    TMJ_COLUMN_FLOAT // One float per tile ID
+} tmj_column_type;
+
+/**
+ * @ingroup tmj
+ * A tile property to compile into a column.
+ */
+typedef struct tmj_column_spec {
+    const char* name; // The property name
+    tmj_column_type type;
+    double default_value; // For tiles without the property; nonzero is true for bool columns
+} tmj_column_spec;
+
+/**
+ * @ingroup tmj
+ * One tile property of every tile ID of a map. Properties of type int, float
+ * and bool are converted to the column's type; other types are ignored.
+ *
+ * With gid masked by TMJ_GID_MASK and less than tmj_tile_columns.gid_count, a
+ * tile's value is ints[gid] or floats[gid], or for bool columns
+ * (bits[gid >> 6] >> (gid & 63)) & 1.
+ */
+typedef struct tmj_tile_column {
+    const char* name; // As given in the tmj_column_spec
+    tmj_column_type type;
+    double default_value; // As given in the tmj_column_spec
+
+    union {
+        uint64_t* bits;
+        int32_t* ints;
+        float* floats;
+    };
+} tmj_tile_column;
+
+/**
+ * @ingroup tmj
+ * Tile properties compiled into dense columns indexed by global tile ID, for
+ * per-tile queries that take a single load. Built by tmj_tile_columns_build().
+ */
+typedef struct tmj_tile_columns {
+    /**
+     * Columns cover tile IDs 0 to gid_count - 1, which spans every tile of
+     * the map's tilesets unless the last one is external and hasn't been set
+     * yet. Tile ID 0 and the tiles of external tilesets that haven't been set
+     * with tmj_tile_columns_set_tileset() hold the default values.
+     */
+    uint32_t gid_count;
+
+    size_t column_count;
+    tmj_tile_column* columns; // In the order of the specs
+
+    void* block; // Internal, the allocation holding the column data
+
+    size_t tileset_count; // Internal
+    uint32_t* firstgids; // Internal, the first tile ID of each of the map's tilesets
+} tmj_tile_columns;
+
+/**
+ * @ingroup tmj
+ * Compiles tile properties of a map's tilesets into columns. Tilesets
+ * deferred by a lazy load are unpacked; external tilesets, which have no tile
+ * definitions in the map, are left at the default values until they're
+ * handed over with tmj_tile_columns_set_tileset().
+ *
+ * The columns don't refer to the map, and may outlive it, but the spec names
+ * must outlive the columns.
+ *
+ * @param map A map.
+ * @param specs The properties to compile, one column each.
+ * @param spec_count The number of specs.
+ *
+ * @return On success, returns the columns, which must be freed by the caller
+ * using tmj_tile_columns_free(). On failure, returns NULL.
+ */
+tmj_tile_columns* tmj_tile_columns_build(Map* map, const tmj_column_spec* specs, size_t spec_count);
+
+/**
+ * @ingroup tmj
+ * Frees tile property columns.
+ *
+ * @param columns Columns returned by tmj_tile_columns_build(), or NULL.
+ */
+void tmj_tile_columns_free(tmj_tile_columns* columns);
+
+/**
+ * @ingroup tmj
+ * Compiles the tile properties of an external tileset of the map, loaded by
+ * the caller, into the columns. The columns grow if the tileset's tiles go
+ * past tmj_tile_columns.gid_count, which moves the column data.
+ *
+ * @param columns Columns returned by tmj_tile_columns_build().
+ * @param index The index of the tileset in Map.tilesets.
+ * @param tileset The loaded tileset.
+ *
+ * @return 0 on success, -1 on failure.
+ */
+int tmj_tile_columns_set_tileset(tmj_tile_columns* columns, size_t index, const Tileset* tileset);
+
+/**
+ * @ingroup tmj
+ * Looks up a column by property name.
+ *
+ * @param columns Columns returned by tmj_tile_columns_build().
+ * @param name A property name.
+ *
+ * @return The first column of the property, or NULL if there is none.
+ */
+const tmj_tile_column* tmj_tile_columns_find(const tmj_tile_columns* columns, const char* name);
+
+/**
+ * @ingroup tmj
+ * Where one chunk of an infinite map's tile layer lives in the map file.
+ */
+typedef struct tmj_chunk_span {
+    int x; // In tiles
+    int y; // In tiles
+    int width; // In tiles
+    int height; // In tiles
+
+    uint64_t offset; // Byte offset of the chunk object in the map file
+    size_t length; // Length of the chunk object in bytes
+} tmj_chunk_span;
+
+/**
+ * @ingroup tmj
+ * The chunks of one tile layer of an indexed map.
+ */
+typedef struct tmj_chunk_layer {
+    int id;
+    char* name;
+    char* type;
+    char* encoding; // "csv" or "base64"
+    char* compression; // Optional
+
+    int max_chunk_width;
+    int max_chunk_height;
+
+    size_t chunk_count;
+    tmj_chunk_span* chunks; // Sorted by y, then x
+} tmj_chunk_layer;
+
+/**
+ * @ingroup tmj
+ * An index of the chunks of an infinite map file, built by
+ * tmj_chunk_index_build(). The index must not be modified by the caller.
+ */
+typedef struct tmj_chunk_index {
+    char* path;
+
+    size_t layer_count;
+    tmj_chunk_layer* layers; // Tile layers in document order, including those in groups
+} tmj_chunk_index;
+
+/**
+ * @ingroup tmj
+ * A decoded chunk of a region.
+ */
+typedef struct tmj_region_chunk {
+    int x; // In tiles
+    int y; // In tiles
+    int width; // In tiles
+    int height; // In tiles
+
+    size_t span; // Index of the chunk in its tmj_chunk_layer
+
+    uint32_t* data; // width * height global tile IDs, row by row
+} tmj_region_chunk;
+
+/**
+ * @ingroup tmj
+ * The decoded chunks of one tile layer that intersect a rectangle of tiles.
+ * The region must not be modified by the caller, except through
+ * tmj_region_move().
+ */
+typedef struct tmj_region {
+    const tmj_chunk_index* index;
+    size_t layer; // Index into index->layers
+
+    int x; // In tiles
+    int y; // In tiles
+    int width; // In tiles
+    int height; // In tiles
+
+    size_t chunk_count;
+    tmj_region_chunk* chunks; // Sorted by y, then x
+} tmj_region;
+
+/**
+ * @ingroup tmj
+ * Scans an infinite map file once, recording the position of every chunk of
+ * every tile layer. The file is read a buffer at a time, and no more of it is
+ * kept in memory than the index itself, so this works for map files much
+ * larger than available memory.
+ *
+ * The file must not change while the index and regions built from it are in
+ * use.
+ *
+ * @param path A relative or absolute filesystem path.
+ *
+ * @return On success, returns an index which must be freed by the caller
+ * using tmj_chunk_index_free(). Returns NULL if the file can't be read, isn't
+ * valid JSON, or isn't an infinite map.
+ */
+tmj_chunk_index* tmj_chunk_index_build(const char* path);
+
+/**
+ * @ingroup tmj
+ * Frees a chunk index. Regions loaded from it must be freed first.
+ *
+ * @param index An index returned by tmj_chunk_index_build(), or NULL.
+ */
+void tmj_chunk_index_free(tmj_chunk_index* index);
+
+/**
+ * @ingroup tmj
+ * Reads and decodes the chunks of a tile layer that intersect a rectangle of
+ * tiles, and nothing else.
+ *
+ * Regions loaded from the same index may be used from different threads.
+ *
+ * @param index A chunk index.
+ * @param layer The index of the layer in index->layers.
+ * @param x The left edge of the rectangle, in tiles.
+ * @param y The top edge of the rectangle, in tiles.
+ * @param width The width of the rectangle, in tiles.
+ * @param height The height of the rectangle, in tiles.
+ *
+ * @return On success, returns a region which must be freed by the caller
+ * using tmj_region_free(). On failure, returns NULL.
+ */
+tmj_region* tmj_region_load(const tmj_chunk_index* index, size_t layer, int x, int y, int width, int height);
+
+/**
+ * @ingroup tmj
+ * Moves a region to a new rectangle. Chunks that are still in range are kept
+ * as they are, new ones are read from the map file, and the rest are freed.
+ *
+ * @param region A region.
+ * @param x The left edge of the rectangle, in tiles.
+ * @param y The top edge of the rectangle, in tiles.
+ * @param width The width of the rectangle, in tiles.
+ * @param height The height of the rectangle, in tiles.
+ *
+ * @return 0 on success. On failure, returns -1 and leaves the region as it
+ * was.
+ */
+int tmj_region_move(tmj_region* region, int x, int y, int width, int height);
+
+/**
+ * @ingroup tmj
+ * Looks up one tile of a region.
+ *
+ * @param region A region.
+ * @param x The column of the tile.
+ * @param y The row of the tile.
+ *
+ * @return The global tile ID at (x, y), or 0 if no loaded chunk covers it.
+ */
+uint32_t tmj_region_tile(const tmj_region* region, int x, int y);
+
+/**
+ * @ingroup tmj
+ * Frees a region and its decoded chunks.
+ *
+ * @param region A region returned by tmj_region_load(), or NULL.
+ */
+void tmj_region_free(tmj_region* region);
+
 #ifdef __cplusplus
 }
 #endif
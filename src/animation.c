@@ -0,0 +1,513 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "tmj.h"
+
+/**
+ * @file
+ *
+ * Animated tiles.
+ *
+ * Every animated tile of the map's tilesets gets a timeline: the global tile
+ * IDs of its frames, and the time each frame ends at, counted from the start
+ * of the loop. The timeline also gets a table from step to frame, a step being
+ * the greatest common divisor of the frame durations, which makes finding the
+ * frame at any time a division and a load. Tables are sized per timeline, as
+ * many bytes as the loop has steps. Timelines of more than 256 frames, or
+ * whose table would be too big, fall back to a binary search over the frame
+ * end times.
+ *
+ * The positions of animated tiles on the map are kept grouped by timeline, so
+ * a tick reports the positions of every timeline whose frame changed by
+ * copying whole ranges.
+ */
+
+// Steps a single table may have, and steps every table together may have
+#define TIMELINE_STEPS_MAX 65536
+#define ANIMATOR_STEPS_MAX ((size_t)1 << 22)
+
+typedef struct timeline {
+    uint32_t gid; // The animated tile
+    uint32_t period; // The length of one loop, in milliseconds
+    uint32_t step; // The common divisor of the frame durations, 0 without a step table
+
+    size_t first_frame; // Into frame_ends and frame_gids
+    size_t frame_count;
+    size_t first_step; // Into steps
+
+    uint32_t current; // The global tile ID shown at the animator's time
+} timeline;
+
+struct tmj_animator {
+    Map* map;
+
+    uint64_t time; // In milliseconds
+
+    Tileset** tilesets; // One per Map.tilesets, NULL until known
+
+    size_t timeline_count;
+    timeline* timelines;
+
+    size_t frame_count;
+    uint32_t* frame_ends; // Per frame, cumulative from the start of its loop
+    uint32_t* frame_gids;
+
+    size_t step_count;
+    uint8_t* steps; // Per step of each step table, the frame it falls in
+
+    uint32_t gid_min; // The span of animated tile IDs
+    size_t gid_span;
+    uint32_t* gid_timelines; // Per tile ID in the span, the timeline index plus one, or 0
+
+    size_t tile_count;
+    tmj_animated_tile* tiles; // Grouped by timeline
+    size_t* tile_offsets; // Per timeline, plus one, the first of its tiles
+
+    size_t dirty_count;
+    tmj_animated_tile* dirty;
+};
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b != 0) {
+        uint32_t t = a % b;
+
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+static void animator_clear(tmj_animator* animator) {
+    free(animator->timelines);
+    free(animator->frame_ends);
+    free(animator->frame_gids);
+    free(animator->steps);
+    free(animator->gid_timelines);
+    free(animator->tiles);
+    free(animator->tile_offsets);
+    free(animator->dirty);
+
+    animator->timeline_count = 0;
+    animator->timelines = NULL;
+    animator->frame_count = 0;
+    animator->frame_ends = NULL;
+    animator->frame_gids = NULL;
+    animator->step_count = 0;
+    animator->steps = NULL;
+    animator->gid_min = 0;
+    animator->gid_span = 0;
+    animator->gid_timelines = NULL;
+    animator->tile_count = 0;
+    animator->tiles = NULL;
+    animator->tile_offsets = NULL;
+    animator->dirty_count = 0;
+    animator->dirty = NULL;
+}
+
+static uint32_t timeline_frame(const tmj_animator* animator, const timeline* t, uint64_t time) {
+    if (t->period == 0) {
+        return animator->frame_gids[t->first_frame];
+    }
+
+    uint32_t offset = (uint32_t)(time % t->period);
+
+    if (t->step != 0) {
+        return animator->frame_gids[t->first_frame + animator->steps[t->first_step + offset / t->step]];
+    }
+
+    // The first frame that ends after the offset
+    const uint32_t* ends = animator->frame_ends + t->first_frame;
+    size_t low = 0;
+    size_t high = t->frame_count - 1;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+
+        if (ends[mid] <= offset) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return animator->frame_gids[t->first_frame + low];
+}
+
+/**
+ * Returns the number of steps in the table of an animation, or 0 if it gets
+ * none, given the steps the tables before it take.
+ */
+static uint32_t animation_steps(const Tile* tile, size_t step_count) {
+    uint32_t period = 0;
+    uint32_t step = 0;
+
+    for (size_t f = 0; f < tile->animation_count; f++) {
+        uint32_t duration = tile->animation[f].duration > 0 ? (uint32_t)tile->animation[f].duration : 0;
+
+        period += duration;
+        step = gcd(step, duration);
+    }
+
+    if (period == 0 || period / step > TIMELINE_STEPS_MAX || tile->animation_count > UINT8_MAX + 1) {
+        return 0;
+    }
+
+    return step_count + period / step <= ANIMATOR_STEPS_MAX ? period / step : 0;
+}
+
+/**
+ * Builds the timelines of every animated tile of the known tilesets. Returns
+ * -1 if out of memory.
+ */
+static int build_timelines(tmj_animator* animator) {
+    const Map* map = animator->map;
+    uint32_t gid_max = 0;
+    size_t step_count = 0;
+
+    animator->gid_min = UINT32_MAX;
+
+    // Count first, so everything is allocated once
+    for (size_t i = 0; i < map->tileset_count; i++) {
+        const Tileset* tileset = animator->tilesets[i];
+
+        for (size_t j = 0; tileset != NULL && j < tileset->tile_count; j++) {
+            const Tile* tile = &tileset->tiles[j];
+
+            if (tile->animation_count == 0) {
+                continue;
+            }
+
+            uint32_t gid = (uint32_t)map->tilesets[i].firstgid + (uint32_t)tile->id;
+
+            animator->gid_min = gid < animator->gid_min ? gid : animator->gid_min;
+            gid_max = gid > gid_max ? gid : gid_max;
+
+            animator->timeline_count++;
+            animator->frame_count += tile->animation_count;
+            step_count += animation_steps(tile, step_count);
+        }
+    }
+
+    if (animator->timeline_count == 0) {
+        animator->gid_min = 0;
+
+        return 0;
+    }
+
+    animator->gid_span = (size_t)(gid_max - animator->gid_min) + 1;
+
+    animator->timelines = calloc(animator->timeline_count, sizeof(timeline));
+    animator->frame_ends = malloc(animator->frame_count * sizeof(uint32_t));
+    animator->frame_gids = malloc(animator->frame_count * sizeof(uint32_t));
+    animator->steps = malloc(step_count > 0 ? step_count : 1);
+    animator->gid_timelines = calloc(animator->gid_span, sizeof(uint32_t));
+
+    if (animator->timelines == NULL || animator->frame_ends == NULL || animator->frame_gids == NULL || animator->steps == NULL ||
+            animator->gid_timelines == NULL) {
+        return -1;
+    }
+
+    size_t t_idx = 0;
+    size_t frame = 0;
+
+    for (size_t i = 0; i < map->tileset_count; i++) {
+        const Tileset* tileset = animator->tilesets[i];
+
+        for (size_t j = 0; tileset != NULL && j < tileset->tile_count; j++) {
+            const Tile* tile = &tileset->tiles[j];
+
+            if (tile->animation_count == 0) {
+                continue;
+            }
+
+            timeline* t = &animator->timelines[t_idx];
+            uint32_t firstgid = (uint32_t)map->tilesets[i].firstgid;
+            uint32_t steps = animation_steps(tile, animator->step_count);
+
+            t->gid = firstgid + (uint32_t)tile->id;
+            t->first_frame = frame;
+            t->frame_count = tile->animation_count;
+
+            for (size_t f = 0; f < tile->animation_count; f++) {
+                // Frames without a duration are never shown
+                uint32_t duration = tile->animation[f].duration > 0 ? (uint32_t)tile->animation[f].duration : 0;
+
+                t->period += duration;
+
+                animator->frame_ends[frame] = t->period;
+                animator->frame_gids[frame] = firstgid + (uint32_t)tile->animation[f].tileid;
+                frame++;
+            }
+
+            if (steps > 0) {
+                uint32_t f = 0;
+
+                t->step = t->period / steps;
+                t->first_step = animator->step_count;
+
+                for (uint32_t s = 0; s < steps; s++) {
+                    while (animator->frame_ends[t->first_frame + f] <= s * t->step) {
+                        f++;
+                    }
+
+                    animator->steps[animator->step_count++] = (uint8_t)f;
+                }
+            }
+
+            t->current = timeline_frame(animator, t, animator->time);
+
+            // A tile defined twice keeps its first animation
+            if (animator->gid_timelines[t->gid - animator->gid_min] == 0) {
+                animator->gid_timelines[t->gid - animator->gid_min] = (uint32_t)t_idx + 1;
+            }
+
+            t_idx++;
+        }
+    }
+
+    return 0;
+}
+
+static size_t gid_timeline(const tmj_animator* animator, uint32_t gid) {
+    uint32_t id = gid & TMJ_GID_MASK;
+
+    if (id < animator->gid_min || (size_t)(id - animator->gid_min) >= animator->gid_span) {
+        return 0;
+    }
+
+    return animator->gid_timelines[id - animator->gid_min];
+}
+
+/**
+ * Calls visit for every tile of a layer tree that has an animated tile ID.
+ */
+typedef void (*tile_visitor)(tmj_animator* animator, const Layer* layer, int x, int y, uint32_t gid);
+
+static void walk_tiles(tmj_animator* animator, const Layer* layers, size_t layer_count, tile_visitor visit) {
+    for (size_t i = 0; i < layer_count; i++) {
+        const Layer* layer = &layers[i];
+
+        if (layer->type == NULL) {
+            continue;
+        }
+
+        if (strcmp(layer->type, "group") == 0) {
+            walk_tiles(animator, layer->layers, layer->layer_count, visit);
+
+            continue;
+        }
+
+        if (strcmp(layer->type, "tilelayer") != 0) {
+            continue;
+        }
+
+        size_t rect_count = layer->chunks != NULL ? layer->chunk_count : 1;
+
+        for (size_t c = 0; c < rect_count; c++) {
+            tmj_view view;
+            tmj_view_run run;
+
+            if (layer->chunks != NULL) {
+                const Chunk* chunk = &layer->chunks[c];
+
+                tmj_view_begin(&view, layer, chunk->x, chunk->y, chunk->width, chunk->height);
+            } else {
+                tmj_view_begin(&view, layer, 0, 0, layer->width, layer->height);
+            }
+
+            while (tmj_view_next(&view, &run)) {
+                for (int x = 0; x < run.length; x++) {
+                    if (gid_timeline(animator, run.gids[x]) != 0) {
+                        visit(animator, layer, run.x + x, run.y, run.gids[x]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void count_tile(tmj_animator* animator, const Layer* layer, int x, int y, uint32_t gid) {
+    (void)layer, (void)x, (void)y;
+
+    animator->tile_offsets[gid_timeline(animator, gid)]++;
+    animator->tile_count++;
+}
+
+static void place_tile(tmj_animator* animator, const Layer* layer, int x, int y, uint32_t gid) {
+    size_t* offset = &animator->tile_offsets[gid_timeline(animator, gid) - 1];
+
+    animator->tiles[(*offset)++] = (tmj_animated_tile){layer, x, y, gid};
+}
+
+/**
+ * Collects the positions of animated tiles, grouped by timeline. Returns -1 if
+ * out of memory.
+ */
+static int build_tiles(tmj_animator* animator) {
+    animator->tile_offsets = calloc(animator->timeline_count + 1, sizeof(size_t));
+
+    if (animator->tile_offsets == NULL) {
+        return -1;
+    }
+
+    if (animator->timeline_count == 0) {
+        return 0;
+    }
+
+    // Counted into tile_offsets[timeline + 1], then summed into the start of each timeline's range
+    walk_tiles(animator, animator->map->layers, animator->map->layer_count, count_tile);
+
+    for (size_t i = 0; i < animator->timeline_count; i++) {
+        animator->tile_offsets[i + 1] += animator->tile_offsets[i];
+    }
+
+    if (animator->tile_count == 0) {
+        return 0;
+    }
+
+    animator->tiles = malloc(animator->tile_count * sizeof(tmj_animated_tile));
+    animator->dirty = malloc(animator->tile_count * sizeof(tmj_animated_tile));
+
+    if (animator->tiles == NULL || animator->dirty == NULL) {
+        return -1;
+    }
+
+    // Placing moves each start to the end of its range, which is the start of the next
+    walk_tiles(animator, animator->map->layers, animator->map->layer_count, place_tile);
+
+    memmove(animator->tile_offsets + 1, animator->tile_offsets, animator->timeline_count * sizeof(size_t));
+
+    animator->tile_offsets[0] = 0;
+
+    return 0;
+}
+
+static int animator_build(tmj_animator* animator) {
+    if (build_timelines(animator) != 0 || build_tiles(animator) != 0) {
+        logmsg(TMJ_LOG_ERR, "Unable to build tile animations, the system is out of memory");
+
+        animator_clear(animator);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+tmj_animator* tmj_animator_create(Map* map) {
+    tmj_animator* animator = calloc(1, sizeof(tmj_animator));
+
+    if (animator == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to create animator, the system is out of memory");
+
+        return NULL;
+    }
+
+    animator->map = map;
+
+    if (map->tileset_count > 0 && (animator->tilesets = calloc(map->tileset_count, sizeof(Tileset*))) == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to create animator, the system is out of memory");
+
+        free(animator);
+
+        return NULL;
+    }
+
+    for (size_t i = 0; i < map->tileset_count; i++) {
+        // External tilesets are left for tmj_animator_set_tileset()
+        if (map->tilesets[i].source != NULL) {
+            continue;
+        }
+
+        if ((animator->tilesets[i] = tmj_map_tileset(map, i)) == NULL) {
+            tmj_animator_free(animator);
+
+            return NULL;
+        }
+    }
+
+    if (animator_build(animator) != 0) {
+        tmj_animator_free(animator);
+
+        return NULL;
+    }
+
+    return animator;
+}
+
+void tmj_animator_free(tmj_animator* animator) {
+    if (animator == NULL) {
+        return;
+    }
+
+    animator_clear(animator);
+
+    free(animator->tilesets);
+    free(animator);
+}
+
+int tmj_animator_set_tileset(tmj_animator* animator, size_t index, Tileset* tileset) {
+    if (index >= animator->map->tileset_count) {
+        logmsg(TMJ_LOG_ERR, "Tileset index %zu is out of range, the map has %zu tilesets", index, animator->map->tileset_count);
+
+        return -1;
+    }
+
+    animator->tilesets[index] = tileset;
+
+    animator_clear(animator);
+
+    return animator_build(animator);
+}
+
+size_t tmj_animator_tick(tmj_animator* animator, uint32_t elapsed) {
+    animator->time += elapsed;
+    animator->dirty_count = 0;
+
+    for (size_t i = 0; i < animator->timeline_count; i++) {
+        timeline* t = &animator->timelines[i];
+        uint32_t current = timeline_frame(animator, t, animator->time);
+
+        if (current == t->current) {
+            continue;
+        }
+
+        t->current = current;
+
+        size_t first = animator->tile_offsets[i];
+        size_t count = animator->tile_offsets[i + 1] - first;
+
+        if (count > 0) {
+            memcpy(animator->dirty + animator->dirty_count, animator->tiles + first, count * sizeof(tmj_animated_tile));
+
+            animator->dirty_count += count;
+        }
+    }
+
+    return animator->dirty_count;
+}
+
+uint32_t tmj_animator_frame(const tmj_animator* animator, uint32_t gid) {
+    size_t t = gid_timeline(animator, gid);
+
+    if (t == 0) {
+        return gid;
+    }
+
+    return animator->timelines[t - 1].current | (gid & ~TMJ_GID_MASK);
+}
+
+const tmj_animated_tile* tmj_animator_tiles(const tmj_animator* animator, size_t* count) {
+    *count = animator->tile_count;
+
+    return animator->tiles;
+}
+
+const tmj_animated_tile* tmj_animator_dirty(const tmj_animator* animator, size_t* count) {
+    *count = animator->dirty_count;
+
+    return animator->dirty;
+}
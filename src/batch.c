@@ -0,0 +1,817 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "tmj.h"
+#include "util.h"
+
+/**
+ * @file
+ *
+ * Draw batch builder.
+ *
+ * Each visible tile layer keeps a window of blocks around the last view. A
+ * block holds the instances of its tiles, sorted by texture slot, and the
+ * ranges of each slot. An update works out which blocks each layer needs,
+ * keeps those it already has, builds the rest, and then merges the blocks of
+ * each layer slot by slot into the output.
+ *
+ * Texture slots number the textures of the map: one per sheet tileset, one
+ * per tile of an image collection.
+ */
+
+#define BATCH_BLOCK_SIZE 16
+
+typedef struct block_group {
+    uint32_t slot;
+    uint32_t first;
+    uint32_t count;
+} block_group;
+
+typedef struct block {
+    size_t group_count;
+    block_group* groups;
+    tmj_tile_instance* instances;
+} block;
+
+typedef struct batch_layer {
+    const Layer* layer;
+
+    float offset_x; // Accumulated through groups
+    float offset_y;
+    float parallax_x; // Accumulated through groups
+    float parallax_y;
+    uint32_t tint; // Accumulated through groups, opacity in alpha
+
+    int min_x; // Extent of the layer, in blocks
+    int min_y;
+    int max_x; // Exclusive
+    int max_y; // Exclusive
+
+    int window_x; // The blocks held, in blocks
+    int window_y;
+    int window_width;
+    int window_height;
+    block** window;
+
+    float shift_x; // Parallax shift for the current view
+    float shift_y;
+} batch_layer;
+
+typedef struct tileset_slots {
+    const Tileset* tileset;
+    uint32_t first_slot;
+} tileset_slots;
+
+typedef struct slot_instance {
+    uint32_t slot;
+    uint32_t order;
+    tmj_tile_instance instance;
+} slot_instance;
+
+typedef struct group_ref {
+    uint32_t slot;
+    uint32_t order;
+    const block* block;
+    const block_group* group;
+} group_ref;
+
+struct tmj_batch_builder {
+    Map* map;
+
+    int block_width; // In tiles
+    int block_height; // In tiles
+
+    size_t tileset_count;
+    tileset_slots* tilesets;
+    size_t slot_count;
+
+    // How far tiles reach past their cell, in pixels
+    float reach_left;
+    float reach_top;
+    float reach_right;
+    float reach_bottom;
+
+    size_t layer_count;
+    batch_layer* layers;
+
+    bool built; // False until the first update, and after the tilesets change
+
+    size_t instance_count;
+    size_t instance_capacity;
+    tmj_tile_instance* instances;
+
+    size_t batch_count;
+    size_t batch_capacity;
+    tmj_batch* batches;
+
+    // Scratch space, kept between blocks and updates
+    size_t scratch_capacity;
+    slot_instance* scratch;
+    size_t ref_capacity;
+    group_ref* refs;
+};
+
+static int floor_div(int a, int b) {
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+static uint32_t apply_opacity(uint32_t color, double opacity) {
+    uint32_t alpha = (uint32_t)((double)(color >> 24) * (opacity < 0 ? 0 : opacity > 1 ? 1 : opacity) + 0.5);
+
+    return (color & 0x00FFFFFFu) | (alpha << 24);
+}
+
+static void block_free(block* b) {
+    if (b != NULL) {
+        free(b->groups);
+        free(b->instances);
+        free(b);
+    }
+}
+
+static void layer_window_free(batch_layer* layer) {
+    for (int i = 0; i < layer->window_width * layer->window_height; i++) {
+        block_free(layer->window[i]);
+    }
+
+    free(layer->window);
+
+    layer->window = NULL;
+    layer->window_width = 0;
+    layer->window_height = 0;
+}
+
+/**
+ * Collects the visible tile layers from the flattened layer tree. Returns -1
+ * if out of memory.
+ */
+static int collect_layers(tmj_batch_builder* builder) {
+    const Map* map = builder->map;
+    size_t count = 0;
+
+    for (size_t i = 0; i < map->flat_layer_count; i++) {
+        const tmj_flat_layer* flat = &map->flat_layers[i];
+
+        count += flat->visible && flat->layer->type != NULL && strcmp(flat->layer->type, "tilelayer") == 0;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    builder->layers = calloc(count, sizeof(batch_layer));
+
+    if (builder->layers == NULL) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < map->flat_layer_count; i++) {
+        const tmj_flat_layer* flat = &map->flat_layers[i];
+
+        if (!flat->visible || flat->layer->type == NULL || strcmp(flat->layer->type, "tilelayer") != 0) {
+            continue;
+        }
+
+        batch_layer* state = &builder->layers[builder->layer_count++];
+
+        state->layer = flat->layer;
+        state->offset_x = (float)flat->offsetx;
+        state->offset_y = (float)flat->offsety;
+        state->parallax_x = (float)flat->parallaxx;
+        state->parallax_y = (float)flat->parallaxy;
+        state->tint = apply_opacity(flat->tint, flat->opacity);
+    }
+
+    return 0;
+}
+
+/**
+ * Works out the extent of each layer in blocks.
+ */
+static void layer_extents(tmj_batch_builder* builder) {
+    for (size_t i = 0; i < builder->layer_count; i++) {
+        batch_layer* state = &builder->layers[i];
+        const Layer* layer = state->layer;
+
+        int x0 = 0, y0 = 0, x1 = layer->width, y1 = layer->height;
+
+        if (layer->chunks != NULL) {
+            x0 = INT32_MAX, y0 = INT32_MAX, x1 = INT32_MIN, y1 = INT32_MIN;
+
+            for (size_t c = 0; c < layer->chunk_count; c++) {
+                const Chunk* chunk = &layer->chunks[c];
+
+                x0 = chunk->x < x0 ? chunk->x : x0;
+                y0 = chunk->y < y0 ? chunk->y : y0;
+                x1 = chunk->x + chunk->width > x1 ? chunk->x + chunk->width : x1;
+                y1 = chunk->y + chunk->height > y1 ? chunk->y + chunk->height : y1;
+            }
+
+            if (layer->chunk_count == 0) {
+                x0 = y0 = x1 = y1 = 0;
+            }
+        }
+
+        state->min_x = floor_div(x0, builder->block_width);
+        state->min_y = floor_div(y0, builder->block_height);
+        state->max_x = floor_div(x1 + builder->block_width - 1, builder->block_width);
+        state->max_y = floor_div(y1 + builder->block_height - 1, builder->block_height);
+    }
+}
+
+/**
+ * Numbers the texture slots of the tilesets known so far, and measures how
+ * far their tiles reach past their cells.
+ */
+static void assign_slots(tmj_batch_builder* builder) {
+    uint32_t slot = 0;
+
+    float cell_width = (float)builder->map->tilewidth;
+    float cell_height = (float)builder->map->tileheight;
+
+    builder->reach_left = builder->reach_top = builder->reach_right = builder->reach_bottom = 0;
+
+    for (size_t i = 0; i < builder->tileset_count; i++) {
+        const Tileset* tileset = builder->tilesets[i].tileset;
+
+        builder->tilesets[i].first_slot = slot;
+
+        if (tileset == NULL) {
+            continue;
+        }
+
+        slot += tileset->image != NULL ? 1 : (uint32_t)tileset->rect_count;
+
+        for (size_t id = 0; id < tileset->rect_count; id++) {
+            const tmj_tile_rect* rect = &tileset->rects[id];
+
+            if (rect->image == NULL) {
+                continue;
+            }
+
+            builder->reach_left = -rect->draw_x > builder->reach_left ? -rect->draw_x : builder->reach_left;
+            builder->reach_top = -rect->draw_y > builder->reach_top ? -rect->draw_y : builder->reach_top;
+
+            float right = rect->draw_x + rect->draw_width - cell_width;
+            float bottom = rect->draw_y + rect->draw_height - cell_height;
+
+            builder->reach_right = right > builder->reach_right ? right : builder->reach_right;
+            builder->reach_bottom = bottom > builder->reach_bottom ? bottom : builder->reach_bottom;
+        }
+    }
+
+    builder->slot_count = slot;
+}
+
+/**
+ * Builds the rects of a tileset for the map's grid, unless it already has
+ * them. Rects built for another grid, such as the tileset's own tile size,
+ * are built again.
+ */
+static int tileset_rects_for_grid(Tileset* tileset, const Map* map) {
+    if (tileset->rects != NULL && tileset->rect_grid_width == map->tilewidth && tileset->rect_grid_height == map->tileheight) {
+        return 0;
+    }
+
+    return tmj_tileset_build_rects(tileset, map->tilewidth, map->tileheight);
+}
+
+tmj_batch_builder* tmj_batch_builder_create(Map* map) {
+    if (map->orientation == NULL || strcmp(map->orientation, "orthogonal") != 0) {
+        logmsg(TMJ_LOG_ERR, "Unable to create batch builder, only orthogonal maps are supported");
+
+        return NULL;
+    }
+
+    if (map->headless) {
+        logmsg(TMJ_LOG_ERR, "Unable to create batch builder, the map was loaded without its presentation fields");
+
+        return NULL;
+    }
+
+    if (map->tilewidth <= 0 || map->tileheight <= 0) {
+        logmsg(TMJ_LOG_ERR, "Unable to create batch builder, the map has no tile size");
+
+        return NULL;
+    }
+
+    tmj_batch_builder* builder = calloc(1, sizeof(tmj_batch_builder));
+
+    if (builder == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to create batch builder, the system is out of memory");
+
+        return NULL;
+    }
+
+    builder->map = map;
+    builder->block_width = BATCH_BLOCK_SIZE;
+    builder->block_height = BATCH_BLOCK_SIZE;
+    builder->tileset_count = map->tileset_count;
+
+    if (map->tileset_count > 0) {
+        builder->tilesets = calloc(map->tileset_count, sizeof(tileset_slots));
+
+        if (builder->tilesets == NULL) {
+            logmsg(TMJ_LOG_ERR, "Unable to create batch builder, the system is out of memory");
+
+            goto fail;
+        }
+    }
+
+    for (size_t i = 0; i < map->tileset_count; i++) {
+        // External tilesets are left for tmj_batch_builder_set_tileset()
+        if (map->tilesets[i].source != NULL) {
+            continue;
+        }
+
+        Tileset* tileset = tmj_map_tileset(map, i);
+
+        if (tileset == NULL) {
+            goto fail;
+        }
+
+        if (tileset_rects_for_grid(tileset, map) != 0) {
+            goto fail;
+        }
+
+        builder->tilesets[i].tileset = tileset;
+    }
+
+    if (collect_layers(builder) != 0) {
+        logmsg(TMJ_LOG_ERR, "Unable to create batch builder, the system is out of memory");
+
+        goto fail;
+    }
+
+    // Blocks of infinite maps line up with their chunks
+    for (size_t i = 0; i < builder->layer_count; i++) {
+        const Layer* layer = builder->layers[i].layer;
+
+        if (layer->chunk_count > 0 && layer->chunks[0].width > 0 && layer->chunks[0].height > 0) {
+            builder->block_width = layer->chunks[0].width;
+            builder->block_height = layer->chunks[0].height;
+
+            break;
+        }
+    }
+
+    layer_extents(builder);
+    assign_slots(builder);
+
+    return builder;
+
+fail:
+    tmj_batch_builder_free(builder);
+
+    return NULL;
+}
+
+void tmj_batch_builder_free(tmj_batch_builder* builder) {
+    if (builder == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < builder->layer_count; i++) {
+        layer_window_free(&builder->layers[i]);
+    }
+
+    free(builder->layers);
+    free(builder->tilesets);
+    free(builder->instances);
+    free(builder->batches);
+    free(builder->scratch);
+    free(builder->refs);
+    free(builder);
+}
+
+int tmj_batch_builder_set_tileset(tmj_batch_builder* builder, size_t index, Tileset* tileset) {
+    if (index >= builder->tileset_count) {
+        logmsg(TMJ_LOG_ERR, "Tileset index %zu is out of range, the map has %zu tilesets", index, builder->tileset_count);
+
+        return -1;
+    }
+
+    if (tileset_rects_for_grid(tileset, builder->map) != 0) {
+        return -1;
+    }
+
+    builder->tilesets[index].tileset = tileset;
+
+    // Slots shift, so every block has to be built again
+    for (size_t i = 0; i < builder->layer_count; i++) {
+        layer_window_free(&builder->layers[i]);
+    }
+
+    assign_slots(builder);
+
+    builder->built = false;
+
+    return 0;
+}
+
+/**
+ * Finds the tileset a tile ID belongs to, starting from the last one found.
+ * Returns the index, or tileset_count if none.
+ */
+static size_t find_tileset(const tmj_batch_builder* builder, uint32_t gid, size_t hint) {
+    const Tileset* tilesets = builder->map->tilesets;
+
+    if (hint < builder->tileset_count && gid >= (uint32_t)tilesets[hint].firstgid &&
+            (hint + 1 == builder->tileset_count || gid < (uint32_t)tilesets[hint + 1].firstgid)) {
+        return hint;
+    }
+
+    // Tilesets are sorted by firstgid, find the last one that starts at or before gid
+    size_t low = 0;
+    size_t high = builder->tileset_count;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+
+        if ((uint32_t)tilesets[mid].firstgid <= gid) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low == 0 ? builder->tileset_count : low - 1;
+}
+
+static int slot_instance_compare(const void* a, const void* b) {
+    const slot_instance* x = a;
+    const slot_instance* y = b;
+
+    if (x->slot != y->slot) {
+        return x->slot < y->slot ? -1 : 1;
+    }
+
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+static int group_ref_compare(const void* a, const void* b) {
+    const group_ref* x = a;
+    const group_ref* y = b;
+
+    if (x->slot != y->slot) {
+        return x->slot < y->slot ? -1 : 1;
+    }
+
+    return x->order < y->order ? -1 : x->order > y->order;
+}
+
+static block* block_build(tmj_batch_builder* builder, const batch_layer* state, int bx, int by) {
+    size_t count = 0;
+    size_t hint = 0;
+
+    float cell_width = (float)builder->map->tilewidth;
+    float cell_height = (float)builder->map->tileheight;
+
+    tmj_view view;
+    tmj_view_run run;
+
+    tmj_view_begin(&view, state->layer, bx * builder->block_width, by * builder->block_height, builder->block_width, builder->block_height);
+
+    while (tmj_view_next(&view, &run)) {
+        if (count + (size_t)run.length > builder->scratch_capacity) {
+            size_t capacity = builder->scratch_capacity ? builder->scratch_capacity * 2 : 256;
+
+            while (capacity < count + (size_t)run.length) {
+                capacity *= 2;
+            }
+
+            slot_instance* grown = realloc(builder->scratch, capacity * sizeof(slot_instance));
+
+            if (grown == NULL) {
+                logmsg(TMJ_LOG_ERR, "Unable to build tile batches, the system is out of memory");
+
+                return NULL;
+            }
+
+            builder->scratch = grown;
+            builder->scratch_capacity = capacity;
+        }
+
+        for (int i = 0; i < run.length; i++) {
+            uint32_t gid = run.gids[i] & TMJ_GID_MASK;
+
+            hint = find_tileset(builder, gid, hint);
+
+            if (hint == builder->tileset_count || builder->tilesets[hint].tileset == NULL) {
+                continue;
+            }
+
+            const Tileset* tileset = builder->tilesets[hint].tileset;
+            uint32_t id = gid - (uint32_t)builder->map->tilesets[hint].firstgid;
+
+            if (id >= tileset->rect_count || tileset->rects[id].image == NULL) {
+                continue;
+            }
+
+            const tmj_tile_rect* rect = &tileset->rects[id];
+            slot_instance* si = &builder->scratch[count];
+
+            si->slot = builder->tilesets[hint].first_slot + (tileset->image != NULL ? 0 : id);
+            si->order = (uint32_t)count;
+            si->instance = (tmj_tile_instance){
+                    .x = (float)(run.x + i) * cell_width + rect->draw_x + state->offset_x,
+                    .y = (float)run.y * cell_height + rect->draw_y + state->offset_y,
+                    .width = rect->draw_width,
+                    .height = rect->draw_height,
+                    .u0 = rect->u0,
+                    .v0 = rect->v0,
+                    .u1 = rect->u1,
+                    .v1 = rect->v1,
+                    .tint = state->tint,
+                    .flags = (uint8_t)(run.gids[i] >> TMJ_GID_FLAGS_SHIFT),
+            };
+
+            count++;
+        }
+    }
+
+    qsort(builder->scratch, count, sizeof(slot_instance), slot_instance_compare);
+
+    size_t group_count = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        group_count += i == 0 || builder->scratch[i].slot != builder->scratch[i - 1].slot;
+    }
+
+    block* b = calloc(1, sizeof(block));
+
+    if (b == NULL || (count > 0 && ((b->groups = malloc(group_count * sizeof(block_group))) == NULL ||
+                                           (b->instances = malloc(count * sizeof(tmj_tile_instance))) == NULL))) {
+        logmsg(TMJ_LOG_ERR, "Unable to build tile batches, the system is out of memory");
+
+        block_free(b);
+
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0 || builder->scratch[i].slot != builder->scratch[i - 1].slot) {
+            b->groups[b->group_count++] = (block_group){builder->scratch[i].slot, (uint32_t)i, 0};
+        }
+
+        b->groups[b->group_count - 1].count++;
+        b->instances[i] = builder->scratch[i].instance;
+    }
+
+    return b;
+}
+
+/**
+ * Moves a layer's window of blocks to the given block range, keeping the
+ * blocks already built and building the rest. Returns 1 if the window moved,
+ * 0 if not, -1 on failure.
+ */
+static int layer_window_move(tmj_batch_builder* builder, batch_layer* state, int x0, int y0, int x1, int y1) {
+    int width = x1 > x0 ? x1 - x0 : 0;
+    int height = y1 > y0 ? y1 - y0 : 0;
+
+    if (builder->built && x0 == state->window_x && y0 == state->window_y && width == state->window_width && height == state->window_height) {
+        return 0;
+    }
+
+    block** window = NULL;
+
+    if (width > 0 && height > 0) {
+        window = calloc((size_t)width * height, sizeof(block*));
+
+        if (window == NULL) {
+            logmsg(TMJ_LOG_ERR, "Unable to build tile batches, the system is out of memory");
+
+            return -1;
+        }
+    }
+
+    // Hand over the blocks that stay in view
+    for (int y = 0; y < state->window_height; y++) {
+        for (int x = 0; x < state->window_width; x++) {
+            block** old = &state->window[(size_t)y * state->window_width + x];
+            int nx = state->window_x + x - x0;
+            int ny = state->window_y + y - y0;
+
+            if (nx >= 0 && ny >= 0 && nx < width && ny < height) {
+                window[(size_t)ny * width + nx] = *old;
+                *old = NULL;
+            }
+        }
+    }
+
+    layer_window_free(state);
+
+    state->window = window;
+    state->window_x = x0;
+    state->window_y = y0;
+    state->window_width = width;
+    state->window_height = height;
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            block** b = &window[(size_t)y * width + x];
+
+            if (*b == NULL && (*b = block_build(builder, state, x0 + x, y0 + y)) == NULL) {
+                layer_window_free(state);
+
+                return -1;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Merges the blocks of every layer into the output, slot by slot.
+ */
+static int assemble(tmj_batch_builder* builder) {
+    builder->instance_count = 0;
+    builder->batch_count = 0;
+
+    for (size_t l = 0; l < builder->layer_count; l++) {
+        batch_layer* state = &builder->layers[l];
+        size_t ref_count = 0;
+        size_t instance_count = 0;
+
+        for (int i = 0; i < state->window_width * state->window_height; i++) {
+            ref_count += state->window[i]->group_count;
+        }
+
+        if (ref_count > builder->ref_capacity) {
+            group_ref* grown = realloc(builder->refs, ref_count * sizeof(group_ref));
+
+            if (grown == NULL) {
+                return -1;
+            }
+
+            builder->refs = grown;
+            builder->ref_capacity = ref_count;
+        }
+
+        ref_count = 0;
+
+        for (int i = 0; i < state->window_width * state->window_height; i++) {
+            const block* b = state->window[i];
+
+            for (size_t g = 0; g < b->group_count; g++) {
+                builder->refs[ref_count] = (group_ref){b->groups[g].slot, (uint32_t)ref_count, b, &b->groups[g]};
+                instance_count += b->groups[g].count;
+                ref_count++;
+            }
+        }
+
+        qsort(builder->refs, ref_count, sizeof(group_ref), group_ref_compare);
+
+        if (builder->instance_count + instance_count > builder->instance_capacity) {
+            size_t capacity = builder->instance_capacity ? builder->instance_capacity : 1024;
+
+            while (capacity < builder->instance_count + instance_count) {
+                capacity *= 2;
+            }
+
+            tmj_tile_instance* grown = realloc(builder->instances, capacity * sizeof(tmj_tile_instance));
+
+            if (grown == NULL) {
+                return -1;
+            }
+
+            builder->instances = grown;
+            builder->instance_capacity = capacity;
+        }
+
+        for (size_t r = 0; r < ref_count; r++) {
+            const group_ref* ref = &builder->refs[r];
+
+            // A new slot starts a new batch
+            if (r == 0 || ref->slot != builder->refs[r - 1].slot) {
+                if (builder->batch_count == builder->batch_capacity) {
+                    size_t capacity = builder->batch_capacity ? builder->batch_capacity * 2 : 16;
+                    tmj_batch* grown = realloc(builder->batches, capacity * sizeof(tmj_batch));
+
+                    if (grown == NULL) {
+                        return -1;
+                    }
+
+                    builder->batches = grown;
+                    builder->batch_capacity = capacity;
+                }
+
+                size_t tileset = 0;
+
+                // The last tileset starting at or before the slot; empty ones share the next one's first slot
+                for (size_t t = 0; t < builder->tileset_count; t++) {
+                    if (builder->tilesets[t].tileset != NULL && builder->tilesets[t].first_slot <= ref->slot) {
+                        tileset = t;
+                    }
+                }
+
+                const Tileset* t = builder->tilesets[tileset].tileset;
+                uint32_t id = ref->slot - builder->tilesets[tileset].first_slot;
+
+                builder->batches[builder->batch_count++] = (tmj_batch){
+                        .layer = state->layer,
+                        .tileset = tileset,
+                        .image = t->image != NULL ? t->image : t->rects[id].image,
+                        .first = builder->instance_count,
+                        .count = 0,
+                };
+            }
+
+            memcpy(builder->instances + builder->instance_count,
+                    ref->block->instances + ref->group->first,
+                    ref->group->count * sizeof(tmj_tile_instance));
+
+            builder->instance_count += ref->group->count;
+            builder->batches[builder->batch_count - 1].count += ref->group->count;
+        }
+    }
+
+    return 0;
+}
+
+int tmj_batch_builder_update(tmj_batch_builder* builder, float x, float y, float width, float height) {
+    const Map* map = builder->map;
+    int changed = !builder->built;
+
+    for (size_t l = 0; l < builder->layer_count; l++) {
+        batch_layer* state = &builder->layers[l];
+
+        state->shift_x = (x - (float)map->parallaxoriginx) * (1 - state->parallax_x);
+        state->shift_y = (y - (float)map->parallaxoriginy) * (1 - state->parallax_y);
+
+        // The view in the layer's own pixels, widened by how far tiles reach out of their cells
+        float left = x - state->shift_x - state->offset_x - builder->reach_right;
+        float top = y - state->shift_y - state->offset_y - builder->reach_bottom;
+        float right = x + width - state->shift_x - state->offset_x + builder->reach_left;
+        float bottom = y + height - state->shift_y - state->offset_y + builder->reach_top;
+
+        float block_width = (float)(builder->block_width * map->tilewidth);
+        float block_height = (float)(builder->block_height * map->tileheight);
+
+        int x0 = (int)floorf(left / block_width);
+        int y0 = (int)floorf(top / block_height);
+        int x1 = (int)ceilf(right / block_width);
+        int y1 = (int)ceilf(bottom / block_height);
+
+        // Nothing is built outside the layer
+        x0 = x0 > state->min_x ? x0 : state->min_x;
+        y0 = y0 > state->min_y ? y0 : state->min_y;
+        x1 = x1 < state->max_x ? x1 : state->max_x;
+        y1 = y1 < state->max_y ? y1 : state->max_y;
+
+        int moved = layer_window_move(builder, state, x0, y0, x1, y1);
+
+        if (moved == -1) {
+            builder->built = false;
+
+            return -1;
+        }
+
+        changed |= moved;
+    }
+
+    if (changed) {
+        if (assemble(builder) != 0) {
+            logmsg(TMJ_LOG_ERR, "Unable to build tile batches, the system is out of memory");
+
+            builder->instance_count = 0;
+            builder->batch_count = 0;
+            builder->built = false;
+
+            return -1;
+        }
+
+        builder->built = true;
+    }
+
+    // Batches are in layer order, so the layer of each can be walked alongside
+    size_t l = 0;
+
+    for (size_t b = 0; b < builder->batch_count; b++) {
+        while (builder->layers[l].layer != builder->batches[b].layer) {
+            l++;
+        }
+
+        builder->batches[b].parallax_x = builder->layers[l].shift_x;
+        builder->batches[b].parallax_y = builder->layers[l].shift_y;
+    }
+
+    return changed;
+}
+
+const tmj_tile_instance* tmj_batch_builder_instances(const tmj_batch_builder* builder, size_t* count) {
+    *count = builder->instance_count;
+
+    return builder->instances;
+}
+
+const tmj_batch* tmj_batch_builder_batches(const tmj_batch_builder* builder, size_t* count) {
+    *count = builder->batch_count;
+
+    return builder->batches;
+}
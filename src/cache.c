@@ -0,0 +1,419 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+#include "log.h"
+#include "tmj.h"
+
+/**
+ * @file
+ *
+ * Decoded chunk cache.
+ *
+ * Entries live in a chained hash table keyed by Chunk address, and on a
+ * doubly-linked list in least- to most-recently-used order. Everything is
+ * guarded by a spinlock. The critical sections only touch the table and the
+ * list; decoding, and allocating a bigger table, happen outside the lock, so a
+ * miss doesn't stall readers of other chunks. If two threads miss on the same chunk at once, both decode it
+ * and the loser's copy is thrown away.
+ */
+
+typedef struct cache_entry {
+    const Chunk* chunk;
+    uint32_t* tiles;
+    size_t size; // In tiles
+
+    size_t pins;
+
+    struct cache_entry* hash_next;
+    struct cache_entry* lru_prev; // Toward the least-recently-used end
+    struct cache_entry* lru_next; // Toward the most-recently-used end
+} cache_entry;
+
+struct tmj_chunk_cache {
+    atomic_flag lock;
+
+    size_t budget;
+
+    size_t bucket_count; // Always a power of two
+    cache_entry** buckets;
+
+    cache_entry* lru_head; // Least-recently used
+    cache_entry* lru_tail; // Most-recently used
+
+    tmj_chunk_cache_stats stats;
+};
+
+#define CACHE_INITIAL_BUCKETS 64
+#define CACHE_LOCK_SPINS 64
+
+static void cache_lock(tmj_chunk_cache* cache) {
+    unsigned spins = 0;
+
+    while (atomic_flag_test_and_set_explicit(&cache->lock, memory_order_acquire)) {
+        // Most sections are a few pointer updates, past that the holder is likely descheduled
+        if (++spins < CACHE_LOCK_SPINS) {
+            continue;
+        }
+
+#ifdef _WIN32
+        SwitchToThread();
+#else
+        sched_yield();
+#endif
+    }
+}
+
+static void cache_unlock(tmj_chunk_cache* cache) {
+    atomic_flag_clear_explicit(&cache->lock, memory_order_release);
+}
+
+static size_t cache_bucket(const tmj_chunk_cache* cache, const Chunk* chunk) {
+    // Fibonacci hashing, chunks are allocated in arrays so the low bits vary least
+    uint64_t h = (uint64_t)(uintptr_t)chunk * UINT64_C(0x9E3779B97F4A7C15);
+
+    return (size_t)(h >> 32) & (cache->bucket_count - 1);
+}
+
+static cache_entry* cache_find(const tmj_chunk_cache* cache, const Chunk* chunk) {
+    cache_entry* entry = cache->buckets[cache_bucket(cache, chunk)];
+
+    while (entry != NULL && entry->chunk != chunk) {
+        entry = entry->hash_next;
+    }
+
+    return entry;
+}
+
+static void lru_unlink(tmj_chunk_cache* cache, cache_entry* entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        cache->lru_head = entry->lru_next;
+    }
+
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        cache->lru_tail = entry->lru_prev;
+    }
+
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+static void lru_push(tmj_chunk_cache* cache, cache_entry* entry) {
+    entry->lru_prev = cache->lru_tail;
+    entry->lru_next = NULL;
+
+    if (cache->lru_tail) {
+        cache->lru_tail->lru_next = entry;
+    } else {
+        cache->lru_head = entry;
+    }
+
+    cache->lru_tail = entry;
+}
+
+static void cache_grow(tmj_chunk_cache* cache, size_t bucket_count) {
+    cache_entry** buckets = calloc(bucket_count, sizeof(cache_entry*));
+
+    // Longer chains are only slower, not wrong
+    if (buckets == NULL) {
+        return;
+    }
+
+    cache_lock(cache);
+
+    // Another writer may have grown the table while this one was allocating
+    if (cache->bucket_count >= bucket_count) {
+        cache_unlock(cache);
+
+        free(buckets);
+
+        return;
+    }
+
+    cache_entry** old = cache->buckets;
+    size_t old_count = cache->bucket_count;
+
+    cache->buckets = buckets;
+    cache->bucket_count = bucket_count;
+
+    for (size_t i = 0; i < old_count; i++) {
+        cache_entry* entry = old[i];
+
+        while (entry != NULL) {
+            cache_entry* next = entry->hash_next;
+            size_t b = cache_bucket(cache, entry->chunk);
+
+            entry->hash_next = buckets[b];
+            buckets[b] = entry;
+
+            entry = next;
+        }
+    }
+
+    cache_unlock(cache);
+
+    free(old);
+}
+
+static void cache_remove(tmj_chunk_cache* cache, cache_entry* entry) {
+    cache_entry** link = &cache->buckets[cache_bucket(cache, entry->chunk)];
+
+    while (*link != entry) {
+        link = &(*link)->hash_next;
+    }
+
+    *link = entry->hash_next;
+
+    lru_unlink(cache, entry);
+
+    cache->stats.resident_chunks--;
+    cache->stats.resident_bytes -= entry->size * sizeof(uint32_t);
+}
+
+/**
+ * Evicts unpinned entries, least-recently-used first, until the cache fits its
+ * budget. Returns the evicted entries chained through hash_next, so they can
+ * be freed after the lock is dropped.
+ */
+static cache_entry* cache_trim(tmj_chunk_cache* cache) {
+    cache_entry* evicted = NULL;
+    cache_entry* entry = cache->lru_head;
+
+    while (entry != NULL && cache->stats.resident_bytes > cache->budget) {
+        cache_entry* next = entry->lru_next;
+
+        if (entry->pins == 0) {
+            cache_remove(cache, entry);
+
+            entry->hash_next = evicted;
+            evicted = entry;
+
+            cache->stats.evictions++;
+        }
+
+        entry = next;
+    }
+
+    return evicted;
+}
+
+static void entries_free(cache_entry* entry) {
+    while (entry != NULL) {
+        cache_entry* next = entry->hash_next;
+
+        free(entry->tiles);
+        free(entry);
+
+        entry = next;
+    }
+}
+
+tmj_chunk_cache* tmj_chunk_cache_create(size_t budget) {
+    tmj_chunk_cache* cache = calloc(1, sizeof(tmj_chunk_cache));
+
+    if (cache == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to create chunk cache, the system is out of memory");
+
+        return NULL;
+    }
+
+    cache->buckets = calloc(CACHE_INITIAL_BUCKETS, sizeof(cache_entry*));
+
+    if (cache->buckets == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to create chunk cache, the system is out of memory");
+
+        free(cache);
+
+        return NULL;
+    }
+
+    atomic_flag_clear(&cache->lock);
+
+    cache->budget = budget;
+    cache->bucket_count = CACHE_INITIAL_BUCKETS;
+
+    return cache;
+}
+
+void tmj_chunk_cache_free(tmj_chunk_cache* cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    cache_entry* entry = cache->lru_head;
+
+    while (entry != NULL) {
+        cache_entry* next = entry->lru_next;
+
+        free(entry->tiles);
+        free(entry);
+
+        entry = next;
+    }
+
+    free(cache->buckets);
+    free(cache);
+}
+
+const uint32_t* tmj_chunk_cache_get(tmj_chunk_cache* cache, const Layer* layer, const Chunk* chunk, size_t* size) {
+    // CSV chunks were decoded by the loader, there is nothing to cache
+    if (!chunk->data_is_str && chunk->data_compact == NULL) {
+        if (size != NULL) {
+            *size = (size_t)chunk->width * chunk->height;
+        }
+
+        return chunk->data_uint;
+    }
+
+    cache_lock(cache);
+
+    cache_entry* entry = cache_find(cache, chunk);
+
+    if (entry != NULL) {
+        entry->pins++;
+        cache->stats.hits++;
+
+        lru_unlink(cache, entry);
+        lru_push(cache, entry);
+
+        cache_unlock(cache);
+
+        if (size != NULL) {
+            *size = entry->size;
+        }
+
+        return entry->tiles;
+    }
+
+    cache->stats.misses++;
+
+    cache_unlock(cache);
+
+    size_t decoded_size = 0;
+    uint32_t* tiles = NULL;
+
+    if (chunk->data_is_str) {
+        tiles = tmj_decode_layer(chunk->data_str, layer->encoding, layer->compression ? layer->compression : "", &decoded_size);
+    } else if ((tiles = malloc(chunk->data_compact->count * sizeof(uint32_t))) != NULL) {
+        decoded_size = chunk->data_compact->count;
+
+        tmj_tiles_read(chunk->data_compact, 0, decoded_size, tiles);
+    }
+
+    if (tiles == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to decode chunk (%d, %d) of layer[%d]", chunk->x, chunk->y, layer->id);
+
+        return NULL;
+    }
+
+    cache_entry* fresh = calloc(1, sizeof(cache_entry));
+
+    if (fresh == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to cache chunk (%d, %d) of layer[%d], the system is out of memory", chunk->x, chunk->y, layer->id);
+
+        free(tiles);
+
+        return NULL;
+    }
+
+    fresh->chunk = chunk;
+    fresh->tiles = tiles;
+    fresh->size = decoded_size;
+    fresh->pins = 1;
+
+    cache_lock(cache);
+
+    // Another reader may have decoded the same chunk in the meantime
+    entry = cache_find(cache, chunk);
+
+    if (entry != NULL) {
+        entry->pins++;
+
+        lru_unlink(cache, entry);
+        lru_push(cache, entry);
+    } else {
+        entry = fresh;
+
+        size_t b = cache_bucket(cache, chunk);
+
+        entry->hash_next = cache->buckets[b];
+        cache->buckets[b] = entry;
+
+        lru_push(cache, entry);
+
+        cache->stats.resident_chunks++;
+        cache->stats.resident_bytes += decoded_size * sizeof(uint32_t);
+    }
+
+    cache_entry* evicted = cache_trim(cache);
+    size_t grow_count = cache->stats.resident_chunks > cache->bucket_count ? cache->bucket_count * 2 : 0;
+
+    cache_unlock(cache);
+
+    if (grow_count > 0) {
+        cache_grow(cache, grow_count);
+    }
+
+    if (entry != fresh) {
+        free(fresh->tiles);
+        free(fresh);
+    }
+
+    entries_free(evicted);
+
+    if (size != NULL) {
+        *size = entry->size;
+    }
+
+    return entry->tiles;
+}
+
+void tmj_chunk_cache_release(tmj_chunk_cache* cache, const Chunk* chunk) {
+    if (!chunk->data_is_str && chunk->data_compact == NULL) {
+        return;
+    }
+
+    cache_lock(cache);
+
+    cache_entry* entry = cache_find(cache, chunk);
+    cache_entry* evicted = NULL;
+
+    if (entry != NULL && entry->pins > 0) {
+        entry->pins--;
+
+        // Pinned entries may have pushed the cache over its budget
+        if (entry->pins == 0) {
+            evicted = cache_trim(cache);
+        }
+    }
+
+    cache_unlock(cache);
+
+    if (entry == NULL) {
+        logmsg(TMJ_LOG_WARNING, "Released chunk (%d, %d) which is not in the cache", chunk->x, chunk->y);
+    }
+
+    entries_free(evicted);
+}
+
+void tmj_chunk_cache_read_stats(tmj_chunk_cache* cache, tmj_chunk_cache_stats* stats) {
+    cache_lock(cache);
+
+    *stats = cache->stats;
+
+    cache_unlock(cache);
+}
@@ -0,0 +1,267 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "tmj.h"
+
+/**
+ * @file
+ *
+ * Tile properties compiled into columns indexed by global tile ID.
+ */
+
+/**
+ * Returns the number of bytes a column of the given type takes for gid_count
+ * tile IDs, rounded up to keep the next column aligned.
+ */
+static size_t column_size(tmj_column_type type, uint32_t gid_count) {
+    if (type == TMJ_COLUMN_BOOL) {
+        return ((size_t)gid_count + 63) / 64 * sizeof(uint64_t);
+    }
+
+    return ((size_t)gid_count * sizeof(int32_t) + 7) / 8 * 8;
+}
+
+/**
+ * Sets the value of a tile ID in a column.
+ */
+static void column_set(tmj_tile_column* column, uint32_t gid, double value) {
+    switch (column->type) {
+        case TMJ_COLUMN_BOOL:
+            if (value != 0) {
+                column->bits[gid >> 6] |= (uint64_t)1 << (gid & 63);
+            } else {
+                column->bits[gid >> 6] &= ~((uint64_t)1 << (gid & 63));
+            }
+
+            break;
+        case TMJ_COLUMN_INT:
+            column->ints[gid] = (int32_t)value;
+
+            break;
+        case TMJ_COLUMN_FLOAT:
+            column->floats[gid] = (float)value;
+
+            break;
+    }
+}
+
+/**
+ * Stores a tile's property in a column, converting it to the column's type.
+ * Properties of other types than int, float and bool are ignored.
+ */
+static void column_store(tmj_tile_column* column, uint32_t gid, const Property* property) {
+    if (strcmp(property->type, "int") == 0) {
+        column_set(column, gid, property->value_int);
+    } else if (strcmp(property->type, "float") == 0) {
+        column_set(column, gid, property->value_float);
+    } else if (strcmp(property->type, "bool") == 0) {
+        column_set(column, gid, property->value_bool);
+    }
+}
+
+/**
+ * Returns the end of the tile IDs of a tileset. Sheets cover every tile ID up
+ * to tilecount, image collections may skip some and go past it.
+ */
+static uint32_t tileset_gid_end(uint32_t firstgid, const Tileset* tileset) {
+    uint32_t count = tileset->tilecount > 0 ? (uint32_t)tileset->tilecount : 0;
+
+    if (tileset->image == NULL) {
+        for (size_t i = 0; i < tileset->tile_count; i++) {
+            if (tileset->tiles[i].id >= 0 && (uint32_t)tileset->tiles[i].id >= count) {
+                count = (uint32_t)tileset->tiles[i].id + 1;
+            }
+        }
+    }
+
+    return firstgid + count;
+}
+
+/**
+ * Stores the properties of a tileset's tiles in the columns.
+ */
+static void tileset_store(tmj_tile_columns* columns, uint32_t firstgid, const Tileset* tileset) {
+    for (size_t t = 0; t < tileset->tile_count; t++) {
+        const Tile* tile = &tileset->tiles[t];
+        uint32_t gid = firstgid + (uint32_t)tile->id;
+
+        if (tile->id < 0 || gid >= columns->gid_count) {
+            continue;
+        }
+
+        for (size_t p = 0; p < tile->property_count; p++) {
+            const Property* property = &tile->properties[p];
+
+            if (property->name == NULL || property->type == NULL) {
+                continue;
+            }
+
+            for (size_t c = 0; c < columns->column_count; c++) {
+                if (strcmp(property->name, columns->columns[c].name) == 0) {
+                    column_store(&columns->columns[c], gid, property);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Grows the columns to cover gid_count tile IDs, keeping the values they
+ * have. New tile IDs, and the padding at the end of each column, hold the
+ * default values.
+ */
+static int columns_resize(tmj_tile_columns* columns, uint32_t gid_count) {
+    size_t block_size = 0;
+
+    for (size_t i = 0; i < columns->column_count; i++) {
+        block_size += column_size(columns->columns[i].type, gid_count);
+    }
+
+    uint8_t* block = NULL;
+
+    if (block_size > 0 && (block = malloc(block_size)) == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to build tile property columns, the system is out of memory");
+
+        return -1;
+    }
+
+    uint8_t* next = block;
+
+    for (size_t i = 0; i < columns->column_count; i++) {
+        tmj_tile_column* column = &columns->columns[i];
+        size_t size = column_size(column->type, gid_count);
+        size_t kept = column_size(column->type, columns->gid_count);
+
+        if (column->type == TMJ_COLUMN_BOOL) {
+            memset(next, column->default_value != 0 ? 0xFF : 0, size);
+        } else {
+            for (size_t gid = 0; gid < size / sizeof(int32_t); gid++) {
+                if (column->type == TMJ_COLUMN_INT) {
+                    ((int32_t*)next)[gid] = (int32_t)column->default_value;
+                } else {
+                    ((float*)next)[gid] = (float)column->default_value;
+                }
+            }
+        }
+
+        if (kept > 0) {
+            memcpy(next, column->bits, kept);
+        }
+
+        column->bits = (uint64_t*)next;
+        next += size;
+    }
+
+    free(columns->block);
+
+    columns->block = block;
+    columns->gid_count = gid_count;
+
+    return 0;
+}
+
+tmj_tile_columns* tmj_tile_columns_build(Map* map, const tmj_column_spec* specs, size_t spec_count) {
+    uint32_t gid_count = 0;
+
+    // Tilesets referenced by source cover none of their tile IDs until they're set
+    for (size_t i = 0; i < map->tileset_count; i++) {
+        uint32_t end = (uint32_t)map->tilesets[i].firstgid;
+
+        if (map->tilesets[i].source == NULL) {
+            Tileset* tileset = tmj_map_tileset(map, i);
+
+            if (tileset == NULL) {
+                return NULL;
+            }
+
+            end = tileset_gid_end(end, tileset);
+        }
+
+        gid_count = end > gid_count ? end : gid_count;
+    }
+
+    tmj_tile_columns* columns = calloc(1, sizeof(tmj_tile_columns));
+
+    if (columns == NULL || (spec_count > 0 && (columns->columns = calloc(spec_count, sizeof(tmj_tile_column))) == NULL) ||
+            (map->tileset_count > 0 && (columns->firstgids = calloc(map->tileset_count, sizeof(uint32_t))) == NULL)) {
+        logmsg(TMJ_LOG_ERR, "Unable to build tile property columns, the system is out of memory");
+
+        tmj_tile_columns_free(columns);
+
+        return NULL;
+    }
+
+    columns->column_count = spec_count;
+    columns->tileset_count = map->tileset_count;
+
+    for (size_t i = 0; i < spec_count; i++) {
+        columns->columns[i].name = specs[i].name;
+        columns->columns[i].type = specs[i].type;
+        columns->columns[i].default_value = specs[i].default_value;
+    }
+
+    if (columns_resize(columns, gid_count) != 0) {
+        tmj_tile_columns_free(columns);
+
+        return NULL;
+    }
+
+    for (size_t i = 0; i < map->tileset_count; i++) {
+        columns->firstgids[i] = (uint32_t)map->tilesets[i].firstgid;
+
+        if (map->tilesets[i].source == NULL) {
+            tileset_store(columns, columns->firstgids[i], &map->tilesets[i]);
+        }
+    }
+
+    return columns;
+}
+
+void tmj_tile_columns_free(tmj_tile_columns* columns) {
+    if (columns == NULL) {
+        return;
+    }
+
+    free(columns->block);
+    free(columns->columns);
+    free(columns->firstgids);
+    free(columns);
+}
+
+int tmj_tile_columns_set_tileset(tmj_tile_columns* columns, size_t index, const Tileset* tileset) {
+    if (index >= columns->tileset_count) {
+        logmsg(TMJ_LOG_ERR, "Tileset index %zu is out of range, the map has %zu tilesets", index, columns->tileset_count);
+
+        return -1;
+    }
+
+    uint32_t firstgid = columns->firstgids[index];
+    uint32_t end = tileset_gid_end(firstgid, tileset);
+
+    if (end > columns->gid_count && columns_resize(columns, end) != 0) {
+        return -1;
+    }
+
+    // Values of a tileset set before are replaced
+    for (size_t c = 0; c < columns->column_count; c++) {
+        for (uint32_t gid = firstgid; gid < end; gid++) {
+            column_set(&columns->columns[c], gid, columns->columns[c].default_value);
+        }
+    }
+
+    tileset_store(columns, firstgid, tileset);
+
+    return 0;
+}
+
+const tmj_tile_column* tmj_tile_columns_find(const tmj_tile_columns* columns, const char* name) {
+    for (size_t i = 0; i < columns->column_count; i++) {
+        if (strcmp(columns->columns[i].name, name) == 0) {
+            return &columns->columns[i];
+        }
+    }
+
+    return NULL;
+}
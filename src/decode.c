@@ -4,10 +4,12 @@
 
 #include "decode.h"
 #include "log.h"
+#include "stats.h"
+#include "trace.h"
 
 #ifdef LIBTMJ_ZSTD
 
-uint8_t* tmj_zstd_decompress(const uint8_t* data, size_t data_size, size_t* decompressed_size) {
+static uint8_t* zstd_decompress(const uint8_t* data, size_t data_size, size_t* decompressed_size) {
     logmsg(TMJ_LOG_DEBUG, "Decode (zstd): Decompressing buffer of size %zu", data_size);
 
     if (data == NULL) {
@@ -30,7 +32,7 @@ uint8_t* tmj_zstd_decompress(const uint8_t* data, size_t data_size, size_t* deco
         return NULL;
     }
 
-    void* ret = malloc(ret_size);
+    void* ret = stats_malloc(ret_size);
 
     if (ret == NULL) {
         logmsg(TMJ_LOG_ERR, "Decode (zstd): Unable to allocate buffer for decompressed data, the system is out of memory");
@@ -45,7 +47,7 @@ uint8_t* tmj_zstd_decompress(const uint8_t* data, size_t data_size, size_t* deco
     if (ZSTD_isError(dsize)) {
         logmsg(TMJ_LOG_ERR, "Decode (zstd): Decompression error: %s", ZSTD_getErrorName(dsize));
 
-        free(ret);
+        stats_free(ret, ret_size);
 
         return NULL;
     }
@@ -55,11 +57,26 @@ uint8_t* tmj_zstd_decompress(const uint8_t* data, size_t data_size, size_t* deco
     return ret;
 }
 
+uint8_t* tmj_zstd_decompress(const uint8_t* data, size_t data_size, size_t* decompressed_size) {
+    trace_scope trace = trace_begin("tmj_zstd_decompress");
+    uint64_t start = stats_phase_begin();
+
+    uint8_t* ret = zstd_decompress(data, data_size, decompressed_size);
+
+    if (ret != NULL) {
+        stats_phase_end(STATS_PHASE_ZSTD, start, *decompressed_size);
+    }
+
+    trace_end(&trace);
+
+    return ret;
+}
+
 #endif
 
 #ifdef LIBTMJ_ZLIB
 
-uint8_t* tmj_zlib_decompress(const uint8_t* data, size_t data_size, size_t* decompressed_size) {
+static uint8_t* zlib_decompress(const uint8_t* data, size_t data_size, size_t* decompressed_size) {
     logmsg(TMJ_LOG_DEBUG, "Decode (zlib): Decompressing buffer of size %zu", data_size);
 
     if (data == NULL) {
@@ -70,7 +87,8 @@ uint8_t* tmj_zlib_decompress(const uint8_t* data, size_t data_size, size_t* deco
 
     const size_t INFLATE_BLOCK_SIZE = 262144;
 
-    uint8_t* out = malloc(INFLATE_BLOCK_SIZE);
+    size_t out_size = INFLATE_BLOCK_SIZE;
+    uint8_t* out = stats_malloc(out_size);
 
     if (out == NULL) {
         logmsg(TMJ_LOG_ERR, "Decode (zlib): Unable to allocate buffer for decompressed data, the system is out of memory");
@@ -143,13 +161,15 @@ uint8_t* tmj_zlib_decompress(const uint8_t* data, size_t data_size, size_t* deco
             case Z_OK:
                 logmsg(TMJ_LOG_DEBUG, "Decode (zlib): inflate OK");
 
-                out = realloc(out, INFLATE_BLOCK_SIZE * realloc_scale);
+                out = stats_realloc(out, out_size, INFLATE_BLOCK_SIZE * realloc_scale);
                 if (out == NULL) {
                     logmsg(TMJ_LOG_ERR, "Decode (zlib): Unable to grow inflate output buffer, the system is out memory");
 
                     return NULL;
                 }
 
+                out_size = INFLATE_BLOCK_SIZE * realloc_scale;
+
                 stream.avail_out = INFLATE_BLOCK_SIZE;
 
                 stream.next_out = out + stream.total_out;
@@ -198,7 +218,7 @@ uint8_t* tmj_zlib_decompress(const uint8_t* data, size_t data_size, size_t* deco
     return out;
 
 fail_zlib:
-    free(out);
+    stats_free(out, out_size);
 
     if (stream.msg) {
         logmsg(TMJ_LOG_ERR, "Decode (zlib): zlib error: '%s'", stream.msg);
@@ -207,6 +227,21 @@ fail_zlib:
     return NULL;
 }
 
+uint8_t* tmj_zlib_decompress(const uint8_t* data, size_t data_size, size_t* decompressed_size) {
+    trace_scope trace = trace_begin("tmj_zlib_decompress");
+    uint64_t start = stats_phase_begin();
+
+    uint8_t* ret = zlib_decompress(data, data_size, decompressed_size);
+
+    if (ret != NULL) {
+        stats_phase_end(STATS_PHASE_ZLIB, start, *decompressed_size);
+    }
+
+    trace_end(&trace);
+
+    return ret;
+}
+
 uint8_t* tmj_zlib_compress(const uint8_t* data, size_t data_size, int level, size_t* compressed_size) {
     logmsg(TMJ_LOG_DEBUG, "Decode (zlib): Compressing buffer of size %zu", data_size);
 
@@ -407,7 +442,7 @@ bool b64_is_valid_char(char c) {
     return false;
 }
 
-uint8_t* tmj_b64_decode(const char* data, size_t* decoded_size) {
+static uint8_t* b64_decode(const char* data, size_t* decoded_size) {
     if (data == NULL) {
         logmsg(TMJ_LOG_ERR, "Decode (b64): Unable to decode null input");
 
@@ -423,7 +458,7 @@ uint8_t* tmj_b64_decode(const char* data, size_t* decoded_size) {
     }
 
     size_t dSize = b64_decode_size(data);
-    uint8_t* out = malloc(dSize);
+    uint8_t* out = stats_malloc(dSize);
 
     if (out == NULL) {
         logmsg(TMJ_LOG_ERR, "Decode (b64): Unable to allocate output buffer, the system is out of memory");
@@ -436,7 +471,7 @@ uint8_t* tmj_b64_decode(const char* data, size_t* decoded_size) {
         if (!b64_is_valid_char(data[i])) {
             logmsg(TMJ_LOG_ERR, "Decode (b64): Invalid Base64 character, '%c'", data[i]);
 
-            free(out);
+            stats_free(out, dSize);
 
             return NULL;
         }
@@ -464,6 +499,21 @@ uint8_t* tmj_b64_decode(const char* data, size_t* decoded_size) {
     return out;
 }
 
+uint8_t* tmj_b64_decode(const char* data, size_t* decoded_size) {
+    trace_scope trace = trace_begin("tmj_b64_decode");
+    uint64_t start = stats_phase_begin();
+
+    uint8_t* ret = b64_decode(data, decoded_size);
+
+    if (ret != NULL) {
+        stats_phase_end(STATS_PHASE_B64, start, *decoded_size);
+    }
+
+    trace_end(&trace);
+
+    return ret;
+}
+
 size_t b64_encoded_size(size_t inlen) {
     size_t ret;
 
@@ -0,0 +1,503 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "tmj.h"
+
+/**
+ * @file
+ *
+ * Inverted index from global tile ID to the positions that hold it.
+ *
+ * The tile layers of the map are split into parts, one per finite layer and
+ * one per chunk. Each part is scanned on its own into a private list of hits,
+ * so parts can be scanned from different threads. Finishing the index sorts
+ * the hits of every part by tile ID into one array, keeping part order and
+ * row-major order within a part.
+ *
+ * A position is stored as 8 bytes: the part, and the cell within the part,
+ * with the tile's flip flags in the top bits of the cell.
+ */
+
+#define CELL_MASK TMJ_GID_MASK
+
+typedef struct index_part {
+    const Layer* layer;
+    const Chunk* chunk; // NULL for finite layers
+
+    int x; // In tiles
+    int y; // In tiles
+    int width; // In tiles
+    int height; // In tiles
+
+    bool scanned;
+
+    size_t hit_count;
+    size_t hit_capacity;
+    uint64_t* hits; // The tile's slot in the high half, its flags and cell in the low half
+} index_part;
+
+typedef struct index_ref {
+    uint32_t part;
+    uint32_t cell; // Flip flags in the top four bits
+} index_ref;
+
+struct tmj_gid_index {
+    size_t gid_span;
+    uint32_t* slots; // Per tile ID below gid_span, its slot plus one, or 0 if it isn't tracked
+    size_t slot_count;
+    uint32_t* slot_gids; // Per slot, its tile ID
+
+    size_t part_count;
+    index_part* parts;
+
+    bool finished;
+
+    size_t ref_count;
+    index_ref* refs; // Grouped by slot
+    size_t* ref_offsets; // Per slot, plus one, the first of its refs
+};
+
+/**
+ * Appends the tracked tiles of one row of plain tile data to a part's hits.
+ * Returns -1 if out of memory.
+ */
+static int scan_row(const tmj_gid_index* index, index_part* part, const uint32_t* gids, size_t length, uint32_t cell) {
+    for (size_t i = 0; i < length; i++) {
+        uint32_t gid = gids[i] & TMJ_GID_MASK;
+
+        if (gid >= index->gid_span || index->slots[gid] == 0) {
+            continue;
+        }
+
+        if (part->hit_count == part->hit_capacity) {
+            size_t capacity = part->hit_capacity > 0 ? part->hit_capacity * 2 : 64;
+            uint64_t* hits = realloc(part->hits, capacity * sizeof(uint64_t));
+
+            if (hits == NULL) {
+                return -1;
+            }
+
+            part->hits = hits;
+            part->hit_capacity = capacity;
+        }
+
+        uint32_t low = (gids[i] & ~TMJ_GID_MASK) | (cell + (uint32_t)i);
+
+        part->hits[part->hit_count++] = (uint64_t)(index->slots[gid] - 1) << 32 | low;
+    }
+
+    return 0;
+}
+
+/**
+ * Scans a part, decoding it first if its data is still encoded. Returns -1 on
+ * failure.
+ */
+static int scan_part(const tmj_gid_index* index, index_part* part) {
+    const Layer* layer = part->layer;
+    bool is_str = part->chunk != NULL ? part->chunk->data_is_str : layer->data_is_str;
+    const uint32_t* data = NULL;
+    uint32_t* decoded = NULL;
+    size_t data_count = 0;
+
+    if (is_str) {
+        const char* str = part->chunk != NULL ? part->chunk->data_str : layer->data_str;
+
+        if (str != NULL) {
+            decoded = tmj_decode_layer(str, layer->encoding, layer->compression != NULL ? layer->compression : "", &data_count);
+
+            if (decoded == NULL) {
+                return -1;
+            }
+
+            data = decoded;
+        }
+    } else if (part->chunk != NULL) {
+        data = part->chunk->data_compact == NULL ? part->chunk->data_uint : NULL;
+        data_count = part->chunk->data_count;
+    } else {
+        data = layer->data_compact == NULL ? layer->data_uint : NULL;
+        data_count = layer->data_count;
+    }
+
+    int ret = 0;
+
+    if (data != NULL) {
+        // Plain data is one long row; short data is only read as far as it goes
+        size_t length = (size_t)part->width * part->height;
+
+        ret = scan_row(index, part, data, data_count < length ? data_count : length, 0);
+    } else if (!is_str) {
+        // Compact and sparse tiles come out of a view, a run at a time
+        tmj_view view;
+        tmj_view_run run;
+
+        tmj_view_begin(&view, layer, part->x, part->y, part->width, part->height);
+
+        while (ret == 0 && tmj_view_next(&view, &run)) {
+            uint32_t cell = (uint32_t)(run.y - part->y) * (uint32_t)part->width + (uint32_t)(run.x - part->x);
+
+            ret = scan_row(index, part, run.gids, (size_t)run.length, cell);
+        }
+    }
+
+    free(decoded);
+
+    return ret;
+}
+
+/**
+ * Counts the parts of a map's tile layers, and fills them in if parts isn't
+ * NULL.
+ */
+static size_t collect_parts(const Map* map, index_part* parts) {
+    size_t count = 0;
+
+    for (size_t i = 0; i < map->flat_layer_count; i++) {
+        const Layer* layer = map->flat_layers[i].layer;
+
+        if (layer->type == NULL || strcmp(layer->type, "tilelayer") != 0 || layer->filtered) {
+            continue;
+        }
+
+        if (layer->chunks == NULL) {
+            if (parts != NULL) {
+                parts[count] = (index_part){.layer = layer, .width = layer->width, .height = layer->height};
+            }
+
+            count++;
+
+            continue;
+        }
+
+        for (size_t c = 0; c < layer->chunk_count; c++) {
+            const Chunk* chunk = &layer->chunks[c];
+
+            if (parts != NULL) {
+                parts[count] = (index_part){
+                        .layer = layer,
+                        .chunk = chunk,
+                        .x = chunk->x,
+                        .y = chunk->y,
+                        .width = chunk->width,
+                        .height = chunk->height,
+                };
+            }
+
+            count++;
+        }
+    }
+
+    return count;
+}
+
+tmj_gid_index* tmj_gid_index_create(const Map* map, const uint32_t* gids, size_t gid_count) {
+    tmj_gid_index* index = calloc(1, sizeof(tmj_gid_index));
+
+    if (index == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to create GID index, the system is out of memory");
+
+        return NULL;
+    }
+
+    for (size_t i = 0; i < gid_count; i++) {
+        uint32_t gid = gids[i] & TMJ_GID_MASK;
+
+        index->gid_span = gid >= index->gid_span ? (size_t)gid + 1 : index->gid_span;
+    }
+
+    index->part_count = collect_parts(map, NULL);
+
+    if ((index->gid_span > 0 && (index->slots = calloc(index->gid_span, sizeof(uint32_t))) == NULL) ||
+            (gid_count > 0 && (index->slot_gids = malloc(gid_count * sizeof(uint32_t))) == NULL) ||
+            (index->part_count > 0 && (index->parts = calloc(index->part_count, sizeof(index_part))) == NULL)) {
+        logmsg(TMJ_LOG_ERR, "Unable to create GID index, the system is out of memory");
+
+        tmj_gid_index_free(index);
+
+        return NULL;
+    }
+
+    collect_parts(map, index->parts);
+
+    // Empty tiles are never tracked, and repeated IDs share a slot
+    for (size_t i = 0; i < gid_count; i++) {
+        uint32_t gid = gids[i] & TMJ_GID_MASK;
+
+        if (gid != 0 && index->slots[gid] == 0) {
+            index->slot_gids[index->slot_count] = gid;
+            index->slots[gid] = (uint32_t)++index->slot_count;
+        }
+    }
+
+    for (size_t i = 0; i < index->part_count; i++) {
+        if ((size_t)index->parts[i].width * index->parts[i].height > CELL_MASK) {
+            logmsg(TMJ_LOG_ERR, "Unable to create GID index, layer[%d] is too large", index->parts[i].layer->id);
+
+            tmj_gid_index_free(index);
+
+            return NULL;
+        }
+    }
+
+    return index;
+}
+
+tmj_gid_index* tmj_gid_index_create_matching(Map* map, tmj_tile_predicate match, void* userdata) {
+    size_t gid_count = 0;
+    size_t gid_capacity = 0;
+    uint32_t* gids = NULL;
+
+    for (size_t i = 0; i < map->tileset_count; i++) {
+        // External tilesets don't have their tiles loaded
+        if (map->tilesets[i].source != NULL) {
+            continue;
+        }
+
+        Tileset* tileset = tmj_map_tileset(map, i);
+
+        if (tileset == NULL) {
+            free(gids);
+
+            return NULL;
+        }
+
+        for (size_t t = 0; t < tileset->tile_count; t++) {
+            if (!match(tileset, &tileset->tiles[t], userdata)) {
+                continue;
+            }
+
+            if (gid_count == gid_capacity) {
+                size_t capacity = gid_capacity > 0 ? gid_capacity * 2 : 16;
+                uint32_t* grown = realloc(gids, capacity * sizeof(uint32_t));
+
+                if (grown == NULL) {
+                    logmsg(TMJ_LOG_ERR, "Unable to create GID index, the system is out of memory");
+
+                    free(gids);
+
+                    return NULL;
+                }
+
+                gids = grown;
+                gid_capacity = capacity;
+            }
+
+            gids[gid_count++] = (uint32_t)(tileset->firstgid + tileset->tiles[t].id);
+        }
+    }
+
+    tmj_gid_index* index = tmj_gid_index_create(map, gids, gid_count);
+
+    free(gids);
+
+    return index;
+}
+
+void tmj_gid_index_free(tmj_gid_index* index) {
+    if (index == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < index->part_count; i++) {
+        free(index->parts[i].hits);
+    }
+
+    free(index->slots);
+    free(index->slot_gids);
+    free(index->parts);
+    free(index->refs);
+    free(index->ref_offsets);
+    free(index);
+}
+
+size_t tmj_gid_index_part_count(const tmj_gid_index* index) {
+    return index->part_count;
+}
+
+int tmj_gid_index_scan(tmj_gid_index* index, size_t part) {
+    if (index->finished || part >= index->part_count) {
+        logmsg(TMJ_LOG_ERR, "Unable to scan part %zu of GID index, it is out of range or the index is finished", part);
+
+        return -1;
+    }
+
+    index_part* p = &index->parts[part];
+
+    free(p->hits);
+
+    p->hits = NULL;
+    p->hit_count = 0;
+    p->hit_capacity = 0;
+    p->scanned = false;
+
+    if (scan_part(index, p) != 0) {
+        logmsg(TMJ_LOG_ERR, "Unable to scan layer[%d] for GID index", p->layer->id);
+
+        return -1;
+    }
+
+    p->scanned = true;
+
+    return 0;
+}
+
+int tmj_gid_index_finish(tmj_gid_index* index) {
+    if (index->finished) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < index->part_count; i++) {
+        if (!index->parts[i].scanned) {
+            logmsg(TMJ_LOG_ERR, "Unable to finish GID index, part %zu was not scanned", i);
+
+            return -1;
+        }
+    }
+
+    index->ref_offsets = calloc(index->slot_count + 1, sizeof(size_t));
+
+    if (index->ref_offsets == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to finish GID index, the system is out of memory");
+
+        return -1;
+    }
+
+    // Counted into ref_offsets[slot + 1], then summed into the start of each slot's range
+    for (size_t i = 0; i < index->part_count; i++) {
+        const index_part* part = &index->parts[i];
+
+        for (size_t h = 0; h < part->hit_count; h++) {
+            index->ref_offsets[(part->hits[h] >> 32) + 1]++;
+        }
+
+        index->ref_count += part->hit_count;
+    }
+
+    for (size_t s = 0; s < index->slot_count; s++) {
+        index->ref_offsets[s + 1] += index->ref_offsets[s];
+    }
+
+    if (index->ref_count > 0 && (index->refs = malloc(index->ref_count * sizeof(index_ref))) == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to finish GID index, the system is out of memory");
+
+        free(index->ref_offsets);
+
+        index->ref_offsets = NULL;
+        index->ref_count = 0;
+
+        return -1;
+    }
+
+    // Placing moves each start to the end of its range, which is the start of the next
+    for (size_t i = 0; i < index->part_count; i++) {
+        index_part* part = &index->parts[i];
+
+        for (size_t h = 0; h < part->hit_count; h++) {
+            size_t* offset = &index->ref_offsets[part->hits[h] >> 32];
+
+            index->refs[(*offset)++] = (index_ref){(uint32_t)i, (uint32_t)part->hits[h]};
+        }
+
+        free(part->hits);
+
+        part->hits = NULL;
+        part->hit_count = 0;
+        part->hit_capacity = 0;
+    }
+
+    memmove(index->ref_offsets + 1, index->ref_offsets, index->slot_count * sizeof(size_t));
+
+    index->ref_offsets[0] = 0;
+    index->finished = true;
+
+    return 0;
+}
+
+int tmj_gid_index_build(tmj_gid_index* index) {
+    for (size_t i = 0; i < index->part_count; i++) {
+        if (!index->parts[i].scanned && tmj_gid_index_scan(index, i) != 0) {
+            return -1;
+        }
+    }
+
+    return tmj_gid_index_finish(index);
+}
+
+/**
+ * Finds the range of refs of a tile ID, or of every tracked tile ID for 0.
+ * Returns false if there is none.
+ */
+static bool find_refs(const tmj_gid_index* index, uint32_t gid, size_t* begin, size_t* end) {
+    *begin = *end = 0;
+
+    if (!index->finished) {
+        return false;
+    }
+
+    gid &= TMJ_GID_MASK;
+
+    if (gid == 0) {
+        *end = index->ref_count;
+    } else if (gid < index->gid_span && index->slots[gid] != 0) {
+        *begin = index->ref_offsets[index->slots[gid] - 1];
+        *end = index->ref_offsets[index->slots[gid]];
+    }
+
+    return *begin < *end;
+}
+
+size_t tmj_gid_index_count(const tmj_gid_index* index, uint32_t gid) {
+    size_t begin, end;
+
+    find_refs(index, gid, &begin, &end);
+
+    return end - begin;
+}
+
+size_t tmj_gid_index_positions(const tmj_gid_index* index, uint32_t gid, size_t first, tmj_tile_position* positions, size_t max) {
+    size_t begin, end;
+
+    if (!find_refs(index, gid, &begin, &end) || first >= end - begin) {
+        return 0;
+    }
+
+    begin += first;
+    end = end - begin < max ? end : begin + max;
+
+    // The last slot whose range starts at or before the first ref
+    size_t low = 0;
+    size_t high = index->slot_count;
+
+    while (low + 1 < high) {
+        size_t mid = low + (high - low) / 2;
+
+        if (index->ref_offsets[mid] <= begin) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    size_t slot = low;
+
+    for (size_t r = begin; r < end; r++) {
+        while (r >= index->ref_offsets[slot + 1]) {
+            slot++;
+        }
+
+        const index_ref* ref = &index->refs[r];
+        const index_part* part = &index->parts[ref->part];
+        uint32_t cell = ref->cell & CELL_MASK;
+        tmj_tile_position* position = &positions[r - begin];
+
+        position->layer = part->layer;
+        position->x = part->x + (int)(cell % (uint32_t)part->width);
+        position->y = part->y + (int)(cell / (uint32_t)part->width);
+        position->gid = index->slot_gids[slot] | (ref->cell & ~CELL_MASK);
+    }
+
+    return end - begin;
+}
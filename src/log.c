@@ -1,8 +1,11 @@
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 
 #include "../include/tmj.h"
+#include "log.h"
+#include "util.h"
 
 /**
  * @file
@@ -10,24 +13,94 @@
 
 #define LOGMSG_BUFSIZE 1024
 
-bool log_debug = false;
-void (*log_callback)(tmj_log_priority, const char*) = NULL;
+typedef void (*log_cb)(tmj_log_priority, const char*);
+typedef void (*log_cb_ud)(tmj_log_priority, const char*, void*);
 
-char logmsg_buf[LOGMSG_BUFSIZE];
+/*
+ * The registered callback is published through a sequence lock, so that
+ * logmsg() always observes a consistent (callback, userdata, debug) triple
+ * without taking a lock. An odd sequence number means a registration is in
+ * progress.
+ */
+static atomic_uint log_seq = 0;
+static atomic_bool log_debug = false;
+static _Atomic(log_cb) log_callback = NULL;
+static _Atomic(log_cb_ud) log_callback_ud = NULL;
+static _Atomic(void*) log_userdata = NULL;
+
+atomic_int log_threshold = TMJ_LOG_CRIT + 1;
+
+TMJ_THREAD_LOCAL char logmsg_buf[LOGMSG_BUFSIZE];
+
+static void log_register(bool debug, log_cb callback, log_cb_ud callback_ud, void* userdata) {
+    unsigned int seq = atomic_load_explicit(&log_seq, memory_order_relaxed);
+
+    // Wait out any concurrent registration, then mark ours as in progress
+    do {
+        while (seq & 1) {
+            seq = atomic_load_explicit(&log_seq, memory_order_relaxed);
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&log_seq, &seq, seq + 1, memory_order_acquire, memory_order_relaxed));
+
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&log_debug, debug, memory_order_relaxed);
+    atomic_store_explicit(&log_callback, callback, memory_order_relaxed);
+    atomic_store_explicit(&log_callback_ud, callback_ud, memory_order_relaxed);
+    atomic_store_explicit(&log_userdata, userdata, memory_order_relaxed);
+
+    int threshold = TMJ_LOG_CRIT + 1;
+
+    if (callback != NULL || callback_ud != NULL) {
+        threshold = debug ? TMJ_LOG_DEBUG : TMJ_LOG_INFO;
+    }
+
+    atomic_store_explicit(&log_threshold, threshold, memory_order_relaxed);
+
+    atomic_store_explicit(&log_seq, seq + 2, memory_order_release);
+}
 
 void tmj_log_regcb(bool debug, void (*callback)(tmj_log_priority, const char*)) {
-    log_debug = debug;
-    log_callback = callback;
+    log_register(debug, callback, NULL, NULL);
+}
+
+void tmj_log_regcb_userdata(bool debug, void (*callback)(tmj_log_priority, const char*, void*), void* userdata) {
+    log_register(debug, NULL, callback, userdata);
 }
 
-void logmsg(tmj_log_priority priority, char* msg, ...) {
+void log_event(tmj_log_priority priority, const char* msg, ...) {
+    bool debug;
+    log_cb callback;
+    log_cb_ud callback_ud;
+    void* userdata;
+
+    // Take a consistent snapshot of the registration, retrying if a writer raced us
+    for (;;) {
+        unsigned int seq = atomic_load_explicit(&log_seq, memory_order_acquire);
+
+        if (seq & 1) {
+            continue;
+        }
+
+        debug = atomic_load_explicit(&log_debug, memory_order_relaxed);
+        callback = atomic_load_explicit(&log_callback, memory_order_relaxed);
+        callback_ud = atomic_load_explicit(&log_callback_ud, memory_order_relaxed);
+        userdata = atomic_load_explicit(&log_userdata, memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+
+        if (atomic_load_explicit(&log_seq, memory_order_relaxed) == seq) {
+            break;
+        }
+    }
+
     // Don't bother logging if there's no callback registered
-    if (log_callback == NULL) {
+    if (callback == NULL && callback_ud == NULL) {
         return;
     }
 
     // Don't log debug messages if we have debugging turned off
-    if (priority == TMJ_LOG_DEBUG && !log_debug) {
+    if (priority == TMJ_LOG_DEBUG && !debug) {
         return;
     }
 
@@ -39,5 +112,9 @@ void logmsg(tmj_log_priority priority, char* msg, ...) {
 
     va_end(args);
 
-    log_callback(priority, logmsg_buf);
+    if (callback_ud != NULL) {
+        callback_ud(priority, logmsg_buf, userdata);
+    } else {
+        callback(priority, logmsg_buf);
+    }
 }
@@ -1,6 +1,7 @@
 #ifndef LIBTMJ_LOG
 #define LIBTMJ_LOG
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
 
@@ -16,46 +17,53 @@
 
 /**
  * @ingroup logging
- * Statically-allocated memory to hold log messages which are passed to the
- * logging callback.
+ * The lowest log priority compiled into the library. Messages below this
+ * priority are removed by the preprocessor, along with the evaluation of their
+ * arguments. Set with the LIBTMJ_LOG_LEVEL cmake option.
  */
-extern char logmsg_buf[];
+#ifndef LIBTMJ_LOG_LEVEL
+#define LIBTMJ_LOG_LEVEL TMJ_LOG_DEBUG
+#endif
+
+/**
+ * @ingroup logging
+ * The lowest log priority that the registered callback currently wants to
+ * receive. Higher than TMJ_LOG_CRIT when no callback is registered. Updated on
+ * registration; checked by logmsg() before formatting anything.
+ */
+extern atomic_int log_threshold;
 
 /**
  * @ingroup logging
  * Processes log messages and passes them to the active logging callback, if
- * there is one.
+ * there is one. This function should not be used directly. Use the logmsg()
+ * macro instead, which skips the call entirely when the message would be
+ * discarded.
+ *
+ * Safe to call from multiple threads at once. Messages are formatted into a
+ * thread-local buffer, so the string handed to the callback is only valid for
+ * the duration of the callback.
  *
  * @param priority One of the set of log priorities defined in the LOG_PRIORITY enum.
  * @param msg      A printf-style format string for the message to be logged
  * @param ...      Format string arguments for the previous argument. See printf() for detail.
  */
-void logmsg(tmj_log_priority priority, char* msg, ...);
-
-///**
-// * @ingroup logging
-// * Processes log messages and passes them to the active logging callback, if
-// * there is one. This function should not be used directly under normal
-// * circumstances. Use the logmsg() macro instead, which uses the preprocessor
-// * to add line/file/function debugging information.
-// *
-// * @param loglevel One of the set of log priorities defined in the LOG_PRIORITY enum.
-// * @param line A source-code line number to report as part of the log message.
-// * @param file A source-code filename to report as part of the log message.
-// * @param func A function name to report as part of the log message.
-// * @param msg      A printf-style format string for the message to be logged
-// * @param ...      Format string arguments for the previous argument. See printf() for detail.
-// */
-// void log_event(int loglevel, int line, char* file, char* func, char* msg, ...);
-
-///**
-// * @ingroup logging
-// * This macro adds line, file, and function name information to logging calls
-// * to aid in debugging. Use this macro wherever a message needs to be logged.
-// *
-// * The expected arguments are identical to that of log_event(). See the
-// * documentation for log_event() for detail.
-// */
-// #define logmsg(loglevel, ...) log_event(loglevel, __LINE__, __FILE__, __func__, msg, __VA_ARGS__);
+void log_event(tmj_log_priority priority, const char* msg, ...);
+
+/**
+ * @ingroup logging
+ * Logs a message. Compiles to nothing if the priority is below
+ * LIBTMJ_LOG_LEVEL, and costs a single relaxed load if the registered callback
+ * would discard it.
+ *
+ * The expected arguments are identical to that of log_event(). See the
+ * documentation for log_event() for detail.
+ */
+#define logmsg(priority, ...) \
+    do { \
+        if ((priority) >= LIBTMJ_LOG_LEVEL && (int)(priority) >= atomic_load_explicit(&log_threshold, memory_order_relaxed)) { \
+            log_event((priority), __VA_ARGS__); \
+        } \
+    } while (0)
 
 #endif
@@ -0,0 +1,368 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lookup.h"
+#include "stats.h"
+#include "tmj.h"
+#include "util.h"
+
+/**
+ * @file
+ *
+ * Object indexes by type and by name.
+ */
+
+/**
+ * Interned strings, and the objects that have each of them. The objects of
+ * handle h are objects[offsets[h]] to objects[offsets[h + 1] - 1].
+ */
+struct tmj_object_lookup {
+    size_t slot_count; // A power of two
+    uint32_t* slots; // Open-addressed by hash, holding handles, 0 if empty
+
+    size_t key_count;
+    size_t key_capacity;
+    const char** keys; // By handle - 1
+
+    size_t object_count;
+    size_t* offsets;
+    Object** objects;
+};
+
+static const char* object_key(const Object* object, bool names) {
+    const char* key = names ? object->name : object->type;
+
+    return key != NULL && key[0] != '\0' ? key : NULL;
+}
+
+static uint32_t lookup_find(const tmj_object_lookup* lookup, const char* key, size_t* slot) {
+    size_t mask = lookup->slot_count - 1;
+
+    *slot = hash_string(key) & mask;
+
+    while (lookup->slots[*slot] != 0) {
+        if (strcmp(lookup->keys[lookup->slots[*slot] - 1], key) == 0) {
+            return lookup->slots[*slot];
+        }
+
+        *slot = (*slot + 1) & mask;
+    }
+
+    return 0;
+}
+
+static uint32_t lookup_intern(tmj_object_lookup* lookup, const char* key) {
+    size_t slot = 0;
+    uint32_t handle = lookup_find(lookup, key, &slot);
+
+    if (handle == 0) {
+        lookup->keys[lookup->key_count++] = key;
+        handle = lookup->slots[slot] = (uint32_t)lookup->key_count;
+    }
+
+    return handle;
+}
+
+/**
+ * Indexes the loaded objects of a map by type, or by name. Objects without a
+ * key aren't indexed.
+ */
+tmj_object_lookup* object_lookup_build(const Map* map, bool names) {
+    size_t count = 0;
+
+    for (size_t i = 0; i < map->flat_layer_count; i++) {
+        count += map->flat_layers[i].layer->object_count;
+    }
+
+    size_t key_capacity = count;
+    size_t slot_count = 16;
+
+    while (slot_count < key_capacity * 2) {
+        slot_count *= 2;
+    }
+
+    tmj_object_lookup* lookup = stats_calloc(1, sizeof(tmj_object_lookup));
+    uint32_t* handles = malloc((count + 1) * sizeof(uint32_t));
+
+    if (lookup == NULL || handles == NULL) {
+        free(handles);
+        object_lookup_free(lookup);
+
+        return NULL;
+    }
+
+    lookup->slot_count = slot_count;
+    lookup->slots = stats_calloc(slot_count, sizeof(uint32_t));
+    lookup->key_capacity = key_capacity;
+    lookup->keys = stats_malloc((key_capacity + 1) * sizeof(const char*));
+
+    if (lookup->slots == NULL || lookup->keys == NULL) {
+        free(handles);
+        object_lookup_free(lookup);
+
+        return NULL;
+    }
+
+    size_t next = 0;
+
+    for (size_t i = 0; i < map->flat_layer_count; i++) {
+        const Layer* layer = map->flat_layers[i].layer;
+
+        for (size_t j = 0; j < layer->object_count; j++) {
+            const char* key = object_key(&layer->objects[j], names);
+
+            handles[next++] = key != NULL ? lookup_intern(lookup, key) : 0;
+        }
+    }
+
+    // Counting sort by handle keeps objects in layer order within a span
+    lookup->offsets = stats_calloc(lookup->key_count + 2, sizeof(size_t));
+
+    if (lookup->offsets == NULL) {
+        free(handles);
+        object_lookup_free(lookup);
+
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (handles[i] != 0) {
+            lookup->offsets[handles[i]]++;
+        }
+    }
+
+    for (size_t h = 1; h <= lookup->key_count; h++) {
+        lookup->offsets[h] += lookup->offsets[h - 1];
+    }
+
+    lookup->object_count = lookup->offsets[lookup->key_count];
+    lookup->offsets[lookup->key_count + 1] = lookup->object_count;
+
+    if (lookup->object_count > 0) {
+        lookup->objects = stats_malloc(lookup->object_count * sizeof(Object*));
+
+        if (lookup->objects == NULL) {
+            free(handles);
+            object_lookup_free(lookup);
+
+            return NULL;
+        }
+    }
+
+    // Fill each span from its end, walking the objects backwards
+    next = count;
+
+    for (size_t i = map->flat_layer_count; i-- > 0;) {
+        Layer* layer = map->flat_layers[i].layer;
+
+        for (size_t j = layer->object_count; j-- > 0;) {
+            uint32_t handle = handles[--next];
+
+            if (handle != 0) {
+                lookup->objects[--lookup->offsets[handle]] = &layer->objects[j];
+            }
+        }
+    }
+
+    free(handles);
+
+    return lookup;
+}
+
+/**
+ * Makes room for key_capacity keys, rehashing the keys into a larger table if
+ * the current one would get more than half full.
+ */
+static int lookup_reserve(tmj_object_lookup* lookup, size_t key_capacity) {
+    if (key_capacity > lookup->key_capacity) {
+        const char** keys = stats_realloc(lookup->keys, (lookup->key_capacity + 1) * sizeof(const char*), (key_capacity + 1) * sizeof(const char*));
+
+        if (keys == NULL) {
+            return -1;
+        }
+
+        lookup->keys = keys;
+        lookup->key_capacity = key_capacity;
+    }
+
+    size_t slot_count = lookup->slot_count;
+
+    while (slot_count < key_capacity * 2) {
+        slot_count *= 2;
+    }
+
+    if (slot_count == lookup->slot_count) {
+        return 0;
+    }
+
+    uint32_t* slots = stats_calloc(slot_count, sizeof(uint32_t));
+
+    if (slots == NULL) {
+        return -1;
+    }
+
+    for (size_t h = 1; h <= lookup->key_count; h++) {
+        size_t slot = hash_string(lookup->keys[h - 1]) & (slot_count - 1);
+
+        while (slots[slot] != 0) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+
+        slots[slot] = (uint32_t)h;
+    }
+
+    stats_free(lookup->slots, lookup->slot_count * sizeof(uint32_t));
+
+    lookup->slot_count = slot_count;
+    lookup->slots = slots;
+
+    return 0;
+}
+
+/**
+ * Merges the objects of a layer into an index by type, or by name. Existing
+ * keys keep their handles, and the layer's objects go at the end of their
+ * spans. Returns -1 if out of memory, leaving the index as it was.
+ */
+int object_lookup_add(tmj_object_lookup* lookup, const Layer* layer, bool names) {
+    size_t count = layer->object_count;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    uint32_t* handles = malloc(count * sizeof(uint32_t));
+
+    if (handles == NULL || lookup_reserve(lookup, lookup->key_count + count) != 0) {
+        free(handles);
+
+        return -1;
+    }
+
+    size_t key_count = lookup->key_count;
+    size_t added = 0;
+
+    for (size_t j = 0; j < count; j++) {
+        const char* key = object_key(&layer->objects[j], names);
+
+        handles[j] = key != NULL ? lookup_intern(lookup, key) : 0;
+        added += handles[j] != 0;
+    }
+
+    size_t* offsets = stats_calloc(lookup->key_count + 2, sizeof(size_t));
+    size_t* ends = malloc((lookup->key_count + 2) * sizeof(size_t));
+    Object** objects = lookup->object_count + added > 0 ? stats_malloc((lookup->object_count + added) * sizeof(Object*)) : NULL;
+
+    if (offsets == NULL || ends == NULL || (lookup->object_count + added > 0 && objects == NULL)) {
+        stats_free(offsets, (lookup->key_count + 2) * sizeof(size_t));
+        free(ends);
+        stats_free(objects, (lookup->object_count + added) * sizeof(Object*));
+        free(handles);
+
+        // Drop the keys interned above, newest first so the probe sequences of the others stay intact
+        for (size_t h = lookup->key_count; h > key_count; h--) {
+            size_t slot = 0;
+
+            lookup_find(lookup, lookup->keys[h - 1], &slot);
+            lookup->slots[slot] = 0;
+        }
+
+        lookup->key_count = key_count;
+
+        return -1;
+    }
+
+    for (size_t j = 0; j < count; j++) {
+        if (handles[j] != 0) {
+            offsets[handles[j]]++;
+        }
+    }
+
+    // Each span is its old objects, followed by room for the layer's
+    size_t next = 0;
+
+    for (size_t h = 1; h <= lookup->key_count; h++) {
+        size_t kept = h <= key_count ? lookup->offsets[h + 1] - lookup->offsets[h] : 0;
+        size_t span = kept + offsets[h];
+
+        if (kept > 0) {
+            memcpy(objects + next, lookup->objects + lookup->offsets[h], kept * sizeof(Object*));
+        }
+
+        offsets[h] = next;
+        ends[h] = next + kept;
+        next += span;
+    }
+
+    offsets[lookup->key_count + 1] = next;
+
+    for (size_t j = 0; j < count; j++) {
+        if (handles[j] != 0) {
+            objects[ends[handles[j]]++] = &layer->objects[j];
+        }
+    }
+
+    stats_free(lookup->offsets, (key_count + 2) * sizeof(size_t));
+    stats_free(lookup->objects, lookup->object_count * sizeof(Object*));
+
+    lookup->offsets = offsets;
+    lookup->objects = objects;
+    lookup->object_count = next;
+
+    free(ends);
+    free(handles);
+
+    return 0;
+}
+
+void object_lookup_free(tmj_object_lookup* lookup) {
+    if (lookup == NULL) {
+        return;
+    }
+
+    stats_free(lookup->slots, lookup->slot_count * sizeof(uint32_t));
+    stats_free(lookup->keys, (lookup->key_capacity + 1) * sizeof(const char*));
+    stats_free(lookup->offsets, (lookup->key_count + 2) * sizeof(size_t));
+    stats_free(lookup->objects, lookup->object_count * sizeof(Object*));
+    stats_free(lookup, sizeof(tmj_object_lookup));
+}
+
+static uint32_t lookup_handle(const tmj_object_lookup* lookup, const char* key) {
+    if (lookup == NULL || key == NULL) {
+        return 0;
+    }
+
+    size_t slot = 0;
+
+    return lookup_find(lookup, key, &slot);
+}
+
+static Object* const* lookup_span(const tmj_object_lookup* lookup, uint32_t handle, size_t* count) {
+    *count = 0;
+
+    if (lookup == NULL || handle == 0 || handle > lookup->key_count) {
+        return NULL;
+    }
+
+    *count = lookup->offsets[handle + 1] - lookup->offsets[handle];
+
+    return lookup->objects + lookup->offsets[handle];
+}
+
+uint32_t tmj_map_object_type(const Map* map, const char* type) {
+    return lookup_handle(map->object_types, type);
+}
+
+uint32_t tmj_map_object_name(const Map* map, const char* name) {
+    return lookup_handle(map->object_names, name);
+}
+
+Object* const* tmj_map_objects_of_type(const Map* map, uint32_t type, size_t* count) {
+    return lookup_span(map->object_types, type, count);
+}
+
+Object* const* tmj_map_objects_named(const Map* map, uint32_t name, size_t* count) {
+    return lookup_span(map->object_names, name, count);
+}
@@ -0,0 +1,14 @@
+#ifndef LIBTMJ_LOOKUP
+#define LIBTMJ_LOOKUP
+
+#include <stdbool.h>
+
+#include "tmj.h"
+
+typedef struct tmj_object_lookup tmj_object_lookup;
+
+tmj_object_lookup* object_lookup_build(const Map* map, bool names);
+int object_lookup_add(tmj_object_lookup* lookup, const Layer* layer, bool names);
+void object_lookup_free(tmj_object_lookup* lookup);
+
+#endif
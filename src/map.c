@@ -3,8 +3,13 @@
 #include <jansson.h>
 
 #include "log.h"
+#include "lookup.h"
+#include "map.h"
+#include "stats.h"
 #include "tileset.h"
 #include "tmj.h"
+#include "trace.h"
+#include "util.h"
 
 /**
  * @file
@@ -25,7 +30,7 @@ Property* unpack_properties(json_t* properties) {
 
     size_t property_count = json_array_size(properties);
 
-    Property* ret = calloc(property_count, sizeof(Property));
+    Property* ret = stats_calloc(property_count, sizeof(Property));
 
     if (ret == NULL) {
         logmsg(TMJ_LOG_ERR, "Unable to unpack properties, the system is out of memory");
@@ -86,7 +91,7 @@ Property* unpack_properties(json_t* properties) {
         }
 
         if (strcmp(ret[idx].type, "float") == 0) {
-            unpk = json_unpack_ex(value, &error, 0, "i", &ret[idx].value_float);
+            unpk = json_unpack_ex(value, &error, 0, "F", &ret[idx].value_float);
 
             if (unpk == -1) {
                 logmsg(TMJ_LOG_ERR, "Unable to unpack float value from property, %s at line %d column %d", error.text, error.line, error.column);
@@ -150,31 +155,11 @@ Property* unpack_properties(json_t* properties) {
 }
 
 /**
- * Unpacks an array of points. The returned array must be freed by the caller.
+ * Unpacks an array of points into ret, which must have room for all of them.
  */
-Point* unpack_points(json_t* points) {
-    if (points == NULL) {
-        return NULL;
-    }
-
-    if (!json_is_array(points)) {
-        logmsg(TMJ_LOG_ERR, "'polygon' or 'polyline' must be an array");
-
-        return NULL;
-    }
-
+static int unpack_points(json_t* points, Point* ret) {
     json_error_t error;
 
-    size_t point_count = json_array_size(points);
-
-    Point* ret = calloc(point_count, sizeof(Point));
-
-    if (ret == NULL) {
-        logmsg(TMJ_LOG_ERR, "Unable to unpack points, the system is out of memory");
-
-        return NULL;
-    }
-
     size_t idx;
     json_t* point;
 
@@ -184,13 +169,11 @@ Point* unpack_points(json_t* points) {
         if (unpk == -1) {
             logmsg(TMJ_LOG_ERR, "Unable to unpack points, %s at line %d column %d", error.text, error.line, error.column);
 
-            free(ret);
-
-            return NULL;
+            return -1;
         }
     }
 
-    return ret;
+    return 0;
 }
 
 /**
@@ -203,7 +186,7 @@ Text* unpack_text(json_t* text) {
 
     json_error_t error;
 
-    Text* ret = calloc(1, sizeof(Text));
+    Text* ret = stats_calloc(1, sizeof(Text));
 
     if (ret == NULL) {
         logmsg(TMJ_LOG_ERR, "Unable to unpack text, the system is out of memory");
@@ -253,7 +236,10 @@ Text* unpack_text(json_t* text) {
     return ret;
 }
 
-Object* unpack_objects(json_t* objects) {
+Object* unpack_objects(json_t* objects, const tmj_load_options* options, Point** points, size_t* point_count) {
+    *points = NULL;
+    *point_count = 0;
+
     if (objects == NULL) {
         return NULL;
     }
@@ -266,14 +252,22 @@ Object* unpack_objects(json_t* objects) {
 
     size_t object_count = json_array_size(objects);
 
-    Object* ret = calloc(object_count, sizeof(Object));
+    Object* ret = stats_calloc(object_count, sizeof(Object));
 
-    if (ret == NULL) {
+    // The point arrays of each polygon or polyline, until the pool can be sized
+    json_t** shapes = stats_calloc(object_count, sizeof(json_t*));
+
+    if (ret == NULL || shapes == NULL) {
         logmsg(TMJ_LOG_ERR, "Unable to unpack objects, the system is out of memory");
 
+        free(ret);
+        free(shapes);
+
         return NULL;
     }
 
+    size_t total_points = 0;
+
     size_t idx = 0;
     json_t* object = NULL;
 
@@ -332,7 +326,12 @@ Object* unpack_objects(json_t* objects) {
         if (unpk == -1) {
             logmsg(TMJ_LOG_ERR, "Unable to unpack object, %s at line %d column %d", error.text, error.line, error.column);
 
-            return NULL;
+            goto fail_properties;
+        }
+
+        // Tiled 1.9 wrote the object type as "class"
+        if (ret[idx].type == NULL) {
+            ret[idx].type = (char*)json_string_value(json_object_get(object, "class"));
         }
 
         // Unpack properties
@@ -355,7 +354,7 @@ Object* unpack_objects(json_t* objects) {
         }
 
         // Unpack text
-        if (text != NULL) {
+        if (text != NULL && !options_headless(options)) {
             ret[idx].text = unpack_text(text);
 
             if (ret[idx].text == NULL) {
@@ -366,40 +365,64 @@ Object* unpack_objects(json_t* objects) {
         }
 
         // If this object is any of the below items, we don't need to unpack anything else
-        if (ret[idx].ellipse || ret[idx].point || ret[idx].gid != 0 || ret[idx].text != NULL) {
+        if (ret[idx].ellipse || ret[idx].point || ret[idx].gid != 0 || text != NULL) {
             continue;
         }
 
-        // Unpack Polygon
-        if (polygon != NULL) {
-            ret[idx].polygon = unpack_points(polygon);
+        // A polygon takes precedence over a polyline; either is unpacked into the pool below
+        shapes[idx] = polygon != NULL ? polygon : polyline;
 
-            if (ret[idx].polygon == NULL) {
-                goto fail_polygon;
-            }
+        if (shapes[idx] == NULL) {
+            continue;
+        }
 
-            ret[idx].polygon_point_count = json_array_size(polygon);
+        if (!json_is_array(shapes[idx])) {
+            logmsg(TMJ_LOG_ERR, "'polygon' or 'polyline' must be an array");
 
-            // No need to unpack a polyline if this object was a polygon
-            continue;
+            goto fail_points;
         }
 
-        // Unpack Polyline
-        if (polyline != NULL) {
-            ret[idx].polyline = unpack_points(polyline);
+        ret[idx].is_polygon = polygon != NULL;
+        ret[idx].point_first = total_points;
+        ret[idx].polygon_point_count = json_array_size(shapes[idx]);
 
-            if (ret[idx].polyline == NULL) {
-                goto fail_polyline;
+        total_points += ret[idx].polygon_point_count;
+    }
+
+    // Every point of the layer goes in one array, in object order
+    if (total_points > 0) {
+        *points = stats_malloc(total_points * sizeof(Point));
+
+        if (*points == NULL) {
+            logmsg(TMJ_LOG_ERR, "Unable to unpack points, the system is out of memory");
+
+            goto fail_points;
+        }
+
+        for (size_t i = 0; i < object_count; i++) {
+            if (shapes[i] == NULL) {
+                continue;
             }
 
-            ret[idx].polyline_point_count = json_array_size(polyline);
+            ret[i].polygon = *points + ret[i].point_first;
+
+            if (unpack_points(shapes[i], ret[i].polygon) != 0) {
+                goto fail_points;
+            }
         }
+
+        *point_count = total_points;
     }
 
+    stats_free(shapes, object_count * sizeof(json_t*));
+
     return ret;
 
-fail_polygon:
-fail_polyline:
+fail_points:
+    free(*points);
+
+    *points = NULL;
+
     for (size_t i = 0; i < object_count; i++) {
         free(ret[i].text);
     }
@@ -410,27 +433,73 @@ fail_text:
     }
 
 fail_properties:
+    free(shapes);
     free(ret);
 
     return NULL;
 }
 
 /**
- * Helper function to free Objects. May cause undefined behavior if the objects
- * were modified by the caller of map_load().
+ * Helper function to free Objects and their point pool. May cause undefined
+ * behavior if the objects were modified by the caller of map_load().
  */
-void free_objects(Object* objects, size_t object_count) {
+void free_objects(Object* objects, size_t object_count, Point* points) {
     for (size_t i = 0; i < object_count; i++) {
-        // We don't bother freeing polyline, because polygon and polyline are a union
-        free(objects[i].polygon);
         free(objects[i].text);
         free(objects[i].properties);
     }
 
     free(objects);
+    free(points);
+}
+
+/**
+ * Swaps a CSV tile array for whichever compact storage the options allow
+ * that takes the least memory. The plain array is kept if none takes less,
+ * if packing fails, or if the data doesn't fill the layer or chunk exactly.
+ */
+static void compact_data(unsigned int** data_uint, size_t count, int width, int height, const tmj_load_options* options, tmj_tiles** data_compact) {
+    tmj_tiles* best = NULL;
+    size_t best_size = count * sizeof(unsigned int);
+
+    if (count != (size_t)width * height) {
+        return;
+    }
+
+    tmj_tiles* candidates[2] = {
+            options_compact(options) ? tmj_tiles_compact((const uint32_t*)*data_uint, count) : NULL,
+            options_sparse(options) ? tmj_tiles_sparse((const uint32_t*)*data_uint, width, height) : NULL,
+    };
+
+    // All of these buffers were allocated during this load, so the ones dropped are released from the stats
+    for (size_t i = 0; i < 2; i++) {
+        if (candidates[i] == NULL) {
+            continue;
+        }
+
+        if (candidates[i]->size < best_size) {
+            if (best != NULL) {
+                stats_free(best, best->size);
+            }
+
+            best = candidates[i];
+            best_size = best->size;
+        } else {
+            stats_free(candidates[i], candidates[i]->size);
+        }
+    }
+
+    if (best == NULL) {
+        return;
+    }
+
+    stats_free(*data_uint, count * sizeof(unsigned int));
+
+    *data_uint = NULL;
+    *data_compact = best;
 }
 
-Chunk* unpack_chunks(json_t* chunks, size_t* chunk_count) {
+Chunk* unpack_chunks(json_t* chunks, size_t* chunk_count, const tmj_load_options* options) {
     if (chunks == NULL) {
         return NULL;
     }
@@ -445,7 +514,7 @@ Chunk* unpack_chunks(json_t* chunks, size_t* chunk_count) {
 
     *chunk_count = json_array_size(chunks);
 
-    Chunk* ret = calloc(*chunk_count, sizeof(Chunk));
+    Chunk* ret = stats_calloc(*chunk_count, sizeof(Chunk));
 
     if (ret == NULL) {
         logmsg(TMJ_LOG_ERR, "Unable to unpack chunks, the system is out of memory");
@@ -496,7 +565,7 @@ Chunk* unpack_chunks(json_t* chunks, size_t* chunk_count) {
         } else if (json_is_array(data)) {
             size_t datum_count = json_array_size(data);
 
-            ret[idx].data_uint = calloc(datum_count, sizeof(unsigned int));
+            ret[idx].data_uint = stats_calloc(datum_count, sizeof(unsigned int));
 
             if (ret[idx].data_uint == NULL) {
                 logmsg(TMJ_LOG_ERR, "Unable to unpack chunk data, the system is out memory");
@@ -516,6 +585,12 @@ Chunk* unpack_chunks(json_t* chunks, size_t* chunk_count) {
                     goto fail_data;
                 }
             }
+
+            ret[idx].data_count = datum_count;
+
+            if (options_compact(options) || options_sparse(options)) {
+                compact_data(&ret[idx].data_uint, datum_count, ret[idx].width, ret[idx].height, options, &ret[idx].data_compact);
+            }
         } else {
             logmsg(TMJ_LOG_ERR, "Unable to unpack chunk, chunk data must be a string or an array of uint");
 
@@ -530,6 +605,8 @@ fail_data:
         if (!ret[i].data_is_str) {
             free(ret[i].data_uint);
         }
+
+        tmj_tiles_free(ret[i].data_compact);
     }
 
 fail_chunk:
@@ -544,15 +621,56 @@ void free_chunks(Chunk* chunks, size_t chunk_count) {
         if (!chunks[i].data_is_str) {
             free(chunks[i].data_uint);
         }
+
+        tmj_tiles_free(chunks[i].data_compact);
     }
 
     free(chunks);
 }
 
+/**
+ * Checks a layer against the layer filter in the given load options. Only the
+ * layer's scalar fields and properties are looked at.
+ */
+static bool layer_included(const Layer* layer, const tmj_load_options* options) {
+    // Group layers carry no data of their own, and their children are filtered individually
+    if (options == NULL || strcmp(layer->type, "group") == 0) {
+        return true;
+    }
+
+    if (options->layer_filter != NULL && !options->layer_filter(layer, options->layer_filter_userdata)) {
+        return false;
+    }
+
+    if (options->layer_name_count == 0 && options->layer_id_count == 0 && options->layer_type_count == 0) {
+        return true;
+    }
+
+    for (size_t i = 0; i < options->layer_name_count; i++) {
+        if (strcmp(layer->name, options->layer_names[i]) == 0) {
+            return true;
+        }
+    }
+
+    for (size_t i = 0; i < options->layer_id_count; i++) {
+        if (layer->id == options->layer_ids[i]) {
+            return true;
+        }
+    }
+
+    for (size_t i = 0; i < options->layer_type_count; i++) {
+        if (strcmp(layer->type, options->layer_types[i]) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 /**
  * Loads map layers recursively
  */
-Layer* unpack_layers(json_t* layers) {
+static Layer* unpack_layers_json(json_t* layers, const tmj_load_options* options) {
     if (!json_is_array(layers)) {
         logmsg(TMJ_LOG_ERR, "Could not unpack layer, 'layers' must be an array");
 
@@ -567,7 +685,7 @@ Layer* unpack_layers(json_t* layers) {
         return NULL;
     }
 
-    Layer* ret = calloc(layer_count, sizeof(Layer));
+    Layer* ret = stats_calloc(layer_count, sizeof(Layer));
 
     if (ret == NULL) {
         logmsg(TMJ_LOG_ERR, "Unable to load layers, the system is out of memory");
@@ -604,9 +722,9 @@ Layer* unpack_layers(json_t* layers) {
                 0,
                 "{"
                 "s?b, s:b,"
-                "s?s, s:s, s?s,"
+                "s?s, s:s,"
                 "s?i, s?i, s:i, s:i,"
-                "s?F, s?F, s:F, s?F, s?F"
+                "s?F, s?F, s:F"
                 "}",
                 "locked",
                 &ret[idx].locked,
@@ -616,8 +734,6 @@ Layer* unpack_layers(json_t* layers) {
                 &ret[idx].class,
                 "name",
                 &ret[idx].name,
-                "tintcolor",
-                &ret[idx].tintcolor,
                 "startx",
                 &ret[idx].startx,
                 "starty",
@@ -631,11 +747,7 @@ Layer* unpack_layers(json_t* layers) {
                 "offsety",
                 &ret[idx].offsety,
                 "opacity",
-                &ret[idx].opacity,
-                "parallaxx",
-                &ret[idx].parallaxx,
-                "parallaxy",
-                &ret[idx].parallaxy);
+                &ret[idx].opacity);
 
         if (unpk == -1) {
             logmsg(TMJ_LOG_ERR, "Could not unpack layer[%d], %s at line %d column %d", ret[idx].id, error.text, error.line, error.column);
@@ -643,8 +755,34 @@ Layer* unpack_layers(json_t* layers) {
             goto fail_layer;
         }
 
+        bool headless = options_headless(options);
+
+        // Unpack presentation-only scalar values
+        if (!headless) {
+            // Tiled leaves out parallax factors of 1
+            ret[idx].parallaxx = 1;
+            ret[idx].parallaxy = 1;
+
+            unpk = json_unpack_ex(layer,
+                    &error,
+                    0,
+                    "{s?s, s?F, s?F}",
+                    "tintcolor",
+                    &ret[idx].tintcolor,
+                    "parallaxx",
+                    &ret[idx].parallaxx,
+                    "parallaxy",
+                    &ret[idx].parallaxy);
+
+            if (unpk == -1) {
+                logmsg(TMJ_LOG_ERR, "Could not unpack layer[%d], %s at line %d column %d", ret[idx].id, error.text, error.line, error.column);
+
+                goto fail_layer;
+            }
+        }
+
         // Unpack conditional scalar values
-        if (strcmp(ret[idx].type, "imagelayer") == 0) {
+        if (strcmp(ret[idx].type, "imagelayer") == 0 && !headless) {
             unpk = json_unpack_ex(layer,
                     &error,
                     0,
@@ -703,12 +841,42 @@ Layer* unpack_layers(json_t* layers) {
             }
         }
 
+        // Unpack properties
+        json_t* properties = NULL;
+
+        unpk = json_unpack_ex(layer, &error, 0, "{s?o}", "properties", &properties);
+
+        if (unpk == -1) {
+            goto fail_properties;
+        }
+
+        if (properties != NULL) {
+            ret[idx].properties = unpack_properties(properties);
+
+            if (ret[idx].properties == NULL) {
+                logmsg(TMJ_LOG_ERR, "Unable to unpack layer[%d]->properties", ret[idx].id);
+
+                goto fail_properties;
+            }
+
+            ret[idx].property_count = json_array_size(properties);
+        }
+
+        // Excluded layers keep their place in the tree, but nothing below this point
+        if (!layer_included(&ret[idx], options)) {
+            logmsg(TMJ_LOG_DEBUG, "Skipping layer[%d], excluded by layer filter", ret[idx].id);
+
+            ret[idx].filtered = true;
+
+            continue;
+        }
+
         // If a tilelayer, make sure we have one of the "data" or "chunks" fields
         if (strcmp(ret[idx].type, "tilelayer") == 0) {
             if (!json_object_get(layer, "data") && !json_object_get(layer, "chunks")) {
                 logmsg(TMJ_LOG_ERR, "Could not unpack layer[%d], missing 'data' and 'chunks' fields", ret[idx].id);
 
-                goto fail_layer;
+                goto fail_properties;
             }
         }
 
@@ -721,7 +889,7 @@ Layer* unpack_layers(json_t* layers) {
             if (unpk == -1) {
                 logmsg(TMJ_LOG_ERR, "Could not unpack layer[%d], %s at line %d column %d", ret[idx].id, error.text, error.line, error.column);
 
-                goto fail_layer;
+                goto fail_properties;
             }
 
             if (json_is_string(data)) {
@@ -732,19 +900,19 @@ Layer* unpack_layers(json_t* layers) {
                 if (unpk == -1) {
                     logmsg(TMJ_LOG_ERR, "Could not unpack layer[%d], %s at line %d column %d", ret[idx].id, error.text, error.line, error.column);
 
-                    goto fail_layer;
+                    goto fail_properties;
                 }
             } else if (json_is_array(data)) {
                 ret[idx].data_is_str = false;
 
                 ret[idx].data_count = json_array_size(data);
 
-                ret[idx].data_uint = calloc(ret[idx].data_count, sizeof(unsigned int));
+                ret[idx].data_uint = stats_calloc(ret[idx].data_count, sizeof(unsigned int));
 
                 if (ret[idx].data_uint == NULL) {
                     logmsg(TMJ_LOG_ERR, "Unable to unpack layer[%d]->data, the system is out of memory", ret[idx].id);
 
-                    goto fail_layer;
+                    goto fail_properties;
                 }
 
                 json_t* datum;
@@ -755,32 +923,17 @@ Layer* unpack_layers(json_t* layers) {
                     unpk = json_unpack_ex(datum, &error, 0, "i", &ret[idx].data_uint[idx2]);
 
                     if (unpk == -1) {
-                        goto fail_data;
+                        goto fail_properties;
                     }
                 }
+
+                if (options_compact(options) || options_sparse(options)) {
+                    compact_data(&ret[idx].data_uint, ret[idx].data_count, ret[idx].width, ret[idx].height, options, &ret[idx].data_compact);
+                }
             } else {
                 logmsg(TMJ_LOG_ERR, "Unable to unpack layer[%d]->data, data must be a string or an array", ret[idx].id);
 
-                goto fail_layer;
-            }
-        }
-
-        // Unpack properties
-        json_t* properties = NULL;
-
-        unpk = json_unpack_ex(layer, &error, 0, "{s?o}", "properties", &properties);
-
-        if (unpk == -1) {
-            goto fail_data;
-        }
-
-        if (properties != NULL) {
-            ret[idx].properties = unpack_properties(properties);
-
-            if (ret[idx].properties == NULL) {
-                logmsg(TMJ_LOG_ERR, "Unable to unpack layer[%d]->properties", ret[idx].id);
-
-                goto fail_data;
+                goto fail_properties;
             }
         }
 
@@ -795,7 +948,7 @@ Layer* unpack_layers(json_t* layers) {
             }
 
             if (chunks != NULL) {
-                ret[idx].chunks = unpack_chunks(chunks, &ret[idx].chunk_count);
+                ret[idx].chunks = unpack_chunks(chunks, &ret[idx].chunk_count, options);
 
                 if (ret[idx].chunks == NULL) {
                     logmsg(TMJ_LOG_ERR, "Unable to unpack layer[%d]->chunks", ret[idx].id);
@@ -815,8 +968,10 @@ Layer* unpack_layers(json_t* layers) {
                 goto fail_chunks;
             }
 
-            if (objects != NULL) {
-                ret[idx].objects = unpack_objects(objects);
+            if (objects != NULL && options_lazy(options)) {
+                ret[idx].lazy_objects = objects;
+            } else if (objects != NULL) {
+                ret[idx].objects = unpack_objects(objects, options, &ret[idx].points, &ret[idx].point_count);
 
                 if (ret[idx].objects == NULL) {
                     logmsg(TMJ_LOG_ERR, "Unable to unpack layer[%d]->objects", ret[idx].id);
@@ -839,13 +994,15 @@ Layer* unpack_layers(json_t* layers) {
             }
 
             if (json_is_array(nested_layers) && json_array_size(nested_layers) > 0) {
-                ret[idx].layers = unpack_layers(nested_layers);
+                ret[idx].layers = unpack_layers(nested_layers, options);
 
                 if (ret[idx].layers == NULL) {
                     logmsg(TMJ_LOG_ERR, "Unable to unpack layer[%d]->layers", ret[idx].id);
 
                     goto fail_objects;
                 }
+
+                ret[idx].layer_count = json_array_size(nested_layers);
             }
         }
     }
@@ -854,7 +1011,7 @@ Layer* unpack_layers(json_t* layers) {
 
 fail_objects:
     for (size_t i = 0; i < layer_count; i++) {
-        free_objects(ret[i].objects, ret[i].object_count);
+        free_objects(ret[i].objects, ret[i].object_count, ret[i].points);
     }
 fail_chunks:
     for (size_t i = 0; i < layer_count; i++) {
@@ -866,11 +1023,12 @@ fail_properties:
         free(ret[i].properties);
     }
 
-fail_data:
     for (size_t i = 0; i < layer_count; i++) {
         if (!ret[i].data_is_str) {
             free(ret[i].data_uint);
         }
+
+        tmj_tiles_free(ret[i].data_compact);
     }
 
 fail_layer:
@@ -879,6 +1037,16 @@ fail_layer:
     return NULL;
 }
 
+Layer* unpack_layers(json_t* layers, const tmj_load_options* options) {
+    trace_scope trace = trace_begin("unpack_layers");
+
+    Layer* ret = unpack_layers_json(layers, options);
+
+    trace_end(&trace);
+
+    return ret;
+}
+
 /**
  * Helper function for freeing layer tree associated with a map. May result in
  * undefined behavior if the layer objects were modified by the caller of
@@ -886,23 +1054,346 @@ fail_layer:
  */
 void layers_free(Layer* layers, size_t layer_count) {
     for (size_t i = 0; i < layer_count; i++) {
-        free_objects(layers[i].objects, layers[i].object_count);
+        free_objects(layers[i].objects, layers[i].object_count, layers[i].points);
         free_chunks(layers[i].chunks, layers[i].chunk_count);
         free(layers[i].properties);
         if (!layers[i].data_is_str) {
             free(layers[i].data_uint);
         }
 
+        tmj_tiles_free(layers[i].data_compact);
+
         layers_free(layers[i].layers, layers[i].layer_count);
     }
 
     free(layers);
 }
 
-Map* map_load_json(json_t* root, const char* path) {
+static size_t count_layers(const Layer* layers, size_t layer_count) {
+    size_t count = layer_count;
+
+    for (size_t i = 0; i < layer_count; i++) {
+        count += count_layers(layers[i].layers, layers[i].layer_count);
+    }
+
+    return count;
+}
+
+/**
+ * Appends a layer tree to map->flat_layers in pre-order, applying the state of
+ * the given parent entry, or of none if parent is TMJ_NO_PARENT.
+ */
+static void flatten_layers(Map* map, Layer* layers, size_t layer_count, size_t parent) {
+    for (size_t i = 0; i < layer_count; i++) {
+        Layer* layer = &layers[i];
+        size_t idx = map->flat_layer_count++;
+        tmj_flat_layer* flat = &map->flat_layers[idx];
+
+        // Headless loads leave parallax factors zeroed
+        double parallaxx = map->headless ? 1 : layer->parallaxx;
+        double parallaxy = map->headless ? 1 : layer->parallaxy;
+
+        flat->layer = layer;
+        flat->parent = parent;
+
+        if (parent == TMJ_NO_PARENT) {
+            flat->depth = 0;
+            flat->visible = layer->visible;
+            flat->offsetx = layer->offsetx;
+            flat->offsety = layer->offsety;
+            flat->opacity = layer->opacity;
+            flat->parallaxx = parallaxx;
+            flat->parallaxy = parallaxy;
+            flat->tint = parse_color(layer->tintcolor);
+        } else {
+            const tmj_flat_layer* group = &map->flat_layers[parent];
+
+            flat->depth = group->depth + 1;
+            flat->visible = group->visible && layer->visible;
+            flat->offsetx = group->offsetx + layer->offsetx;
+            flat->offsety = group->offsety + layer->offsety;
+            flat->opacity = group->opacity * layer->opacity;
+            flat->parallaxx = group->parallaxx * parallaxx;
+            flat->parallaxy = group->parallaxy * parallaxy;
+            flat->tint = multiply_color(group->tint, parse_color(layer->tintcolor));
+        }
+
+        flatten_layers(map, layer->layers, layer->layer_count, idx);
+
+        map->flat_layers[idx].end = map->flat_layer_count;
+    }
+}
+
+/**
+ * Returns the position in map->flat_layers of the layer holding an object.
+ */
+static size_t object_layer(const Map* map, const Object* object) {
+    size_t i = 0;
+
+    while (i < map->flat_layer_count) {
+        const Layer* layer = map->flat_layers[i].layer;
+
+        if (layer->object_count > 0 && object >= layer->objects && object < layer->objects + layer->object_count) {
+            break;
+        }
+
+        i++;
+    }
+
+    return i;
+}
+
+/**
+ * Orders objects by ID, and objects sharing an ID by layer order, then by
+ * object order.
+ */
+static int object_id_compare(const Map* map, const Object* a, const Object* b) {
+    if (a->id != b->id) {
+        return a->id < b->id ? -1 : 1;
+    }
+
+    // IDs are unique in well-formed maps, so this walk is rarely taken
+    size_t x = object_layer(map, a);
+    size_t y = object_layer(map, b);
+
+    if (x != y) {
+        return x < y ? -1 : 1;
+    }
+
+    return a < b ? -1 : a > b;
+}
+
+/**
+ * Sorts objects with object_id_compare() by merging, using a scratch array as
+ * big as the objects.
+ */
+static void sort_object_ids(const Map* map, Object** objects, size_t count, Object** scratch) {
+    Object** from = objects;
+    Object** to = scratch;
+
+    for (size_t width = 1; width < count; width *= 2) {
+        for (size_t low = 0; low < count; low += width * 2) {
+            size_t mid = count - low > width ? low + width : count;
+            size_t high = count - mid > width ? mid + width : count;
+            size_t i = low;
+            size_t j = mid;
+            size_t k = low;
+
+            while (i < mid && j < high) {
+                to[k++] = object_id_compare(map, from[j], from[i]) < 0 ? from[j++] : from[i++];
+            }
+
+            while (i < mid) {
+                to[k++] = from[i++];
+            }
+
+            while (j < high) {
+                to[k++] = from[j++];
+            }
+        }
+
+        Object** swap = from;
+
+        from = to;
+        to = swap;
+    }
+
+    if (from != objects) {
+        memcpy(objects, from, count * sizeof(Object*));
+    }
+}
+
+/**
+ * Indexes the loaded objects of every layer by ID, replacing any previous
+ * index. The index is dense, indexed by ID, unless IDs are too sparse for
+ * that, in which case it is sorted by ID. Either way, objects with negative
+ * IDs are left out, and of objects sharing an ID the first in layer order is
+ * kept. Returns -1 if out of memory, leaving the previous index in place.
+ */
+static int index_object_ids(Map* map) {
+    size_t count = 0;
+    int max_id = 0;
+
+    for (size_t i = 0; i < map->flat_layer_count; i++) {
+        const Layer* layer = map->flat_layers[i].layer;
+
+        for (size_t j = 0; j < layer->object_count; j++) {
+            max_id = layer->objects[j].id > max_id ? layer->objects[j].id : max_id;
+            count += layer->objects[j].id >= 0;
+        }
+    }
+
+    bool dense = (size_t)max_id <= count * 2 + 1024;
+    size_t size = dense ? (size_t)max_id + 1 : count;
+    Object** index = NULL;
+    Object** scratch = NULL;
+
+    if (size > 0) {
+        index = stats_calloc(size, sizeof(Object*));
+
+        if (index == NULL || (!dense && (scratch = stats_malloc(size * sizeof(Object*))) == NULL)) {
+            stats_free(index, size * sizeof(Object*));
+
+            return -1;
+        }
+    }
+
+    size_t next = 0;
+
+    for (size_t i = 0; i < map->flat_layer_count; i++) {
+        Layer* layer = map->flat_layers[i].layer;
+
+        for (size_t j = 0; j < layer->object_count; j++) {
+            Object* object = &layer->objects[j];
+
+            if (object->id < 0) {
+                continue;
+            }
+
+            if (!dense) {
+                index[next++] = object;
+            } else if (index[object->id] == NULL) {
+                index[object->id] = object;
+            }
+        }
+    }
+
+    if (!dense) {
+        sort_object_ids(map, index, size, scratch);
+
+        stats_free(scratch, size * sizeof(Object*));
+    }
+
+    stats_free(map->object_index, map->object_index_size * sizeof(Object*));
+
+    map->object_index = index;
+    map->object_index_size = size;
+    map->object_index_dense = dense;
+
+    return 0;
+}
+
+/**
+ * Indexes the loaded objects of every layer by ID, and by type and name if
+ * the map asks for it. Returns -1 if out of memory.
+ */
+static int index_objects(Map* map) {
+    if (index_object_ids(map) != 0) {
+        return -1;
+    }
+
+    if (!map->object_lookup) {
+        return 0;
+    }
+
+    map->object_types = object_lookup_build(map, false);
+    map->object_names = object_lookup_build(map, true);
+
+    return map->object_types != NULL && map->object_names != NULL ? 0 : -1;
+}
+
+/**
+ * Adds the objects of a layer unpacked after the map was indexed to the
+ * indexes. The ID index grows in place while it stays dense; a sorted one has
+ * the objects appended and is sorted again. Either way, duplicate IDs resolve
+ * as if the whole index were rebuilt. The objects are merged into the
+ * spans of the indexes by type and name. Returns -1 if out of memory, in
+ * which case the indexes that couldn't take the objects go without them.
+ */
+static int index_layer_objects(Map* map, Layer* layer) {
+    size_t count = 0;
+    int max_id = 0;
+
+    for (size_t i = 0; i < map->flat_layer_count; i++) {
+        count += map->flat_layers[i].layer->object_count;
+    }
+
+    size_t added = 0;
+
+    for (size_t j = 0; j < layer->object_count; j++) {
+        max_id = layer->objects[j].id > max_id ? layer->objects[j].id : max_id;
+        added += layer->objects[j].id >= 0;
+    }
+
+    size_t size = map->object_index_size;
+
+    if (map->object_index_dense && (size_t)max_id > count * 2 + 1024) {
+        // Too sparse for a dense index now, this sorts every object instead
+        if (index_object_ids(map) != 0) {
+            return -1;
+        }
+    } else if (map->object_index_dense) {
+        size_t new_size = (size_t)max_id + 1 > size ? (size_t)max_id + 1 : size;
+
+        if (new_size > size) {
+            Object** index = stats_realloc(map->object_index, size * sizeof(Object*), new_size * sizeof(Object*));
+
+            if (index == NULL) {
+                return -1;
+            }
+
+            memset(index + size, 0, (new_size - size) * sizeof(Object*));
+
+            map->object_index = index;
+            map->object_index_size = new_size;
+        }
+
+        for (size_t j = 0; j < layer->object_count; j++) {
+            Object* object = &layer->objects[j];
+
+            if (object->id < 0) {
+                continue;
+            }
+
+            Object** slot = &map->object_index[object->id];
+
+            // The layer may come before the one holding the object indexed already
+            if (*slot == NULL || object_id_compare(map, object, *slot) < 0) {
+                *slot = object;
+            }
+        }
+    } else if (added > 0) {
+        Object** scratch = stats_malloc((size + added) * sizeof(Object*));
+
+        if (scratch == NULL) {
+            return -1;
+        }
+
+        Object** index = stats_realloc(map->object_index, size * sizeof(Object*), (size + added) * sizeof(Object*));
+
+        if (index == NULL) {
+            stats_free(scratch, (size + added) * sizeof(Object*));
+
+            return -1;
+        }
+
+        for (size_t j = 0; j < layer->object_count; j++) {
+            if (layer->objects[j].id >= 0) {
+                index[size++] = &layer->objects[j];
+            }
+        }
+
+        sort_object_ids(map, index, size, scratch);
+
+        stats_free(scratch, size * sizeof(Object*));
+
+        map->object_index = index;
+        map->object_index_size = size;
+    }
+    if (!map->object_lookup) {
+        return 0;
+    }
+
+    int types = object_lookup_add(map->object_types, layer, false);
+    int names = object_lookup_add(map->object_names, layer, true);
+
+    return types == 0 && names == 0 ? 0 : -1;
+}
+
+Map* map_load_json(json_t* root, const char* path, const tmj_load_options* options) {
     json_error_t error;
 
-    Map* map = calloc(1, sizeof(Map));
+    Map* map = stats_calloc(1, sizeof(Map));
 
     if (map == NULL) {
         logmsg(TMJ_LOG_ERR, "Could not load map '%s', the system is out of memory", path);
@@ -911,6 +1402,9 @@ Map* map_load_json(json_t* root, const char* path) {
     }
 
     map->root = root;
+    map->headless = options_headless(options);
+    map->tile_rects = options_tile_rects(options);
+    map->object_lookup = options_object_lookup(options);
 
     // Verify type (i.e, check that this is a map and not a tileset or something)
     int unpk = json_unpack_ex(root, &error, 0, "{s:s}", "type", &map->type);
@@ -939,7 +1433,6 @@ Map* map_load_json(json_t* root, const char* path) {
             "s:b,"
             "s?s, s?s, s:s, s:s, s:s, s:s,"
             "s:i, s:i, s:i, s:i, s:i, s:i, s:i,"
-            "s?F, s?F,"
             "s:o, s:o, s?o"
             "}",
             "infinite",
@@ -970,10 +1463,6 @@ Map* map_load_json(json_t* root, const char* path) {
             &map->tilewidth,
             "width",
             &map->width,
-            "parallaxoriginx",
-            &map->parallaxoriginx,
-            "parallaxoriginy",
-            &map->parallaxoriginy,
             "tilesets",
             &tilesets,
             "layers",
@@ -987,6 +1476,17 @@ Map* map_load_json(json_t* root, const char* path) {
         goto fail_map;
     }
 
+    // Unpack presentation-only scalar values
+    if (!options_headless(options)) {
+        unpk = json_unpack_ex(root, &error, 0, "{s?F, s?F}", "parallaxoriginx", &map->parallaxoriginx, "parallaxoriginy", &map->parallaxoriginy);
+
+        if (unpk == -1) {
+            logmsg(TMJ_LOG_ERR, "Could not unpack map[%s], %s at line %d, column %d", path, error.text, error.line, error.column);
+
+            goto fail_map;
+        }
+    }
+
     // Unpack conditional scalar values
     if (strcmp(map->orientation, "staggered") == 0 || strcmp(map->orientation, "hexagonal") == 0) {
         unpk = json_unpack_ex(root, &error, 0, "{s:s, s:s}", "staggeraxis", &map->staggeraxis, "staggerindex", &map->staggerindex);
@@ -1017,10 +1517,12 @@ Map* map_load_json(json_t* root, const char* path) {
 
             goto fail_map;
         }
+
+        map->property_count = json_array_size(properties);
     }
 
     // Unpack layers
-    map->layers = unpack_layers(layers);
+    map->layers = unpack_layers(layers, options);
 
     if (map->layers == NULL) {
         logmsg(TMJ_LOG_ERR, "Unable to unpack map[%s]->layers", path);
@@ -1030,6 +1532,26 @@ Map* map_load_json(json_t* root, const char* path) {
 
     map->layer_count = json_array_size(layers);
 
+    size_t flat_layer_count = count_layers(map->layers, map->layer_count);
+
+    if (flat_layer_count > 0) {
+        map->flat_layers = stats_malloc(flat_layer_count * sizeof(tmj_flat_layer));
+
+        if (map->flat_layers == NULL) {
+            logmsg(TMJ_LOG_ERR, "Unable to flatten map[%s]->layers, the system is out of memory", path);
+
+            goto fail_layers;
+        }
+
+        flatten_layers(map, map->layers, map->layer_count, TMJ_NO_PARENT);
+    }
+
+    if (index_objects(map) != 0) {
+        logmsg(TMJ_LOG_ERR, "Unable to index map[%s] objects, the system is out of memory", path);
+
+        goto fail_layers;
+    }
+
     // Unpack tilesets
     if (!json_is_array(tilesets)) {
         logmsg(TMJ_LOG_ERR, "Unable to unpack map[%s]->tilesets, tilesets must be an array of Tilesets", path);
@@ -1039,7 +1561,7 @@ Map* map_load_json(json_t* root, const char* path) {
 
     size_t tileset_count = json_array_size(tilesets);
 
-    map->tilesets = calloc(tileset_count, sizeof(Tileset));
+    map->tilesets = stats_calloc(tileset_count, sizeof(Tileset));
 
     if (map->tilesets == NULL) {
         logmsg(TMJ_LOG_ERR, "Unable to unpack map[%s]->tilesets, the system is out of memory", path);
@@ -1069,13 +1591,24 @@ Map* map_load_json(json_t* root, const char* path) {
             map->tilesets[idx].firstgid = firstgid;
             map->tilesets[idx].source = source;
         }
+        // The tileset is embedded in the map, save it for tmj_map_tileset()
+        else if (options_lazy(options)) {
+            map->tilesets[idx].firstgid = firstgid;
+            map->tilesets[idx].lazy_tileset = tileset;
+        }
         // The tileset is embedded in the map, unpack it
         else {
-            if (unpack_tileset(tileset, &map->tilesets[idx]) != 0) {
+            if (unpack_tileset(tileset, &map->tilesets[idx], options) != 0) {
                 logmsg(TMJ_LOG_ERR, "Unable to unpack map[%s]->tilesets, could not unpack embedded tileset", path);
 
                 goto fail_tilesets;
             }
+
+            if (options_tile_rects(options) && tmj_tileset_build_rects(&map->tilesets[idx], map->tilewidth, map->tileheight) != 0) {
+                map->tileset_count = idx + 1;
+
+                goto fail_tilesets;
+            }
         }
 
         map->tileset_count = tileset_count;
@@ -1087,6 +1620,10 @@ fail_tilesets:
     tilesets_free(map->tilesets, map->tileset_count);
 
 fail_layers:
+    object_lookup_free(map->object_types);
+    object_lookup_free(map->object_names);
+    free(map->object_index);
+    free(map->flat_layers);
     layers_free(map->layers, map->layer_count);
 
 fail_properties:
@@ -1100,7 +1637,7 @@ fail_map:
     return NULL;
 }
 
-Map* tmj_map_loadf(const char* path, bool check_extension) {
+Map* tmj_map_loadf_ex(const char* path, bool check_extension, const tmj_load_options* options) {
     char* ext = strrchr(path, '.');
 
     if (check_extension) {
@@ -1121,7 +1658,7 @@ Map* tmj_map_loadf(const char* path, bool check_extension) {
     logmsg(TMJ_LOG_DEBUG, "Loading JSON map file %s", path);
 
     json_error_t error;
-    json_t* root = json_load_file(path, JSON_REJECT_DUPLICATES, &error);
+    json_t* root = load_json_file(path, &error);
 
     if (root == NULL) {
         logmsg(TMJ_LOG_ERR, "Could not load map %s, %s at line %d column %d", path, error.text, error.line, error.column);
@@ -1129,13 +1666,25 @@ Map* tmj_map_loadf(const char* path, bool check_extension) {
         return NULL;
     }
 
-    return map_load_json(root, path);
+    trace_scope trace = trace_begin("map_load_json");
+    uint64_t start = stats_phase_begin();
+
+    Map* ret = map_load_json(root, path, options);
+
+    stats_phase_end(STATS_PHASE_UNPACK, start, 0);
+    trace_end(&trace);
+
+    if (ret != NULL) {
+        stats_count_load(false);
+    }
+
+    return ret;
 }
 
-Map* tmj_map_load(const char* map, const char* name) {
+Map* tmj_map_load_ex(const char* map, const char* name, const tmj_load_options* options) {
     json_error_t error;
 
-    json_t* root = json_loads(map, JSON_REJECT_DUPLICATES, &error);
+    json_t* root = load_json_string(map, &error);
 
     if (root == NULL) {
         logmsg(TMJ_LOG_ERR, "Could not load map %s, %s at line %d column %d", name, error.text, error.line, error.column);
@@ -1143,7 +1692,141 @@ Map* tmj_map_load(const char* map, const char* name) {
         return NULL;
     }
 
-    return map_load_json(root, name);
+    trace_scope trace = trace_begin("map_load_json");
+    uint64_t start = stats_phase_begin();
+
+    Map* ret = map_load_json(root, name, options);
+
+    stats_phase_end(STATS_PHASE_UNPACK, start, 0);
+    trace_end(&trace);
+
+    if (ret != NULL) {
+        stats_count_load(false);
+    }
+
+    return ret;
+}
+
+Map* tmj_map_loadf(const char* path, bool check_extension) {
+    return tmj_map_loadf_ex(path, check_extension, NULL);
+}
+
+Map* tmj_map_load(const char* map, const char* name) {
+    return tmj_map_load_ex(map, name, NULL);
+}
+
+Object* tmj_layer_objects(Map* map, Layer* layer, size_t* count) {
+    if (count != NULL) {
+        *count = 0;
+    }
+
+    if (layer->lazy_objects != NULL) {
+        tmj_load_options options = {0};
+
+        options.profile = map->headless ? TMJ_LOAD_HEADLESS : TMJ_LOAD_FULL;
+
+        uint64_t start = stats_phase_begin();
+
+        Point* points = NULL;
+        size_t point_count = 0;
+        Object* objects = unpack_objects(layer->lazy_objects, &options, &points, &point_count);
+
+        stats_phase_end(STATS_PHASE_UNPACK, start, 0);
+
+        if (objects == NULL) {
+            logmsg(TMJ_LOG_ERR, "Unable to unpack layer[%d]->objects", layer->id);
+
+            return NULL;
+        }
+
+        layer->objects = objects;
+        layer->object_count = json_array_size(layer->lazy_objects);
+        layer->points = points;
+        layer->point_count = point_count;
+        layer->lazy_objects = NULL;
+
+        // The indexes stay usable if this fails, they just lack these objects
+        if (index_layer_objects(map, layer) != 0) {
+            logmsg(TMJ_LOG_ERR, "Unable to index layer[%d]->objects, the system is out of memory", layer->id);
+        }
+    }
+
+    if (count != NULL) {
+        *count = layer->object_count;
+    }
+
+    return layer->objects;
+}
+
+Object* tmj_map_object(const Map* map, int id) {
+    if (map->object_index_dense) {
+        return id >= 0 && (size_t)id < map->object_index_size ? map->object_index[id] : NULL;
+    }
+
+    size_t low = 0;
+    size_t high = map->object_index_size;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+
+        if (map->object_index[mid]->id < id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low < map->object_index_size && map->object_index[low]->id == id ? map->object_index[low] : NULL;
+}
+
+Object* tmj_map_property_object(const Map* map, const Property* property) {
+    if (property->type == NULL || strcmp(property->type, "object") != 0) {
+        return NULL;
+    }
+
+    return tmj_map_object(map, property->value_object);
+}
+
+Tileset* tmj_map_tileset(Map* map, size_t index) {
+    if (index >= map->tileset_count) {
+        logmsg(TMJ_LOG_ERR, "Tileset index %zu is out of range, the map has %zu tilesets", index, map->tileset_count);
+
+        return NULL;
+    }
+
+    Tileset* tileset = &map->tilesets[index];
+
+    if (tileset->lazy_tileset != NULL) {
+        tmj_load_options options = {0};
+
+        options.profile = map->headless ? TMJ_LOAD_HEADLESS : TMJ_LOAD_FULL;
+        options.tile_rects = map->tile_rects;
+
+        // Unpack into a scratch tileset, so a failure leaves the deferred one intact
+        Tileset unpacked = {0};
+
+        uint64_t start = stats_phase_begin();
+
+        int unpk = unpack_tileset(tileset->lazy_tileset, &unpacked, &options);
+
+        stats_phase_end(STATS_PHASE_UNPACK, start, 0);
+
+        if (unpk != 0) {
+            logmsg(TMJ_LOG_ERR, "Unable to unpack map->tilesets[%zu], could not unpack embedded tileset", index);
+
+            return NULL;
+        }
+
+        if (map->tile_rects && tmj_tileset_build_rects(&unpacked, map->tilewidth, map->tileheight) != 0) {
+            tileset_clear(&unpacked);
+
+            return NULL;
+        }
+
+        *tileset = unpacked;
+    }
+
+    return tileset;
 }
 
 void tmj_map_free(Map* map) {
@@ -1152,6 +1835,10 @@ void tmj_map_free(Map* map) {
     }
 
     tilesets_free(map->tilesets, map->tileset_count);
+    object_lookup_free(map->object_types);
+    object_lookup_free(map->object_names);
+    free(map->object_index);
+    free(map->flat_layers);
     layers_free(map->layers, map->layer_count);
     free(map->properties);
 
@@ -6,7 +6,8 @@
 #include "tmj.h"
 
 Property* unpack_properties(json_t* properties);
-Object* unpack_objects(json_t* objects);
-void free_objects(Object* objects, size_t object_count);
+Object* unpack_objects(json_t* objects, const tmj_load_options* options, Point** points, size_t* point_count);
+void free_objects(Object* objects, size_t object_count, Point* points);
+Layer* unpack_layers(json_t* layers, const tmj_load_options* options);
 
 #endif
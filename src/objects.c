@@ -0,0 +1,280 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "tmj.h"
+#include "util.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OBJECTS_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define OBJECTS_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+ * @file
+ *
+ * Structure-of-arrays object views, and bounding box culling.
+ */
+
+#define DEG_TO_RAD 0.017453292519943295
+
+/**
+ * Works out the bounding box of an object in layer pixels, rotation included.
+ */
+static void object_bounds(const Object* object, float* min_x, float* min_y, float* max_x, float* max_y) {
+    double x0 = 0, y0 = 0, x1 = object->width, y1 = object->height;
+
+    if (object->polygon != NULL && object->polygon_point_count > 0) {
+        x0 = x1 = object->polygon[0].x;
+        y0 = y1 = object->polygon[0].y;
+
+        for (size_t i = 1; i < object->polygon_point_count; i++) {
+            const Point* p = &object->polygon[i];
+
+            x0 = p->x < x0 ? p->x : x0;
+            y0 = p->y < y0 ? p->y : y0;
+            x1 = p->x > x1 ? p->x : x1;
+            y1 = p->y > y1 ? p->y : y1;
+        }
+    } else if (object->gid != 0) {
+        // Tile objects hang from their bottom-left corner
+        y0 = -object->height;
+        y1 = 0;
+    }
+
+    if (object->rotation != 0) {
+        // Tiled rotates clockwise, in degrees, around the object's position
+        double c = cos(object->rotation * DEG_TO_RAD);
+        double s = sin(object->rotation * DEG_TO_RAD);
+        double xs[4] = {x0, x1, x1, x0};
+        double ys[4] = {y0, y0, y1, y1};
+
+        x0 = y0 = INFINITY;
+        x1 = y1 = -INFINITY;
+
+        for (int i = 0; i < 4; i++) {
+            double rx = xs[i] * c - ys[i] * s;
+            double ry = xs[i] * s + ys[i] * c;
+
+            x0 = rx < x0 ? rx : x0;
+            y0 = ry < y0 ? ry : y0;
+            x1 = rx > x1 ? rx : x1;
+            y1 = ry > y1 ? ry : y1;
+        }
+    }
+
+    *min_x = (float)(object->x + x0);
+    *min_y = (float)(object->y + y0);
+    *max_x = (float)(object->x + x1);
+    *max_y = (float)(object->y + y1);
+}
+
+/**
+ * Finds the index of an object type in the view's type table, adding it if
+ * it's new. The table is open-addressed by the type's hash, with slots
+ * holding type indices plus one.
+ */
+static uint32_t intern_type(tmj_object_soa* soa, uint32_t* slots, size_t slot_mask, const char* type) {
+    if (type == NULL || type[0] == '\0') {
+        return 0;
+    }
+
+    size_t slot = hash_string(type) & slot_mask;
+
+    while (slots[slot] != 0) {
+        if (strcmp(soa->type_names[slots[slot] - 1], type) == 0) {
+            return slots[slot] - 1;
+        }
+
+        slot = (slot + 1) & slot_mask;
+    }
+
+    slots[slot] = (uint32_t)soa->type_count + 1;
+    soa->type_names[soa->type_count] = type;
+
+    return (uint32_t)soa->type_count++;
+}
+
+tmj_object_soa* tmj_object_soa_build(Map* map, Layer* layer) {
+    if (layer->type == NULL || strcmp(layer->type, "objectgroup") != 0) {
+        logmsg(TMJ_LOG_ERR, "Unable to build object view of layer[%d], it is not an object layer", layer->id);
+
+        return NULL;
+    }
+
+    size_t count = 0;
+    Object* objects = tmj_layer_objects(map, layer, &count);
+
+    if (objects == NULL && layer->lazy_objects != NULL) {
+        return NULL;
+    }
+
+    // Padding lets vector loops run to the end without a scalar tail
+    size_t padded = (count + TMJ_OBJECT_SOA_PAD - 1) / TMJ_OBJECT_SOA_PAD * TMJ_OBJECT_SOA_PAD;
+    size_t slot_count = 16;
+
+    while (slot_count < count * 2) {
+        slot_count *= 2;
+    }
+
+    tmj_object_soa* soa = calloc(1, sizeof(tmj_object_soa));
+    uint32_t* slots = calloc(slot_count, sizeof(uint32_t));
+
+    // Twelve 4-byte arrays, then the visibility bytes
+    if (soa == NULL || slots == NULL || (padded > 0 && (soa->block = malloc(padded * (12 * sizeof(float) + 1))) == NULL) ||
+            (soa->type_names = malloc((count + 1) * sizeof(const char*))) == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to build object view of layer[%d], the system is out of memory", layer->id);
+
+        free(slots);
+        tmj_object_soa_free(soa);
+
+        return NULL;
+    }
+
+    float* floats = soa->block;
+
+    soa->count = count;
+    soa->objects = objects;
+    soa->x = floats;
+    soa->y = floats + padded;
+    soa->width = floats + padded * 2;
+    soa->height = floats + padded * 3;
+    soa->rotation = floats + padded * 4;
+    soa->min_x = floats + padded * 5;
+    soa->min_y = floats + padded * 6;
+    soa->max_x = floats + padded * 7;
+    soa->max_y = floats + padded * 8;
+    soa->ids = (int32_t*)(floats + padded * 9);
+    soa->gids = (uint32_t*)(floats + padded * 10);
+    soa->types = (uint32_t*)(floats + padded * 11);
+    soa->visible = (uint8_t*)(floats + padded * 12);
+
+    soa->type_names[0] = NULL;
+    soa->type_count = 1;
+
+    for (size_t i = 0; i < count; i++) {
+        const Object* object = &objects[i];
+
+        soa->x[i] = (float)object->x;
+        soa->y[i] = (float)object->y;
+        soa->width[i] = (float)object->width;
+        soa->height[i] = (float)object->height;
+        soa->rotation[i] = (float)object->rotation;
+        soa->ids[i] = object->id;
+        soa->gids[i] = (uint32_t)object->gid;
+        soa->types[i] = intern_type(soa, slots, slot_count - 1, object->type);
+        soa->visible[i] = object->visible;
+
+        object_bounds(object, &soa->min_x[i], &soa->min_y[i], &soa->max_x[i], &soa->max_y[i]);
+    }
+
+    // Padding boxes are empty, so they never pass a cull
+    for (size_t i = count; i < padded; i++) {
+        soa->x[i] = soa->y[i] = soa->width[i] = soa->height[i] = soa->rotation[i] = 0;
+        soa->min_x[i] = soa->min_y[i] = INFINITY;
+        soa->max_x[i] = soa->max_y[i] = -INFINITY;
+        soa->ids[i] = 0;
+        soa->gids[i] = 0;
+        soa->types[i] = 0;
+        soa->visible[i] = 0;
+    }
+
+    free(slots);
+
+    return soa;
+}
+
+void tmj_object_soa_free(tmj_object_soa* soa) {
+    if (soa == NULL) {
+        return;
+    }
+
+    free(soa->block);
+    free(soa->type_names);
+    free(soa);
+}
+
+size_t tmj_aabb_cull(const float* min_x,
+        const float* min_y,
+        const float* max_x,
+        const float* max_y,
+        size_t count,
+        float left,
+        float top,
+        float right,
+        float bottom,
+        uint32_t* indices) {
+    size_t hits = 0;
+    size_t i = 0;
+
+    // Four boxes per vector, the hits compressed out of a bit mask
+#if defined(OBJECTS_SSE2)
+    const __m128 l = _mm_set1_ps(left);
+    const __m128 t = _mm_set1_ps(top);
+    const __m128 r = _mm_set1_ps(right);
+    const __m128 b = _mm_set1_ps(bottom);
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 in = _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(min_x + i), r), _mm_cmpge_ps(_mm_loadu_ps(max_x + i), l));
+
+        in = _mm_and_ps(in, _mm_and_ps(_mm_cmple_ps(_mm_loadu_ps(min_y + i), b), _mm_cmpge_ps(_mm_loadu_ps(max_y + i), t)));
+
+        unsigned mask = (unsigned)_mm_movemask_ps(in);
+
+        while (mask != 0) {
+            unsigned lane = 0;
+
+            while (!(mask & (1u << lane))) {
+                lane++;
+            }
+
+            indices[hits++] = (uint32_t)(i + lane);
+            mask &= mask - 1;
+        }
+    }
+#elif defined(OBJECTS_NEON)
+    const float32x4_t l = vdupq_n_f32(left);
+    const float32x4_t t = vdupq_n_f32(top);
+    const float32x4_t r = vdupq_n_f32(right);
+    const float32x4_t b = vdupq_n_f32(bottom);
+    const uint32x4_t bits = {1, 2, 4, 8};
+
+    for (; i + 4 <= count; i += 4) {
+        uint32x4_t in = vandq_u32(vcleq_f32(vld1q_f32(min_x + i), r), vcgeq_f32(vld1q_f32(max_x + i), l));
+
+        in = vandq_u32(in, vandq_u32(vcleq_f32(vld1q_f32(min_y + i), b), vcgeq_f32(vld1q_f32(max_y + i), t)));
+
+        uint32x4_t lanes = vandq_u32(in, bits);
+        unsigned mask = vgetq_lane_u32(lanes, 0) | vgetq_lane_u32(lanes, 1) | vgetq_lane_u32(lanes, 2) | vgetq_lane_u32(lanes, 3);
+
+        while (mask != 0) {
+            unsigned lane = 0;
+
+            while (!(mask & (1u << lane))) {
+                lane++;
+            }
+
+            indices[hits++] = (uint32_t)(i + lane);
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        if (min_x[i] <= right && max_x[i] >= left && min_y[i] <= bottom && max_y[i] >= top) {
+            indices[hits++] = (uint32_t)i;
+        }
+    }
+
+    return hits;
+}
+
+size_t tmj_object_soa_cull(const tmj_object_soa* soa, float left, float top, float right, float bottom, uint32_t* indices) {
+    // The padding boxes are left out, an unbounded rectangle would match them
+    return tmj_aabb_cull(soa->min_x, soa->min_y, soa->max_x, soa->max_y, soa->count, left, top, right, bottom, indices);
+}
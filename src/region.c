@@ -0,0 +1,1052 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <jansson.h>
+
+#include "log.h"
+#include "stats.h"
+#include "tmj.h"
+
+/**
+ * @file
+ *
+ * Region streaming for infinite maps.
+ *
+ * Building an index runs a small pull scanner over the map file, a buffer at
+ * a time, so memory use doesn't depend on the size of the file. The scanner
+ * only understands as much of the map format as it needs to find tile layers
+ * and their chunks; every other value is skipped without being kept.
+ * Loading a region then reads each chunk's byte span back from the file, and
+ * hands that one object to jansson.
+ */
+
+#define SCAN_BUFFER_SIZE 65536
+
+typedef struct scanner {
+    FILE* file;
+    const char* path;
+
+    uint64_t offset; // File offset of buf[0]
+    size_t pos;
+    size_t len;
+
+    char* str; // The last string read, when kept
+    size_t str_len;
+    size_t str_cap;
+
+    char buf[SCAN_BUFFER_SIZE];
+} scanner;
+
+static int file_seek(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, SEEK_SET);
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static int scan_peek(scanner* s) {
+    if (s->pos == s->len) {
+        uint64_t start = stats_phase_begin();
+
+        s->offset += s->len;
+        s->len = fread(s->buf, 1, sizeof(s->buf), s->file);
+        s->pos = 0;
+
+        stats_phase_end(STATS_PHASE_IO, start, s->len);
+
+        if (s->len == 0) {
+            return EOF;
+        }
+    }
+
+    return (unsigned char)s->buf[s->pos];
+}
+
+static int scan_get(scanner* s) {
+    int c = scan_peek(s);
+
+    if (c != EOF) {
+        s->pos++;
+    }
+
+    return c;
+}
+
+static uint64_t scan_offset(const scanner* s) {
+    return s->offset + s->pos;
+}
+
+static void scan_ws(scanner* s) {
+    int c = scan_peek(s);
+
+    while (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+        s->pos++;
+        c = scan_peek(s);
+    }
+}
+
+static int scan_error(scanner* s, const char* what) {
+    logmsg(TMJ_LOG_ERR, "Unable to index map '%s', %s at byte %llu", s->path, what, (unsigned long long)scan_offset(s));
+
+    return -1;
+}
+
+static int str_push(scanner* s, char c) {
+    if (s->str_len + 1 >= s->str_cap) {
+        size_t cap = s->str_cap ? s->str_cap * 2 : 64;
+        char* str = realloc(s->str, cap);
+
+        if (str == NULL) {
+            return scan_error(s, "the system is out of memory");
+        }
+
+        s->str = str;
+        s->str_cap = cap;
+    }
+
+    s->str[s->str_len++] = c;
+    s->str[s->str_len] = '\0';
+
+    return 0;
+}
+
+static int scan_hex4(scanner* s, unsigned int* out) {
+    *out = 0;
+
+    for (int i = 0; i < 4; i++) {
+        int c = scan_get(s);
+
+        *out <<= 4;
+
+        if (c >= '0' && c <= '9') {
+            *out |= (unsigned int)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            *out |= (unsigned int)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            *out |= (unsigned int)(c - 'A' + 10);
+        } else {
+            return scan_error(s, "invalid unicode escape");
+        }
+    }
+
+    return 0;
+}
+
+static int str_push_utf8(scanner* s, unsigned int cp) {
+    if (cp < 0x80) {
+        return str_push(s, (char)cp);
+    }
+
+    if (cp < 0x800) {
+        return str_push(s, (char)(0xC0 | (cp >> 6))) | str_push(s, (char)(0x80 | (cp & 0x3F)));
+    }
+
+    if (cp < 0x10000) {
+        return str_push(s, (char)(0xE0 | (cp >> 12))) | str_push(s, (char)(0x80 | ((cp >> 6) & 0x3F)))
+             | str_push(s, (char)(0x80 | (cp & 0x3F)));
+    }
+
+    return str_push(s, (char)(0xF0 | (cp >> 18))) | str_push(s, (char)(0x80 | ((cp >> 12) & 0x3F)))
+         | str_push(s, (char)(0x80 | ((cp >> 6) & 0x3F))) | str_push(s, (char)(0x80 | (cp & 0x3F)));
+}
+
+/**
+ * Reads a string. If keep is set, the unescaped string is left in s->str,
+ * otherwise it is only skipped over.
+ */
+static int scan_string(scanner* s, bool keep) {
+    if (scan_get(s) != '"') {
+        return scan_error(s, "expected a string");
+    }
+
+    // Pushing and dropping a terminator leaves a valid buffer, even for ""
+    s->str_len = 0;
+
+    if (keep && str_push(s, '\0') == -1) {
+        return -1;
+    }
+
+    s->str_len = 0;
+
+    for (;;) {
+        int c = scan_get(s);
+
+        if (c == EOF) {
+            return scan_error(s, "unterminated string");
+        }
+
+        if (c == '"') {
+            return 0;
+        }
+
+        if (c == '\\') {
+            c = scan_get(s);
+
+            if (!keep) {
+                if (c == EOF) {
+                    return scan_error(s, "unterminated string");
+                }
+
+                continue;
+            }
+
+            unsigned int cp = 0;
+
+            switch (c) {
+                case 'b':
+                    c = '\b';
+                    break;
+                case 'f':
+                    c = '\f';
+                    break;
+                case 'n':
+                    c = '\n';
+                    break;
+                case 'r':
+                    c = '\r';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case '"':
+                case '\\':
+                case '/':
+                    break;
+                case 'u':
+                    if (scan_hex4(s, &cp) == -1) {
+                        return -1;
+                    }
+
+                    // Surrogate pair
+                    if (cp >= 0xD800 && cp < 0xDC00) {
+                        unsigned int low = 0;
+
+                        if (scan_get(s) != '\\' || scan_get(s) != 'u' || scan_hex4(s, &low) == -1 || low < 0xDC00 || low > 0xDFFF) {
+                            return scan_error(s, "invalid surrogate pair");
+                        }
+
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+
+                    if (str_push_utf8(s, cp) == -1) {
+                        return -1;
+                    }
+
+                    continue;
+                default:
+                    return scan_error(s, "invalid escape");
+            }
+        }
+
+        if (keep && str_push(s, (char)c) == -1) {
+            return -1;
+        }
+    }
+}
+
+static int scan_int(scanner* s, long long* out) {
+    char num[32];
+    size_t len = 0;
+    int c = scan_peek(s);
+
+    while (c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E' || (c >= '0' && c <= '9')) {
+        if (len + 1 == sizeof(num)) {
+            return scan_error(s, "number too long");
+        }
+
+        num[len++] = (char)c;
+        s->pos++;
+        c = scan_peek(s);
+    }
+
+    num[len] = '\0';
+
+    char* end = NULL;
+    double value = strtod(num, &end);
+
+    if (len == 0 || *end != '\0') {
+        return scan_error(s, "expected a number");
+    }
+
+    *out = (long long)value;
+
+    return 0;
+}
+
+/**
+ * Skips over any value, without keeping any of it.
+ */
+static int scan_skip(scanner* s) {
+    size_t depth = 0;
+
+    do {
+        scan_ws(s);
+
+        int c = scan_peek(s);
+
+        if (c == '"') {
+            if (scan_string(s, false) == -1) {
+                return -1;
+            }
+        } else if (c == '{' || c == '[') {
+            s->pos++;
+            depth++;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0) {
+                return scan_error(s, "unbalanced brackets");
+            }
+
+            s->pos++;
+            depth--;
+        } else if (c == ',' || c == ':') {
+            if (depth == 0) {
+                return scan_error(s, "unexpected separator");
+            }
+
+            s->pos++;
+        } else if (c == EOF) {
+            return scan_error(s, "unexpected end of file");
+        } else {
+            // Numbers, true, false and null are runs of plain characters
+            while (c != EOF && c != ',' && c != ':' && c != '}' && c != ']' && c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+                s->pos++;
+                c = scan_peek(s);
+            }
+        }
+    } while (depth > 0);
+
+    return 0;
+}
+
+/**
+ * Steps to the next key of an object, leaving it in s->str.
+ *
+ * @return 1 if there is another key, 0 at the end of the object, -1 on error.
+ */
+static int scan_key(scanner* s, bool* first) {
+    scan_ws(s);
+
+    if (*first) {
+        if (scan_get(s) != '{') {
+            return scan_error(s, "expected an object");
+        }
+
+        scan_ws(s);
+    }
+
+    if (scan_peek(s) == '}') {
+        s->pos++;
+
+        return 0;
+    }
+
+    if (!*first) {
+        if (scan_get(s) != ',') {
+            return scan_error(s, "expected ',' or '}'");
+        }
+
+        scan_ws(s);
+    }
+
+    *first = false;
+
+    if (scan_string(s, true) == -1) {
+        return -1;
+    }
+
+    scan_ws(s);
+
+    if (scan_get(s) != ':') {
+        return scan_error(s, "expected ':'");
+    }
+
+    scan_ws(s);
+
+    return 1;
+}
+
+/**
+ * Steps to the next element of an array.
+ *
+ * @return 1 if there is another element, 0 at the end of the array, -1 on
+ * error.
+ */
+static int scan_element(scanner* s, bool* first) {
+    scan_ws(s);
+
+    if (*first) {
+        if (scan_get(s) != '[') {
+            return scan_error(s, "expected an array");
+        }
+
+        scan_ws(s);
+    }
+
+    if (scan_peek(s) == ']') {
+        s->pos++;
+
+        return 0;
+    }
+
+    if (!*first) {
+        if (scan_get(s) != ',') {
+            return scan_error(s, "expected ',' or ']'");
+        }
+
+        scan_ws(s);
+    }
+
+    *first = false;
+
+    return 1;
+}
+
+static void kept_string_free(char* str) {
+    if (str != NULL) {
+        stats_free(str, strlen(str) + 1);
+    }
+}
+
+/**
+ * Shrinks an array grown by doubling down to its element count, so that it
+ * can be released by size. Returns NULL if the array is empty or could not be
+ * shrunk, in which case it has been released.
+ */
+static void* array_trim(void* array, size_t cap, size_t count, size_t size) {
+    if (cap == count) {
+        return array;
+    }
+
+    void* trimmed = count > 0 ? stats_realloc(array, cap * size, count * size) : NULL;
+
+    if (trimmed == NULL) {
+        stats_free(array, cap * size);
+    }
+
+    return trimmed;
+}
+
+static int scan_kept_string(scanner* s, char** out) {
+    if (scan_string(s, true) == -1) {
+        return -1;
+    }
+
+    kept_string_free(*out);
+
+    *out = stats_malloc(s->str_len + 1);
+
+    if (*out == NULL) {
+        return scan_error(s, "the system is out of memory");
+    }
+
+    memcpy(*out, s->str, s->str_len + 1);
+
+    return 0;
+}
+
+static void chunk_layer_clear(tmj_chunk_layer* layer) {
+    kept_string_free(layer->name);
+    kept_string_free(layer->type);
+    kept_string_free(layer->encoding);
+    kept_string_free(layer->compression);
+    stats_free(layer->chunks, layer->chunk_count * sizeof(tmj_chunk_span));
+}
+
+static int scan_chunk_list(scanner* s, tmj_chunk_layer* layer, size_t* cap) {
+    bool first = true;
+    int more;
+
+    while ((more = scan_element(s, &first)) == 1) {
+        if (layer->chunk_count == *cap) {
+            size_t new_cap = *cap ? *cap * 2 : 16;
+            tmj_chunk_span* chunks = stats_realloc(layer->chunks, *cap * sizeof(tmj_chunk_span), new_cap * sizeof(tmj_chunk_span));
+
+            if (chunks == NULL) {
+                return scan_error(s, "the system is out of memory");
+            }
+
+            layer->chunks = chunks;
+            *cap = new_cap;
+        }
+
+        tmj_chunk_span* chunk = &layer->chunks[layer->chunk_count];
+        long long values[4] = {0};
+        bool first_key = true;
+        int key;
+
+        memset(chunk, 0, sizeof(*chunk));
+
+        chunk->offset = scan_offset(s);
+
+        while ((key = scan_key(s, &first_key)) == 1) {
+            int field = strcmp(s->str, "x") == 0 ? 0 : strcmp(s->str, "y") == 0 ? 1 : strcmp(s->str, "width") == 0 ? 2 : strcmp(s->str, "height") == 0 ? 3 : -1;
+
+            if ((field == -1 ? scan_skip(s) : scan_int(s, &values[field])) == -1) {
+                return -1;
+            }
+        }
+
+        if (key == -1) {
+            return -1;
+        }
+
+        chunk->length = (size_t)(scan_offset(s) - chunk->offset);
+        chunk->x = (int)values[0];
+        chunk->y = (int)values[1];
+        chunk->width = (int)values[2];
+        chunk->height = (int)values[3];
+
+        if (chunk->width > layer->max_chunk_width) {
+            layer->max_chunk_width = chunk->width;
+        }
+
+        if (chunk->height > layer->max_chunk_height) {
+            layer->max_chunk_height = chunk->height;
+        }
+
+        layer->chunk_count++;
+    }
+
+    return more;
+}
+
+static int scan_chunks(scanner* s, tmj_chunk_layer* layer) {
+    size_t cap = 0;
+    int more = scan_chunk_list(s, layer, &cap);
+
+    layer->chunks = array_trim(layer->chunks, cap, layer->chunk_count, sizeof(tmj_chunk_span));
+
+    if (layer->chunks == NULL && layer->chunk_count > 0) {
+        layer->chunk_count = 0;
+
+        return more == -1 ? -1 : scan_error(s, "the system is out of memory");
+    }
+
+    return more;
+}
+
+static int chunk_compare(const void* a, const void* b) {
+    const tmj_chunk_span* ca = a;
+    const tmj_chunk_span* cb = b;
+
+    if (ca->y != cb->y) {
+        return ca->y < cb->y ? -1 : 1;
+    }
+
+    return ca->x < cb->x ? -1 : ca->x > cb->x;
+}
+
+static int scan_layers(scanner* s, tmj_chunk_index* index, size_t* cap);
+
+static int scan_layer(scanner* s, tmj_chunk_index* index, size_t* cap) {
+    tmj_chunk_layer layer = {0};
+    bool first = true;
+    int key;
+
+    while ((key = scan_key(s, &first)) == 1) {
+        int unpk = 0;
+
+        if (strcmp(s->str, "id") == 0) {
+            long long id = 0;
+
+            unpk = scan_int(s, &id);
+            layer.id = (int)id;
+        } else if (strcmp(s->str, "name") == 0) {
+            unpk = scan_kept_string(s, &layer.name);
+        } else if (strcmp(s->str, "type") == 0) {
+            unpk = scan_kept_string(s, &layer.type);
+        } else if (strcmp(s->str, "encoding") == 0) {
+            unpk = scan_kept_string(s, &layer.encoding);
+        } else if (strcmp(s->str, "compression") == 0) {
+            unpk = scan_kept_string(s, &layer.compression);
+        } else if (strcmp(s->str, "chunks") == 0) {
+            unpk = scan_chunks(s, &layer);
+        } else if (strcmp(s->str, "layers") == 0) {
+            unpk = scan_layers(s, index, cap);
+        } else {
+            unpk = scan_skip(s);
+        }
+
+        if (unpk == -1) {
+            chunk_layer_clear(&layer);
+
+            return -1;
+        }
+    }
+
+    // Only tile layers are indexed, the layers of groups were added as they were found
+    if (key == -1 || layer.type == NULL || strcmp(layer.type, "tilelayer") != 0) {
+        chunk_layer_clear(&layer);
+
+        return key;
+    }
+
+    if (layer.encoding == NULL) {
+        layer.encoding = stats_malloc(sizeof("csv"));
+
+        if (layer.encoding == NULL) {
+            chunk_layer_clear(&layer);
+
+            return scan_error(s, "the system is out of memory");
+        }
+
+        memcpy(layer.encoding, "csv", sizeof("csv"));
+    }
+
+    if (layer.chunk_count > 0) {
+        qsort(layer.chunks, layer.chunk_count, sizeof(tmj_chunk_span), chunk_compare);
+    }
+
+    if (index->layer_count == *cap) {
+        size_t new_cap = *cap ? *cap * 2 : 8;
+        tmj_chunk_layer* layers = stats_realloc(index->layers, *cap * sizeof(tmj_chunk_layer), new_cap * sizeof(tmj_chunk_layer));
+
+        if (layers == NULL) {
+            chunk_layer_clear(&layer);
+
+            return scan_error(s, "the system is out of memory");
+        }
+
+        index->layers = layers;
+        *cap = new_cap;
+    }
+
+    index->layers[index->layer_count++] = layer;
+
+    return 0;
+}
+
+static int scan_layers(scanner* s, tmj_chunk_index* index, size_t* cap) {
+    bool first = true;
+    int more;
+
+    while ((more = scan_element(s, &first)) == 1) {
+        if (scan_layer(s, index, cap) == -1) {
+            return -1;
+        }
+    }
+
+    return more;
+}
+
+tmj_chunk_index* tmj_chunk_index_build(const char* path) {
+    logmsg(TMJ_LOG_DEBUG, "Indexing chunks of map file '%s'", path);
+
+    FILE* file = fopen(path, "rb");
+
+    if (file == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to index map '%s', the file could not be opened", path);
+
+        return NULL;
+    }
+
+    scanner* s = calloc(1, sizeof(scanner));
+    tmj_chunk_index* index = stats_calloc(1, sizeof(tmj_chunk_index));
+    char* path_copy = stats_malloc(strlen(path) + 1);
+
+    if (s == NULL || index == NULL || path_copy == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to index map '%s', the system is out of memory", path);
+
+        goto fail_alloc;
+    }
+
+    memcpy(path_copy, path, strlen(path) + 1);
+
+    index->path = path_copy;
+
+    s->file = file;
+    s->path = path;
+
+    uint64_t start = stats_phase_begin();
+
+    size_t cap = 0;
+    bool first = true;
+    bool infinite = false;
+    int key;
+
+    while ((key = scan_key(s, &first)) == 1) {
+        int unpk = 0;
+
+        if (strcmp(s->str, "layers") == 0) {
+            unpk = scan_layers(s, index, &cap);
+        } else if (strcmp(s->str, "infinite") == 0) {
+            infinite = scan_peek(s) == 't';
+            unpk = scan_skip(s);
+        } else {
+            unpk = scan_skip(s);
+        }
+
+        if (unpk == -1) {
+            key = -1;
+
+            break;
+        }
+    }
+
+    stats_phase_end(STATS_PHASE_UNPACK, start, 0);
+
+    index->layers = array_trim(index->layers, cap, index->layer_count, sizeof(tmj_chunk_layer));
+
+    if (index->layers == NULL && index->layer_count > 0) {
+        logmsg(TMJ_LOG_ERR, "Unable to index map '%s', the system is out of memory", path);
+
+        index->layer_count = 0;
+        key = -1;
+    }
+
+    if (key == -1) {
+        goto fail_index;
+    }
+
+    if (!infinite) {
+        logmsg(TMJ_LOG_ERR, "Unable to index map '%s', only infinite maps are made of chunks", path);
+
+        goto fail_index;
+    }
+
+    free(s->str);
+    free(s);
+    fclose(file);
+
+    return index;
+
+fail_index:
+    tmj_chunk_index_free(index);
+    index = NULL;
+    path_copy = NULL;
+
+fail_alloc:
+    if (s != NULL) {
+        free(s->str);
+    }
+
+    free(s);
+    stats_free(index, sizeof(tmj_chunk_index));
+    kept_string_free(path_copy);
+    fclose(file);
+
+    return NULL;
+}
+
+void tmj_chunk_index_free(tmj_chunk_index* index) {
+    if (index == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < index->layer_count; i++) {
+        chunk_layer_clear(&index->layers[i]);
+    }
+
+    stats_free(index->layers, index->layer_count * sizeof(tmj_chunk_layer));
+    kept_string_free(index->path);
+    stats_free(index, sizeof(tmj_chunk_index));
+}
+
+static bool chunk_intersects(const tmj_chunk_span* chunk, int x, int y, int width, int height) {
+    return chunk->x < x + width && chunk->x + chunk->width > x && chunk->y < y + height && chunk->y + chunk->height > y;
+}
+
+/**
+ * Finds the first chunk, in (y, x) order, that is not before (x, y).
+ */
+static size_t chunk_lower_bound(const tmj_chunk_layer* layer, size_t lo, size_t hi, int x, int y) {
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const tmj_chunk_span* c = &layer->chunks[mid];
+
+        if (c->y < y || (c->y == y && c->x < x)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/**
+ * Reads and decodes one chunk from the map file.
+ */
+static uint32_t* chunk_read(FILE* file, const tmj_chunk_index* index, const tmj_chunk_layer* layer, const tmj_chunk_span* span) {
+    char* buf = stats_malloc(span->length);
+
+    if (buf == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to read chunk (%d, %d) of layer[%d], the system is out of memory", span->x, span->y, layer->id);
+
+        return NULL;
+    }
+
+    uint64_t start = stats_phase_begin();
+
+    bool read = file_seek(file, span->offset) == 0 && fread(buf, 1, span->length, file) == span->length;
+
+    stats_phase_end(STATS_PHASE_IO, start, read ? span->length : 0);
+
+    if (!read) {
+        logmsg(TMJ_LOG_ERR, "Unable to read chunk (%d, %d) of layer[%d] from '%s'", span->x, span->y, layer->id, index->path);
+
+        stats_free(buf, span->length);
+
+        return NULL;
+    }
+
+    json_error_t error;
+
+    start = stats_phase_begin();
+
+    json_t* root = json_loadb(buf, span->length, 0, &error);
+
+    stats_phase_end(STATS_PHASE_PARSE, start, 0);
+    stats_free(buf, span->length);
+
+    if (root == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to parse chunk (%d, %d) of layer[%d], %s", span->x, span->y, layer->id, error.text);
+
+        return NULL;
+    }
+
+    size_t count = (size_t)span->width * span->height;
+    uint32_t* tiles = NULL;
+    json_t* data = json_object_get(root, "data");
+
+    if (json_is_string(data)) {
+        size_t size = 0;
+
+        tiles = tmj_decode_layer(json_string_value(data), layer->encoding, layer->compression ? layer->compression : "", &size);
+
+        if (tiles != NULL && size != count) {
+            logmsg(TMJ_LOG_ERR, "Chunk (%d, %d) of layer[%d] decoded to %zu tiles, expected %zu", span->x, span->y, layer->id, size, count);
+
+            stats_free(tiles, size * sizeof(uint32_t));
+            tiles = NULL;
+        }
+    } else if (json_is_array(data) && json_array_size(data) == count) {
+        tiles = stats_malloc(count * sizeof(uint32_t));
+
+        for (size_t i = 0; tiles != NULL && i < count; i++) {
+            tiles[i] = (uint32_t)json_integer_value(json_array_get(data, i));
+        }
+    } else {
+        logmsg(TMJ_LOG_ERR, "Chunk (%d, %d) of layer[%d] has no data of the expected size", span->x, span->y, layer->id);
+    }
+
+    json_decref(root);
+
+    return tiles;
+}
+
+/**
+ * Finds the first resident chunk of a region, in (y, x) order, that is not
+ * before (x, y).
+ */
+static size_t region_lower_bound(const tmj_region* region, size_t lo, size_t hi, int x, int y) {
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const tmj_region_chunk* chunk = &region->chunks[mid];
+
+        if (chunk->y < y || (chunk->y == y && chunk->x < x)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static void region_chunks_free(tmj_region_chunk* chunks, size_t chunk_count) {
+    for (size_t c = 0; c < chunk_count; c++) {
+        stats_free(chunks[c].data, (size_t)chunks[c].width * chunks[c].height * sizeof(uint32_t));
+    }
+
+    stats_free(chunks, (chunk_count ? chunk_count : 1) * sizeof(tmj_region_chunk));
+}
+
+tmj_region* tmj_region_load(const tmj_chunk_index* index, size_t layer, int x, int y, int width, int height) {
+    if (layer >= index->layer_count) {
+        logmsg(TMJ_LOG_ERR, "Unable to load region, layer %zu is out of range, the index has %zu tile layers", layer, index->layer_count);
+
+        return NULL;
+    }
+
+    tmj_region* region = stats_calloc(1, sizeof(tmj_region));
+
+    if (region == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to load region, the system is out of memory");
+
+        return NULL;
+    }
+
+    region->index = index;
+    region->layer = layer;
+
+    if (tmj_region_move(region, x, y, width, height) == -1) {
+        tmj_region_free(region);
+
+        return NULL;
+    }
+
+    return region;
+}
+
+int tmj_region_move(tmj_region* region, int x, int y, int width, int height) {
+    const tmj_chunk_layer* layer = &region->index->layers[region->layer];
+
+    // First pass counts the chunks in range, second pass fills them in
+    tmj_region_chunk* chunks = NULL;
+    size_t chunk_count = 0;
+
+    for (int pass = 0; pass < 2; pass++) {
+        size_t n = 0;
+        size_t i = chunk_lower_bound(layer, 0, layer->chunk_count, INT32_MIN, y - layer->max_chunk_height + 1);
+
+        while (i < layer->chunk_count && layer->chunks[i].y < y + height) {
+            int row = layer->chunks[i].y;
+            size_t row_end = chunk_lower_bound(layer, i, layer->chunk_count, INT32_MIN, row + 1);
+
+            for (size_t c = chunk_lower_bound(layer, i, row_end, x - layer->max_chunk_width + 1, row); c < row_end && layer->chunks[c].x < x + width; c++) {
+                if (chunk_intersects(&layer->chunks[c], x, y, width, height)) {
+                    if (pass == 1) {
+                        chunks[n].span = c;
+                    }
+
+                    n++;
+                }
+            }
+
+            i = row_end;
+        }
+
+        if (pass == 0) {
+            chunk_count = n;
+            chunks = stats_calloc(chunk_count ? chunk_count : 1, sizeof(tmj_region_chunk));
+
+            if (chunks == NULL) {
+                logmsg(TMJ_LOG_ERR, "Unable to move region, the system is out of memory");
+
+                return -1;
+            }
+        }
+    }
+
+    // Keep the chunks that are still in range, both lists are in (y, x) order
+    size_t old = 0;
+
+    for (size_t c = 0; c < chunk_count; c++) {
+        while (old < region->chunk_count && region->chunks[old].span < chunks[c].span) {
+            old++;
+        }
+
+        if (old < region->chunk_count && region->chunks[old].span == chunks[c].span) {
+            chunks[c].data = region->chunks[old].data;
+            region->chunks[old].data = NULL;
+        }
+    }
+
+    FILE* file = NULL;
+
+    for (size_t c = 0; c < chunk_count; c++) {
+        const tmj_chunk_span* span = &layer->chunks[chunks[c].span];
+
+        chunks[c].x = span->x;
+        chunks[c].y = span->y;
+        chunks[c].width = span->width;
+        chunks[c].height = span->height;
+
+        if (chunks[c].data != NULL) {
+            continue;
+        }
+
+        if (file == NULL && (file = fopen(region->index->path, "rb")) == NULL) {
+            logmsg(TMJ_LOG_ERR, "Unable to move region, '%s' could not be opened", region->index->path);
+
+            goto fail_chunks;
+        }
+
+        chunks[c].data = chunk_read(file, region->index, layer, span);
+
+        if (chunks[c].data == NULL) {
+            goto fail_chunks;
+        }
+    }
+
+    if (file != NULL) {
+        fclose(file);
+    }
+
+    // Release the chunks that went out of range
+    region_chunks_free(region->chunks, region->chunk_count);
+
+    region->chunks = chunks;
+    region->chunk_count = chunk_count;
+    region->x = x;
+    region->y = y;
+    region->width = width;
+    region->height = height;
+
+    return 0;
+
+fail_chunks:
+    if (file != NULL) {
+        fclose(file);
+    }
+
+    // Hand the kept chunks back, so the region is left as it was
+    old = 0;
+
+    for (size_t c = 0; c < chunk_count; c++) {
+        while (old < region->chunk_count && region->chunks[old].span < chunks[c].span) {
+            old++;
+        }
+
+        if (old < region->chunk_count && region->chunks[old].span == chunks[c].span) {
+            region->chunks[old].data = chunks[c].data;
+            chunks[c].data = NULL;
+        }
+    }
+
+    region_chunks_free(chunks, chunk_count);
+
+    return -1;
+}
+
+uint32_t tmj_region_tile(const tmj_region* region, int x, int y) {
+    const tmj_chunk_layer* layer = &region->index->layers[region->layer];
+
+    // Same walk as tmj_region_move(), over the resident chunks
+    size_t i = region_lower_bound(region, 0, region->chunk_count, INT32_MIN, y - layer->max_chunk_height + 1);
+
+    while (i < region->chunk_count && region->chunks[i].y <= y) {
+        int row = region->chunks[i].y;
+        size_t row_end = region_lower_bound(region, i, region->chunk_count, INT32_MIN, row + 1);
+
+        for (size_t c = region_lower_bound(region, i, row_end, x - layer->max_chunk_width + 1, row); c < row_end && region->chunks[c].x <= x; c++) {
+            const tmj_region_chunk* chunk = &region->chunks[c];
+
+            if (x < chunk->x + chunk->width && y < chunk->y + chunk->height) {
+                return chunk->data[(size_t)(y - chunk->y) * chunk->width + (x - chunk->x)];
+            }
+        }
+
+        i = row_end;
+    }
+
+    return 0;
+}
+
+void tmj_region_free(tmj_region* region) {
+    if (region == NULL) {
+        return;
+    }
+
+    region_chunks_free(region->chunks, region->chunk_count);
+    stats_free(region, sizeof(tmj_region));
+}
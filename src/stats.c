@@ -0,0 +1,148 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "stats.h"
+#include "util.h"
+
+/**
+ * @file
+ */
+
+TMJ_THREAD_LOCAL tmj_load_stats* stats_attached = NULL;
+
+tmj_load_stats* tmj_load_stats_attach(tmj_load_stats* stats) {
+    tmj_load_stats* prev = stats_attached;
+
+    stats_attached = stats;
+
+    return prev;
+}
+
+tmj_load_stats* stats_current(void) {
+    return stats_attached;
+}
+
+uint64_t stats_phase_begin(void) {
+    if (stats_attached == NULL) {
+        return 0;
+    }
+
+    return time_now_ns();
+}
+
+void stats_phase_end(stats_phase phase, uint64_t start, size_t bytes) {
+    tmj_load_stats* stats = stats_attached;
+
+    if (stats == NULL || start == 0) {
+        return;
+    }
+
+    uint64_t elapsed = time_now_ns() - start;
+
+    switch (phase) {
+        case STATS_PHASE_IO:
+            stats->io_ns += elapsed;
+            stats->bytes_read += bytes;
+            break;
+
+        case STATS_PHASE_PARSE:
+            stats->parse_ns += elapsed;
+            break;
+
+        case STATS_PHASE_UNPACK:
+            stats->unpack_ns += elapsed;
+            break;
+
+        case STATS_PHASE_B64:
+            stats->b64_ns += elapsed;
+            stats->bytes_b64 += bytes;
+            break;
+
+        case STATS_PHASE_ZLIB:
+            stats->zlib_ns += elapsed;
+            stats->bytes_zlib += bytes;
+            break;
+
+        case STATS_PHASE_ZSTD:
+            stats->zstd_ns += elapsed;
+            stats->bytes_zstd += bytes;
+            break;
+    }
+}
+
+void stats_count_load(bool tileset) {
+    if (stats_attached == NULL) {
+        return;
+    }
+
+    if (tileset) {
+        stats_attached->tilesets_loaded++;
+    } else {
+        stats_attached->maps_loaded++;
+    }
+}
+
+static void stats_grow(size_t size) {
+    tmj_load_stats* stats = stats_attached;
+
+    if (stats == NULL) {
+        return;
+    }
+
+    stats->alloc_count++;
+    stats->alloc_bytes += size;
+    stats->live_bytes += size;
+
+    if (stats->live_bytes > stats->peak_bytes) {
+        stats->peak_bytes = stats->live_bytes;
+    }
+}
+
+static void stats_shrink(size_t size) {
+    tmj_load_stats* stats = stats_attached;
+
+    if (stats == NULL) {
+        return;
+    }
+
+    stats->live_bytes = stats->live_bytes > size ? stats->live_bytes - size : 0;
+}
+
+void* stats_calloc(size_t count, size_t size) {
+    void* ret = calloc(count, size);
+
+    if (ret != NULL) {
+        stats_grow(count * size);
+    }
+
+    return ret;
+}
+
+void* stats_malloc(size_t size) {
+    void* ret = malloc(size);
+
+    if (ret != NULL) {
+        stats_grow(size);
+    }
+
+    return ret;
+}
+
+void* stats_realloc(void* ptr, size_t old_size, size_t new_size) {
+    void* ret = realloc(ptr, new_size);
+
+    if (ret != NULL) {
+        stats_shrink(old_size);
+        stats_grow(new_size);
+    }
+
+    return ret;
+}
+
+void stats_free(void* ptr, size_t size) {
+    if (ptr != NULL) {
+        stats_shrink(size);
+    }
+
+    free(ptr);
+}
@@ -0,0 +1,93 @@
+#ifndef LIBTMJ_STATS
+#define LIBTMJ_STATS
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../include/tmj.h"
+
+/**
+ * @file
+ *
+ * @defgroup stats Stats
+ *
+ * Private API for filling in the tmj_load_stats attached to the calling
+ * thread. Every function here is a no-op when no stats are attached.
+ */
+
+/**
+ * @ingroup stats
+ * The phases tracked by tmj_load_stats.
+ */
+typedef enum STATS_PHASE {
+    STATS_PHASE_IO,
+    STATS_PHASE_PARSE,
+    STATS_PHASE_UNPACK,
+    STATS_PHASE_B64,
+    STATS_PHASE_ZLIB,
+    STATS_PHASE_ZSTD
+} stats_phase;
+
+/**
+ * @ingroup stats
+ * Returns the stats attached to the calling thread, or NULL.
+ */
+tmj_load_stats* stats_current(void);
+
+/**
+ * @ingroup stats
+ * Marks the start of a timed phase.
+ *
+ * @return A timestamp to hand to stats_phase_end(), or 0 if no stats are
+ * attached (in which case the clock is not read).
+ */
+uint64_t stats_phase_begin(void);
+
+/**
+ * @ingroup stats
+ * Marks the end of a timed phase, adding its duration and output size to the
+ * attached stats.
+ *
+ * @param phase The phase being timed.
+ * @param start The value returned by the matching stats_phase_begin().
+ * @param bytes The number of bytes read (for STATS_PHASE_IO) or produced (for
+ * the decoding phases) during the phase. Ignored for the other phases.
+ */
+void stats_phase_end(stats_phase phase, uint64_t start, size_t bytes);
+
+/**
+ * @ingroup stats
+ * Counts a successfully loaded map or tileset.
+ */
+void stats_count_load(bool tileset);
+
+/**
+ * @ingroup stats
+ * calloc(), recording the allocation in the attached stats.
+ */
+void* stats_calloc(size_t count, size_t size);
+
+/**
+ * @ingroup stats
+ * malloc(), recording the allocation in the attached stats.
+ */
+void* stats_malloc(size_t size);
+
+/**
+ * @ingroup stats
+ * realloc(), recording the change in size in the attached stats.
+ *
+ * @param ptr The buffer to resize.
+ * @param old_size The current size of the buffer.
+ * @param new_size The desired size of the buffer.
+ */
+void* stats_realloc(void* ptr, size_t old_size, size_t new_size);
+
+/**
+ * @ingroup stats
+ * free(), for buffers of known size that do not outlive the call that
+ * allocated them. Releases the bytes from the attached stats' live total.
+ */
+void stats_free(void* ptr, size_t size);
+
+#endif
@@ -0,0 +1,708 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "stats.h"
+#include "tmj.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TILES_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define TILES_NEON
+#include <arm_neon.h>
+#endif
+
+/**
+ * @file
+ *
+ * Compact tile storage.
+ *
+ * A tmj_tiles is a single allocation: the structure itself, followed by the
+ * row offsets and runs of sparse tiles, followed by the stored tile IDs,
+ * followed by the flag bitplanes, if any.
+ */
+
+static const uint32_t flag_bits[TMJ_TILE_FLAG_PLANES] = {
+        TMJ_FLIPPED_HORIZONTALLY,
+        TMJ_FLIPPED_VERTICALLY,
+        TMJ_FLIPPED_DIAGONALLY,
+        TMJ_ROTATED_HEXAGONAL_120,
+};
+
+/**
+ * Finds the narrowest ID width that fits the given tiles, and whether any of
+ * them is flagged.
+ */
+static void tiles_scan(const uint32_t* gids, size_t count, uint32_t* max_id, uint32_t* any_flags) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t id = gids[i] & TMJ_GID_MASK;
+
+        *max_id = id > *max_id ? id : *max_id;
+        *any_flags |= gids[i];
+    }
+}
+
+static uint8_t id_width(uint32_t max_id) {
+    return max_id <= UINT8_MAX ? 1 : max_id <= UINT16_MAX ? 2 : 4;
+}
+
+/**
+ * Stores count tiles as stored tiles at through at + count - 1. The flag
+ * planes must have been zeroed.
+ */
+static void tiles_store(tmj_tiles* tiles, size_t at, const uint32_t* gids, size_t count) {
+    switch (tiles->id_bytes) {
+        case 1: {
+            uint8_t* ids = (uint8_t*)tiles->ids + at;
+
+            for (size_t i = 0; i < count; i++) {
+                ids[i] = (uint8_t)(gids[i] & TMJ_GID_MASK);
+            }
+        } break;
+        case 2: {
+            uint16_t* ids = (uint16_t*)tiles->ids + at;
+
+            for (size_t i = 0; i < count; i++) {
+                ids[i] = (uint16_t)(gids[i] & TMJ_GID_MASK);
+            }
+        } break;
+        default: {
+            uint32_t* ids = (uint32_t*)tiles->ids + at;
+
+            for (size_t i = 0; i < count; i++) {
+                ids[i] = gids[i] & TMJ_GID_MASK;
+            }
+        } break;
+    }
+
+    if (tiles->flags == NULL) {
+        return;
+    }
+
+    uint8_t* flags = (uint8_t*)tiles->flags;
+    size_t plane_size = (tiles->stored + 7) / 8;
+
+    for (size_t i = 0; i < count; i++) {
+        if ((gids[i] & ~TMJ_GID_MASK) == 0) {
+            continue;
+        }
+
+        size_t t = at + i;
+
+        for (size_t p = 0; p < TMJ_TILE_FLAG_PLANES; p++) {
+            if (gids[i] & flag_bits[p]) {
+                flags[p * plane_size + t / 8] |= (uint8_t)(1u << (t % 8));
+            }
+        }
+    }
+}
+
+/**
+ * Lays out the IDs and flag planes of stored tiles at the end of a tiles
+ * allocation, starting at offset bytes in.
+ */
+static void tiles_layout(tmj_tiles* tiles, size_t offset, uint32_t max_id, uint32_t any_flags) {
+    tiles->id_bytes = id_width(max_id);
+
+    size_t ids_size = tiles->stored * tiles->id_bytes;
+    size_t flags_size = (any_flags & ~TMJ_GID_MASK) ? (tiles->stored + 7) / 8 * TMJ_TILE_FLAG_PLANES : 0;
+
+    // Offsets up to here are multiples of four, which keeps the IDs aligned
+    tiles->ids = (uint8_t*)tiles + offset;
+    tiles->flags = flags_size ? (uint8_t*)tiles + offset + ids_size : NULL;
+
+    if (tiles->flags != NULL) {
+        memset((uint8_t*)tiles->flags, 0, flags_size);
+    }
+}
+
+static size_t tiles_stored_size(size_t stored, uint32_t max_id, uint32_t any_flags) {
+    return stored * id_width(max_id) + ((any_flags & ~TMJ_GID_MASK) ? (stored + 7) / 8 * TMJ_TILE_FLAG_PLANES : 0);
+}
+
+tmj_tiles* tmj_tiles_compact(const uint32_t* gids, size_t count) {
+    uint32_t max_id = 0;
+    uint32_t any_flags = 0;
+
+    tiles_scan(gids, count, &max_id, &any_flags);
+
+    size_t size = sizeof(tmj_tiles) + tiles_stored_size(count, max_id, any_flags);
+
+    tmj_tiles* tiles = stats_malloc(size);
+
+    if (tiles == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to pack %zu tiles, the system is out of memory", count);
+
+        return NULL;
+    }
+
+    memset(tiles, 0, sizeof(tmj_tiles));
+
+    tiles->size = size;
+    tiles->count = count;
+    tiles->stored = count;
+
+    tiles_layout(tiles, sizeof(tmj_tiles), max_id, any_flags);
+    tiles_store(tiles, 0, gids, count);
+
+    return tiles;
+}
+
+tmj_tiles* tmj_tiles_sparse(const uint32_t* gids, int width, int height) {
+    if (width < 0 || height < 0) {
+        logmsg(TMJ_LOG_ERR, "Unable to pack %dx%d tiles, the dimensions must not be negative", width, height);
+
+        return NULL;
+    }
+
+    size_t count = (size_t)width * height;
+    size_t run_count = 0;
+    size_t stored = 0;
+    uint32_t max_id = 0;
+    uint32_t any_flags = 0;
+
+    // First pass, size the runs and the stored tiles
+    for (size_t i = 0; i < count; i++) {
+        if (gids[i] == 0) {
+            continue;
+        }
+
+        if (i % width == 0 || gids[i - 1] == 0) {
+            run_count++;
+        }
+
+        stored++;
+
+        uint32_t id = gids[i] & TMJ_GID_MASK;
+
+        max_id = id > max_id ? id : max_id;
+        any_flags |= gids[i];
+    }
+
+    if (stored > UINT32_MAX) {
+        logmsg(TMJ_LOG_ERR, "Unable to pack %zu tiles sparsely, too many are non-empty", count);
+
+        return NULL;
+    }
+
+    size_t offset = sizeof(tmj_tiles) + ((size_t)height + 1) * sizeof(uint32_t) + run_count * sizeof(tmj_tile_run);
+    size_t size = offset + tiles_stored_size(stored, max_id, any_flags);
+
+    tmj_tiles* tiles = stats_malloc(size);
+
+    if (tiles == NULL) {
+        logmsg(TMJ_LOG_ERR, "Unable to pack %zu tiles, the system is out of memory", count);
+
+        return NULL;
+    }
+
+    memset(tiles, 0, sizeof(tmj_tiles));
+
+    uint32_t* rows = (uint32_t*)(tiles + 1);
+    tmj_tile_run* runs = (tmj_tile_run*)(rows + height + 1);
+
+    tiles->size = size;
+    tiles->count = count;
+    tiles->stored = stored;
+    tiles->width = width;
+    tiles->height = height;
+    tiles->rows = rows;
+    tiles->runs = runs;
+
+    tiles_layout(tiles, offset, max_id, any_flags);
+
+    // Second pass, fill in the runs and store their tiles
+    uint32_t run = 0;
+    uint32_t first = 0;
+
+    for (int y = 0; y < height; y++) {
+        const uint32_t* row = gids + (size_t)y * width;
+
+        rows[y] = run;
+
+        for (int x = 0; x < width;) {
+            if (row[x] == 0) {
+                x++;
+
+                continue;
+            }
+
+            int start = x;
+
+            while (x < width && row[x] != 0) {
+                x++;
+            }
+
+            runs[run] = (tmj_tile_run){(uint32_t)start, (uint32_t)(x - start), first};
+
+            tiles_store(tiles, first, row + start, (size_t)(x - start));
+
+            first += (uint32_t)(x - start);
+            run++;
+        }
+    }
+
+    rows[height] = run;
+
+    return tiles;
+}
+
+void tmj_tiles_free(tmj_tiles* tiles) {
+    free(tiles);
+}
+
+static uint32_t stored_get(const tmj_tiles* tiles, size_t index) {
+    uint32_t gid;
+
+    switch (tiles->id_bytes) {
+        case 1:
+            gid = ((const uint8_t*)tiles->ids)[index];
+            break;
+        case 2:
+            gid = ((const uint16_t*)tiles->ids)[index];
+            break;
+        default:
+            gid = ((const uint32_t*)tiles->ids)[index];
+            break;
+    }
+
+    if (tiles->flags != NULL) {
+        size_t plane_size = (tiles->stored + 7) / 8;
+
+        for (size_t p = 0; p < TMJ_TILE_FLAG_PLANES; p++) {
+            if (tiles->flags[p * plane_size + index / 8] & (1u << (index % 8))) {
+                gid |= flag_bits[p];
+            }
+        }
+    }
+
+    return gid;
+}
+
+static void stored_read(const tmj_tiles* tiles, size_t start, size_t count, uint32_t* gids) {
+    // Widen the IDs first, with the width switch hoisted out of the loop
+    switch (tiles->id_bytes) {
+        case 1: {
+            const uint8_t* ids = (const uint8_t*)tiles->ids + start;
+
+            for (size_t i = 0; i < count; i++) {
+                gids[i] = ids[i];
+            }
+        } break;
+        case 2: {
+            const uint16_t* ids = (const uint16_t*)tiles->ids + start;
+
+            for (size_t i = 0; i < count; i++) {
+                gids[i] = ids[i];
+            }
+        } break;
+        default:
+            memcpy(gids, (const uint32_t*)tiles->ids + start, count * sizeof(uint32_t));
+            break;
+    }
+
+    if (tiles->flags == NULL) {
+        return;
+    }
+
+    // Then merge in one plane at a time, skipping bytes with no flags set
+    size_t plane_size = (tiles->stored + 7) / 8;
+
+    for (size_t p = 0; p < TMJ_TILE_FLAG_PLANES; p++) {
+        const uint8_t* plane = tiles->flags + p * plane_size;
+
+        for (size_t i = 0; i < count;) {
+            size_t t = start + i;
+            uint8_t bits = plane[t / 8] >> (t % 8);
+
+            if (bits == 0) {
+                i += 8 - t % 8;
+
+                continue;
+            }
+
+            if (bits & 1) {
+                gids[i] |= flag_bits[p];
+            }
+
+            i++;
+        }
+    }
+}
+
+/**
+ * Finds the first run of row y of sparse tiles that ends past column x.
+ */
+static uint32_t run_search(const tmj_tiles* tiles, int y, uint32_t x) {
+    uint32_t low = tiles->rows[y];
+    uint32_t high = tiles->rows[y + 1];
+
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+
+        if (tiles->runs[mid].x + tiles->runs[mid].length <= x) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+uint32_t tmj_tiles_get(const tmj_tiles* tiles, size_t index) {
+    if (tiles->rows == NULL) {
+        return stored_get(tiles, index);
+    }
+
+    int y = (int)(index / tiles->width);
+    uint32_t x = (uint32_t)(index % tiles->width);
+    uint32_t run = run_search(tiles, y, x);
+
+    if (run == tiles->rows[y + 1] || tiles->runs[run].x > x) {
+        return 0;
+    }
+
+    return stored_get(tiles, tiles->runs[run].first + (x - tiles->runs[run].x));
+}
+
+void tmj_tiles_read(const tmj_tiles* tiles, size_t start, size_t count, uint32_t* gids) {
+    if (tiles->rows == NULL) {
+        stored_read(tiles, start, count, gids);
+
+        return;
+    }
+
+    memset(gids, 0, count * sizeof(uint32_t));
+
+    size_t end = start + count;
+
+    for (size_t row_start = start - start % tiles->width; row_start < end; row_start += tiles->width) {
+        int y = (int)(row_start / tiles->width);
+
+        // The part of the row that was asked for
+        uint32_t x0 = (uint32_t)(row_start < start ? start - row_start : 0);
+        uint32_t x1 = (uint32_t)(end - row_start < (size_t)tiles->width ? end - row_start : (size_t)tiles->width);
+
+        for (uint32_t run = run_search(tiles, y, x0); run < tiles->rows[y + 1] && tiles->runs[run].x < x1; run++) {
+            const tmj_tile_run* r = &tiles->runs[run];
+
+            uint32_t from = r->x > x0 ? r->x : x0;
+            uint32_t to = r->x + r->length < x1 ? r->x + r->length : x1;
+
+            stored_read(tiles, r->first + (from - r->x), to - from, gids + (row_start + from - start));
+        }
+    }
+}
+
+static void gids_split_scalar(const uint32_t* gids, size_t count, uint32_t* ids, uint8_t* flags) {
+    if (ids != NULL) {
+        for (size_t i = 0; i < count; i++) {
+            ids[i] = gids[i] & TMJ_GID_MASK;
+        }
+    }
+
+    if (flags != NULL) {
+        for (size_t i = 0; i < count; i++) {
+            flags[i] = (uint8_t)(gids[i] >> TMJ_GID_FLAGS_SHIFT);
+        }
+    }
+}
+
+void tmj_gids_split(const uint32_t* gids, size_t count, uint32_t* ids, uint8_t* flags) {
+    size_t i = 0;
+
+    // Sixteen tiles at a time, which fills a vector of flag bytes
+#if defined(TILES_SSE2)
+    const __m128i mask = _mm_set1_epi32((int)TMJ_GID_MASK);
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i v[4];
+
+        for (int j = 0; j < 4; j++) {
+            v[j] = _mm_loadu_si128((const __m128i*)(gids + i + 4 * j));
+        }
+
+        if (ids != NULL) {
+            for (int j = 0; j < 4; j++) {
+                _mm_storeu_si128((__m128i*)(ids + i + 4 * j), _mm_and_si128(v[j], mask));
+            }
+        }
+
+        if (flags != NULL) {
+            // The flags fit in a byte once shifted down, so narrowing with saturation loses nothing
+            __m128i low = _mm_packs_epi32(_mm_srli_epi32(v[0], TMJ_GID_FLAGS_SHIFT), _mm_srli_epi32(v[1], TMJ_GID_FLAGS_SHIFT));
+            __m128i high = _mm_packs_epi32(_mm_srli_epi32(v[2], TMJ_GID_FLAGS_SHIFT), _mm_srli_epi32(v[3], TMJ_GID_FLAGS_SHIFT));
+
+            _mm_storeu_si128((__m128i*)(flags + i), _mm_packus_epi16(low, high));
+        }
+    }
+#elif defined(TILES_NEON)
+    const uint32x4_t mask = vdupq_n_u32(TMJ_GID_MASK);
+
+    for (; i + 16 <= count; i += 16) {
+        uint32x4_t v[4];
+
+        for (int j = 0; j < 4; j++) {
+            v[j] = vld1q_u32(gids + i + 4 * j);
+        }
+
+        if (ids != NULL) {
+            for (int j = 0; j < 4; j++) {
+                vst1q_u32(ids + i + 4 * j, vandq_u32(v[j], mask));
+            }
+        }
+
+        if (flags != NULL) {
+            uint16x8_t low = vcombine_u16(vmovn_u32(vshrq_n_u32(v[0], TMJ_GID_FLAGS_SHIFT)), vmovn_u32(vshrq_n_u32(v[1], TMJ_GID_FLAGS_SHIFT)));
+            uint16x8_t high = vcombine_u16(vmovn_u32(vshrq_n_u32(v[2], TMJ_GID_FLAGS_SHIFT)), vmovn_u32(vshrq_n_u32(v[3], TMJ_GID_FLAGS_SHIFT)));
+
+            vst1q_u8(flags + i, vcombine_u8(vmovn_u16(low), vmovn_u16(high)));
+        }
+    }
+#endif
+
+    gids_split_scalar(gids + i, count - i, ids != NULL ? ids + i : NULL, flags != NULL ? flags + i : NULL);
+}
+
+uint32_t tmj_layer_tile(const Layer* layer, int x, int y) {
+    if (layer->data_is_str || x < 0 || y < 0 || x >= layer->width || y >= layer->height) {
+        return 0;
+    }
+
+    size_t index = (size_t)y * layer->width + x;
+
+    // Short CSV data is only read as far as it goes
+    if (layer->data_compact != NULL) {
+        return index < layer->data_compact->count ? tmj_tiles_get(layer->data_compact, index) : 0;
+    }
+
+    return layer->data_uint != NULL && index < layer->data_count ? layer->data_uint[index] : 0;
+}
+
+uint32_t tmj_chunk_tile(const Chunk* chunk, int x, int y) {
+    if (chunk->data_is_str || x < 0 || y < 0 || x >= chunk->width || y >= chunk->height) {
+        return 0;
+    }
+
+    size_t index = (size_t)y * chunk->width + x;
+
+    if (chunk->data_compact != NULL) {
+        return index < chunk->data_compact->count ? tmj_tiles_get(chunk->data_compact, index) : 0;
+    }
+
+    return chunk->data_uint != NULL && index < chunk->data_count ? chunk->data_uint[index] : 0;
+}
+
+/**
+ * Points a view at the next layer data or chunk that overlaps its rectangle.
+ * Returns false if there is none left.
+ */
+static bool view_source(tmj_view* view) {
+    const Layer* layer = view->layer;
+    size_t source_count = layer->chunks != NULL ? layer->chunk_count : 1;
+
+    while (view->next_chunk < source_count) {
+        size_t i = view->next_chunk++;
+
+        int x, y, width, height;
+        size_t count;
+        const uint32_t* data;
+        const tmj_tiles* tiles;
+
+        if (layer->chunks != NULL) {
+            const Chunk* chunk = &layer->chunks[i];
+
+            x = chunk->x;
+            y = chunk->y;
+            width = chunk->width;
+            height = chunk->height;
+            data = chunk->data_is_str ? NULL : (const uint32_t*)chunk->data_uint;
+            tiles = chunk->data_compact;
+            count = chunk->data_count;
+        } else {
+            x = 0;
+            y = 0;
+            width = layer->width;
+            height = layer->height;
+            data = layer->data_is_str ? NULL : (const uint32_t*)layer->data_uint;
+            tiles = layer->data_compact;
+            count = layer->data_count;
+        }
+
+        if (data == NULL && tiles == NULL) {
+            continue;
+        }
+
+        // Short CSV data is only read as far as it goes, whether it's plain or compact
+        if (tiles != NULL) {
+            count = tiles->count;
+        }
+
+        if (count < (size_t)width * height) {
+            height = width > 0 ? (int)(count / width) : 0;
+        }
+
+        int x0 = view->left > x ? view->left - x : 0;
+        int x1 = view->right - x < width ? view->right - x : width;
+        int y0 = view->top > y ? view->top - y : 0;
+        int y1 = view->bottom - y < height ? view->bottom - y : height;
+
+        if (x0 >= x1 || y0 >= y1) {
+            continue;
+        }
+
+        view->data = data;
+        view->tiles = tiles;
+        view->origin_x = x;
+        view->origin_y = y;
+        view->width = width;
+        view->x0 = x0;
+        view->x1 = x1;
+        view->y1 = y1;
+        view->row = y0;
+        view->col = x0;
+        view->buffer_length = 0;
+
+        if (tiles != NULL && tiles->rows != NULL) {
+            view->run = run_search(tiles, y0, (uint32_t)x0);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+static void view_next_row(tmj_view* view) {
+    view->row++;
+    view->col = view->x0;
+    view->buffer_length = 0;
+
+    if (view->row < view->y1 && view->tiles != NULL && view->tiles->rows != NULL) {
+        view->run = run_search(view->tiles, view->row, (uint32_t)view->x0);
+    }
+}
+
+void tmj_view_begin(tmj_view* view, const Layer* layer, int x, int y, int width, int height) {
+    memset(view, 0, offsetof(tmj_view, buffer));
+
+    view->layer = layer;
+    view->left = x;
+    view->top = y;
+    view->right = x + width;
+    view->bottom = y + height;
+
+    if (layer->type == NULL || strcmp(layer->type, "tilelayer") != 0 || width <= 0 || height <= 0 || !view_source(view)) {
+        view->row = view->y1;
+        view->next_chunk = SIZE_MAX;
+    }
+}
+
+bool tmj_view_next(tmj_view* view, tmj_view_run* run) {
+    while (true) {
+        if (view->row >= view->y1) {
+            if (view->next_chunk == SIZE_MAX || !view_source(view)) {
+                view->next_chunk = SIZE_MAX;
+
+                return false;
+            }
+        }
+
+        if (view->col >= view->x1) {
+            view_next_row(view);
+
+            continue;
+        }
+
+        int start;
+        int length;
+        const uint32_t* gids;
+
+        if (view->data != NULL) {
+            // Plain data, scanned in place
+            const uint32_t* row = view->data + (size_t)view->row * view->width;
+
+            while (view->col < view->x1 && row[view->col] == 0) {
+                view->col++;
+            }
+
+            if (view->col == view->x1) {
+                continue;
+            }
+
+            start = view->col;
+
+            while (view->col < view->x1 && row[view->col] != 0) {
+                view->col++;
+            }
+
+            length = view->col - start;
+            gids = row + start;
+        } else if (view->tiles->rows != NULL) {
+            // Sparse tiles, empty stretches are skipped by going from run to run
+            const tmj_tiles* tiles = view->tiles;
+
+            if (view->run == tiles->rows[view->row + 1] || tiles->runs[view->run].x >= (uint32_t)view->x1) {
+                view->col = view->x1;
+
+                continue;
+            }
+
+            const tmj_tile_run* r = &tiles->runs[view->run];
+            int run_end = (int)(r->x + r->length) < view->x1 ? (int)(r->x + r->length) : view->x1;
+
+            start = (int)r->x > view->col ? (int)r->x : view->col;
+            length = run_end - start < TMJ_VIEW_RUN_MAX ? run_end - start : TMJ_VIEW_RUN_MAX;
+
+            stored_read(tiles, r->first + (size_t)(start - r->x), (size_t)length, view->buffer);
+
+            view->col = start + length;
+
+            if (view->col >= (int)(r->x + r->length)) {
+                view->run++;
+            }
+
+            gids = view->buffer;
+        } else {
+            // Packed tiles, unpacked a buffer at a time and then scanned
+            if (view->buffer_length == 0 || view->col >= view->buffer_col + view->buffer_length) {
+                int length = view->x1 - view->col < TMJ_VIEW_RUN_MAX ? view->x1 - view->col : TMJ_VIEW_RUN_MAX;
+
+                tmj_tiles_read(view->tiles, (size_t)view->row * view->width + view->col, (size_t)length, view->buffer);
+
+                view->buffer_col = view->col;
+                view->buffer_length = length;
+            }
+
+            int buffer_end = view->buffer_col + view->buffer_length;
+
+            while (view->col < buffer_end && view->buffer[view->col - view->buffer_col] == 0) {
+                view->col++;
+            }
+
+            if (view->col == buffer_end) {
+                continue;
+            }
+
+            start = view->col;
+
+            while (view->col < buffer_end && view->buffer[view->col - view->buffer_col] != 0) {
+                view->col++;
+            }
+
+            length = view->col - start;
+            gids = view->buffer + (start - view->buffer_col);
+        }
+
+        run->x = view->origin_x + start;
+        run->y = view->origin_y + view->row;
+        run->length = length;
+        run->gids = gids;
+
+        return true;
+    }
+}
@@ -3,14 +3,17 @@
 #include <jansson.h>
 
 #include "log.h"
+#include "stats.h"
 #include "map.h"
 #include "tmj.h"
+#include "trace.h"
+#include "util.h"
 
 /**
  * @file
  */
 
-int unpack_tileset(json_t* tileset, Tileset* ret) {
+static int unpack_tileset_json(json_t* tileset, Tileset* ret, const tmj_load_options* options) {
     logmsg(TMJ_LOG_DEBUG, "Unpacking tileset");
 
     if (tileset == NULL) {
@@ -31,8 +34,8 @@ int unpack_tileset(json_t* tileset, Tileset* ret) {
             &error,
             0,
             "{"
-            "s?s, s?s, s?s, s:s, s:s, s?s, s?s, s:s, s?s, s?s, s:s, s:s,"
-            "s:i, s?i, s:i, s:i, s:i, s:i, s:i, s:i, s:i,"
+            "s?s, s?s, s?s, s?s, s:s, s?s, s?s, s:s, s?s, s?s, s:s, s:s,"
+            "s:i, s?i, s?i, s?i, s:i, s:i, s:i, s:i, s:i,"
             "s?o, s?o, s?o, s?o, s?o, s?o"
             "}",
             "backgroundcolor",
@@ -98,7 +101,7 @@ int unpack_tileset(json_t* tileset, Tileset* ret) {
 
     // Unpack Grid
     if (grid) {
-        ret->grid = calloc(1, sizeof(Grid));
+        ret->grid = stats_calloc(1, sizeof(Grid));
 
         if (ret->grid == NULL) {
             logmsg(TMJ_LOG_ERR, "Unable to unpack tileset[%s]->grid, the system is out of memory", ret->name);
@@ -118,7 +121,7 @@ int unpack_tileset(json_t* tileset, Tileset* ret) {
 
     // Unpack TileOffset
     if (tileoffset) {
-        ret->tileoffset = calloc(1, sizeof(TileOffset));
+        ret->tileoffset = stats_calloc(1, sizeof(TileOffset));
 
         if (ret->tileoffset == NULL) {
             logmsg(TMJ_LOG_ERR, "Unable to unpack tileset[%s]->tileoffset, the system is out of memory", ret->name);
@@ -137,7 +140,7 @@ int unpack_tileset(json_t* tileset, Tileset* ret) {
 
     // Unpack Transformations
     if (transformations) {
-        ret->transformations = calloc(1, sizeof(Transformations));
+        ret->transformations = stats_calloc(1, sizeof(Transformations));
 
         if (ret->transformations == NULL) {
             logmsg(TMJ_LOG_ERR, "Unable to unpack tileset[%s]->transformations, the system is out of memory", ret->name);
@@ -181,8 +184,10 @@ int unpack_tileset(json_t* tileset, Tileset* ret) {
         ret->property_count = json_array_size(properties);
     }
 
+    bool headless = options_headless(options);
+
     // Unpack Terrains
-    if (terrains) {
+    if (terrains && !headless) {
         if (!json_is_array(terrains)) {
             logmsg(TMJ_LOG_ERR, "Unable to unpack tileset[%s]->terrains, terrains must be an array of Terrains", ret->name);
 
@@ -191,7 +196,7 @@ int unpack_tileset(json_t* tileset, Tileset* ret) {
 
         ret->terrain_count = json_array_size(terrains);
 
-        ret->terrains = calloc(ret->terrain_count, sizeof(Terrain));
+        ret->terrains = stats_calloc(ret->terrain_count, sizeof(Terrain));
 
         if (ret->terrains == NULL) {
             logmsg(TMJ_LOG_ERR, "Unable to unpack tileset[%s]->terrains, the system is out of memory", ret->name);
@@ -249,7 +254,7 @@ int unpack_tileset(json_t* tileset, Tileset* ret) {
 
         ret->tile_count = json_array_size(tiles);
 
-        ret->tiles = calloc(ret->tile_count, sizeof(Tile));
+        ret->tiles = stats_calloc(ret->tile_count, sizeof(Tile));
 
         if (ret->tiles == NULL) {
             logmsg(TMJ_LOG_ERR, "Unable to unpack tileset[%s]->tiles, the system is out of memory", ret->name);
@@ -313,7 +318,7 @@ int unpack_tileset(json_t* tileset, Tileset* ret) {
 
             // Unpack Tile objectgroup
             if (objectgroup) {
-                ret->tiles[idx].objectgroup = calloc(1, sizeof(Layer));
+                ret->tiles[idx].objectgroup = stats_calloc(1, sizeof(Layer));
 
                 if (ret->tiles[idx].objectgroup == NULL) {
                     logmsg(TMJ_LOG_ERR,
@@ -385,7 +390,10 @@ int unpack_tileset(json_t* tileset, Tileset* ret) {
                 }
 
                 if (objects) {
-                    ret->tiles[idx].objectgroup->objects = unpack_objects(objects);
+                    ret->tiles[idx].objectgroup->objects = unpack_objects(objects,
+                            options,
+                            &ret->tiles[idx].objectgroup->points,
+                            &ret->tiles[idx].objectgroup->point_count);
 
                     if (ret->tiles[idx].objectgroup->objects == NULL) {
                         logmsg(TMJ_LOG_ERR, "Unable to unpack tileset[%s]->tiles[%d]->objectgroup->objects", ret->name, ret->tiles[idx].id);
@@ -410,7 +418,7 @@ int unpack_tileset(json_t* tileset, Tileset* ret) {
             }
 
             // Unpack Tile animation
-            if (animation) {
+            if (animation && !headless) {
                 if (!json_is_array(animation)) {
                     logmsg(TMJ_LOG_ERR,
                             "Unable to unpack tileset[%s]->tiles[%d]->animation, animation must be an array of Frames",
@@ -420,7 +428,7 @@ int unpack_tileset(json_t* tileset, Tileset* ret) {
                     goto fail_tiles;
                 }
 
-                ret->tiles[idx].animation = calloc(json_array_size(animation), sizeof(Frame));
+                ret->tiles[idx].animation = stats_calloc(json_array_size(animation), sizeof(Frame));
 
                 if (ret->tiles[idx].animation == NULL) {
                     logmsg(TMJ_LOG_ERR,
@@ -476,7 +484,7 @@ int unpack_tileset(json_t* tileset, Tileset* ret) {
             }
 
             // Unpack Tile terrain
-            if (terrain) {
+            if (terrain && !headless) {
                 if (!json_is_array(terrain)) {
                     logmsg(TMJ_LOG_ERR,
                             "Unable to unpack tileset[%s]->tiles[%d]->terrain, terrain must be an array of terrain "
@@ -513,7 +521,7 @@ fail_tiles:
 
         if (ret->tiles[i].objectgroup != NULL) {
             free(ret->tiles[i].objectgroup->properties);
-            free_objects(ret->tiles[i].objectgroup->objects, ret->tiles[i].objectgroup->object_count);
+            free_objects(ret->tiles[i].objectgroup->objects, ret->tiles[i].objectgroup->object_count, ret->tiles[i].objectgroup->points);
         }
 
         free(ret->tiles[i].objectgroup);
@@ -544,48 +552,185 @@ fail_grid:
     return -1;
 }
 
+int unpack_tileset(json_t* tileset, Tileset* ret, const tmj_load_options* options) {
+    trace_scope trace = trace_begin("unpack_tileset");
+
+    int unpk = unpack_tileset_json(tileset, ret, options);
+
+    trace_end(&trace);
+
+    return unpk;
+}
+
+void tileset_clear(Tileset* tileset) {
+    // Free tiles
+    if (tileset->tiles) {
+        for (size_t j = 0; j < tileset->tile_count; j++) {
+            free(tileset->tiles[j].animation);
+            if (tileset->tiles[j].objectgroup != NULL) {
+                free(tileset->tiles[j].objectgroup->properties);
+                free_objects(tileset->tiles[j].objectgroup->objects,
+                        tileset->tiles[j].objectgroup->object_count,
+                        tileset->tiles[j].objectgroup->points);
+            }
+            free(tileset->tiles[j].objectgroup);
+            free(tileset->tiles[j].properties);
+        }
+
+        free(tileset->tiles);
+    }
+
+    // Free terrains
+    if (tileset->terrains) {
+        for (size_t j = 0; j < tileset->terrain_count; j++) {
+            free(tileset->terrains[j].properties);
+        }
+
+        free(tileset->terrains);
+    }
+
+    // Free everything else
+    free(tileset->properties);
+    free(tileset->transformations);
+    free(tileset->tileoffset);
+    free(tileset->grid);
+    free(tileset->rects);
+
+    json_decref(tileset->root);
+}
+
 /**
  * Helper function for freeing tilesets embedded in maps
  */
 void tilesets_free(Tileset* tilesets, size_t tileset_count) {
     for (size_t i = 0; i < tileset_count; i++) {
-        // Free tiles
-        if (tilesets[i].tiles) {
-            for (size_t j = 0; j < tilesets[i].tile_count; j++) {
-                free(tilesets[i].tiles[j].animation);
-                if (tilesets[i].tiles[j].objectgroup != NULL) {
-                    free(tilesets[i].tiles[j].objectgroup->properties);
-                    free_objects(tilesets[i].tiles[j].objectgroup->objects, tilesets[i].tiles[j].objectgroup->object_count);
-                }
-                free(tilesets[i].tiles[j].objectgroup);
-                free(tilesets[i].tiles[j].properties);
-            }
+        tileset_clear(&tilesets[i]);
+    }
+
+    free(tilesets);
+}
 
-            free(tilesets[i].tiles);
+/**
+ * Fills in where a tile of the given size is drawn within a map cell.
+ */
+static void tile_rect_draw(const Tileset* tileset, tmj_tile_rect* rect, float width, float height, int grid_width, int grid_height) {
+    float draw_width = width;
+    float draw_height = height;
+    float x = 0;
+    float y = 0;
+
+    if (tileset->tilerendersize != NULL && strcmp(tileset->tilerendersize, "grid") == 0) {
+        draw_width = (float)grid_width;
+        draw_height = (float)grid_height;
+
+        // Scale to fit the cell, and center the tile in it
+        if (tileset->fillmode != NULL && strcmp(tileset->fillmode, "preserve-aspect-fit") == 0 && width > 0 && height > 0) {
+            float scale = draw_width / width < draw_height / height ? draw_width / width : draw_height / height;
+
+            draw_width = width * scale;
+            draw_height = height * scale;
+            x = ((float)grid_width - draw_width) / 2;
+            y = ((float)grid_height - draw_height) / 2;
         }
+    } else {
+        // Tiles larger or smaller than the cell share its bottom-left corner
+        y = (float)grid_height - draw_height;
+    }
+
+    if (tileset->tileoffset != NULL) {
+        x += (float)tileset->tileoffset->x;
+        y += (float)tileset->tileoffset->y;
+    }
 
-        // Free terrains
-        if (tilesets[i].terrains) {
-            for (size_t j = 0; j < tilesets[i].terrain_count; j++) {
-                free(tilesets[i].terrains[j].properties);
+    rect->draw_x = x;
+    rect->draw_y = y;
+    rect->draw_width = draw_width;
+    rect->draw_height = draw_height;
+}
+
+static void tile_rect_uv(tmj_tile_rect* rect, int image_width, int image_height) {
+    if (image_width <= 0 || image_height <= 0) {
+        return;
+    }
+
+    rect->u0 = (float)rect->x / (float)image_width;
+    rect->v0 = (float)rect->y / (float)image_height;
+    rect->u1 = (float)(rect->x + rect->width) / (float)image_width;
+    rect->v1 = (float)(rect->y + rect->height) / (float)image_height;
+}
+
+int tmj_tileset_build_rects(Tileset* tileset, int grid_width, int grid_height) {
+    // Sheets cover every tile ID up to tilecount, image collections may skip some
+    size_t rect_count = tileset->tilecount > 0 ? (size_t)tileset->tilecount : 0;
+
+    if (tileset->image == NULL) {
+        for (size_t i = 0; i < tileset->tile_count; i++) {
+            if (tileset->tiles[i].id >= 0 && (size_t)tileset->tiles[i].id >= rect_count) {
+                rect_count = (size_t)tileset->tiles[i].id + 1;
             }
+        }
+    }
 
-            free(tilesets[i].terrains);
+    tmj_tile_rect* rects = NULL;
+
+    if (rect_count > 0) {
+        rects = stats_calloc(rect_count, sizeof(tmj_tile_rect));
+
+        if (rects == NULL) {
+            logmsg(TMJ_LOG_ERR, "Unable to build tile rectangles of tileset[%s], the system is out of memory", tileset->name);
+
+            return -1;
         }
+    }
 
-        // Free everything else
-        free(tilesets[i].properties);
-        free(tilesets[i].transformations);
-        free(tilesets[i].tileoffset);
-        free(tilesets[i].grid);
+    if (tileset->image != NULL) {
+        int columns = tileset->columns > 0 ? tileset->columns : 1;
 
-        json_decref(tilesets[i].root);
+        for (size_t id = 0; id < rect_count; id++) {
+            tmj_tile_rect* rect = &rects[id];
+
+            rect->image = tileset->image;
+            rect->x = tileset->margin + (int)(id % columns) * (tileset->tilewidth + tileset->spacing);
+            rect->y = tileset->margin + (int)(id / columns) * (tileset->tileheight + tileset->spacing);
+            rect->width = tileset->tilewidth;
+            rect->height = tileset->tileheight;
+
+            tile_rect_uv(rect, tileset->imagewidth, tileset->imageheight);
+            tile_rect_draw(tileset, rect, (float)rect->width, (float)rect->height, grid_width, grid_height);
+        }
+    } else {
+        for (size_t i = 0; i < tileset->tile_count; i++) {
+            const Tile* tile = &tileset->tiles[i];
+
+            if (tile->id < 0 || tile->image == NULL) {
+                continue;
+            }
+
+            tmj_tile_rect* rect = &rects[tile->id];
+
+            // A tile without a sub-rectangle uses its whole image
+            rect->image = tile->image;
+            rect->x = tile->x;
+            rect->y = tile->y;
+            rect->width = tile->width > 0 ? tile->width : tile->imagewidth - tile->x;
+            rect->height = tile->height > 0 ? tile->height : tile->imageheight - tile->y;
+
+            tile_rect_uv(rect, tile->imagewidth, tile->imageheight);
+            tile_rect_draw(tileset, rect, (float)rect->width, (float)rect->height, grid_width, grid_height);
+        }
     }
 
-    free(tilesets);
+    stats_free(tileset->rects, tileset->rect_count * sizeof(tmj_tile_rect));
+
+    tileset->rect_count = rect_count;
+    tileset->rects = rects;
+    tileset->rect_grid_width = grid_width;
+    tileset->rect_grid_height = grid_height;
+
+    return 0;
 }
 
-Tileset* tmj_tileset_loadf(const char* path, bool check_extension) {
+Tileset* tmj_tileset_loadf_ex(const char* path, bool check_extension, const tmj_load_options* options) {
     logmsg(TMJ_LOG_DEBUG, "Loading JSON tileset file '%s'", path);
 
     char* ext = strrchr(path, '.');
@@ -606,7 +751,7 @@ Tileset* tmj_tileset_loadf(const char* path, bool check_extension) {
     }
 
     json_error_t error;
-    json_t* root = json_load_file(path, JSON_REJECT_DUPLICATES, &error);
+    json_t* root = load_json_file(path, &error);
 
     if (root == NULL) {
         logmsg(TMJ_LOG_ERR, "Could not load tileset '%s', %s at line %d column %d", path, error.text, error.line, error.column);
@@ -614,7 +759,7 @@ Tileset* tmj_tileset_loadf(const char* path, bool check_extension) {
         return NULL;
     }
 
-    Tileset* ret = calloc(1, sizeof(Tileset));
+    Tileset* ret = stats_calloc(1, sizeof(Tileset));
 
     if (ret == NULL) {
         logmsg(TMJ_LOG_ERR, "Unable to load tileset[%s], the system is out of memory", path);
@@ -622,7 +767,9 @@ Tileset* tmj_tileset_loadf(const char* path, bool check_extension) {
         return NULL;
     }
 
-    if (unpack_tileset(root, ret) == -1) {
+    uint64_t start = stats_phase_begin();
+
+    if (unpack_tileset(root, ret, options) == -1) {
         logmsg(TMJ_LOG_ERR, "Unable to unpack tileset[%s]", path);
 
         free(ret);
@@ -632,14 +779,23 @@ Tileset* tmj_tileset_loadf(const char* path, bool check_extension) {
 
     ret->root = root;
 
+    if (options_tile_rects(options) && tmj_tileset_build_rects(ret, ret->tilewidth, ret->tileheight) != 0) {
+        tmj_tileset_free(ret);
+
+        return NULL;
+    }
+
+    stats_phase_end(STATS_PHASE_UNPACK, start, 0);
+    stats_count_load(true);
+
     return ret;
 }
 
-Tileset* tmj_tileset_load(const char* tileset) {
+Tileset* tmj_tileset_load_ex(const char* tileset, const tmj_load_options* options) {
     logmsg(TMJ_LOG_DEBUG, "Loading JSON tileset from string");
 
     json_error_t error;
-    json_t* root = json_loads(tileset, JSON_REJECT_DUPLICATES, &error);
+    json_t* root = load_json_string(tileset, &error);
 
     if (root == NULL) {
         logmsg(TMJ_LOG_ERR, "Could not load tileset, %s at line %d column %d", error.text, error.line, error.column);
@@ -647,7 +803,7 @@ Tileset* tmj_tileset_load(const char* tileset) {
         return NULL;
     }
 
-    Tileset* ret = calloc(1, sizeof(Tileset));
+    Tileset* ret = stats_calloc(1, sizeof(Tileset));
 
     if (ret == NULL) {
         logmsg(TMJ_LOG_ERR, "Unable to load tileset, the system is out of memory");
@@ -655,7 +811,9 @@ Tileset* tmj_tileset_load(const char* tileset) {
         return NULL;
     }
 
-    if (unpack_tileset(root, ret) == -1) {
+    uint64_t start = stats_phase_begin();
+
+    if (unpack_tileset(root, ret, options) == -1) {
         logmsg(TMJ_LOG_ERR, "Unable to unpack tileset");
 
         free(ret);
@@ -665,9 +823,26 @@ Tileset* tmj_tileset_load(const char* tileset) {
 
     ret->root = root;
 
+    if (options_tile_rects(options) && tmj_tileset_build_rects(ret, ret->tilewidth, ret->tileheight) != 0) {
+        tmj_tileset_free(ret);
+
+        return NULL;
+    }
+
+    stats_phase_end(STATS_PHASE_UNPACK, start, 0);
+    stats_count_load(true);
+
     return ret;
 }
 
+Tileset* tmj_tileset_loadf(const char* path, bool check_extension) {
+    return tmj_tileset_loadf_ex(path, check_extension, NULL);
+}
+
+Tileset* tmj_tileset_load(const char* tileset) {
+    return tmj_tileset_load_ex(tileset, NULL);
+}
+
 void tmj_tileset_free(Tileset* tileset) {
     tilesets_free(tileset, 1);
 }
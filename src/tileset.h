@@ -3,7 +3,8 @@
 
 #include "tmj.h"
 
-int unpack_tileset(json_t* tileset, Tileset* ret);
+int unpack_tileset(json_t* tileset, Tileset* ret, const tmj_load_options* options);
+void tileset_clear(Tileset* tileset);
 void tilesets_free(Tileset* tilesets, size_t tileset_count);
 
 #endif
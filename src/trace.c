@@ -0,0 +1,155 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "../include/tmj.h"
+#include "trace.h"
+#include "util.h"
+
+/**
+ * @file
+ */
+
+typedef void (*trace_hook)(const char*, void*);
+
+/*
+ * Hooks are published through a sequence lock, like the logging callback, so
+ * that a scope never pairs one registration's begin hook with another's
+ * userdata.
+ */
+static atomic_uint trace_seq = 0;
+static atomic_bool trace_enabled = false;
+static _Atomic(trace_hook) trace_begin_hook = NULL;
+static _Atomic(trace_hook) trace_end_hook = NULL;
+static _Atomic(void*) trace_userdata = NULL;
+
+void tmj_set_trace_hooks(void (*begin)(const char*, void*), void (*end)(const char*, void*), void* userdata) {
+    unsigned int seq = atomic_load_explicit(&trace_seq, memory_order_relaxed);
+
+    do {
+        while (seq & 1) {
+            seq = atomic_load_explicit(&trace_seq, memory_order_relaxed);
+        }
+    } while (!atomic_compare_exchange_weak_explicit(&trace_seq, &seq, seq + 1, memory_order_acquire, memory_order_relaxed));
+
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&trace_begin_hook, begin, memory_order_relaxed);
+    atomic_store_explicit(&trace_end_hook, end, memory_order_relaxed);
+    atomic_store_explicit(&trace_userdata, userdata, memory_order_relaxed);
+    atomic_store_explicit(&trace_enabled, begin != NULL || end != NULL, memory_order_relaxed);
+
+    atomic_store_explicit(&trace_seq, seq + 2, memory_order_release);
+}
+
+trace_scope trace_begin(const char* name) {
+    trace_scope scope = {name, NULL, NULL};
+
+    if (!atomic_load_explicit(&trace_enabled, memory_order_relaxed)) {
+        return scope;
+    }
+
+    trace_hook begin;
+
+    for (;;) {
+        unsigned int seq = atomic_load_explicit(&trace_seq, memory_order_acquire);
+
+        if (seq & 1) {
+            continue;
+        }
+
+        begin = atomic_load_explicit(&trace_begin_hook, memory_order_relaxed);
+        scope.end = atomic_load_explicit(&trace_end_hook, memory_order_relaxed);
+        scope.userdata = atomic_load_explicit(&trace_userdata, memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+
+        if (atomic_load_explicit(&trace_seq, memory_order_relaxed) == seq) {
+            break;
+        }
+    }
+
+    if (begin != NULL) {
+        begin(name, scope.userdata);
+    }
+
+    return scope;
+}
+
+void trace_end(const trace_scope* scope) {
+    if (scope->end != NULL) {
+        scope->end(scope->name, scope->userdata);
+    }
+}
+
+/*
+ * Chrome trace-event sink
+ *
+ * Writes the JSON array format described in
+ * https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+ * which can be loaded into chrome://tracing or https://ui.perfetto.dev
+ */
+
+static FILE* chrome_file = NULL;
+static uint64_t chrome_epoch = 0;
+static atomic_uint chrome_next_tid = 1;
+
+TMJ_THREAD_LOCAL unsigned int chrome_tid = 0;
+
+static void chrome_event(const char* name, char phase, FILE* f) {
+    if (chrome_tid == 0) {
+        chrome_tid = atomic_fetch_add_explicit(&chrome_next_tid, 1, memory_order_relaxed);
+    }
+
+    double ts = (double)(time_now_ns() - chrome_epoch) / 1000.0;
+
+    // A single fprintf() per event, so that events from different threads don't interleave
+    fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"libtmj\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}", name, phase, ts, chrome_tid);
+}
+
+static void chrome_begin(const char* name, void* userdata) {
+    chrome_event(name, 'B', userdata);
+}
+
+static void chrome_end(const char* name, void* userdata) {
+    chrome_event(name, 'E', userdata);
+}
+
+int tmj_trace_chrome_open(const char* path) {
+    if (chrome_file != NULL) {
+        return -1;
+    }
+
+    FILE* f = fopen(path, "w");
+
+    if (f == NULL) {
+        return -1;
+    }
+
+    chrome_epoch = time_now_ns();
+
+    // Leading metadata event, so that every real event can be written with a leading comma
+    fprintf(f, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"libtmj\"}}");
+
+    chrome_file = f;
+
+    tmj_set_trace_hooks(chrome_begin, chrome_end, f);
+
+    return 0;
+}
+
+int tmj_trace_chrome_close(void) {
+    if (chrome_file == NULL) {
+        return -1;
+    }
+
+    tmj_set_trace_hooks(NULL, NULL, NULL);
+
+    fprintf(chrome_file, "\n]\n");
+
+    int ret = fclose(chrome_file);
+
+    chrome_file = NULL;
+
+    return ret == 0 ? 0 : -1;
+}
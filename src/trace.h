@@ -0,0 +1,40 @@
+#ifndef LIBTMJ_TRACE
+#define LIBTMJ_TRACE
+
+/**
+ * @file
+ *
+ * @defgroup trace Trace
+ *
+ * Private API for emitting begin/end events to the hooks registered with
+ * tmj_set_trace_hooks().
+ */
+
+/**
+ * @ingroup trace
+ * An open trace scope. Holds the hooks that were registered when the scope
+ * began, so that its end event always reaches the same sink as its begin
+ * event.
+ */
+typedef struct trace_scope {
+    const char* name;
+    void (*end)(const char*, void*);
+    void* userdata;
+} trace_scope;
+
+/**
+ * @ingroup trace
+ * Opens a trace scope, calling the registered begin hook, if there is one.
+ *
+ * @param name A string literal naming the scope.
+ */
+trace_scope trace_begin(const char* name);
+
+/**
+ * @ingroup trace
+ * Closes a trace scope, calling the end hook that was registered when it was
+ * opened.
+ */
+void trace_end(const trace_scope* scope);
+
+#endif
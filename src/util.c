@@ -1,10 +1,23 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 199309L
+#endif
+
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
 #include "decode.h"
 #include "log.h"
+#include "stats.h"
+#include "util.h"
 
 // Library version definition
 const unsigned int TMJ_VERSION_MAJOR = LIBTMJ_VERSION_MAJOR;
@@ -32,7 +45,7 @@ uint32_t* tmj_decode_layer(const char* data, const char* encoding, const char* c
     uint8_t* dat2 = NULL;
 
     if (strlen(compression) == 0) {
-        dat2 = malloc(dsize);
+        dat2 = stats_malloc(dsize);
         memcpy(dat2, dat, dsize);
         dsize2 = dsize;
     }
@@ -63,14 +76,161 @@ uint32_t* tmj_decode_layer(const char* data, const char* encoding, const char* c
     if (dat2 == NULL) {
         logmsg(TMJ_LOG_ERR, "Unable to decompress %s encoded layer data", compression);
 
-        free(dat);
+        stats_free(dat, dsize);
 
         return NULL;
     }
 
-    free(dat);
+    stats_free(dat, dsize);
 
     *size = dsize2 / 4;
 
     return (uint32_t*)dat2;
 }
+
+uint64_t time_now_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq = {0};
+    LARGE_INTEGER now;
+
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
+    }
+
+    QueryPerformanceCounter(&now);
+
+    return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000u + (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000u / freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * jansson read callback, which times each read as I/O
+ */
+size_t load_json_file_read(void* buffer, size_t buflen, void* data) {
+    FILE* f = data;
+
+    uint64_t start = stats_phase_begin();
+
+    size_t n = fread(buffer, 1, buflen, f);
+
+    stats_phase_end(STATS_PHASE_IO, start, n);
+
+    if (n == 0 && ferror(f)) {
+        return (size_t)-1;
+    }
+
+    return n;
+}
+
+json_t* load_json_file(const char* path, json_error_t* error) {
+    FILE* f = fopen(path, "rb");
+
+    if (f == NULL) {
+        memset(error, 0, sizeof(json_error_t));
+
+        error->line = -1;
+        error->column = -1;
+        error->position = 0;
+
+        snprintf(error->text, JSON_ERROR_TEXT_LENGTH, "unable to open %s", path);
+
+        return NULL;
+    }
+
+    tmj_load_stats* stats = stats_current();
+    uint64_t io_before = stats ? stats->io_ns : 0;
+    uint64_t start = stats_phase_begin();
+
+    json_t* root = json_load_callback(load_json_file_read, f, JSON_REJECT_DUPLICATES, error);
+
+    // Reads happen inside the parse, so push the start forward by the time they took
+    if (stats != NULL) {
+        stats_phase_end(STATS_PHASE_PARSE, start + (stats->io_ns - io_before), 0);
+    }
+
+    fclose(f);
+
+    return root;
+}
+
+json_t* load_json_string(const char* str, json_error_t* error) {
+    uint64_t start = stats_phase_begin();
+
+    json_t* root = json_loads(str, JSON_REJECT_DUPLICATES, error);
+
+    stats_phase_end(STATS_PHASE_PARSE, start, 0);
+
+    if (stats_current() != NULL) {
+        stats_current()->bytes_read += strlen(str);
+    }
+
+    return root;
+}
+
+bool options_headless(const tmj_load_options* options) {
+    return options != NULL && options->profile == TMJ_LOAD_HEADLESS;
+}
+
+bool options_lazy(const tmj_load_options* options) {
+    return options != NULL && options->lazy;
+}
+
+bool options_compact(const tmj_load_options* options) {
+    return options != NULL && options->compact_tiles;
+}
+
+bool options_sparse(const tmj_load_options* options) {
+    return options != NULL && options->sparse_tiles;
+}
+
+bool options_tile_rects(const tmj_load_options* options) {
+    return options != NULL && options->tile_rects && !options_headless(options);
+}
+
+bool options_object_lookup(const tmj_load_options* options) {
+    return options != NULL && options->object_lookup;
+}
+
+uint32_t hash_string(const char* str) {
+    uint32_t hash = 2166136261u;
+
+    for (const char* c = str; *c != '\0'; c++) {
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+    }
+
+    return hash;
+}
+
+uint32_t parse_color(const char* color) {
+    if (color == NULL || color[0] != '#') {
+        return 0xFFFFFFFFu;
+    }
+
+    size_t len = strlen(color + 1);
+    char* end = NULL;
+    unsigned long value = strtoul(color + 1, &end, 16);
+
+    if (*end != '\0' || (len != 6 && len != 8)) {
+        return 0xFFFFFFFFu;
+    }
+
+    return len == 6 ? 0xFF000000u | (uint32_t)value : (uint32_t)value;
+}
+
+uint32_t multiply_color(uint32_t a, uint32_t b) {
+    uint32_t ret = 0;
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t c = ((a >> shift) & 0xFF) * ((b >> shift) & 0xFF);
+
+        ret |= ((c + 127) / 255) << shift;
+    }
+
+    return ret;
+}
@@ -0,0 +1,152 @@
+#ifndef LIBTMJ_UTIL
+#define LIBTMJ_UTIL
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <jansson.h>
+
+#include "tmj.h"
+
+/**
+ * @file
+ *
+ * @defgroup util Util
+ *
+ * Private helpers shared across the library.
+ */
+
+/**
+ * @ingroup util
+ * Storage class for thread-local variables.
+ */
+#ifdef _MSC_VER
+#define TMJ_THREAD_LOCAL __declspec(thread)
+#else
+#define TMJ_THREAD_LOCAL _Thread_local
+#endif
+
+/**
+ * @ingroup util
+ * Reads a monotonic clock.
+ *
+ * @return The current time in nanoseconds, relative to an unspecified epoch.
+ */
+uint64_t time_now_ns(void);
+
+/**
+ * @ingroup util
+ * Parses the JSON file at the given path, accounting the time spent reading
+ * and parsing it to the attached tmj_load_stats, if any.
+ *
+ * @param path A relative or absolute filesystem path.
+ * @param[out] error Filled in by jansson on failure.
+ *
+ * @return The parsed root object, or NULL on failure.
+ */
+json_t* load_json_file(const char* path, json_error_t* error);
+
+/**
+ * @ingroup util
+ * Parses the given JSON string, accounting the time spent parsing it to the
+ * attached tmj_load_stats, if any.
+ *
+ * @param str A null-terminated JSON string.
+ * @param[out] error Filled in by jansson on failure.
+ *
+ * @return The parsed root object, or NULL on failure.
+ */
+json_t* load_json_string(const char* str, json_error_t* error);
+
+/**
+ * @ingroup util
+ * Checks whether a load should skip presentation-only structures.
+ *
+ * @param options The load options, or NULL.
+ *
+ * @return True if options asks for the TMJ_LOAD_HEADLESS profile.
+ */
+bool options_headless(const tmj_load_options* options);
+
+/**
+ * @ingroup util
+ * Checks whether a load should defer unpacking objects and embedded tilesets.
+ *
+ * @param options The load options, or NULL.
+ *
+ * @return True if options asks for a lazy load.
+ */
+bool options_lazy(const tmj_load_options* options);
+
+/**
+ * @ingroup util
+ * Checks whether a load should pack CSV tile data into tmj_tiles.
+ *
+ * @param options The load options, or NULL.
+ *
+ * @return True if options asks for compact tile storage.
+ */
+bool options_compact(const tmj_load_options* options);
+
+/**
+ * @ingroup util
+ * Checks whether the given load options ask for sparse tile storage.
+ *
+ * @param options The load options, or NULL.
+ *
+ * @return True if options asks for sparse tile storage.
+ */
+bool options_sparse(const tmj_load_options* options);
+
+/**
+ * @ingroup util
+ * Checks whether the given load options ask for tile rectangle tables. Headless
+ * loads never build them.
+ *
+ * @param options The load options, or NULL.
+ *
+ * @return True if options asks for tile rectangle tables.
+ */
+bool options_tile_rects(const tmj_load_options* options);
+
+/**
+ * @ingroup util
+ * Checks whether the given load options ask for object type and name
+ * indexes.
+ *
+ * @param options The load options, or NULL.
+ *
+ * @return True if options asks for object lookup indexes.
+ */
+bool options_object_lookup(const tmj_load_options* options);
+
+/**
+ * @ingroup util
+ * Hashes a string with 32-bit FNV-1a, for the library's string tables.
+ *
+ * @param str A null-terminated string.
+ *
+ * @return The string's hash.
+ */
+uint32_t hash_string(const char* str);
+
+/**
+ * @ingroup util
+ * Parses a Tiled color.
+ *
+ * @param color A color in "#RRGGBB" or "#AARRGGBB" form, or NULL.
+ *
+ * @return The color as 0xAARRGGBB. NULL and malformed colors are opaque white.
+ */
+uint32_t parse_color(const char* color);
+
+/**
+ * @ingroup util
+ * Multiplies two 0xAARRGGBB colors channel by channel, as Tiled combines the
+ * tints of nested layers.
+ *
+ * @return The product, rounded to the nearest 8-bit value per channel.
+ */
+uint32_t multiply_color(uint32_t a, uint32_t b);
+
+#endif
@@ -97,6 +97,30 @@ void test_zlib_decode(void) {
     free(msg_gzip_decompressed);
 }
 
+void test_zlib_decode_stats(void) {
+    const char* msg_zlib = "eJwLycgsVgCixLz8kozUIoWS1OISheKSosy8dEUGAKBMCl4=";
+
+    tmj_load_stats stats = {0};
+
+    tmj_load_stats_attach(&stats);
+
+    size_t size = 0;
+    uint32_t* out = tmj_decode_layer(msg_zlib, "base64", "zlib", &size);
+
+    tmj_load_stats_attach(NULL);
+
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_EQUAL_size_t(35, stats.bytes_b64);
+    TEST_ASSERT_EQUAL_size_t(29, stats.bytes_zlib);
+    TEST_ASSERT_EQUAL_size_t(0, stats.bytes_zstd);
+    TEST_ASSERT_TRUE(stats.zlib_ns > 0);
+    TEST_ASSERT_EQUAL_size_t(2, stats.alloc_count);
+    // The base64 buffer is released before the call returns
+    TEST_ASSERT_EQUAL_size_t(stats.alloc_bytes - 35, stats.live_bytes);
+
+    free(out);
+}
+
 void test_zlib_encode(void) {
     const char* msg_zlib = "This is another test string!";
 
@@ -138,6 +162,7 @@ int main(void) {
     RUN_TEST(test_b64_encode);
 #ifdef LIBTMJ_ZLIB
     RUN_TEST(test_zlib_decode);
+    RUN_TEST(test_zlib_decode_stats);
     RUN_TEST(test_zlib_encode);
 #endif
 #ifdef LIBTMJ_ZSTD
@@ -66,6 +66,68 @@ void test_map_load(void) {
     free(s);
 }
 
+void test_chunk_index(void) {
+    tmj_chunk_index* index = tmj_chunk_index_build(testmap_path);
+
+    TEST_ASSERT_NOT_NULL(index);
+
+    // The object layer has no chunks, so it isn't indexed
+    TEST_ASSERT_EQUAL_size_t(3, index->layer_count);
+    TEST_ASSERT_EQUAL_STRING("village", index->layers[1].name);
+    TEST_ASSERT_EQUAL_STRING("csv", index->layers[1].encoding);
+    TEST_ASSERT_EQUAL_size_t(2, index->layers[1].chunk_count);
+    TEST_ASSERT_EQUAL_size_t(4, index->layers[2].chunk_count);
+
+    // Only the chunks under the rectangle are loaded
+    tmj_region* region = tmj_region_load(index, 0, 20, 4, 8, 8);
+
+    TEST_ASSERT_NOT_NULL(region);
+    TEST_ASSERT_EQUAL_size_t(1, region->chunk_count);
+    TEST_ASSERT_EQUAL_INT(16, region->chunks[0].x);
+    TEST_ASSERT_EQUAL_INT(0, region->chunks[0].y);
+
+    // A rectangle straddling every chunk boundary
+    TEST_ASSERT_EQUAL_INT(0, tmj_region_move(region, 8, 8, 16, 16));
+    TEST_ASSERT_EQUAL_size_t(4, region->chunk_count);
+
+    TEST_ASSERT_EQUAL_UINT(0, tmj_region_tile(region, 100, 100));
+
+    tmj_region_free(region);
+
+    // Every indexed layer matches the full load
+    const size_t chunked[] = {0, 1, 3};
+
+    for (size_t l = 0; l < index->layer_count; l++) {
+        const Layer* layer = &mf->layers[chunked[l]];
+
+        TEST_ASSERT_EQUAL_INT(layer->id, index->layers[l].id);
+
+        region = tmj_region_load(index, l, 0, 0, 32, 32);
+
+        TEST_ASSERT_NOT_NULL(region);
+        TEST_ASSERT_EQUAL_size_t(layer->chunk_count, region->chunk_count);
+
+        for (size_t c = 0; c < layer->chunk_count; c++) {
+            const Chunk* chunk = &layer->chunks[c];
+
+            for (int y = 0; y < chunk->height; y++) {
+                for (int x = 0; x < chunk->width; x++) {
+                    TEST_ASSERT_EQUAL_UINT(chunk->data_uint[y * chunk->width + x], tmj_region_tile(region, chunk->x + x, chunk->y + y));
+                }
+            }
+        }
+
+        tmj_region_free(region);
+    }
+
+    TEST_ASSERT_NULL(tmj_region_load(index, 3, 0, 0, 1, 1));
+
+    tmj_chunk_index_free(index);
+
+    // Finite maps are not made of chunks
+    TEST_ASSERT_NULL(tmj_chunk_index_build("example/overworld.tmj"));
+}
+
 void test_map_free(void) {
     tmj_map_free(mf);
     tmj_map_free(mf2);
@@ -76,6 +138,7 @@ int main(void) {
     UNITY_BEGIN();
     RUN_TEST(test_map_loadf);
     RUN_TEST(test_map_load);
+    RUN_TEST(test_chunk_index);
     RUN_TEST(test_map_free);
     return UNITY_END();
 }
@@ -0,0 +1,1493 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/tmj.h"
+#include "../tools/mapgen.h"
+
+#include "Unity/src/unity.h"
+
+void log_cb(tmj_log_priority priority, const char* msg) {
+    switch (priority) {
+        case TMJ_LOG_DEBUG:
+            printf("DEBUG: %s\n", msg);
+            break;
+        case TMJ_LOG_INFO:
+            printf("INFO: %s\n", msg);
+            break;
+        case TMJ_LOG_WARNING:
+            printf("WARNING: %s\n", msg);
+            break;
+        case TMJ_LOG_ERR:
+            printf("ERR: %s\n", msg);
+            break;
+        case TMJ_LOG_CRIT:
+            printf("CRIT: %s\n", msg);
+            break;
+    }
+}
+
+void setUp(void) {
+    // Debug output for maps this size would drown out everything else
+    tmj_log_regcb(false, log_cb);
+}
+
+void tearDown(void) {}
+
+// Checks the decoded contents of every tile layer against the generator
+void check_tile_layers(const mapgen_config* config, const Map* map) {
+    size_t count = (size_t)config->width * config->height;
+    uint32_t* expected = malloc(count * sizeof(uint32_t));
+
+    TEST_ASSERT_NOT_NULL(expected);
+
+    for (int l = 0; l < config->tile_layers; l++) {
+        const Layer* layer = &map->layers[l];
+
+        TEST_ASSERT_EQUAL_STRING("tilelayer", layer->type);
+        TEST_ASSERT_EQUAL_INT(config->width, layer->width);
+        TEST_ASSERT_EQUAL_INT(config->height, layer->height);
+
+        mapgen_layer_tiles(config, l, expected);
+
+        if (!config->infinite) {
+            if (layer->data_is_str) {
+                size_t size = 0;
+                uint32_t* tiles = tmj_decode_layer(layer->data_str, layer->encoding, layer->compression ? layer->compression : "", &size);
+
+                TEST_ASSERT_NOT_NULL(tiles);
+                TEST_ASSERT_EQUAL_size_t(count, size);
+                TEST_ASSERT_EQUAL_MEMORY(expected, tiles, count * sizeof(uint32_t));
+
+                free(tiles);
+            } else {
+                TEST_ASSERT_EQUAL_size_t(count, layer->data_count);
+                TEST_ASSERT_EQUAL_MEMORY(expected, layer->data_uint, count * sizeof(uint32_t));
+            }
+
+            continue;
+        }
+
+        int chunks_x = (config->width + config->chunk_width - 1) / config->chunk_width;
+        int chunks_y = (config->height + config->chunk_height - 1) / config->chunk_height;
+
+        TEST_ASSERT_EQUAL_size_t((size_t)chunks_x * chunks_y, layer->chunk_count);
+
+        for (size_t c = 0; c < layer->chunk_count; c++) {
+            const Chunk* chunk = &layer->chunks[c];
+            size_t size = (size_t)chunk->width * chunk->height;
+            uint32_t* tiles = chunk->data_uint;
+
+            if (chunk->data_is_str) {
+                tiles = tmj_decode_layer(chunk->data_str, layer->encoding, layer->compression ? layer->compression : "", &size);
+
+                TEST_ASSERT_NOT_NULL(tiles);
+                TEST_ASSERT_EQUAL_size_t((size_t)chunk->width * chunk->height, size);
+            }
+
+            for (int y = 0; y < chunk->height; y++) {
+                for (int x = 0; x < chunk->width; x++) {
+                    int mx = chunk->x + x;
+                    int my = chunk->y + y;
+                    uint32_t want = mx < config->width && my < config->height ? expected[(size_t)my * config->width + mx] : 0;
+
+                    TEST_ASSERT_EQUAL_HEX32(want, tiles[y * chunk->width + x]);
+                }
+            }
+
+            if (chunk->data_is_str) {
+                free(tiles);
+            }
+        }
+    }
+
+    free(expected);
+}
+
+Map* load_generated(const mapgen_config* config) {
+    char* json = mapgen_map(config, NULL);
+
+    TEST_ASSERT_NOT_NULL(json);
+
+    Map* map = tmj_map_load(json, "generated");
+
+    free(json);
+
+    TEST_ASSERT_NOT_NULL(map);
+    TEST_ASSERT_EQUAL_size_t(config->tile_layers + config->object_layers, map->layer_count);
+    TEST_ASSERT_EQUAL_size_t(config->tilesets, map->tileset_count);
+
+    return map;
+}
+
+void test_generator_deterministic(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.seed = 42;
+
+    char* a = mapgen_map(&config, NULL);
+    char* b = mapgen_map(&config, NULL);
+
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_NOT_NULL(b);
+    TEST_ASSERT_EQUAL_STRING(a, b);
+
+    config.seed = 43;
+
+    char* c = mapgen_map(&config, NULL);
+
+    TEST_ASSERT_NOT_NULL(c);
+    TEST_ASSERT_TRUE(strcmp(a, c) != 0);
+
+    free(a);
+    free(b);
+    free(c);
+}
+
+void test_generator_invalid(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.compression = MAPGEN_ZLIB; // CSV can't be compressed
+
+    TEST_ASSERT_NULL(mapgen_map(&config, NULL));
+
+    mapgen_default_config(&config);
+    config.tile_layers = 0;
+    config.object_layers = 0;
+
+    TEST_ASSERT_NULL(mapgen_map(&config, NULL));
+}
+
+void test_large_csv(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.width = 256;
+    config.height = 256;
+
+    Map* map = load_generated(&config);
+
+    check_tile_layers(&config, map);
+
+    tmj_map_free(map);
+}
+
+void test_large_base64(void) {
+    const mapgen_compression methods[] = {MAPGEN_NONE, MAPGEN_ZLIB, MAPGEN_GZIP, MAPGEN_ZSTD};
+
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (!mapgen_compression_supported(methods[i])) {
+            continue;
+        }
+
+        mapgen_config config;
+
+        mapgen_default_config(&config);
+        config.width = 512;
+        config.height = 512;
+        config.encoding = MAPGEN_BASE64;
+        config.compression = methods[i];
+
+        Map* map = load_generated(&config);
+
+        check_tile_layers(&config, map);
+
+        tmj_map_free(map);
+    }
+}
+
+void test_large_infinite(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.width = 200; // Not a multiple of the chunk size, so edge chunks are padded
+    config.height = 120;
+    config.infinite = true;
+    config.chunk_width = 32;
+    config.chunk_height = 16;
+
+    Map* map = load_generated(&config);
+
+    TEST_ASSERT_TRUE(map->infinite);
+    check_tile_layers(&config, map);
+
+    tmj_map_free(map);
+
+    if (mapgen_compression_supported(MAPGEN_ZLIB)) {
+        config.encoding = MAPGEN_BASE64;
+        config.compression = MAPGEN_ZLIB;
+
+        map = load_generated(&config);
+
+        check_tile_layers(&config, map);
+
+        tmj_map_free(map);
+    }
+}
+
+void test_large_objects(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.tile_layers = 1;
+    config.object_layers = 4;
+    config.objects = 2000;
+    config.polygon_points = 32;
+    config.properties = 4;
+
+    Map* map = load_generated(&config);
+
+    size_t polygons = 0;
+    size_t closed = 0;
+    int next_id = 1;
+
+    for (int l = 0; l < config.object_layers; l++) {
+        const Layer* layer = &map->layers[config.tile_layers + l];
+        size_t points = 0;
+
+        TEST_ASSERT_EQUAL_STRING("objectgroup", layer->type);
+        TEST_ASSERT_EQUAL_size_t(config.objects, layer->object_count);
+
+        for (size_t i = 0; i < layer->object_count; i++) {
+            const Object* object = &layer->objects[i];
+
+            TEST_ASSERT_EQUAL_INT(next_id++, object->id);
+            TEST_ASSERT_EQUAL_PTR(object, tmj_map_object(map, object->id));
+            TEST_ASSERT_EQUAL_size_t(config.properties, object->property_count);
+
+            if (object->polygon != NULL) {
+                TEST_ASSERT_EQUAL_size_t(config.polygon_points, object->polygon_point_count);
+                polygons++;
+                closed += object->is_polygon;
+
+                // Points are pooled per layer, in object order
+                TEST_ASSERT_EQUAL_size_t(points, object->point_first);
+                TEST_ASSERT_EQUAL_PTR(layer->points + points, object->polygon);
+
+                points += object->polygon_point_count;
+            }
+        }
+
+        TEST_ASSERT_EQUAL_size_t(points, layer->point_count);
+    }
+
+    TEST_ASSERT_EQUAL_INT(next_id, map->nextobjectid);
+    TEST_ASSERT_NULL(tmj_map_object(map, 0));
+    TEST_ASSERT_NULL(tmj_map_object(map, next_id));
+    TEST_ASSERT_GREATER_THAN(0, polygons);
+
+    // Shapes are drawn evenly from polygons and polylines
+    TEST_ASSERT_GREATER_THAN(0, closed);
+    TEST_ASSERT_LESS_THAN(polygons, closed);
+
+    tmj_map_free(map);
+}
+
+void test_large_tilesets(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.tilesets = 8;
+    config.tiles = 1024;
+    config.animated_tiles = 64;
+
+    Map* map = load_generated(&config);
+
+    for (int i = 0; i < config.tilesets; i++) {
+        const Tileset* tileset = &map->tilesets[i];
+
+        TEST_ASSERT_EQUAL_INT(1 + i * config.tiles, tileset->firstgid);
+        TEST_ASSERT_EQUAL_INT(config.tiles, tileset->tilecount);
+        TEST_ASSERT_EQUAL_size_t(config.tiles, tileset->tile_count);
+        TEST_ASSERT_EQUAL_size_t(4, tileset->tiles[0].animation_count);
+    }
+
+    check_tile_layers(&config, map);
+
+    tmj_map_free(map);
+
+    // External tilesets are referenced by source, and load on their own
+    config.external_tilesets = true;
+
+    map = load_generated(&config);
+
+    char source[32];
+    snprintf(source, sizeof(source), MAPGEN_TILESET_SOURCE, 3);
+
+    TEST_ASSERT_EQUAL_STRING(source, map->tilesets[3].source);
+    TEST_ASSERT_EQUAL_INT(1 + 3 * config.tiles, map->tilesets[3].firstgid);
+
+    tmj_map_free(map);
+
+    char* json = mapgen_tileset(&config, 3, NULL);
+
+    TEST_ASSERT_NOT_NULL(json);
+
+    Tileset* tileset = tmj_tileset_load(json);
+
+    free(json);
+
+    TEST_ASSERT_NOT_NULL(tileset);
+    TEST_ASSERT_EQUAL_STRING("tileset3", tileset->name);
+    TEST_ASSERT_EQUAL_size_t(config.tiles, tileset->tile_count);
+
+    tmj_tileset_free(tileset);
+}
+
+void test_large_lazy(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.object_layers = 2;
+    config.objects = 500;
+    config.tilesets = 4;
+    config.animated_tiles = 16;
+
+    char* json = mapgen_map(&config, NULL);
+
+    TEST_ASSERT_NOT_NULL(json);
+
+    tmj_load_options options = {0};
+
+    options.lazy = true;
+
+    Map* eager = tmj_map_load(json, "eager");
+    Map* lazy = tmj_map_load_ex(json, "lazy", &options);
+
+    free(json);
+
+    TEST_ASSERT_NOT_NULL(eager);
+    TEST_ASSERT_NOT_NULL(lazy);
+
+    // Only the firstgid of deferred tilesets is known up front
+    for (int i = 0; i < config.tilesets; i++) {
+        TEST_ASSERT_EQUAL_INT(eager->tilesets[i].firstgid, lazy->tilesets[i].firstgid);
+        TEST_ASSERT_NULL(lazy->tilesets[i].tiles);
+        TEST_ASSERT_NULL(lazy->tilesets[i].name);
+    }
+
+    // Touch one tileset and one object layer, the rest stay deferred
+    Tileset* tileset = tmj_map_tileset(lazy, 2);
+
+    TEST_ASSERT_NOT_NULL(tileset);
+    TEST_ASSERT_EQUAL_PTR(&lazy->tilesets[2], tileset);
+    TEST_ASSERT_EQUAL_STRING(eager->tilesets[2].name, tileset->name);
+    TEST_ASSERT_EQUAL_size_t(eager->tilesets[2].tile_count, tileset->tile_count);
+    TEST_ASSERT_EQUAL_size_t(4, tileset->tiles[0].animation_count);
+    TEST_ASSERT_EQUAL_PTR(tileset, tmj_map_tileset(lazy, 2));
+    TEST_ASSERT_NULL(lazy->tilesets[3].tiles);
+
+    Layer* layer = &lazy->layers[config.tile_layers + 1];
+    size_t count = 0;
+    Object* objects = tmj_layer_objects(lazy, layer, &count);
+
+    TEST_ASSERT_NOT_NULL(objects);
+    TEST_ASSERT_EQUAL_size_t(config.objects, count);
+    TEST_ASSERT_NULL(lazy->layers[config.tile_layers].objects);
+
+    const Layer* expected = &eager->layers[config.tile_layers + 1];
+
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT_EQUAL_INT(expected->objects[i].id, objects[i].id);
+        TEST_ASSERT_EQUAL_size_t(expected->objects[i].property_count, objects[i].property_count);
+        TEST_ASSERT_EQUAL_size_t(expected->objects[i].polygon_point_count, objects[i].polygon_point_count);
+        TEST_ASSERT_EQUAL_PTR(&objects[i], tmj_map_object(lazy, objects[i].id));
+    }
+
+    // Objects of layers still deferred aren't indexed yet
+    TEST_ASSERT_NOT_NULL(tmj_map_object(eager, eager->layers[config.tile_layers].objects[0].id));
+    TEST_ASSERT_NULL(tmj_map_object(lazy, eager->layers[config.tile_layers].objects[0].id));
+
+    // Unpacking them adds them to the index, next to the objects already in it
+    objects = tmj_layer_objects(lazy, &lazy->layers[config.tile_layers], &count);
+
+    TEST_ASSERT_NOT_NULL(objects);
+
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT_EQUAL_PTR(&objects[i], tmj_map_object(lazy, objects[i].id));
+    }
+
+    TEST_ASSERT_EQUAL_PTR(&layer->objects[0], tmj_map_object(lazy, layer->objects[0].id));
+
+    // Tile data is not deferred
+    check_tile_layers(&config, lazy);
+
+    tmj_map_free(eager);
+    tmj_map_free(lazy);
+}
+
+void test_object_lookup(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.object_layers = 3;
+    config.objects = 1000;
+
+    char* json = mapgen_map(&config, NULL);
+
+    TEST_ASSERT_NOT_NULL(json);
+
+    tmj_load_options options = {0};
+
+    options.object_lookup = true;
+
+    Map* map = tmj_map_load_ex(json, "lookup", &options);
+
+    options.lazy = true;
+
+    Map* lazy = tmj_map_load_ex(json, "lazy", &options);
+
+    free(json);
+
+    TEST_ASSERT_NOT_NULL(map);
+    TEST_ASSERT_NOT_NULL(lazy);
+
+    const char* types[] = {"npc", "chest", "door", "spawn", "trigger", "sign", "enemy", "pickup"};
+    size_t total = 0;
+
+    for (int t = 0; t < 8; t++) {
+        uint32_t handle = tmj_map_object_type(map, types[t]);
+        size_t count = 0;
+        Object* const* objects = tmj_map_objects_of_type(map, handle, &count);
+
+        TEST_ASSERT_NOT_EQUAL(0, handle);
+        TEST_ASSERT_NOT_NULL(objects);
+
+        // Spans hold exactly the objects of the type, in layer order
+        size_t next = 0;
+
+        for (int l = 0; l < config.object_layers; l++) {
+            Layer* layer = &map->layers[config.tile_layers + l];
+
+            for (size_t i = 0; i < layer->object_count; i++) {
+                if (strcmp(layer->objects[i].type, types[t]) == 0) {
+                    TEST_ASSERT_LESS_THAN(count, next);
+                    TEST_ASSERT_EQUAL_PTR(&layer->objects[i], objects[next++]);
+                }
+            }
+        }
+
+        TEST_ASSERT_EQUAL_size_t(count, next);
+        total += count;
+    }
+
+    TEST_ASSERT_EQUAL_size_t(config.objects * config.object_layers, total);
+
+    // Generated names are unique
+    Object* target = &map->layers[config.tile_layers + 2].objects[17];
+    size_t count = 0;
+    Object* const* named = tmj_map_objects_named(map, tmj_map_object_name(map, target->name), &count);
+
+    TEST_ASSERT_EQUAL_size_t(1, count);
+    TEST_ASSERT_EQUAL_PTR(target, named[0]);
+
+    // Deferred layers join the indexes as they're unpacked, handles unchanged
+    TEST_ASSERT_EQUAL_UINT(0, tmj_map_object_type(lazy, "npc"));
+    TEST_ASSERT_NOT_NULL(tmj_layer_objects(lazy, &lazy->layers[config.tile_layers], NULL));
+
+    uint32_t npc = tmj_map_object_type(lazy, "npc");
+    size_t before = 0;
+
+    TEST_ASSERT_NOT_EQUAL(0, npc);
+    TEST_ASSERT_NOT_NULL(tmj_map_objects_of_type(lazy, npc, &before));
+    TEST_ASSERT_NOT_NULL(tmj_layer_objects(lazy, &lazy->layers[config.tile_layers + 1], NULL));
+    TEST_ASSERT_EQUAL_UINT(npc, tmj_map_object_type(lazy, "npc"));
+
+    size_t after = 0;
+
+    tmj_map_objects_of_type(lazy, npc, &after);
+    TEST_ASSERT_GREATER_THAN(before, after);
+
+    // With every layer unpacked in order, the spans match the eager load's
+    TEST_ASSERT_NOT_NULL(tmj_layer_objects(lazy, &lazy->layers[config.tile_layers + 2], NULL));
+
+    for (int t = 0; t < 8; t++) {
+        size_t eager_count = 0;
+        size_t lazy_count = 0;
+        Object* const* eager_objects = tmj_map_objects_of_type(map, tmj_map_object_type(map, types[t]), &eager_count);
+        Object* const* lazy_objects = tmj_map_objects_of_type(lazy, tmj_map_object_type(lazy, types[t]), &lazy_count);
+
+        TEST_ASSERT_EQUAL_size_t(eager_count, lazy_count);
+
+        for (size_t i = 0; i < lazy_count; i++) {
+            TEST_ASSERT_EQUAL_INT(eager_objects[i]->id, lazy_objects[i]->id);
+        }
+    }
+
+    named = tmj_map_objects_named(lazy, tmj_map_object_name(lazy, target->name), &count);
+
+    TEST_ASSERT_EQUAL_size_t(1, count);
+    TEST_ASSERT_EQUAL_PTR(&lazy->layers[config.tile_layers + 2].objects[17], named[0]);
+
+    tmj_map_free(map);
+    tmj_map_free(lazy);
+}
+
+void check_gid_index(const mapgen_config* config, const tmj_load_options* options) {
+    char* json = mapgen_map(config, NULL);
+
+    TEST_ASSERT_NOT_NULL(json);
+
+    Map* map = tmj_map_load_ex(json, "gid_index", options);
+
+    free(json);
+
+    TEST_ASSERT_NOT_NULL(map);
+
+    uint32_t gids[] = {1, 5, 17};
+    tmj_gid_index* index = tmj_gid_index_create(map, gids, 3);
+
+    TEST_ASSERT_NOT_NULL(index);
+    TEST_ASSERT_EQUAL_INT(0, tmj_gid_index_build(index));
+
+    size_t count = (size_t)config->width * config->height;
+    uint32_t* expected = malloc(count * sizeof(uint32_t));
+    tmj_tile_position* positions = malloc(count * config->tile_layers * sizeof(tmj_tile_position));
+
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(positions);
+
+    for (int g = 0; g < 3; g++) {
+        size_t found = tmj_gid_index_positions(index, gids[g], 0, positions, count * config->tile_layers);
+        size_t want = 0;
+
+        TEST_ASSERT_EQUAL_size_t(tmj_gid_index_count(index, gids[g]), found);
+
+        for (int l = 0; l < config->tile_layers; l++) {
+            mapgen_layer_tiles(config, l, expected);
+
+            for (size_t i = 0; i < count; i++) {
+                want += (expected[i] & TMJ_GID_MASK) == gids[g];
+            }
+        }
+
+        TEST_ASSERT_EQUAL_size_t(want, found);
+        TEST_ASSERT_GREATER_THAN(0, found);
+
+        // Every position holds the tile, as its layer stores it
+        for (size_t i = 0; i < found; i++) {
+            int l = (int)(positions[i].layer - map->layers);
+
+            mapgen_layer_tiles(config, l, expected);
+
+            TEST_ASSERT_EQUAL_HEX32(expected[(size_t)positions[i].y * config->width + positions[i].x], positions[i].gid);
+            TEST_ASSERT_EQUAL_UINT(gids[g], positions[i].gid & TMJ_GID_MASK);
+        }
+    }
+
+    free(positions);
+    free(expected);
+    tmj_gid_index_free(index);
+    tmj_map_free(map);
+}
+
+void test_gid_index(void) {
+    mapgen_config config;
+    tmj_load_options options = {0};
+
+    mapgen_default_config(&config);
+    config.width = 96;
+    config.height = 80;
+    config.tile_layers = 2;
+    config.object_layers = 0;
+    config.tiles = 32;
+
+    // Plain, then packed tiles read through a view
+    check_gid_index(&config, NULL);
+
+    options.compact_tiles = true;
+    check_gid_index(&config, &options);
+
+    // Encoded data is decoded part by part
+    config.encoding = MAPGEN_BASE64;
+    check_gid_index(&config, NULL);
+
+    config.infinite = true;
+    check_gid_index(&config, NULL);
+}
+
+void test_tile_columns(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.tile_layers = 1;
+    config.object_layers = 0;
+    config.tilesets = 3;
+    config.tiles = 300;
+    config.properties = 4;
+
+    Map* map = load_generated(&config);
+
+    tmj_column_spec specs[] = {{"prop0", TMJ_COLUMN_INT, -1}, {"prop1", TMJ_COLUMN_BOOL, 0}, {"prop2", TMJ_COLUMN_FLOAT, 0.5}};
+    tmj_tile_columns* columns = tmj_tile_columns_build(map, specs, 3);
+
+    TEST_ASSERT_NOT_NULL(columns);
+    TEST_ASSERT_EQUAL_UINT(1 + config.tilesets * config.tiles, columns->gid_count);
+
+    size_t checked = 0;
+
+    // Every tile definition agrees with the columns
+    for (size_t i = 0; i < map->tileset_count; i++) {
+        const Tileset* tileset = &map->tilesets[i];
+
+        for (size_t t = 0; t < tileset->tile_count; t++) {
+            const Tile* tile = &tileset->tiles[t];
+            uint32_t gid = (uint32_t)(tileset->firstgid + tile->id);
+            int32_t want_int = -1;
+            bool want_bool = false;
+            float want_float = 0.5f;
+
+            for (size_t p = 0; p < tile->property_count; p++) {
+                const Property* property = &tile->properties[p];
+                double value = 0;
+
+                if (strcmp(property->type, "int") == 0) {
+                    value = property->value_int;
+                } else if (strcmp(property->type, "bool") == 0) {
+                    value = property->value_bool;
+                } else {
+                    continue;
+                }
+
+                if (strcmp(property->name, "prop0") == 0) {
+                    want_int = (int32_t)value;
+                } else if (strcmp(property->name, "prop1") == 0) {
+                    want_bool = value != 0;
+                } else if (strcmp(property->name, "prop2") == 0) {
+                    want_float = (float)value;
+                }
+
+                checked++;
+            }
+
+            TEST_ASSERT_EQUAL_INT32(want_int, columns->columns[0].ints[gid]);
+            TEST_ASSERT_EQUAL_UINT64(want_bool, (columns->columns[1].bits[gid >> 6] >> (gid & 63)) & 1);
+            TEST_ASSERT_EQUAL_FLOAT(want_float, columns->columns[2].floats[gid]);
+        }
+    }
+
+    TEST_ASSERT_GREATER_THAN(0, checked);
+
+    tmj_tile_columns_free(columns);
+    tmj_map_free(map);
+}
+
+void test_chunk_cache(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.width = 128;
+    config.height = 64;
+    config.tile_layers = 1;
+    config.object_layers = 0;
+    config.infinite = true;
+    config.encoding = MAPGEN_BASE64;
+    config.compression = mapgen_compression_supported(MAPGEN_ZLIB) ? MAPGEN_ZLIB : MAPGEN_NONE;
+
+    Map* map = load_generated(&config);
+    const Layer* layer = &map->layers[0];
+    size_t chunk_bytes = (size_t)config.chunk_width * config.chunk_height * sizeof(uint32_t);
+
+    TEST_ASSERT_EQUAL_size_t(32, layer->chunk_count);
+
+    uint32_t* expected = malloc((size_t)config.width * config.height * sizeof(uint32_t));
+
+    TEST_ASSERT_NOT_NULL(expected);
+
+    mapgen_layer_tiles(&config, 0, expected);
+
+    tmj_chunk_cache* cache = tmj_chunk_cache_create(4 * chunk_bytes);
+
+    TEST_ASSERT_NOT_NULL(cache);
+
+    // Two passes over every chunk, with room for only four of them
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t c = 0; c < layer->chunk_count; c++) {
+            const Chunk* chunk = &layer->chunks[c];
+            size_t size = 0;
+            const uint32_t* tiles = tmj_chunk_cache_get(cache, layer, chunk, &size);
+
+            TEST_ASSERT_NOT_NULL(tiles);
+            TEST_ASSERT_EQUAL_size_t((size_t)chunk->width * chunk->height, size);
+
+            for (int y = 0; y < chunk->height; y++) {
+                TEST_ASSERT_EQUAL_MEMORY(&expected[(size_t)(chunk->y + y) * config.width + chunk->x], &tiles[y * chunk->width], chunk->width * sizeof(uint32_t));
+            }
+
+            // Hits hand back the same decoded data
+            TEST_ASSERT_EQUAL_PTR(tiles, tmj_chunk_cache_get(cache, layer, chunk, NULL));
+
+            tmj_chunk_cache_release(cache, chunk);
+            tmj_chunk_cache_release(cache, chunk);
+        }
+    }
+
+    tmj_chunk_cache_stats stats;
+
+    tmj_chunk_cache_read_stats(cache, &stats);
+
+    TEST_ASSERT_EQUAL_size_t(2 * layer->chunk_count, stats.misses);
+    TEST_ASSERT_EQUAL_size_t(2 * layer->chunk_count, stats.hits);
+    TEST_ASSERT_EQUAL_size_t(2 * layer->chunk_count - 4, stats.evictions);
+    TEST_ASSERT_EQUAL_size_t(4, stats.resident_chunks);
+    TEST_ASSERT_EQUAL_size_t(4 * chunk_bytes, stats.resident_bytes);
+
+    // The most recently used chunk is still resident
+    const Chunk* last = &layer->chunks[layer->chunk_count - 1];
+
+    TEST_ASSERT_NOT_NULL(tmj_chunk_cache_get(cache, layer, last, NULL));
+    tmj_chunk_cache_release(cache, last);
+
+    // Pinned chunks are kept even when they don't fit
+    for (size_t c = 0; c < 6; c++) {
+        TEST_ASSERT_NOT_NULL(tmj_chunk_cache_get(cache, layer, &layer->chunks[c], NULL));
+    }
+
+    tmj_chunk_cache_read_stats(cache, &stats);
+
+    TEST_ASSERT_EQUAL_size_t(6, stats.resident_chunks);
+
+    for (size_t c = 0; c < 6; c++) {
+        tmj_chunk_cache_release(cache, &layer->chunks[c]);
+    }
+
+    tmj_chunk_cache_read_stats(cache, &stats);
+
+    TEST_ASSERT_EQUAL_size_t(4, stats.resident_chunks);
+    TEST_ASSERT_EQUAL_size_t(2 * layer->chunk_count + 1, stats.hits);
+
+    tmj_chunk_cache_free(cache);
+    free(expected);
+    tmj_map_free(map);
+}
+
+void test_region_streaming(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.width = 200;
+    config.height = 150;
+    config.tile_layers = 2;
+    config.infinite = true;
+    config.chunk_width = 32;
+    config.chunk_height = 16;
+    config.encoding = MAPGEN_BASE64;
+    config.compression = mapgen_compression_supported(MAPGEN_ZSTD) ? MAPGEN_ZSTD : MAPGEN_NONE;
+
+    size_t size = 0;
+    char* json = mapgen_map(&config, &size);
+
+    TEST_ASSERT_NOT_NULL(json);
+
+    const char* path = LIBTMJ_TEST_OUTPUT_DIR "/region_streaming.tmj";
+    FILE* f = fopen(path, "wb");
+
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL_size_t(size, fwrite(json, 1, size, f));
+    TEST_ASSERT_EQUAL_INT(0, fclose(f));
+
+    free(json);
+
+    // Everything the index and region allocate is released again as they are freed
+    tmj_load_stats stats = {0};
+
+    tmj_load_stats_attach(&stats);
+
+    tmj_chunk_index* index = tmj_chunk_index_build(path);
+
+    TEST_ASSERT_NOT_NULL(index);
+    TEST_ASSERT_EQUAL_size_t(config.tile_layers, index->layer_count);
+    TEST_ASSERT_EQUAL_size_t(7 * 10, index->layers[1].chunk_count);
+    TEST_ASSERT_EQUAL_INT(32, index->layers[1].max_chunk_width);
+
+    uint32_t* expected = malloc((size_t)config.width * config.height * sizeof(uint32_t));
+
+    TEST_ASSERT_NOT_NULL(expected);
+
+    mapgen_layer_tiles(&config, 1, expected);
+
+    // Pan a 40x30 camera diagonally across the map
+    tmj_region* region = tmj_region_load(index, 1, -20, -10, 40, 30);
+
+    TEST_ASSERT_NOT_NULL(region);
+
+    for (int step = 0; step < 12; step++) {
+        int cx = -20 + step * 17;
+        int cy = -10 + step * 13;
+
+        const uint32_t* kept = NULL;
+        int kept_x = 0;
+        int kept_y = 0;
+
+        // Remember a chunk which will still be in range after the move
+        for (size_t c = 0; c < region->chunk_count && step > 0; c++) {
+            const tmj_region_chunk* chunk = &region->chunks[c];
+
+            if (chunk->x + chunk->width > cx + 17 && chunk->y + chunk->height > cy + 13) {
+                kept = chunk->data;
+                kept_x = chunk->x;
+                kept_y = chunk->y;
+
+                break;
+            }
+        }
+
+        TEST_ASSERT_EQUAL_INT(0, tmj_region_move(region, cx, cy, 40, 30));
+
+        // Chunks still in range are not read again
+        if (kept != NULL) {
+            bool found = false;
+
+            for (size_t c = 0; c < region->chunk_count; c++) {
+                if (region->chunks[c].x == kept_x && region->chunks[c].y == kept_y) {
+                    TEST_ASSERT_EQUAL_PTR(kept, region->chunks[c].data);
+                    found = true;
+                }
+            }
+
+            TEST_ASSERT_TRUE(found);
+        }
+
+        for (int y = cy; y < cy + 30; y++) {
+            for (int x = cx; x < cx + 40; x++) {
+                bool inside = x >= 0 && y >= 0 && x < config.width && y < config.height;
+
+                TEST_ASSERT_EQUAL_HEX32(inside ? expected[(size_t)y * config.width + x] : 0, tmj_region_tile(region, x, y));
+            }
+        }
+
+        // At most a 3x3 block of chunks covers a 40x30 rectangle
+        TEST_ASSERT_LESS_OR_EQUAL(9, region->chunk_count);
+    }
+
+    tmj_region_free(region);
+    tmj_chunk_index_free(index);
+    tmj_load_stats_attach(NULL);
+
+    TEST_ASSERT_GREATER_THAN(0, stats.alloc_bytes);
+    TEST_ASSERT_EQUAL_size_t(0, stats.live_bytes);
+
+    free(expected);
+    remove(path);
+}
+
+// Checks packed tiles against the array they were packed from, one at a time and in runs
+void check_packed(const tmj_tiles* tiles, const uint32_t* gids, size_t count) {
+    TEST_ASSERT_EQUAL_size_t(count, tiles->count);
+
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT_EQUAL_HEX32(gids[i], tmj_tiles_get(tiles, i));
+    }
+
+    uint32_t run[77];
+
+    // Runs that start and end off byte boundaries of the flag planes
+    for (size_t start = 3; start + 77 <= count; start += 501) {
+        tmj_tiles_read(tiles, start, 77, run);
+
+        TEST_ASSERT_EQUAL_MEMORY(gids + start, run, sizeof(run));
+    }
+}
+
+void test_compact_tiles(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.width = 256;
+    config.height = 256;
+    config.tile_layers = 1;
+    config.object_layers = 0;
+
+    size_t count = (size_t)config.width * config.height;
+    uint32_t* gids = malloc(count * sizeof(uint32_t));
+
+    TEST_ASSERT_NOT_NULL(gids);
+
+    // Tile ID ranges that need one, two and four bytes
+    const int tiles[] = {200, 4096, 40000};
+    const int tilesets[] = {1, 4, 2};
+    const uint8_t widths[] = {1, 2, 4};
+
+    for (size_t i = 0; i < 3; i++) {
+        config.tiles = tiles[i];
+        config.tilesets = tilesets[i];
+
+        mapgen_layer_tiles(&config, 0, gids);
+
+        tmj_tiles* packed = tmj_tiles_compact(gids, count);
+
+        TEST_ASSERT_NOT_NULL(packed);
+        TEST_ASSERT_EQUAL_UINT8(widths[i], packed->id_bytes);
+        TEST_ASSERT_NOT_NULL(packed->flags); // The generator flips the odd tile
+
+        check_packed(packed, gids, count);
+
+        tmj_tiles_free(packed);
+
+        // Without flags there are no flag planes
+        for (size_t t = 0; t < count; t++) {
+            gids[t] &= TMJ_GID_MASK;
+        }
+
+        packed = tmj_tiles_compact(gids, count);
+
+        TEST_ASSERT_NOT_NULL(packed);
+        TEST_ASSERT_NULL(packed->flags);
+
+        check_packed(packed, gids, count);
+
+        tmj_tiles_free(packed);
+    }
+
+    free(gids);
+
+    // Loading with compact_tiles packs CSV layers and chunks
+    config.tiles = 256;
+    config.tilesets = 1;
+    config.tile_layers = 2;
+
+    for (int infinite = 0; infinite < 2; infinite++) {
+        config.infinite = infinite;
+
+        char* json = mapgen_map(&config, NULL);
+
+        TEST_ASSERT_NOT_NULL(json);
+
+        tmj_load_options options = {0};
+
+        options.compact_tiles = true;
+
+        tmj_load_stats plain_stats = {0};
+        tmj_load_stats compact_stats = {0};
+
+        tmj_load_stats_attach(&plain_stats);
+        Map* plain = tmj_map_load(json, "plain");
+        tmj_load_stats_attach(&compact_stats);
+        Map* compact = tmj_map_load_ex(json, "compact", &options);
+        tmj_load_stats_attach(NULL);
+
+        free(json);
+
+        TEST_ASSERT_NOT_NULL(plain);
+        TEST_ASSERT_NOT_NULL(compact);
+
+        for (int l = 0; l < config.tile_layers; l++) {
+            const Layer* a = &plain->layers[l];
+            const Layer* b = &compact->layers[l];
+
+            if (!infinite) {
+                TEST_ASSERT_NULL(b->data_uint);
+                TEST_ASSERT_NOT_NULL(b->data_compact);
+                TEST_ASSERT_EQUAL_UINT8(2, b->data_compact->id_bytes);
+
+                for (int y = 0; y < config.height; y++) {
+                    for (int x = 0; x < config.width; x++) {
+                        TEST_ASSERT_EQUAL_HEX32(tmj_layer_tile(a, x, y), tmj_layer_tile(b, x, y));
+                    }
+                }
+
+                continue;
+            }
+
+            for (size_t c = 0; c < a->chunk_count; c++) {
+                TEST_ASSERT_NULL(b->chunks[c].data_uint);
+                TEST_ASSERT_NOT_NULL(b->chunks[c].data_compact);
+
+                for (int y = 0; y < a->chunks[c].height; y++) {
+                    for (int x = 0; x < a->chunks[c].width; x++) {
+                        TEST_ASSERT_EQUAL_HEX32(tmj_chunk_tile(&a->chunks[c], x, y), tmj_chunk_tile(&b->chunks[c], x, y));
+                    }
+                }
+            }
+        }
+
+        // Tile data dominates these maps, so packing it to 16 bits nearly halves what stays allocated
+        TEST_ASSERT_LESS_THAN(plain_stats.live_bytes * 2 / 3, compact_stats.live_bytes);
+
+        tmj_map_free(plain);
+        tmj_map_free(compact);
+    }
+}
+
+// Walks a view over a layer and checks it reports exactly the non-empty tiles of gids inside the rectangle
+void check_view(const Layer* layer, const uint32_t* gids, int width, int height, int left, int top, int right, int bottom) {
+    uint32_t* seen = calloc((size_t)width * height, sizeof(uint32_t));
+
+    TEST_ASSERT_NOT_NULL(seen);
+
+    tmj_view view;
+    tmj_view_run run;
+
+    tmj_view_begin(&view, layer, left, top, right - left, bottom - top);
+
+    while (tmj_view_next(&view, &run)) {
+        TEST_ASSERT_GREATER_THAN(0, run.length);
+        TEST_ASSERT_TRUE(run.x >= left && run.x + run.length <= right);
+        TEST_ASSERT_TRUE(run.y >= top && run.y < bottom);
+
+        for (int i = 0; i < run.length; i++) {
+            size_t index = (size_t)run.y * width + run.x + i;
+
+            TEST_ASSERT_NOT_EQUAL(0, run.gids[i]);
+            TEST_ASSERT_EQUAL_HEX32(0, seen[index]);
+
+            seen[index] = run.gids[i];
+        }
+    }
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            bool inside = x >= left && x < right && y >= top && y < bottom;
+            size_t index = (size_t)y * width + x;
+
+            TEST_ASSERT_EQUAL_HEX32(inside ? gids[index] : 0, seen[index]);
+        }
+    }
+
+    free(seen);
+}
+
+void test_sparse_tiles(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.width = 256;
+    config.height = 256;
+    config.tile_layers = 1;
+    config.object_layers = 0;
+    config.empty_percent = 95;
+
+    size_t count = (size_t)config.width * config.height;
+    uint32_t* gids = malloc(count * sizeof(uint32_t));
+
+    TEST_ASSERT_NOT_NULL(gids);
+
+    mapgen_layer_tiles(&config, 0, gids);
+
+    tmj_tiles* sparse = tmj_tiles_sparse(gids, config.width, config.height);
+    tmj_tiles* packed = tmj_tiles_compact(gids, count);
+
+    TEST_ASSERT_NOT_NULL(sparse);
+    TEST_ASSERT_NOT_NULL(packed);
+    TEST_ASSERT_NOT_NULL(sparse->rows);
+    TEST_ASSERT_LESS_THAN(count / 10, sparse->stored);
+    TEST_ASSERT_LESS_THAN(packed->size / 4, sparse->size);
+
+    check_packed(sparse, gids, count);
+
+    // Reads across several rows
+    uint32_t* rows = malloc(3 * config.width * sizeof(uint32_t));
+
+    TEST_ASSERT_NOT_NULL(rows);
+
+    tmj_tiles_read(sparse, 100, 3 * config.width, rows);
+
+    TEST_ASSERT_EQUAL_MEMORY(gids + 100, rows, 3 * config.width * sizeof(uint32_t));
+
+    free(rows);
+    tmj_tiles_free(sparse);
+    tmj_tiles_free(packed);
+
+    // Views over every storage, on finite and infinite maps, including rectangles hanging off the layer
+    const int rects[][4] = {{0, 0, 256, 256}, {-7, 13, 100, 77}, {250, 250, 300, 300}, {31, 0, 33, 256}};
+
+    for (int infinite = 0; infinite < 2; infinite++) {
+        config.infinite = infinite;
+
+        char* json = mapgen_map(&config, NULL);
+
+        TEST_ASSERT_NOT_NULL(json);
+
+        tmj_load_options options[3] = {{0}, {0}, {0}};
+
+        options[1].compact_tiles = true;
+        options[2].sparse_tiles = true;
+
+        tmj_load_stats stats[3] = {{0}, {0}, {0}};
+
+        for (int o = 0; o < 3; o++) {
+            tmj_load_stats_attach(&stats[o]);
+            Map* map = tmj_map_load_ex(json, "view", &options[o]);
+            tmj_load_stats_attach(NULL);
+
+            TEST_ASSERT_NOT_NULL(map);
+
+            const Layer* layer = &map->layers[0];
+
+            if (o == 2 && !infinite) {
+                TEST_ASSERT_NOT_NULL(layer->data_compact);
+                TEST_ASSERT_NOT_NULL(layer->data_compact->rows);
+            }
+
+            for (size_t r = 0; r < sizeof(rects) / sizeof(rects[0]); r++) {
+                int left = rects[r][0] > 0 ? rects[r][0] : 0;
+                int top = rects[r][1] > 0 ? rects[r][1] : 0;
+
+                check_view(layer, gids, config.width, config.height, rects[r][0], rects[r][1], rects[r][2], rects[r][3]);
+
+                // Rectangles clipped to the layer see the same tiles
+                check_view(layer, gids, config.width, config.height, left, top, rects[r][2] < 256 ? rects[r][2] : 256,
+                        rects[r][3] < 256 ? rects[r][3] : 256);
+            }
+
+            tmj_map_free(map);
+        }
+
+        free(json);
+
+        // Storing only the non-empty tiles beats packing all of them, by less on 16x16 chunks where row offsets weigh more
+        TEST_ASSERT_LESS_THAN(infinite ? stats[1].live_bytes : stats[1].live_bytes / 2, stats[2].live_bytes);
+    }
+
+    free(gids);
+}
+
+void test_gids_split(void) {
+    // Every flag combination, around every tile ID width, followed by generated tiles
+    uint32_t gids[1024 + 64];
+
+    for (uint32_t i = 0; i < 64; i++) {
+        gids[i] = (i % 16) << TMJ_GID_FLAGS_SHIFT | (i < 32 ? i : TMJ_GID_MASK - i);
+    }
+
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.width = 32;
+    config.height = 32;
+
+    mapgen_layer_tiles(&config, 0, gids + 64);
+
+    uint32_t ids[1024 + 64];
+    uint8_t flags[1024 + 64];
+
+    // Odd offsets and lengths exercise the unaligned loads and the scalar tail
+    for (size_t start = 0; start < 3; start++) {
+        for (size_t count = 0; count + start <= 1024 + 64; count += count < 40 ? 1 : 331) {
+            memset(ids, 0xAA, sizeof(ids));
+            memset(flags, 0xAA, sizeof(flags));
+
+            tmj_gids_split(gids + start, count, ids + start, flags + start);
+
+            for (size_t i = 0; i < count; i++) {
+                TEST_ASSERT_EQUAL_HEX32(gids[start + i] & TMJ_GID_MASK, ids[start + i]);
+                TEST_ASSERT_EQUAL_UINT8(gids[start + i] >> 28, flags[start + i]);
+            }
+
+            // Nothing is written past the end
+            if (start + count < 1024 + 64) {
+                TEST_ASSERT_EQUAL_HEX32(0xAAAAAAAA, ids[start + count]);
+                TEST_ASSERT_EQUAL_UINT8(0xAA, flags[start + count]);
+            }
+        }
+    }
+
+    // Either output can be left out
+    memset(ids, 0, sizeof(ids));
+
+    tmj_gids_split(gids, 1024 + 64, NULL, flags);
+    tmj_gids_split(gids, 1024 + 64, ids, NULL);
+
+    for (size_t i = 0; i < 1024 + 64; i++) {
+        TEST_ASSERT_EQUAL_HEX32(gids[i] & TMJ_GID_MASK, ids[i]);
+        TEST_ASSERT_EQUAL_UINT8(gids[i] >> 28, flags[i]);
+    }
+}
+
+void test_large_tile_rects(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.tilesets = 3;
+
+    char* json = mapgen_map(&config, NULL);
+
+    TEST_ASSERT_NOT_NULL(json);
+
+    tmj_load_options options = {0};
+
+    options.tile_rects = true;
+
+    // Built at load, and on first access for tilesets a lazy load deferred
+    for (int lazy = 0; lazy < 2; lazy++) {
+        options.lazy = lazy;
+
+        Map* map = tmj_map_load_ex(json, "rects", &options);
+
+        TEST_ASSERT_NOT_NULL(map);
+
+        for (size_t i = 0; i < map->tileset_count; i++) {
+            Tileset* tileset = tmj_map_tileset(map, i);
+
+            TEST_ASSERT_NOT_NULL(tileset);
+            TEST_ASSERT_EQUAL_size_t(config.tiles, tileset->rect_count);
+
+            for (size_t id = 0; id < tileset->rect_count; id++) {
+                const tmj_tile_rect* rect = &tileset->rects[id];
+
+                TEST_ASSERT_EQUAL_PTR(tileset->image, rect->image);
+                TEST_ASSERT_EQUAL_INT((int)(id % tileset->columns) * tileset->tilewidth, rect->x);
+                TEST_ASSERT_EQUAL_INT((int)(id / tileset->columns) * tileset->tileheight, rect->y);
+                TEST_ASSERT_TRUE(rect->u1 <= 1.0f && rect->v1 <= 1.0f);
+                TEST_ASSERT_EQUAL_FLOAT(map->tilewidth, rect->draw_width);
+            }
+        }
+
+        tmj_map_free(map);
+    }
+
+    free(json);
+}
+
+/**
+ * Counts the tiles of the given layer in a rectangle of 16x16 blocks.
+ */
+static size_t block_tiles(const mapgen_config* config, int layer, int x0, int y0, int x1, int y1) {
+    uint32_t* gids = malloc((size_t)config->width * config->height * sizeof(uint32_t));
+
+    TEST_ASSERT_NOT_NULL(gids);
+
+    mapgen_layer_tiles(config, layer, gids);
+
+    size_t count = 0;
+
+    for (int y = y0 * 16; y < y1 * 16 && y < config->height; y++) {
+        for (int x = x0 * 16; x < x1 * 16 && x < config->width; x++) {
+            count += gids[(size_t)y * config->width + x] != 0;
+        }
+    }
+
+    free(gids);
+
+    return count;
+}
+
+void test_batch_builder(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.width = 128;
+    config.height = 96;
+    config.tilesets = 3;
+
+    Map* map = load_generated(&config);
+    tmj_batch_builder* builder = tmj_batch_builder_create(map);
+
+    TEST_ASSERT_NOT_NULL(builder);
+
+    float block_width = 16.0f * map->tilewidth;
+    float block_height = 16.0f * map->tileheight;
+
+    // Straddles blocks [1, 4) x [1, 3)
+    TEST_ASSERT_EQUAL_INT(1, tmj_batch_builder_update(builder, block_width + 8, block_height + 8, block_width * 2, block_height));
+
+    size_t instance_count = 0;
+    size_t batch_count = 0;
+
+    const tmj_tile_instance* instances = tmj_batch_builder_instances(builder, &instance_count);
+    const tmj_batch* batches = tmj_batch_builder_batches(builder, &batch_count);
+
+    size_t expected = 0;
+
+    for (int l = 0; l < config.tile_layers; l++) {
+        expected += block_tiles(&config, l, 1, 1, 4, 3);
+    }
+
+    TEST_ASSERT_EQUAL_size_t(expected, instance_count);
+
+    // Batches cover the instances in order, one per layer and tileset at most
+    size_t next = 0;
+
+    for (size_t b = 0; b < batch_count; b++) {
+        TEST_ASSERT_EQUAL_size_t(next, batches[b].first);
+        TEST_ASSERT_EQUAL_PTR(map->tilesets[batches[b].tileset].image, batches[b].image);
+
+        for (size_t b2 = 0; b2 < b; b2++) {
+            TEST_ASSERT_FALSE(batches[b2].layer == batches[b].layer && batches[b2].tileset == batches[b].tileset);
+        }
+
+        for (size_t i = batches[b].first; i < batches[b].first + batches[b].count; i++) {
+            TEST_ASSERT_TRUE(instances[i].x >= block_width && instances[i].x < block_width * 4);
+            TEST_ASSERT_TRUE(instances[i].y >= block_height && instances[i].y < block_height * 3);
+        }
+
+        next += batches[b].count;
+    }
+
+    TEST_ASSERT_EQUAL_size_t(instance_count, next);
+    TEST_ASSERT_LESS_OR_EQUAL(config.tile_layers * config.tilesets, batch_count);
+
+    // Blocks are kept while in view, and built when the view reaches new ones
+    TEST_ASSERT_EQUAL_INT(0, tmj_batch_builder_update(builder, block_width + 4, block_height + 4, block_width * 2, block_height));
+    TEST_ASSERT_EQUAL_INT(1, tmj_batch_builder_update(builder, block_width * 2 + 8, block_height + 8, block_width * 2, block_height));
+
+    instances = tmj_batch_builder_instances(builder, &instance_count);
+    expected = 0;
+
+    for (int l = 0; l < config.tile_layers; l++) {
+        expected += block_tiles(&config, l, 2, 1, 5, 3);
+    }
+
+    TEST_ASSERT_EQUAL_size_t(expected, instance_count);
+
+    tmj_batch_builder_free(builder);
+    tmj_map_free(map);
+}
+
+void test_large_animation(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.tilesets = 2;
+    config.animated_tiles = 16;
+
+    Map* map = load_generated(&config);
+    tmj_animator* animator = tmj_animator_create(map);
+
+    TEST_ASSERT_NOT_NULL(animator);
+
+    uint32_t* gids = malloc((size_t)config.width * config.height * sizeof(uint32_t));
+
+    TEST_ASSERT_NOT_NULL(gids);
+
+    size_t expected = 0;
+
+    for (int l = 0; l < config.tile_layers; l++) {
+        mapgen_layer_tiles(&config, l, gids);
+
+        for (int i = 0; i < config.width * config.height; i++) {
+            uint32_t id = gids[i] & TMJ_GID_MASK;
+
+            for (size_t t = 0; t < map->tileset_count; t++) {
+                uint32_t firstgid = (uint32_t)map->tilesets[t].firstgid;
+
+                expected += id >= firstgid && id < firstgid + (uint32_t)config.animated_tiles;
+            }
+        }
+    }
+
+    free(gids);
+
+    size_t count = 0;
+    const tmj_animated_tile* tiles = tmj_animator_tiles(animator, &count);
+
+    TEST_ASSERT_EQUAL_size_t(expected, count);
+
+    uint32_t* before = malloc(count * sizeof(uint32_t));
+
+    TEST_ASSERT_NOT_NULL(before);
+
+    // Every tick reports exactly the positions whose frame changed
+    for (int tick = 0; tick < 100; tick++) {
+        size_t changed = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            before[i] = tmj_animator_frame(animator, tiles[i].gid);
+        }
+
+        size_t dirty_count = tmj_animator_tick(animator, 17 + (uint32_t)tick % 40);
+        const tmj_animated_tile* dirty = tmj_animator_dirty(animator, &dirty_count);
+
+        for (size_t i = 0; i < count; i++) {
+            changed += tmj_animator_frame(animator, tiles[i].gid) != before[i];
+        }
+
+        TEST_ASSERT_EQUAL_size_t(changed, dirty_count);
+        TEST_ASSERT_TRUE(dirty_count == 0 || dirty != NULL);
+    }
+
+    free(before);
+
+    tmj_animator_free(animator);
+    tmj_map_free(map);
+}
+
+void test_object_soa_cull(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.tile_layers = 1;
+    config.objects = 5000;
+
+    Map* map = load_generated(&config);
+    tmj_object_soa* soa = tmj_object_soa_build(map, &map->layers[1]);
+
+    TEST_ASSERT_NOT_NULL(soa);
+    TEST_ASSERT_EQUAL_size_t(map->layers[1].object_count, soa->count);
+
+    for (size_t i = 0; i < soa->count; i++) {
+        const Object* object = &soa->objects[i];
+
+        TEST_ASSERT_EQUAL_INT(object->id, soa->ids[i]);
+        TEST_ASSERT_EQUAL_FLOAT((float)object->x, soa->x[i]);
+        TEST_ASSERT_TRUE(soa->min_x[i] <= soa->max_x[i] && soa->min_y[i] <= soa->max_y[i]);
+
+        if (soa->types[i] == 0) {
+            TEST_ASSERT_TRUE(object->type == NULL || object->type[0] == '\0');
+        } else {
+            TEST_ASSERT_EQUAL_STRING(object->type, soa->type_names[soa->types[i]]);
+        }
+
+        // Boxes have a corner at the object's position, rotated or not; polygon points may not
+        if (object->polygon == NULL) {
+            TEST_ASSERT_TRUE(soa->min_x[i] <= (float)object->x && (float)object->x <= soa->max_x[i]);
+            TEST_ASSERT_TRUE(soa->min_y[i] <= (float)object->y && (float)object->y <= soa->max_y[i]);
+        }
+    }
+
+    uint32_t* indices = malloc(soa->count * sizeof(uint32_t));
+
+    TEST_ASSERT_NOT_NULL(indices);
+
+    // The vector path agrees with a plain loop, including rectangles that cover nothing or everything
+    const float rects[][4] = {{100, 100, 612, 400}, {0, 0, 1, 1}, {-1e6f, -1e6f, 1e6f, 1e6f}, {5000, 5000, 6000, 6000}, {333, 0, 334, 4096}};
+
+    for (size_t r = 0; r < sizeof(rects) / sizeof(rects[0]); r++) {
+        const float* rect = rects[r];
+        size_t hits = tmj_object_soa_cull(soa, rect[0], rect[1], rect[2], rect[3], indices);
+        size_t expected = 0;
+
+        for (size_t i = 0; i < soa->count; i++) {
+            if (soa->min_x[i] <= rect[2] && soa->max_x[i] >= rect[0] && soa->min_y[i] <= rect[3] && soa->max_y[i] >= rect[1]) {
+                TEST_ASSERT_TRUE(expected < hits);
+                TEST_ASSERT_EQUAL_UINT((uint32_t)i, indices[expected]);
+
+                expected++;
+            }
+        }
+
+        TEST_ASSERT_EQUAL_size_t(expected, hits);
+    }
+
+    free(indices);
+
+    tmj_object_soa_free(soa);
+    tmj_map_free(map);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_generator_deterministic);
+    RUN_TEST(test_generator_invalid);
+    RUN_TEST(test_large_csv);
+    RUN_TEST(test_large_base64);
+    RUN_TEST(test_large_infinite);
+    RUN_TEST(test_large_objects);
+    RUN_TEST(test_large_tilesets);
+    RUN_TEST(test_large_lazy);
+    RUN_TEST(test_object_lookup);
+    RUN_TEST(test_chunk_cache);
+    RUN_TEST(test_region_streaming);
+    RUN_TEST(test_compact_tiles);
+    RUN_TEST(test_sparse_tiles);
+    RUN_TEST(test_gids_split);
+    RUN_TEST(test_large_tile_rects);
+    RUN_TEST(test_batch_builder);
+    RUN_TEST(test_large_animation);
+    RUN_TEST(test_object_soa_cull);
+    RUN_TEST(test_gid_index);
+    RUN_TEST(test_tile_columns);
+    return UNITY_END();
+}
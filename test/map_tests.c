@@ -1,4 +1,6 @@
+#include <math.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "../include/tmj.h"
 
@@ -69,6 +71,1198 @@ void test_map_load(void) {
     free(s);
 }
 
+void test_map_load_stats(void) {
+    tmj_load_stats stats = {0};
+
+    TEST_ASSERT_NULL(tmj_load_stats_attach(&stats));
+
+    Map* m = tmj_map_loadf(testmap_path, true);
+
+    TEST_ASSERT_EQUAL_PTR(&stats, tmj_load_stats_attach(NULL));
+    TEST_ASSERT_NOT_NULL(m);
+
+    FILE* f = fopen(testmap_path, "rb");
+    fseek(f, 0, SEEK_END);
+    size_t fsize = ftell(f);
+    fclose(f);
+
+    TEST_ASSERT_EQUAL_size_t(fsize, stats.bytes_read);
+    TEST_ASSERT_EQUAL_size_t(1, stats.maps_loaded);
+    TEST_ASSERT_EQUAL_size_t(0, stats.tilesets_loaded);
+    TEST_ASSERT_TRUE(stats.parse_ns > 0);
+    TEST_ASSERT_TRUE(stats.unpack_ns > 0);
+    TEST_ASSERT_TRUE(stats.alloc_count > 0);
+    TEST_ASSERT_TRUE(stats.peak_bytes > 0);
+    TEST_ASSERT_TRUE(stats.peak_bytes <= stats.alloc_bytes);
+
+    // Detached; nothing more is recorded
+    tmj_map_free(tmj_map_loadf(testmap_path, true));
+
+    TEST_ASSERT_EQUAL_size_t(1, stats.maps_loaded);
+
+    tmj_map_free(m);
+}
+
+typedef struct trace_counts {
+    int depth;
+    int max_depth;
+    int unbalanced;
+    int map_load_json;
+    int unpack_layers;
+    int unpack_tileset;
+} trace_counts;
+
+void trace_begin_cb(const char* name, void* userdata) {
+    trace_counts* counts = userdata;
+
+    counts->depth++;
+
+    if (counts->depth > counts->max_depth) {
+        counts->max_depth = counts->depth;
+    }
+
+    if (strcmp(name, "map_load_json") == 0) {
+        counts->map_load_json++;
+    } else if (strcmp(name, "unpack_layers") == 0) {
+        counts->unpack_layers++;
+    } else if (strcmp(name, "unpack_tileset") == 0) {
+        counts->unpack_tileset++;
+    }
+}
+
+void trace_end_cb(const char* name, void* userdata) {
+    trace_counts* counts = userdata;
+
+    (void)name;
+
+    if (--counts->depth < 0) {
+        counts->unbalanced++;
+    }
+}
+
+void test_map_trace_hooks(void) {
+    trace_counts counts = {0};
+
+    tmj_set_trace_hooks(trace_begin_cb, trace_end_cb, &counts);
+
+    Map* m = tmj_map_loadf(testmap_path2, true);
+
+    tmj_set_trace_hooks(NULL, NULL, NULL);
+
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL_INT(0, counts.depth);
+    TEST_ASSERT_EQUAL_INT(0, counts.unbalanced);
+    TEST_ASSERT_EQUAL_INT(1, counts.map_load_json);
+    TEST_ASSERT_TRUE(counts.unpack_layers >= 1);
+    TEST_ASSERT_EQUAL_INT((int)m->tileset_count, counts.unpack_tileset);
+    TEST_ASSERT_TRUE(counts.max_depth >= 2);
+
+    tmj_map_free(m);
+}
+
+void test_map_trace_chrome(void) {
+    const char* trace_path = "map_tests_trace.json";
+
+    TEST_ASSERT_EQUAL_INT(0, tmj_trace_chrome_open(trace_path));
+    TEST_ASSERT_EQUAL_INT(-1, tmj_trace_chrome_open(trace_path));
+
+    tmj_map_free(tmj_map_loadf(testmap_path, true));
+
+    TEST_ASSERT_EQUAL_INT(0, tmj_trace_chrome_close());
+    TEST_ASSERT_EQUAL_INT(-1, tmj_trace_chrome_close());
+
+    // The trace must be a valid JSON array with matched begin/end events
+    json_error_t error;
+    json_t* root = json_load_file(trace_path, 0, &error);
+
+    remove(trace_path);
+
+    TEST_ASSERT_NOT_NULL(root);
+    TEST_ASSERT_TRUE(json_is_array(root));
+
+    int depth = 0;
+    size_t idx;
+    json_t* event;
+
+    json_array_foreach(root, idx, event) {
+        const char* ph = json_string_value(json_object_get(event, "ph"));
+
+        if (strcmp(ph, "B") == 0) {
+            depth++;
+        } else if (strcmp(ph, "E") == 0) {
+            depth--;
+        }
+
+        TEST_ASSERT_TRUE(depth >= 0);
+    }
+
+    TEST_ASSERT_EQUAL_INT(0, depth);
+    TEST_ASSERT_TRUE(json_array_size(root) > 2);
+
+    json_decref(root);
+}
+
+void test_map_filter_lists(void) {
+    const char* names[] = {"village"};
+    const char* types[] = {"objectgroup"};
+
+    tmj_load_options options = {0};
+
+    options.layer_names = names;
+    options.layer_name_count = 1;
+    options.layer_types = types;
+    options.layer_type_count = 1;
+
+    Map* m = tmj_map_loadf_ex(testmap_path, true, &options);
+
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL_size_t(4, m->layer_count);
+
+    // Excluded layers keep their identity, but not their contents
+    TEST_ASSERT_TRUE(m->layers[0].filtered);
+    TEST_ASSERT_EQUAL_STRING("Tile Layer 1", m->layers[0].name);
+    TEST_ASSERT_NULL(m->layers[0].data_uint);
+    TEST_ASSERT_EQUAL_size_t(0, m->layers[0].data_count);
+
+    TEST_ASSERT_FALSE(m->layers[1].filtered);
+    TEST_ASSERT_EQUAL_size_t(400, m->layers[1].data_count);
+
+    TEST_ASSERT_FALSE(m->layers[2].filtered);
+    TEST_ASSERT_EQUAL_size_t(2, m->layers[2].object_count);
+
+    TEST_ASSERT_TRUE(m->layers[3].filtered);
+    TEST_ASSERT_NULL(m->layers[3].data_uint);
+
+    tmj_map_free(m);
+
+    const int ids[] = {2};
+
+    options = (tmj_load_options){0};
+    options.layer_ids = ids;
+    options.layer_id_count = 1;
+
+    m = tmj_map_loadf_ex(testmap_path, true, &options);
+
+    TEST_ASSERT_NOT_NULL(m);
+
+    for (size_t i = 0; i < m->layer_count; i++) {
+        TEST_ASSERT_EQUAL(m->layers[i].id != 2, m->layers[i].filtered);
+    }
+
+    tmj_map_free(m);
+}
+
+bool skip_objectgroups(const Layer* layer, void* userdata) {
+    (*(int*)userdata)++;
+
+    return strcmp(layer->type, "objectgroup") != 0;
+}
+
+void test_map_filter_predicate(void) {
+    int calls = 0;
+
+    tmj_load_options options = {0};
+
+    options.layer_filter = skip_objectgroups;
+    options.layer_filter_userdata = &calls;
+
+    Map* m = tmj_map_loadf_ex(testmap_path2, true, &options);
+
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL_INT(2, calls);
+    TEST_ASSERT_EQUAL_size_t(2, m->layer_count);
+    TEST_ASSERT_FALSE(m->layers[0].filtered);
+    TEST_ASSERT_NOT_NULL(m->layers[0].data_uint);
+    TEST_ASSERT_TRUE(m->layers[1].filtered);
+    TEST_ASSERT_NULL(m->layers[1].objects);
+    TEST_ASSERT_EQUAL_size_t(0, m->layers[1].object_count);
+
+    tmj_map_free(m);
+}
+
+void test_map_filter_groups(void) {
+    const char* map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                      "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":2,\"height\":1,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":5,\"nextobjectid\":2,\"tilesets\":[],\"layers\":["
+                      "{\"id\":1,\"name\":\"world\",\"type\":\"group\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,\"layers\":["
+                      "{\"id\":2,\"name\":\"collision\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"width\":2,\"height\":1,\"data\":[1,0]},"
+                      "{\"id\":3,\"name\":\"decor\",\"type\":\"objectgroup\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"objects\":[{\"id\":1,\"name\":\"\",\"visible\":true,\"x\":0,\"y\":0,\"width\":0,\"height\":0,\"rotation\":0}]}]},"
+                      "{\"id\":4,\"name\":\"ground\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"width\":2,\"height\":1,\"data\":[3,3]}]}";
+
+    const char* names[] = {"collision"};
+
+    tmj_load_options options = {0};
+
+    options.layer_names = names;
+    options.layer_name_count = 1;
+
+    Map* m = tmj_map_load_ex(map, "groups", &options);
+
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL_size_t(2, m->layer_count);
+
+    // The group is walked into even though its name doesn't match
+    TEST_ASSERT_FALSE(m->layers[0].filtered);
+    TEST_ASSERT_EQUAL_size_t(2, m->layers[0].layer_count);
+    TEST_ASSERT_FALSE(m->layers[0].layers[0].filtered);
+    TEST_ASSERT_EQUAL_UINT(1, m->layers[0].layers[0].data_uint[0]);
+    TEST_ASSERT_TRUE(m->layers[0].layers[1].filtered);
+    TEST_ASSERT_NULL(m->layers[0].layers[1].objects);
+
+    TEST_ASSERT_TRUE(m->layers[1].filtered);
+    TEST_ASSERT_NULL(m->layers[1].data_uint);
+
+    tmj_map_free(m);
+}
+
+void test_map_headless(void) {
+    const char* map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                      "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":2,\"height\":1,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":4,\"nextobjectid\":3,\"parallaxoriginx\":8,"
+                      "\"parallaxoriginy\":4,\"tilesets\":[],\"layers\":["
+                      "{\"id\":1,\"name\":\"ground\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"tintcolor\":\"#ff0000\",\"parallaxx\":0.5,\"parallaxy\":0.25,\"width\":2,\"height\":1,\"data\":[1,2]},"
+                      "{\"id\":2,\"name\":\"labels\",\"type\":\"objectgroup\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"objects\":[{\"id\":1,\"name\":\"sign\",\"visible\":true,\"x\":0,\"y\":0,\"width\":32,\"height\":16,"
+                      "\"rotation\":0,\"text\":{\"text\":\"Hello\",\"wrap\":true}},"
+                      "{\"id\":2,\"name\":\"spawn\",\"visible\":true,\"x\":8,\"y\":8,\"width\":0,\"height\":0,\"rotation\":0,"
+                      "\"point\":true}]},"
+                      "{\"id\":3,\"name\":\"sky\",\"type\":\"imagelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"image\":\"sky.png\",\"imagewidth\":64,\"imageheight\":32,\"repeatx\":true,\"repeaty\":false}]}";
+
+    Map* m = tmj_map_load_ex(map, "full", NULL);
+
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL_DOUBLE(8, m->parallaxoriginx);
+    TEST_ASSERT_EQUAL_STRING("#ff0000", m->layers[0].tintcolor);
+    TEST_ASSERT_EQUAL_DOUBLE(0.5, m->layers[0].parallaxx);
+    TEST_ASSERT_NOT_NULL(m->layers[1].objects[0].text);
+    TEST_ASSERT_EQUAL_STRING("Hello", m->layers[1].objects[0].text->text);
+    TEST_ASSERT_EQUAL_STRING("sky.png", m->layers[2].image);
+    TEST_ASSERT_EQUAL_INT(64, m->layers[2].imagewidth);
+
+    tmj_map_free(m);
+
+    tmj_load_options options = {0};
+
+    options.profile = TMJ_LOAD_HEADLESS;
+
+    m = tmj_map_load_ex(map, "headless", &options);
+
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL_DOUBLE(0, m->parallaxoriginx);
+    TEST_ASSERT_EQUAL_DOUBLE(0, m->parallaxoriginy);
+
+    // Presentation fields are skipped
+    TEST_ASSERT_NULL(m->layers[0].tintcolor);
+    TEST_ASSERT_EQUAL_DOUBLE(0, m->layers[0].parallaxx);
+    TEST_ASSERT_EQUAL_DOUBLE(0, m->layers[0].parallaxy);
+    TEST_ASSERT_NULL(m->layers[1].objects[0].text);
+    TEST_ASSERT_NULL(m->layers[2].image);
+    TEST_ASSERT_EQUAL_INT(0, m->layers[2].imagewidth);
+    TEST_ASSERT_FALSE(m->layers[2].repeatx);
+
+    // Everything else loads as usual
+    TEST_ASSERT_EQUAL_size_t(3, m->layer_count);
+    TEST_ASSERT_EQUAL_size_t(2, m->layers[0].data_count);
+    TEST_ASSERT_EQUAL_UINT(2, m->layers[0].data_uint[1]);
+    TEST_ASSERT_EQUAL_size_t(2, m->layers[1].object_count);
+    TEST_ASSERT_EQUAL_STRING("sign", m->layers[1].objects[0].name);
+    TEST_ASSERT_EQUAL_INT(32, (int)m->layers[1].objects[0].width);
+    TEST_ASSERT_TRUE(m->layers[1].objects[1].point);
+    TEST_ASSERT_EQUAL_STRING("sky", m->layers[2].name);
+
+    tmj_map_free(m);
+}
+
+void test_map_lazy(void) {
+    tmj_load_options options = {0};
+
+    options.lazy = true;
+
+    Map* m = tmj_map_loadf_ex(testmap_path, true, &options);
+
+    TEST_ASSERT_NOT_NULL(m);
+
+    // Objects are left for the first access
+    Layer* layer = &m->layers[2];
+
+    TEST_ASSERT_NULL(layer->objects);
+    TEST_ASSERT_EQUAL_size_t(0, layer->object_count);
+
+    size_t count = 0;
+    Object* objects = tmj_layer_objects(m, layer, &count);
+
+    TEST_ASSERT_NOT_NULL(objects);
+    TEST_ASSERT_EQUAL_size_t(2, count);
+    TEST_ASSERT_EQUAL_size_t(2, layer->object_count);
+
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT_EQUAL_INT(mf->layers[2].objects[i].id, objects[i].id);
+        TEST_ASSERT_EQUAL_STRING(mf->layers[2].objects[i].name, objects[i].name);
+    }
+
+    TEST_ASSERT_EQUAL_PTR(objects, tmj_layer_objects(m, layer, NULL));
+
+    // Tile layers have no objects
+    TEST_ASSERT_NULL(tmj_layer_objects(m, &m->layers[0], &count));
+    TEST_ASSERT_EQUAL_size_t(0, count);
+
+    // External tilesets are returned as they are
+    Tileset* tileset = tmj_map_tileset(m, 0);
+
+    TEST_ASSERT_NOT_NULL(tileset);
+    TEST_ASSERT_EQUAL_STRING("overworld.tsj", tileset->source);
+    TEST_ASSERT_EQUAL_INT(1, tileset->firstgid);
+    TEST_ASSERT_NULL(tmj_map_tileset(m, 1));
+
+    tmj_map_free(m);
+}
+
+void test_map_flat_layers(void) {
+    const char* map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                      "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":1,\"height\":1,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":6,\"nextobjectid\":1,\"tilesets\":[],\"layers\":["
+                      "{\"id\":1,\"name\":\"world\",\"type\":\"group\",\"visible\":true,\"opacity\":0.5,\"x\":0,\"y\":0,"
+                      "\"offsetx\":10,\"offsety\":-4,\"tintcolor\":\"#ff0000\",\"parallaxx\":0.5,\"layers\":["
+                      "{\"id\":2,\"name\":\"ground\",\"type\":\"tilelayer\",\"visible\":false,\"opacity\":0.5,\"x\":0,\"y\":0,"
+                      "\"offsetx\":1,\"tintcolor\":\"#80ffffff\",\"width\":1,\"height\":1,\"data\":[0]},"
+                      "{\"id\":3,\"name\":\"far\",\"type\":\"group\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"parallaxx\":0.5,\"parallaxy\":0.25,\"layers\":["
+                      "{\"id\":4,\"name\":\"birds\",\"type\":\"objectgroup\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"objects\":[]}]}]},"
+                      "{\"id\":5,\"name\":\"top\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"width\":1,\"height\":1,\"data\":[0]}]}";
+
+    Map* m = tmj_map_load(map, "flat");
+
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL_size_t(5, m->flat_layer_count);
+
+    const tmj_flat_layer* flat = m->flat_layers;
+
+    // Pre-order, each entry pointing at its group and past its subtree
+    TEST_ASSERT_EQUAL_PTR(&m->layers[0], flat[0].layer);
+    TEST_ASSERT_EQUAL_PTR(&m->layers[0].layers[0], flat[1].layer);
+    TEST_ASSERT_EQUAL_PTR(&m->layers[0].layers[1], flat[2].layer);
+    TEST_ASSERT_EQUAL_PTR(&m->layers[0].layers[1].layers[0], flat[3].layer);
+    TEST_ASSERT_EQUAL_PTR(&m->layers[1], flat[4].layer);
+
+    TEST_ASSERT_EQUAL_size_t(TMJ_NO_PARENT, flat[0].parent);
+    TEST_ASSERT_EQUAL_size_t(0, flat[1].parent);
+    TEST_ASSERT_EQUAL_size_t(0, flat[2].parent);
+    TEST_ASSERT_EQUAL_size_t(2, flat[3].parent);
+    TEST_ASSERT_EQUAL_size_t(TMJ_NO_PARENT, flat[4].parent);
+
+    TEST_ASSERT_EQUAL_size_t(4, flat[0].end);
+    TEST_ASSERT_EQUAL_size_t(2, flat[1].end);
+    TEST_ASSERT_EQUAL_size_t(4, flat[2].end);
+    TEST_ASSERT_EQUAL_size_t(2, flat[3].depth);
+
+    // Offsets add up, opacity, parallax and tints multiply
+    TEST_ASSERT_FALSE(flat[1].visible);
+    TEST_ASSERT_EQUAL_DOUBLE(11, flat[1].offsetx);
+    TEST_ASSERT_EQUAL_DOUBLE(-4, flat[1].offsety);
+    TEST_ASSERT_EQUAL_DOUBLE(0.25, flat[1].opacity);
+    TEST_ASSERT_EQUAL_HEX32(0x80FF0000u, flat[1].tint);
+
+    TEST_ASSERT_TRUE(flat[3].visible);
+    TEST_ASSERT_EQUAL_DOUBLE(0.25, flat[3].parallaxx);
+    TEST_ASSERT_EQUAL_DOUBLE(0.25, flat[3].parallaxy);
+    TEST_ASSERT_EQUAL_HEX32(0xFFFF0000u, flat[3].tint);
+
+    TEST_ASSERT_EQUAL_DOUBLE(0, flat[4].offsetx);
+    TEST_ASSERT_EQUAL_DOUBLE(1, flat[4].parallaxx);
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFFu, flat[4].tint);
+
+    tmj_map_free(m);
+
+    tmj_load_options options = {0};
+
+    options.profile = TMJ_LOAD_HEADLESS;
+
+    m = tmj_map_load_ex(map, "headless", &options);
+
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL_size_t(5, m->flat_layer_count);
+
+    // Without presentation fields, tints and parallax are left at their defaults
+    TEST_ASSERT_EQUAL_DOUBLE(1, m->flat_layers[3].parallaxx);
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFFu, m->flat_layers[3].tint);
+    TEST_ASSERT_EQUAL_DOUBLE(11, m->flat_layers[1].offsetx);
+
+    tmj_map_free(m);
+}
+
+void test_map_batch_groups(void) {
+    const char* map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                      "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":4,\"height\":1,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":5,\"nextobjectid\":1,\"tilesets\":["
+                      "{\"firstgid\":1,\"type\":\"tileset\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"name\":\"terrain\","
+                      "\"image\":\"terrain.png\",\"imagewidth\":32,\"imageheight\":16,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"tilecount\":2,\"columns\":2,\"margin\":0,\"spacing\":0}],\"layers\":["
+                      "{\"id\":1,\"name\":\"world\",\"type\":\"group\",\"visible\":true,\"opacity\":0.5,\"x\":0,\"y\":0,"
+                      "\"offsetx\":8,\"tintcolor\":\"#ff8000\",\"parallaxx\":0.5,\"layers\":["
+                      "{\"id\":2,\"name\":\"ground\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"offsetx\":4,\"tintcolor\":\"#80ffffff\",\"width\":4,\"height\":1,\"data\":[1,2,1,0]}]},"
+                      "{\"id\":3,\"name\":\"hidden\",\"type\":\"tilelayer\",\"visible\":false,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"width\":4,\"height\":1,\"data\":[1,1,1,1]},"
+                      "{\"id\":4,\"name\":\"top\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"width\":4,\"height\":1,\"data\":[2147483650,0,0,0]}]}";
+
+    Map* m = tmj_map_load(map, "batch");
+
+    TEST_ASSERT_NOT_NULL(m);
+
+    tmj_batch_builder* builder = tmj_batch_builder_create(m);
+
+    TEST_ASSERT_NOT_NULL(builder);
+    TEST_ASSERT_EQUAL_INT(1, tmj_batch_builder_update(builder, 100, 0, 64, 16));
+
+    size_t instance_count = 0;
+    size_t batch_count = 0;
+
+    const tmj_tile_instance* instances = tmj_batch_builder_instances(builder, &instance_count);
+    const tmj_batch* batches = tmj_batch_builder_batches(builder, &batch_count);
+
+    // The hidden layer is left out, and the grouped layer's tiles share a texture
+    TEST_ASSERT_EQUAL_size_t(4, instance_count);
+    TEST_ASSERT_EQUAL_size_t(2, batch_count);
+    TEST_ASSERT_EQUAL_PTR(&m->layers[0].layers[0], batches[0].layer);
+    TEST_ASSERT_EQUAL_STRING("terrain.png", batches[0].image);
+    TEST_ASSERT_EQUAL_size_t(3, batches[0].count);
+    TEST_ASSERT_EQUAL_PTR(&m->layers[2], batches[1].layer);
+    TEST_ASSERT_EQUAL_size_t(3, batches[1].first);
+
+    // Offsets add up, tints multiply, and the group's opacity scales alpha
+    TEST_ASSERT_EQUAL_FLOAT(12, instances[0].x);
+    TEST_ASSERT_EQUAL_FLOAT(28, instances[1].x);
+    TEST_ASSERT_EQUAL_FLOAT(0.5f, instances[1].u0);
+    TEST_ASSERT_EQUAL_HEX32(0x40FF8000u, instances[0].tint);
+    TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFFu, instances[3].tint);
+    TEST_ASSERT_EQUAL_UINT8(TMJ_FLIPPED_HORIZONTALLY >> TMJ_GID_FLAGS_SHIFT, instances[3].flags);
+
+    TEST_ASSERT_EQUAL_FLOAT(50, batches[0].parallax_x);
+    TEST_ASSERT_EQUAL_FLOAT(0, batches[1].parallax_x);
+
+    // Moving within the same blocks only shifts the parallax
+    TEST_ASSERT_EQUAL_INT(0, tmj_batch_builder_update(builder, 110, 0, 64, 16));
+
+    batches = tmj_batch_builder_batches(builder, &batch_count);
+
+    TEST_ASSERT_EQUAL_FLOAT(55, batches[0].parallax_x);
+
+    tmj_batch_builder_free(builder);
+    tmj_map_free(m);
+
+    tmj_load_options options = {0};
+
+    options.profile = TMJ_LOAD_HEADLESS;
+
+    m = tmj_map_load_ex(map, "headless", &options);
+
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_NULL(tmj_batch_builder_create(m));
+
+    tmj_map_free(m);
+}
+
+void test_map_batch_external_tileset(void) {
+    const char* map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                      "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":2,\"height\":1,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":2,\"nextobjectid\":1,"
+                      "\"tilesets\":[{\"firstgid\":1,\"source\":\"tall.tsj\"}],\"layers\":["
+                      "{\"id\":1,\"name\":\"ground\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"width\":2,\"height\":1,\"data\":[0,2]}]}";
+    const char* tileset = "{\"type\":\"tileset\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"name\":\"tall\","
+                          "\"image\":\"tall.png\",\"imagewidth\":32,\"imageheight\":32,"
+                          "\"tilewidth\":16,\"tileheight\":32,\"tilecount\":2,\"columns\":2,\"margin\":0,\"spacing\":0}";
+
+    Map* m = tmj_map_load(map, "batch");
+
+    TEST_ASSERT_NOT_NULL(m);
+
+    // Loaded on its own, the tileset's rects are built for its own tile size
+    tmj_load_options options = {0};
+
+    options.tile_rects = true;
+
+    Tileset* t = tmj_tileset_load_ex(tileset, &options);
+
+    TEST_ASSERT_NOT_NULL(t);
+    TEST_ASSERT_EQUAL_FLOAT(0, t->rects[1].draw_y);
+
+    tmj_batch_builder* builder = tmj_batch_builder_create(m);
+
+    TEST_ASSERT_NOT_NULL(builder);
+    TEST_ASSERT_EQUAL_INT(0, tmj_batch_builder_set_tileset(builder, 0, t));
+    TEST_ASSERT_EQUAL_INT(16, t->rect_grid_height);
+    TEST_ASSERT_EQUAL_INT(1, tmj_batch_builder_update(builder, 0, 0, 32, 16));
+
+    size_t instance_count = 0;
+    const tmj_tile_instance* instances = tmj_batch_builder_instances(builder, &instance_count);
+
+    // The 32 pixel tall tile shares the bottom of its 16 pixel cell
+    TEST_ASSERT_EQUAL_size_t(1, instance_count);
+    TEST_ASSERT_EQUAL_FLOAT(16, instances[0].x);
+    TEST_ASSERT_EQUAL_FLOAT(-16, instances[0].y);
+
+    tmj_batch_builder_free(builder);
+    tmj_tileset_free(t);
+    tmj_map_free(m);
+}
+
+void test_map_animator(void) {
+    const char* map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                      "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":4,\"height\":1,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":4,\"nextobjectid\":1,\"tilesets\":["
+                      "{\"firstgid\":1,\"type\":\"tileset\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"name\":\"water\","
+                      "\"image\":\"water.png\",\"imagewidth\":64,\"imageheight\":16,\"tilewidth\":16,\"tileheight\":16,"
+                      "\"tilecount\":4,\"columns\":4,\"margin\":0,\"spacing\":0,\"tiles\":["
+                      "{\"id\":0,\"animation\":[{\"tileid\":0,\"duration\":100},{\"tileid\":1,\"duration\":50}]},"
+                      "{\"id\":2,\"animation\":[{\"tileid\":2,\"duration\":30},{\"tileid\":3,\"duration\":30},{\"tileid\":2,\"duration\":45}]},"
+                      "{\"id\":3,\"animation\":[{\"tileid\":3,\"duration\":1000},{\"tileid\":0,\"duration\":7}]}]}],\"layers\":["
+                      "{\"id\":1,\"name\":\"sea\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"width\":4,\"height\":1,\"data\":[1,3,4,2147483649]},"
+                      "{\"id\":2,\"name\":\"world\",\"type\":\"group\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,\"layers\":["
+                      "{\"id\":3,\"name\":\"shore\",\"type\":\"tilelayer\",\"visible\":false,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"width\":4,\"height\":1,\"data\":[3,2,0,0]}]}]}";
+
+    Map* m = tmj_map_load(map, "animator");
+
+    TEST_ASSERT_NOT_NULL(m);
+
+    tmj_animator* animator = tmj_animator_create(m);
+
+    TEST_ASSERT_NOT_NULL(animator);
+
+    size_t count = 0;
+    const tmj_animated_tile* tiles = tmj_animator_tiles(animator, &count);
+
+    // Grouped by tile ID, hidden and grouped layers included
+    TEST_ASSERT_EQUAL_size_t(5, count);
+    TEST_ASSERT_EQUAL_UINT(1, tiles[0].gid & TMJ_GID_MASK);
+    TEST_ASSERT_EQUAL_UINT(1, tiles[1].gid & TMJ_GID_MASK);
+    TEST_ASSERT_EQUAL_UINT(3, tiles[2].gid);
+    TEST_ASSERT_EQUAL_UINT(3, tiles[3].gid);
+    TEST_ASSERT_EQUAL_PTR(&m->layers[1].layers[0], tiles[3].layer);
+    TEST_ASSERT_EQUAL_UINT(4, tiles[4].gid);
+    TEST_ASSERT_EQUAL_INT(2, tiles[4].x);
+
+    TEST_ASSERT_EQUAL_UINT(1, tmj_animator_frame(animator, 1));
+    TEST_ASSERT_EQUAL_UINT(2, tmj_animator_frame(animator, 2));
+
+    // At 100ms only the first animation moves on
+    TEST_ASSERT_EQUAL_size_t(2, tmj_animator_tick(animator, 100));
+
+    tiles = tmj_animator_dirty(animator, &count);
+
+    TEST_ASSERT_EQUAL_size_t(2, count);
+    TEST_ASSERT_EQUAL_INT(0, tiles[0].x);
+    TEST_ASSERT_EQUAL_INT(3, tiles[1].x);
+    TEST_ASSERT_EQUAL_UINT(2, tmj_animator_frame(animator, 1));
+    TEST_ASSERT_EQUAL_HEX32(TMJ_FLIPPED_HORIZONTALLY | 2, tmj_animator_frame(animator, TMJ_FLIPPED_HORIZONTALLY | 1));
+
+    // The second animation loops back to the frame it started on
+    TEST_ASSERT_EQUAL_size_t(0, tmj_animator_tick(animator, 5));
+    TEST_ASSERT_EQUAL_size_t(2, tmj_animator_tick(animator, 30));
+    TEST_ASSERT_EQUAL_UINT(4, tmj_animator_frame(animator, 3));
+
+    // 1005ms is into the last frame of the third animation, a loop of 1007 steps
+    TEST_ASSERT_EQUAL_size_t(3, tmj_animator_tick(animator, 870));
+    TEST_ASSERT_EQUAL_UINT(1, tmj_animator_frame(animator, 4));
+    TEST_ASSERT_EQUAL_UINT(3, tmj_animator_frame(animator, 3));
+    TEST_ASSERT_EQUAL_UINT(2, tmj_animator_frame(animator, 1));
+
+    tmj_animator_free(animator);
+    tmj_map_free(m);
+}
+
+void test_map_animator_long(void) {
+    const char* map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                      "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":2,\"height\":1,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":2,\"nextobjectid\":1,\"tilesets\":["
+                      "{\"firstgid\":1,\"type\":\"tileset\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"name\":\"slow\","
+                      "\"image\":\"slow.png\",\"imagewidth\":32,\"imageheight\":16,\"tilewidth\":16,\"tileheight\":16,"
+                      "\"tilecount\":2,\"columns\":2,\"margin\":0,\"spacing\":0,\"tiles\":["
+                      "{\"id\":0,\"animation\":[{\"tileid\":0,\"duration\":65536},{\"tileid\":1,\"duration\":1}]},"
+                      "{\"id\":1,\"animation\":[{\"tileid\":1,\"duration\":150},{\"tileid\":0,\"duration\":151}]}]}],\"layers\":["
+                      "{\"id\":1,\"name\":\"ground\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"width\":2,\"height\":1,\"data\":[1,2]}]}";
+
+    Map* m = tmj_map_load(map, "animator");
+
+    TEST_ASSERT_NOT_NULL(m);
+
+    tmj_animator* animator = tmj_animator_create(m);
+
+    TEST_ASSERT_NOT_NULL(animator);
+
+    // Durations of 150 and 151ms step by 1ms, 301 steps a loop
+    TEST_ASSERT_EQUAL_size_t(0, tmj_animator_tick(animator, 149));
+    TEST_ASSERT_EQUAL_size_t(1, tmj_animator_tick(animator, 1));
+    TEST_ASSERT_EQUAL_UINT(1, tmj_animator_frame(animator, 2));
+    TEST_ASSERT_EQUAL_size_t(1, tmj_animator_tick(animator, 151));
+    TEST_ASSERT_EQUAL_UINT(2, tmj_animator_frame(animator, 2));
+
+    // 65537 steps are too many for a table, the first animation is searched
+    TEST_ASSERT_EQUAL_UINT(1, tmj_animator_frame(animator, 1));
+    tmj_animator_tick(animator, 65536 - 301);
+    TEST_ASSERT_EQUAL_UINT(2, tmj_animator_frame(animator, 1));
+    TEST_ASSERT_EQUAL_UINT(65536 % 301 < 150 ? 2 : 1, tmj_animator_frame(animator, 2));
+    tmj_animator_tick(animator, 1);
+    TEST_ASSERT_EQUAL_UINT(1, tmj_animator_frame(animator, 1));
+
+    tmj_animator_free(animator);
+    tmj_map_free(m);
+}
+
+void test_map_object_soa(void) {
+    const char* map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                      "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":1,\"height\":1,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":3,\"nextobjectid\":5,\"tilesets\":[],\"layers\":["
+                      "{\"id\":1,\"name\":\"ground\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"width\":1,\"height\":1,\"data\":[0]},"
+                      "{\"id\":2,\"name\":\"things\",\"type\":\"objectgroup\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,\"objects\":["
+                      "{\"id\":1,\"name\":\"door\",\"visible\":true,\"x\":10,\"y\":20,\"width\":30,\"height\":10,\"rotation\":90},"
+                      "{\"id\":2,\"name\":\"crate\",\"type\":\"prop\",\"visible\":true,\"x\":100,\"y\":50,\"width\":16,\"height\":16,"
+                      "\"rotation\":0,\"gid\":1},"
+                      "{\"id\":3,\"name\":\"area\",\"type\":\"spawn\",\"visible\":true,\"x\":0,\"y\":0,\"width\":0,\"height\":0,"
+                      "\"rotation\":0,\"polygon\":[{\"x\":-5,\"y\":0},{\"x\":5,\"y\":-2},{\"x\":0,\"y\":8}]},"
+                      "{\"id\":4,\"name\":\"start\",\"type\":\"spawn\",\"visible\":false,\"x\":7,\"y\":8,\"width\":0,\"height\":0,"
+                      "\"rotation\":0,\"point\":true}]}]}";
+
+    Map* m = tmj_map_load(map, "objects");
+
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_NULL(tmj_object_soa_build(m, &m->layers[0]));
+
+    tmj_object_soa* soa = tmj_object_soa_build(m, &m->layers[1]);
+
+    TEST_ASSERT_NOT_NULL(soa);
+    TEST_ASSERT_EQUAL_size_t(4, soa->count);
+    TEST_ASSERT_EQUAL_PTR(m->layers[1].objects, soa->objects);
+    TEST_ASSERT_EQUAL_INT(3, soa->ids[2]);
+    TEST_ASSERT_EQUAL_UINT(1, soa->gids[1]);
+    TEST_ASSERT_EQUAL_FLOAT(90, soa->rotation[0]);
+    TEST_ASSERT_EQUAL_UINT8(0, soa->visible[3]);
+
+    // Untyped objects share entry 0, equal types share an entry
+    TEST_ASSERT_EQUAL_size_t(3, soa->type_count);
+    TEST_ASSERT_EQUAL_UINT(0, soa->types[0]);
+    TEST_ASSERT_EQUAL_STRING("prop", soa->type_names[soa->types[1]]);
+    TEST_ASSERT_EQUAL_STRING("spawn", soa->type_names[soa->types[2]]);
+    TEST_ASSERT_EQUAL_UINT(soa->types[2], soa->types[3]);
+
+    // Rotated a quarter turn clockwise around its position
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0, soa->min_x[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 20, soa->min_y[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 10, soa->max_x[0]);
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 50, soa->max_y[0]);
+
+    // Tile objects stand on their position
+    TEST_ASSERT_EQUAL_FLOAT(34, soa->min_y[1]);
+    TEST_ASSERT_EQUAL_FLOAT(50, soa->max_y[1]);
+
+    TEST_ASSERT_EQUAL_FLOAT(-5, soa->min_x[2]);
+    TEST_ASSERT_EQUAL_FLOAT(-2, soa->min_y[2]);
+    TEST_ASSERT_EQUAL_FLOAT(5, soa->max_x[2]);
+    TEST_ASSERT_EQUAL_FLOAT(8, soa->max_y[2]);
+
+    uint32_t indices[4];
+
+    TEST_ASSERT_EQUAL_size_t(1, tmj_object_soa_cull(soa, 0, 0, 6, 6, indices));
+    TEST_ASSERT_EQUAL_UINT(2, indices[0]);
+
+    // Edges count, so the point is in
+    TEST_ASSERT_EQUAL_size_t(2, tmj_object_soa_cull(soa, 5, 5, 7, 8, indices));
+    TEST_ASSERT_EQUAL_UINT(2, indices[0]);
+    TEST_ASSERT_EQUAL_UINT(3, indices[1]);
+
+    // An unbounded rectangle finds every object, and only those
+    TEST_ASSERT_EQUAL_size_t(4, tmj_object_soa_cull(soa, -INFINITY, -INFINITY, INFINITY, INFINITY, indices));
+    TEST_ASSERT_EQUAL_UINT(3, indices[3]);
+
+    tmj_object_soa_free(soa);
+    tmj_map_free(m);
+}
+
+void test_map_object_refs(void) {
+    const char* map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                      "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":1,\"height\":1,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":4,\"nextobjectid\":5000,\"tilesets\":[],"
+                      "\"properties\":[{\"name\":\"spawn\",\"type\":\"object\",\"value\":4000}],\"layers\":["
+                      "{\"id\":1,\"name\":\"things\",\"type\":\"objectgroup\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"properties\":[{\"name\":\"gone\",\"type\":\"object\",\"value\":7}],\"objects\":["
+                      "{\"id\":1,\"name\":\"lever\",\"visible\":true,\"x\":0,\"y\":0,\"width\":8,\"height\":8,\"rotation\":0,"
+                      "\"properties\":[{\"name\":\"target\",\"type\":\"object\",\"value\":4000},"
+                      "{\"name\":\"label\",\"type\":\"string\",\"value\":\"open\"}]}]},"
+                      "{\"id\":2,\"name\":\"group\",\"type\":\"group\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,\"layers\":["
+                      "{\"id\":3,\"name\":\"doors\",\"type\":\"objectgroup\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"objects\":[{\"id\":4000,\"name\":\"door\",\"visible\":true,\"x\":32,\"y\":0,\"width\":16,"
+                      "\"height\":32,\"rotation\":0,\"properties\":[{\"name\":\"lever\",\"type\":\"object\",\"value\":1}]}]}]}]}";
+
+    Map* m = tmj_map_load(map, "refs");
+
+    TEST_ASSERT_NOT_NULL(m);
+
+    Object* lever = &m->layers[0].objects[0];
+    Object* door = &m->layers[1].layers[0].objects[0];
+
+    // IDs this sparse get a sorted index rather than a dense one
+    TEST_ASSERT_FALSE(m->object_index_dense);
+    TEST_ASSERT_EQUAL_PTR(lever, tmj_map_object(m, 1));
+    TEST_ASSERT_EQUAL_PTR(door, tmj_map_object(m, 4000));
+    TEST_ASSERT_NULL(tmj_map_object(m, 2));
+    TEST_ASSERT_NULL(tmj_map_object(m, 5000));
+
+    TEST_ASSERT_EQUAL_PTR(door, tmj_map_property_object(m, &m->properties[0]));
+    TEST_ASSERT_EQUAL_PTR(door, tmj_map_property_object(m, &lever->properties[0]));
+    TEST_ASSERT_EQUAL_PTR(lever, tmj_map_property_object(m, &door->properties[0]));
+    TEST_ASSERT_NULL(tmj_map_property_object(m, &lever->properties[1]));
+
+    // References to missing objects keep their ID
+    TEST_ASSERT_EQUAL_INT(7, m->layers[0].properties[0].value_object);
+    TEST_ASSERT_NULL(tmj_map_property_object(m, &m->layers[0].properties[0]));
+
+    tmj_map_free(m);
+
+    // Deferred layers join the index as they're unpacked, which turns it sorted here
+    tmj_load_options options = {0};
+
+    options.lazy = true;
+
+    m = tmj_map_load_ex(map, "refs", &options);
+
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_NULL(tmj_map_object(m, 4000));
+    TEST_ASSERT_NOT_NULL(tmj_layer_objects(m, &m->layers[1].layers[0], NULL));
+    TEST_ASSERT_FALSE(m->object_index_dense);
+    TEST_ASSERT_EQUAL_PTR(&m->layers[1].layers[0].objects[0], tmj_map_object(m, 4000));
+    TEST_ASSERT_NULL(tmj_map_object(m, 1));
+    TEST_ASSERT_NOT_NULL(tmj_layer_objects(m, &m->layers[0], NULL));
+    TEST_ASSERT_EQUAL_PTR(&m->layers[0].objects[0], tmj_map_object(m, 1));
+    TEST_ASSERT_EQUAL_PTR(&m->layers[1].layers[0].objects[0], tmj_map_object(m, 4000));
+
+    tmj_map_free(m);
+}
+
+void test_map_object_duplicates(void) {
+    const char* format = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                         "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":1,\"height\":1,"
+                         "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":3,\"nextobjectid\":%d,\"tilesets\":[],\"layers\":["
+                         "{\"id\":1,\"name\":\"first\",\"type\":\"objectgroup\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,\"objects\":["
+                         "{\"id\":5,\"name\":\"a\",\"visible\":true,\"x\":0,\"y\":0,\"width\":8,\"height\":8,\"rotation\":0},"
+                         "{\"id\":5,\"name\":\"b\",\"visible\":true,\"x\":0,\"y\":0,\"width\":8,\"height\":8,\"rotation\":0},"
+                         "{\"id\":-1,\"name\":\"c\",\"visible\":true,\"x\":0,\"y\":0,\"width\":8,\"height\":8,\"rotation\":0}]},"
+                         "{\"id\":2,\"name\":\"second\",\"type\":\"objectgroup\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,\"objects\":["
+                         "{\"id\":5,\"name\":\"d\",\"visible\":true,\"x\":0,\"y\":0,\"width\":8,\"height\":8,\"rotation\":0},"
+                         "{\"id\":%d,\"name\":\"e\",\"visible\":true,\"x\":0,\"y\":0,\"width\":8,\"height\":8,\"rotation\":0}]}]}";
+
+    // Both index shapes, each loaded whole and with the later layer unpacked first
+    int last_ids[] = {6, 90000};
+    char map[2048];
+
+    for (size_t i = 0; i < 4; i++) {
+        int last_id = last_ids[i / 2];
+        tmj_load_options options = {0};
+
+        options.lazy = i % 2 == 1;
+
+        snprintf(map, sizeof(map), format, last_id + 1, last_id);
+
+        Map* m = tmj_map_load_ex(map, "duplicates", &options);
+
+        TEST_ASSERT_NOT_NULL(m);
+
+        if (options.lazy) {
+            TEST_ASSERT_NOT_NULL(tmj_layer_objects(m, &m->layers[1], NULL));
+            TEST_ASSERT_EQUAL_STRING("d", tmj_map_object(m, 5)->name);
+            TEST_ASSERT_NOT_NULL(tmj_layer_objects(m, &m->layers[0], NULL));
+        }
+
+        TEST_ASSERT_EQUAL(last_id < 1024, m->object_index_dense);
+        TEST_ASSERT_EQUAL_PTR(&m->layers[0].objects[0], tmj_map_object(m, 5));
+        TEST_ASSERT_EQUAL_PTR(&m->layers[1].objects[1], tmj_map_object(m, last_id));
+        TEST_ASSERT_NULL(tmj_map_object(m, -1));
+
+        tmj_map_free(m);
+    }
+}
+
+void test_map_object_lookup(void) {
+    const char* map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                      "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":1,\"height\":1,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":4,\"nextobjectid\":6,\"tilesets\":[],\"layers\":["
+                      "{\"id\":1,\"name\":\"spawns\",\"type\":\"objectgroup\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"objects\":[{\"id\":1,\"name\":\"a\",\"type\":\"spawn\",\"visible\":true,\"x\":0,\"y\":0,\"width\":0,"
+                      "\"height\":0,\"rotation\":0},"
+                      "{\"id\":2,\"name\":\"\",\"visible\":true,\"x\":0,\"y\":0,\"width\":0,\"height\":0,\"rotation\":0}]},"
+                      "{\"id\":2,\"name\":\"group\",\"type\":\"group\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,\"layers\":["
+                      "{\"id\":3,\"name\":\"level\",\"type\":\"objectgroup\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"objects\":[{\"id\":3,\"name\":\"boss_door\",\"class\":\"door\",\"visible\":true,\"x\":0,\"y\":0,"
+                      "\"width\":0,\"height\":0,\"rotation\":0},"
+                      "{\"id\":4,\"name\":\"b\",\"type\":\"spawn\",\"visible\":true,\"x\":0,\"y\":0,\"width\":0,\"height\":0,"
+                      "\"rotation\":0},"
+                      "{\"id\":5,\"name\":\"a\",\"type\":\"spawn\",\"visible\":true,\"x\":0,\"y\":0,\"width\":0,\"height\":0,"
+                      "\"rotation\":0}]}]}]}";
+
+    tmj_load_options options = {0};
+
+    options.object_lookup = true;
+
+    Map* m = tmj_map_load_ex(map, "lookup", &options);
+
+    TEST_ASSERT_NOT_NULL(m);
+
+    Object* first = m->layers[0].objects;
+    Object* nested = m->layers[1].layers[0].objects;
+
+    uint32_t spawn = tmj_map_object_type(m, "spawn");
+    size_t count = 0;
+    Object* const* objects = tmj_map_objects_of_type(m, spawn, &count);
+
+    TEST_ASSERT_NOT_EQUAL(0, spawn);
+    TEST_ASSERT_EQUAL_size_t(3, count);
+    TEST_ASSERT_EQUAL_PTR(&first[0], objects[0]);
+    TEST_ASSERT_EQUAL_PTR(&nested[1], objects[1]);
+    TEST_ASSERT_EQUAL_PTR(&nested[2], objects[2]);
+
+    // Types written as "class" are indexed as well
+    objects = tmj_map_objects_of_type(m, tmj_map_object_type(m, "door"), &count);
+
+    TEST_ASSERT_EQUAL_size_t(1, count);
+    TEST_ASSERT_EQUAL_PTR(&nested[0], objects[0]);
+    TEST_ASSERT_EQUAL_STRING("door", nested[0].type);
+
+    objects = tmj_map_objects_named(m, tmj_map_object_name(m, "boss_door"), &count);
+
+    TEST_ASSERT_EQUAL_size_t(1, count);
+    TEST_ASSERT_EQUAL_PTR(&nested[0], objects[0]);
+
+    objects = tmj_map_objects_named(m, tmj_map_object_name(m, "a"), &count);
+
+    TEST_ASSERT_EQUAL_size_t(2, count);
+    TEST_ASSERT_EQUAL_PTR(&first[0], objects[0]);
+    TEST_ASSERT_EQUAL_PTR(&nested[2], objects[1]);
+
+    // Empty names and unknown keys have no handle
+    TEST_ASSERT_EQUAL_UINT(0, tmj_map_object_name(m, ""));
+    TEST_ASSERT_EQUAL_UINT(0, tmj_map_object_type(m, "chest"));
+    TEST_ASSERT_NULL(tmj_map_objects_of_type(m, 0, &count));
+    TEST_ASSERT_EQUAL_size_t(0, count);
+    TEST_ASSERT_NULL(tmj_map_objects_named(m, 99, &count));
+
+    tmj_map_free(m);
+
+    // Indexes are opt-in
+    m = tmj_map_load(map, "plain");
+
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL_UINT(0, tmj_map_object_type(m, "spawn"));
+
+    tmj_map_free(m);
+}
+
+bool is_spawn(const Tileset* tileset, const Tile* tile, void* userdata) {
+    (void)tileset;
+
+    for (size_t i = 0; i < tile->property_count; i++) {
+        if (strcmp(tile->properties[i].name, "marker") == 0 && strcmp(tile->properties[i].value_string, userdata) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void test_map_gid_index(void) {
+    const char* map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                      "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":3,\"height\":2,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":4,\"nextobjectid\":1,\"tilesets\":["
+                      "{\"firstgid\":1,\"type\":\"tileset\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"name\":\"markers\","
+                      "\"image\":\"markers.png\",\"imagewidth\":64,\"imageheight\":16,\"tilewidth\":16,\"tileheight\":16,"
+                      "\"tilecount\":4,\"columns\":4,\"margin\":0,\"spacing\":0,\"tiles\":["
+                      "{\"id\":1,\"properties\":[{\"name\":\"marker\",\"type\":\"string\",\"value\":\"spawn\"}]},"
+                      "{\"id\":2,\"properties\":[{\"name\":\"marker\",\"type\":\"string\",\"value\":\"chest\"}]},"
+                      "{\"id\":3,\"properties\":[{\"name\":\"marker\",\"type\":\"string\",\"value\":\"spawn\"}]}]}],\"layers\":["
+                      "{\"id\":1,\"name\":\"ground\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"width\":3,\"height\":2,\"data\":[1,2,1,4,3,2147483650]},"
+                      "{\"id\":2,\"name\":\"world\",\"type\":\"group\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,\"layers\":["
+                      "{\"id\":3,\"name\":\"markers\",\"type\":\"tilelayer\",\"visible\":false,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"width\":3,\"height\":2,\"data\":[0,0,4,0,2,0]}]}]}";
+
+    Map* m = tmj_map_load(map, "gid_index");
+
+    TEST_ASSERT_NOT_NULL(m);
+
+    // Tiles 2 and 4 are spawn markers
+    tmj_gid_index* index = tmj_gid_index_create_matching(m, is_spawn, "spawn");
+
+    TEST_ASSERT_NOT_NULL(index);
+    TEST_ASSERT_EQUAL_size_t(2, tmj_gid_index_part_count(index));
+    TEST_ASSERT_EQUAL_size_t(0, tmj_gid_index_count(index, 2));
+    TEST_ASSERT_EQUAL_INT(0, tmj_gid_index_build(index));
+
+    tmj_tile_position positions[8];
+
+    TEST_ASSERT_EQUAL_size_t(3, tmj_gid_index_count(index, 2));
+    TEST_ASSERT_EQUAL_size_t(3, tmj_gid_index_positions(index, 2, 0, positions, 8));
+    TEST_ASSERT_EQUAL_PTR(&m->layers[0], positions[0].layer);
+    TEST_ASSERT_EQUAL_INT(1, positions[0].x);
+    TEST_ASSERT_EQUAL_INT(0, positions[0].y);
+    TEST_ASSERT_EQUAL_INT(2, positions[1].x);
+    TEST_ASSERT_EQUAL_INT(1, positions[1].y);
+
+    // Flipped tiles are found, and keep their flags
+    TEST_ASSERT_EQUAL_HEX32(2147483650u, positions[1].gid);
+    TEST_ASSERT_EQUAL_PTR(&m->layers[1].layers[0], positions[2].layer);
+    TEST_ASSERT_EQUAL_INT(1, positions[2].x);
+    TEST_ASSERT_EQUAL_INT(1, positions[2].y);
+
+    // 0 asks for everything, grouped by tile ID
+    TEST_ASSERT_EQUAL_size_t(5, tmj_gid_index_count(index, 0));
+    TEST_ASSERT_EQUAL_size_t(3, tmj_gid_index_positions(index, 0, 2, positions, 8));
+    TEST_ASSERT_EQUAL_HEX32(2, positions[0].gid);
+    TEST_ASSERT_EQUAL_HEX32(4, positions[1].gid);
+    TEST_ASSERT_EQUAL_INT(0, positions[1].x);
+    TEST_ASSERT_EQUAL_INT(1, positions[1].y);
+    TEST_ASSERT_EQUAL_HEX32(4, positions[2].gid);
+    TEST_ASSERT_EQUAL_INT(2, positions[2].x);
+    TEST_ASSERT_EQUAL_INT(0, positions[2].y);
+
+    TEST_ASSERT_EQUAL_size_t(0, tmj_gid_index_count(index, 3));
+    TEST_ASSERT_EQUAL_size_t(1, tmj_gid_index_positions(index, 0, 4, positions, 8));
+    TEST_ASSERT_EQUAL_size_t(0, tmj_gid_index_positions(index, 0, 5, positions, 8));
+
+    tmj_gid_index_free(index);
+
+    // Explicit tile IDs, scanned part by part
+    uint32_t gids[] = {1, 1, 100};
+
+    index = tmj_gid_index_create(m, gids, 3);
+
+    TEST_ASSERT_NOT_NULL(index);
+    TEST_ASSERT_EQUAL_INT(-1, tmj_gid_index_finish(index));
+    TEST_ASSERT_EQUAL_INT(0, tmj_gid_index_scan(index, 1));
+    TEST_ASSERT_EQUAL_INT(0, tmj_gid_index_scan(index, 0));
+    TEST_ASSERT_EQUAL_INT(-1, tmj_gid_index_scan(index, 2));
+    TEST_ASSERT_EQUAL_INT(0, tmj_gid_index_finish(index));
+    TEST_ASSERT_EQUAL_size_t(2, tmj_gid_index_count(index, 1));
+    TEST_ASSERT_EQUAL_size_t(0, tmj_gid_index_count(index, 100));
+
+    tmj_gid_index_free(index);
+    tmj_map_free(m);
+}
+
+void test_map_short_chunk(void) {
+    // A 16x16 chunk with only its first four tiles given
+    const char* map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                      "\"renderorder\":\"right-down\",\"infinite\":true,\"compressionlevel\":-1,\"width\":16,\"height\":16,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":2,\"nextobjectid\":1,\"tilesets\":[],\"layers\":["
+                      "{\"id\":1,\"name\":\"ground\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"startx\":0,\"starty\":0,\"width\":16,\"height\":16,"
+                      "\"chunks\":[{\"x\":0,\"y\":0,\"width\":16,\"height\":16,\"data\":[1,2,3,4]}]}]}";
+
+    for (int profile = 0; profile < 3; profile++) {
+        tmj_load_options options = {0};
+
+        options.compact_tiles = profile == 1;
+        options.sparse_tiles = profile == 2;
+
+        Map* m = tmj_map_load_ex(map, "short", &options);
+
+        TEST_ASSERT_NOT_NULL(m);
+
+        const Chunk* c = &m->layers[0].chunks[0];
+
+        // Short data isn't compacted, and the tiles past its end read as empty
+        TEST_ASSERT_NULL(c->data_compact);
+        TEST_ASSERT_EQUAL_size_t(4, c->data_count);
+        TEST_ASSERT_EQUAL_UINT(4, tmj_chunk_tile(c, 3, 0));
+        TEST_ASSERT_EQUAL_UINT(0, tmj_chunk_tile(c, 4, 0));
+        TEST_ASSERT_EQUAL_UINT(0, tmj_chunk_tile(c, 15, 15));
+
+        tmj_map_free(m);
+    }
+}
+
+void test_map_short_view(void) {
+    uint32_t gids[100];
+
+    for (size_t i = 0; i < 100; i++) {
+        gids[i] = 1;
+    }
+
+    // Compact tiles packed from short data, as a caller could set them
+    char type[] = "tilelayer";
+    Layer layer = {0};
+
+    layer.type = type;
+    layer.width = 16;
+    layer.height = 16;
+    layer.data_compact = tmj_tiles_compact(gids, 100);
+
+    TEST_ASSERT_NOT_NULL(layer.data_compact);
+
+    // Only the whole rows the data holds are walked
+    tmj_view view;
+    tmj_view_run run;
+    int tiles = 0;
+
+    tmj_view_begin(&view, &layer, 0, 0, 16, 16);
+
+    while (tmj_view_next(&view, &run)) {
+        TEST_ASSERT_LESS_THAN(6, run.y);
+
+        tiles += run.length;
+    }
+
+    TEST_ASSERT_EQUAL_INT(96, tiles);
+    TEST_ASSERT_EQUAL_UINT(1, tmj_layer_tile(&layer, 3, 6));
+    TEST_ASSERT_EQUAL_UINT(0, tmj_layer_tile(&layer, 4, 6));
+
+    tmj_tiles_free(layer.data_compact);
+}
+
+void test_map_float_property(void) {
+    const char* map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                      "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":1,\"height\":1,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":2,\"nextobjectid\":1,\"tilesets\":[],"
+                      "\"properties\":[{\"name\":\"gravity\",\"type\":\"float\",\"value\":9.81},"
+                      "{\"name\":\"scale\",\"type\":\"float\",\"value\":3}],\"layers\":["
+                      "{\"id\":1,\"name\":\"ground\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"width\":1,\"height\":1,\"data\":[0]}]}";
+
+    Map* m = tmj_map_load(map, "float");
+
+    // Float values may be written as integers too
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL_size_t(2, m->property_count);
+    TEST_ASSERT_EQUAL_DOUBLE(9.81, m->properties[0].value_float);
+    TEST_ASSERT_EQUAL_DOUBLE(3, m->properties[1].value_float);
+
+    tmj_map_free(m);
+}
+
+void test_map_tile_columns(void) {
+    const char* map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+                      "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":1,\"height\":1,"
+                      "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":2,\"nextobjectid\":1,\"tilesets\":["
+                      "{\"firstgid\":1,\"type\":\"tileset\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"name\":\"ground\","
+                      "\"image\":\"ground.png\",\"imagewidth\":64,\"imageheight\":16,\"tilewidth\":16,\"tileheight\":16,"
+                      "\"tilecount\":4,\"columns\":4,\"margin\":0,\"spacing\":0,\"tiles\":["
+                      "{\"id\":0,\"properties\":[{\"name\":\"solid\",\"type\":\"bool\",\"value\":true},"
+                      "{\"name\":\"friction\",\"type\":\"float\",\"value\":0.25}]},"
+                      "{\"id\":2,\"properties\":[{\"name\":\"damage\",\"type\":\"int\",\"value\":7},"
+                      "{\"name\":\"friction\",\"type\":\"int\",\"value\":2},"
+                      "{\"name\":\"solid\",\"type\":\"string\",\"value\":\"yes\"}]}]},"
+                      "{\"firstgid\":5,\"source\":\"walls.tsj\"},"
+                      "{\"firstgid\":69,\"type\":\"tileset\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"name\":\"lava\","
+                      "\"tilewidth\":16,\"tileheight\":16,\"tilecount\":2,\"columns\":0,\"margin\":0,\"spacing\":0,\"tiles\":["
+                      "{\"id\":1,\"image\":\"lava.png\",\"imagewidth\":16,\"imageheight\":16,"
+                      "\"properties\":[{\"name\":\"damage\",\"type\":\"int\",\"value\":50},"
+                      "{\"name\":\"solid\",\"type\":\"bool\",\"value\":false}]},"
+                      "{\"id\":3,\"image\":\"magma.png\",\"imagewidth\":16,\"imageheight\":16,"
+                      "\"properties\":[{\"name\":\"damage\",\"type\":\"int\",\"value\":80}]}]}],\"layers\":["
+                      "{\"id\":1,\"name\":\"ground\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+                      "\"width\":1,\"height\":1,\"data\":[1]}]}";
+
+    Map* m = tmj_map_load(map, "columns");
+
+    TEST_ASSERT_NOT_NULL(m);
+    TEST_ASSERT_EQUAL_FLOAT(0.25, m->tilesets[0].tiles[0].properties[1].value_float);
+
+    tmj_column_spec specs[] = {{"solid", TMJ_COLUMN_BOOL, 0}, {"friction", TMJ_COLUMN_FLOAT, 1}, {"damage", TMJ_COLUMN_INT, 0}};
+    tmj_tile_columns* columns = tmj_tile_columns_build(m, specs, 3);
+
+    TEST_ASSERT_NOT_NULL(columns);
+    // The image collection's tile IDs go past its tile count
+    TEST_ASSERT_EQUAL_UINT(73, columns->gid_count);
+    TEST_ASSERT_EQUAL_size_t(3, columns->column_count);
+
+    const tmj_tile_column* solid = tmj_tile_columns_find(columns, "solid");
+    const tmj_tile_column* friction = tmj_tile_columns_find(columns, "friction");
+    const tmj_tile_column* damage = tmj_tile_columns_find(columns, "damage");
+
+    TEST_ASSERT_EQUAL_PTR(&columns->columns[0], solid);
+    TEST_ASSERT_NULL(tmj_tile_columns_find(columns, "slippery"));
+
+    TEST_ASSERT_EQUAL_UINT64(0x2, solid->bits[0]);
+    TEST_ASSERT_EQUAL_UINT64(0, solid->bits[1]);
+
+    // Values convert to the column's type, and missing ones take the default
+    TEST_ASSERT_EQUAL_FLOAT(1, friction->floats[0]);
+    TEST_ASSERT_EQUAL_FLOAT(0.25f, friction->floats[1]);
+    TEST_ASSERT_EQUAL_FLOAT(1, friction->floats[2]);
+    TEST_ASSERT_EQUAL_FLOAT(2, friction->floats[3]);
+    TEST_ASSERT_EQUAL_FLOAT(1, friction->floats[40]);
+
+    TEST_ASSERT_EQUAL_INT32(7, damage->ints[3]);
+    TEST_ASSERT_EQUAL_INT32(0, damage->ints[69]);
+    TEST_ASSERT_EQUAL_INT32(50, damage->ints[70]);
+    TEST_ASSERT_EQUAL_INT32(80, damage->ints[72]);
+
+    // External tilesets are compiled once they're handed over
+    const char* walls = "{\"type\":\"tileset\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"name\":\"walls\","
+                        "\"image\":\"walls.png\",\"imagewidth\":128,\"imageheight\":128,\"tilewidth\":16,\"tileheight\":16,"
+                        "\"tilecount\":64,\"columns\":8,\"margin\":0,\"spacing\":0,\"tiles\":["
+                        "{\"id\":2,\"properties\":[{\"name\":\"solid\",\"type\":\"bool\",\"value\":true},"
+                        "{\"name\":\"damage\",\"type\":\"int\",\"value\":3}]}]}";
+    Tileset* t = tmj_tileset_load(walls);
+
+    TEST_ASSERT_NOT_NULL(t);
+    TEST_ASSERT_EQUAL_INT(-1, tmj_tile_columns_set_tileset(columns, 3, t));
+    TEST_ASSERT_EQUAL_INT(0, tmj_tile_columns_set_tileset(columns, 1, t));
+    TEST_ASSERT_EQUAL_UINT(73, columns->gid_count);
+    TEST_ASSERT_EQUAL_UINT64(0x82, solid->bits[0]);
+    TEST_ASSERT_EQUAL_INT32(3, damage->ints[7]);
+    TEST_ASSERT_EQUAL_INT32(50, damage->ints[70]);
+
+    tmj_tile_columns_free(columns);
+
+    // Defaults fill bool columns too, until a tile says otherwise
+    specs[0].default_value = 1;
+    columns = tmj_tile_columns_build(m, specs, 1);
+
+    TEST_ASSERT_NOT_NULL(columns);
+    TEST_ASSERT_EQUAL_UINT64(UINT64_MAX, columns->columns[0].bits[0]);
+    TEST_ASSERT_EQUAL_UINT64(UINT64_MAX & ~((uint64_t)1 << 6), columns->columns[0].bits[1]);
+
+    tmj_tile_columns_free(columns);
+    tmj_map_free(m);
+
+    // Columns grow when the last tileset is external, and the new tile IDs take the defaults
+    map = "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+          "\"renderorder\":\"right-down\",\"infinite\":false,\"compressionlevel\":-1,\"width\":1,\"height\":1,"
+          "\"tilewidth\":16,\"tileheight\":16,\"nextlayerid\":2,\"nextobjectid\":1,"
+          "\"tilesets\":[{\"firstgid\":1,\"source\":\"walls.tsj\"}],\"layers\":["
+          "{\"id\":1,\"name\":\"ground\",\"type\":\"tilelayer\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0,"
+          "\"width\":1,\"height\":1,\"data\":[3]}]}";
+    m = tmj_map_load(map, "columns");
+
+    TEST_ASSERT_NOT_NULL(m);
+
+    specs[0].default_value = 0;
+    columns = tmj_tile_columns_build(m, specs, 3);
+
+    TEST_ASSERT_NOT_NULL(columns);
+    TEST_ASSERT_EQUAL_UINT(1, columns->gid_count);
+    TEST_ASSERT_EQUAL_INT(0, tmj_tile_columns_set_tileset(columns, 0, t));
+    TEST_ASSERT_EQUAL_UINT(65, columns->gid_count);
+    TEST_ASSERT_EQUAL_UINT64(0x8, columns->columns[0].bits[0]);
+    TEST_ASSERT_EQUAL_UINT64(0, columns->columns[0].bits[1]);
+    TEST_ASSERT_EQUAL_FLOAT(1, columns->columns[1].floats[64]);
+    TEST_ASSERT_EQUAL_INT32(3, columns->columns[2].ints[3]);
+
+    tmj_tile_columns_free(columns);
+    tmj_tileset_free(t);
+    tmj_map_free(m);
+}
+
 void test_map_free(void) {
     tmj_map_free(mf);
     tmj_map_free(mf2);
@@ -79,6 +1273,28 @@ int main(void) {
     UNITY_BEGIN();
     RUN_TEST(test_map_loadf);
     RUN_TEST(test_map_load);
+    RUN_TEST(test_map_load_stats);
+    RUN_TEST(test_map_trace_hooks);
+    RUN_TEST(test_map_trace_chrome);
+    RUN_TEST(test_map_filter_lists);
+    RUN_TEST(test_map_filter_predicate);
+    RUN_TEST(test_map_filter_groups);
+    RUN_TEST(test_map_headless);
+    RUN_TEST(test_map_lazy);
+    RUN_TEST(test_map_flat_layers);
+    RUN_TEST(test_map_batch_groups);
+    RUN_TEST(test_map_batch_external_tileset);
+    RUN_TEST(test_map_animator);
+    RUN_TEST(test_map_animator_long);
+    RUN_TEST(test_map_object_soa);
+    RUN_TEST(test_map_object_refs);
+    RUN_TEST(test_map_object_duplicates);
+    RUN_TEST(test_map_object_lookup);
+    RUN_TEST(test_map_gid_index);
+    RUN_TEST(test_map_float_property);
+    RUN_TEST(test_map_short_chunk);
+    RUN_TEST(test_map_short_view);
+    RUN_TEST(test_map_tile_columns);
     RUN_TEST(test_map_free);
     return UNITY_END();
 }
@@ -0,0 +1,381 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/tmj.h"
+#include "../tools/mapgen.h"
+
+#include "Unity/src/unity.h"
+
+#define THREAD_COUNT 8
+#define ITERATIONS 40
+
+typedef struct log_ctx {
+    atomic_size_t messages;
+    atomic_size_t load_errors;
+    atomic_size_t corrupted;
+} log_ctx;
+
+log_ctx ctx_a;
+log_ctx ctx_b;
+
+atomic_bool loading_done;
+
+_Thread_local int thread_no = -1;
+
+char* map_strs[3] = {NULL};
+char* map_paths[3] = {"example/overworld.tmj", "example/overworld_inf.tmj", "example/testmap.tmj"};
+
+// Checks that messages are not garbled by other threads, and that the userdata
+// pointer always arrives paired with a registration that was actually made
+void log_cb(tmj_log_priority priority, const char* msg, void* userdata) {
+    (void)priority;
+
+    if (userdata != &ctx_a && userdata != &ctx_b) {
+        atomic_fetch_add(&ctx_a.corrupted, 1);
+
+        return;
+    }
+
+    log_ctx* ctx = userdata;
+
+    atomic_fetch_add(&ctx->messages, 1);
+
+    int n = -1;
+
+    if (sscanf(msg, "Could not load map thread-%d,", &n) == 1) {
+        atomic_fetch_add(&ctx->load_errors, 1);
+
+        if (n != thread_no) {
+            atomic_fetch_add(&ctx->corrupted, 1);
+        }
+    }
+}
+
+char* read_file(const char* path) {
+    FILE* f = fopen(path, "rb");
+
+    if (f == NULL) {
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    size_t fsize = ftell(f);
+    rewind(f);
+
+    char* s = calloc(1, fsize + 1);
+
+    if (fread(s, 1, fsize, f) != fsize) {
+        free(s);
+        s = NULL;
+    }
+
+    fclose(f);
+
+    return s;
+}
+
+void* load_worker(void* arg) {
+    thread_no = (int)(size_t)arg;
+
+    char name[32];
+    snprintf(name, sizeof(name), "thread-%d", thread_no);
+
+    size_t failures = 0;
+
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        Map* m = tmj_map_load(map_strs[i % 3], name);
+
+        if (m == NULL) {
+            failures++;
+        }
+
+        tmj_map_free(m);
+
+        // Deliberately malformed, so that the error message carries our name
+        if (tmj_map_load("{\"type\": ", name) != NULL) {
+            failures++;
+        }
+    }
+
+    return (void*)failures;
+}
+
+void* regcb_worker(void* arg) {
+    (void)arg;
+
+    size_t i = 0;
+
+    while (!atomic_load(&loading_done)) {
+        tmj_log_regcb_userdata(true, log_cb, (i++ % 2) ? &ctx_b : &ctx_a);
+    }
+
+    return NULL;
+}
+
+void setUp(void) {
+    tmj_log_regcb_userdata(true, log_cb, &ctx_a);
+}
+
+void tearDown(void) {}
+
+void test_load_maps(void) {
+    for (size_t i = 0; i < 3; i++) {
+        map_strs[i] = read_file(map_paths[i]);
+        TEST_ASSERT_NOT_NULL(map_strs[i]);
+    }
+}
+
+void test_parallel_load(void) {
+    pthread_t loaders[THREAD_COUNT];
+    pthread_t registrar;
+
+    TEST_ASSERT_EQUAL_INT(0, pthread_create(&registrar, NULL, regcb_worker, NULL));
+
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&loaders[i], NULL, load_worker, (void*)i));
+    }
+
+    size_t failures = 0;
+
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        void* ret = NULL;
+
+        pthread_join(loaders[i], &ret);
+
+        failures += (size_t)ret;
+    }
+
+    atomic_store(&loading_done, true);
+    pthread_join(registrar, NULL);
+
+    TEST_ASSERT_EQUAL_size_t(0, failures);
+    TEST_ASSERT_EQUAL_size_t(0, atomic_load(&ctx_a.corrupted) + atomic_load(&ctx_b.corrupted));
+    TEST_ASSERT_EQUAL_size_t(THREAD_COUNT * ITERATIONS, atomic_load(&ctx_a.load_errors) + atomic_load(&ctx_b.load_errors));
+    TEST_ASSERT_GREATER_THAN(0, atomic_load(&ctx_a.messages) + atomic_load(&ctx_b.messages));
+}
+
+typedef struct cache_ctx {
+    const Layer* layer;
+    const uint32_t* expected; // Every chunk, decoded up front
+    tmj_chunk_cache* cache;
+} cache_ctx;
+
+void* cache_worker(void* arg) {
+    cache_ctx* ctx = arg;
+    size_t chunk_tiles = (size_t)ctx->layer->chunks[0].width * ctx->layer->chunks[0].height;
+    size_t failures = 0;
+    uint64_t state = (uint64_t)(uintptr_t)&failures; // Stack addresses differ per thread
+
+    for (size_t i = 0; i < ITERATIONS * 50; i++) {
+        // xorshift, so each thread walks the chunks in its own order
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        size_t c = state % ctx->layer->chunk_count;
+        const uint32_t* tiles = tmj_chunk_cache_get(ctx->cache, ctx->layer, &ctx->layer->chunks[c], NULL);
+
+        if (tiles == NULL || memcmp(tiles, ctx->expected + c * chunk_tiles, chunk_tiles * sizeof(uint32_t)) != 0) {
+            failures++;
+        }
+
+        if (tiles != NULL) {
+            tmj_chunk_cache_release(ctx->cache, &ctx->layer->chunks[c]);
+        }
+    }
+
+    return (void*)failures;
+}
+
+void test_parallel_chunk_cache(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.width = 256;
+    config.height = 256;
+    config.tile_layers = 1;
+    config.object_layers = 0;
+    config.infinite = true;
+    config.encoding = MAPGEN_BASE64;
+
+    char* json = mapgen_map(&config, NULL);
+
+    TEST_ASSERT_NOT_NULL(json);
+
+    Map* map = tmj_map_load(json, "chunks");
+
+    free(json);
+
+    TEST_ASSERT_NOT_NULL(map);
+
+    const Layer* layer = &map->layers[0];
+    size_t chunk_tiles = (size_t)config.chunk_width * config.chunk_height;
+    uint32_t* expected = malloc(layer->chunk_count * chunk_tiles * sizeof(uint32_t));
+
+    TEST_ASSERT_NOT_NULL(expected);
+
+    for (size_t c = 0; c < layer->chunk_count; c++) {
+        size_t size = 0;
+        uint32_t* tiles = tmj_decode_layer(layer->chunks[c].data_str, layer->encoding, "", &size);
+
+        TEST_ASSERT_NOT_NULL(tiles);
+        TEST_ASSERT_EQUAL_size_t(chunk_tiles, size);
+
+        memcpy(expected + c * chunk_tiles, tiles, chunk_tiles * sizeof(uint32_t));
+        free(tiles);
+    }
+
+    // A quarter of the chunks fit, so the threads keep evicting each other's
+    cache_ctx ctx = {layer, expected, tmj_chunk_cache_create(layer->chunk_count / 4 * chunk_tiles * sizeof(uint32_t))};
+
+    TEST_ASSERT_NOT_NULL(ctx.cache);
+
+    pthread_t readers[THREAD_COUNT];
+
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&readers[i], NULL, cache_worker, &ctx));
+    }
+
+    size_t failures = 0;
+
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        void* ret = NULL;
+
+        pthread_join(readers[i], &ret);
+
+        failures += (size_t)ret;
+    }
+
+    tmj_chunk_cache_stats stats;
+
+    tmj_chunk_cache_read_stats(ctx.cache, &stats);
+
+    TEST_ASSERT_EQUAL_size_t(0, failures);
+    TEST_ASSERT_EQUAL_size_t(THREAD_COUNT * ITERATIONS * 50, stats.hits + stats.misses);
+    TEST_ASSERT_GREATER_THAN(0, stats.evictions);
+    TEST_ASSERT_LESS_OR_EQUAL(layer->chunk_count / 4 * chunk_tiles * sizeof(uint32_t), stats.resident_bytes);
+
+    tmj_chunk_cache_free(ctx.cache);
+    free(expected);
+    tmj_map_free(map);
+}
+
+typedef struct scan_ctx {
+    tmj_gid_index* index;
+    atomic_size_t next_part;
+} scan_ctx;
+
+void* scan_worker(void* arg) {
+    scan_ctx* ctx = arg;
+    size_t failures = 0;
+    size_t part;
+
+    while ((part = atomic_fetch_add(&ctx->next_part, 1)) < tmj_gid_index_part_count(ctx->index)) {
+        failures += tmj_gid_index_scan(ctx->index, part) != 0;
+    }
+
+    return (void*)failures;
+}
+
+void test_parallel_gid_index(void) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+    config.width = 256;
+    config.height = 256;
+    config.tile_layers = 2;
+    config.object_layers = 0;
+    config.infinite = true;
+    config.encoding = MAPGEN_BASE64;
+
+    char* json = mapgen_map(&config, NULL);
+
+    TEST_ASSERT_NOT_NULL(json);
+
+    Map* map = tmj_map_load(json, "gids");
+
+    free(json);
+
+    TEST_ASSERT_NOT_NULL(map);
+
+    uint32_t gids[] = {3, 7, 11};
+    tmj_gid_index* serial = tmj_gid_index_create(map, gids, 3);
+    scan_ctx ctx = {.index = tmj_gid_index_create(map, gids, 3)};
+
+    TEST_ASSERT_NOT_NULL(serial);
+    TEST_ASSERT_NOT_NULL(ctx.index);
+    TEST_ASSERT_EQUAL_INT(0, tmj_gid_index_build(serial));
+
+    // Threads take chunks off a shared counter, decoding them as they go
+    pthread_t scanners[THREAD_COUNT];
+
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        TEST_ASSERT_EQUAL_INT(0, pthread_create(&scanners[i], NULL, scan_worker, &ctx));
+    }
+
+    size_t failures = 0;
+
+    for (size_t i = 0; i < THREAD_COUNT; i++) {
+        void* ret = NULL;
+
+        pthread_join(scanners[i], &ret);
+
+        failures += (size_t)ret;
+    }
+
+    TEST_ASSERT_EQUAL_size_t(0, failures);
+    TEST_ASSERT_EQUAL_INT(0, tmj_gid_index_finish(ctx.index));
+
+    // The merge doesn't depend on which thread scanned what
+    size_t count = tmj_gid_index_count(serial, 0);
+    tmj_tile_position* expected = malloc(count * sizeof(tmj_tile_position));
+    tmj_tile_position* positions = malloc(count * sizeof(tmj_tile_position));
+
+    TEST_ASSERT_NOT_NULL(expected);
+    TEST_ASSERT_NOT_NULL(positions);
+    TEST_ASSERT_GREATER_THAN(0, count);
+    TEST_ASSERT_EQUAL_size_t(count, tmj_gid_index_positions(serial, 0, 0, expected, count));
+    TEST_ASSERT_EQUAL_size_t(count, tmj_gid_index_positions(ctx.index, 0, 0, positions, count));
+
+    for (size_t i = 0; i < count; i++) {
+        TEST_ASSERT_EQUAL_PTR(expected[i].layer, positions[i].layer);
+        TEST_ASSERT_EQUAL_INT(expected[i].x, positions[i].x);
+        TEST_ASSERT_EQUAL_INT(expected[i].y, positions[i].y);
+        TEST_ASSERT_EQUAL_HEX32(expected[i].gid, positions[i].gid);
+    }
+
+    free(positions);
+    free(expected);
+    tmj_gid_index_free(ctx.index);
+    tmj_gid_index_free(serial);
+    tmj_map_free(map);
+}
+
+void test_unregister(void) {
+    size_t before = atomic_load(&ctx_a.messages);
+
+    tmj_log_regcb_userdata(true, NULL, NULL);
+
+    TEST_ASSERT_NULL(tmj_map_load("{", "unregistered"));
+    TEST_ASSERT_EQUAL_size_t(before, atomic_load(&ctx_a.messages));
+}
+
+void test_free_maps(void) {
+    for (size_t i = 0; i < 3; i++) {
+        free(map_strs[i]);
+    }
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_load_maps);
+    RUN_TEST(test_parallel_load);
+    RUN_TEST(test_parallel_chunk_cache);
+    RUN_TEST(test_parallel_gid_index);
+    RUN_TEST(test_unregister);
+    RUN_TEST(test_free_maps);
+    return UNITY_END();
+}
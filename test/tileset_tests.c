@@ -59,6 +59,128 @@ void test_tileset_load(void) {
     free(s);
 }
 
+void test_tileset_headless(void) {
+    tmj_load_options options = {0};
+
+    options.profile = TMJ_LOAD_HEADLESS;
+
+    Tileset* t = tmj_tileset_loadf_ex(tileset_path, true, &options);
+
+    TEST_ASSERT_NOT_NULL(t);
+    TEST_ASSERT_EQUAL_size_t(tf->tile_count, t->tile_count);
+    TEST_ASSERT_NULL(t->terrains);
+    TEST_ASSERT_EQUAL_size_t(0, t->terrain_count);
+
+    size_t animated = 0;
+
+    for (size_t i = 0; i < t->tile_count; i++) {
+        TEST_ASSERT_EQUAL_INT(tf->tiles[i].id, t->tiles[i].id);
+        TEST_ASSERT_NULL(t->tiles[i].animation);
+        TEST_ASSERT_EQUAL_size_t(0, t->tiles[i].animation_count);
+
+        animated += tf->tiles[i].animation_count > 0;
+    }
+
+    // Make sure there was something to skip
+    TEST_ASSERT_GREATER_THAN(0, animated);
+
+    tmj_tileset_free(t);
+}
+
+void test_tileset_rects(void) {
+    tmj_load_options options = {0};
+
+    options.tile_rects = true;
+
+    Tileset* t = tmj_tileset_loadf_ex(tileset_path, true, &options);
+
+    TEST_ASSERT_NOT_NULL(t);
+    TEST_ASSERT_EQUAL_size_t(189, t->rect_count);
+
+    // Tile 44 is in the third row, fifth column of the 21-column sheet
+    tmj_tile_rect* r = &t->rects[44];
+
+    TEST_ASSERT_EQUAL_STRING("overworld.png", r->image);
+    TEST_ASSERT_EQUAL_INT(32, r->y);
+    TEST_ASSERT_EQUAL_INT(2 * 16, r->x);
+    TEST_ASSERT_EQUAL_INT(16, r->width);
+    TEST_ASSERT_EQUAL_INT(16, r->height);
+    TEST_ASSERT_EQUAL_FLOAT(32.0 / 336, r->u0);
+    TEST_ASSERT_EQUAL_FLOAT(32.0 / 144, r->v0);
+    TEST_ASSERT_EQUAL_FLOAT(48.0 / 336, r->u1);
+    TEST_ASSERT_EQUAL_FLOAT(48.0 / 144, r->v1);
+    TEST_ASSERT_EQUAL_FLOAT(0, r->draw_x);
+    TEST_ASSERT_EQUAL_FLOAT(0, r->draw_y);
+    TEST_ASSERT_EQUAL_FLOAT(16, r->draw_width);
+
+    // The last tile ends at the bottom-right corner of the image
+    TEST_ASSERT_EQUAL_FLOAT(1.0, t->rects[188].u1);
+    TEST_ASSERT_EQUAL_FLOAT(1.0, t->rects[188].v1);
+
+    // Drawn on a larger grid, tiles sit on the bottom of their cell
+    TEST_ASSERT_EQUAL_INT(0, tmj_tileset_build_rects(t, 32, 24));
+    TEST_ASSERT_EQUAL_FLOAT(8, t->rects[44].draw_y);
+    TEST_ASSERT_EQUAL_FLOAT(16, t->rects[44].draw_height);
+
+    tmj_tileset_free(t);
+
+    // Headless loads skip the table
+    options.profile = TMJ_LOAD_HEADLESS;
+
+    t = tmj_tileset_loadf_ex(tileset_path, true, &options);
+
+    TEST_ASSERT_NOT_NULL(t);
+    TEST_ASSERT_NULL(t->rects);
+
+    tmj_tileset_free(t);
+}
+
+void test_tileset_rects_collection(void) {
+    // An image collection, with a gap in its tile IDs and a cropped tile, drawn at the grid size
+    const char* json = "{\"type\":\"tileset\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"name\":\"props\",\"columns\":0,\"margin\":0,\"spacing\":0,\"tilecount\":2,"
+                       "\"tilewidth\":64,\"tileheight\":32,\"tilerendersize\":\"grid\",\"fillmode\":\"preserve-aspect-fit\","
+                       "\"tileoffset\":{\"x\":1,\"y\":-2},\"tiles\":["
+                       "{\"id\":0,\"image\":\"tree.png\",\"imagewidth\":64,\"imageheight\":32},"
+                       "{\"id\":3,\"image\":\"rock.png\",\"imagewidth\":40,\"imageheight\":40,\"x\":10,\"y\":20,\"width\":20,\"height\":20}]}";
+
+    tmj_load_options options = {0};
+
+    options.tile_rects = true;
+
+    Tileset* t = tmj_tileset_load_ex(json, &options);
+
+    TEST_ASSERT_NOT_NULL(t);
+    TEST_ASSERT_EQUAL_size_t(4, t->rect_count);
+    TEST_ASSERT_NULL(t->rects[1].image);
+    TEST_ASSERT_NULL(t->rects[2].image);
+
+    TEST_ASSERT_EQUAL_INT(0, tmj_tileset_build_rects(t, 16, 16));
+
+    // 64x32 fits a 16x16 cell as 16x8, centered
+    tmj_tile_rect* tree = &t->rects[0];
+
+    TEST_ASSERT_EQUAL_STRING("tree.png", tree->image);
+    TEST_ASSERT_EQUAL_FLOAT(1.0, tree->u1);
+    TEST_ASSERT_EQUAL_FLOAT(1.0, tree->v1);
+    TEST_ASSERT_EQUAL_FLOAT(16, tree->draw_width);
+    TEST_ASSERT_EQUAL_FLOAT(8, tree->draw_height);
+    TEST_ASSERT_EQUAL_FLOAT(1, tree->draw_x);
+    TEST_ASSERT_EQUAL_FLOAT(4 - 2, tree->draw_y);
+
+    tmj_tile_rect* rock = &t->rects[3];
+
+    TEST_ASSERT_EQUAL_STRING("rock.png", rock->image);
+    TEST_ASSERT_EQUAL_INT(20, rock->width);
+    TEST_ASSERT_EQUAL_FLOAT(0.25, rock->u0);
+    TEST_ASSERT_EQUAL_FLOAT(0.5, rock->v0);
+    TEST_ASSERT_EQUAL_FLOAT(0.75, rock->u1);
+    TEST_ASSERT_EQUAL_FLOAT(1.0, rock->v1);
+    TEST_ASSERT_EQUAL_FLOAT(16, rock->draw_width);
+    TEST_ASSERT_EQUAL_FLOAT(16, rock->draw_height);
+
+    tmj_tileset_free(t);
+}
+
 void test_tileset_free(void) {
     tmj_tileset_free(tf);
     tmj_tileset_free(ts);
@@ -68,6 +190,9 @@ int main(void) {
     UNITY_BEGIN();
     RUN_TEST(test_tileset_loadf);
     RUN_TEST(test_tileset_load);
+    RUN_TEST(test_tileset_headless);
+    RUN_TEST(test_tileset_rects);
+    RUN_TEST(test_tileset_rects_collection);
     RUN_TEST(test_tileset_free);
     return UNITY_END();
 }
@@ -0,0 +1,756 @@
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LIBTMJ_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef LIBTMJ_ZSTD
+#include <zstd.h>
+#endif
+
+#include "../src/decode.h"
+#include "mapgen.h"
+
+/**
+ * @file
+ */
+
+#define MAPGEN_TILE_SIZE 16
+#define MAPGEN_COLUMNS 16
+
+const char* object_types[] = {"npc", "chest", "door", "spawn", "trigger", "sign", "enemy", "pickup"};
+
+/*
+ * Random numbers
+ *
+ * Every layer, tileset and object layer draws from its own stream, derived
+ * from the seed with splitmix64, so that changing one part of the
+ * configuration doesn't reshuffle the rest of the map.
+ */
+
+typedef struct rng {
+    uint64_t state;
+} rng;
+
+static void rng_seed(rng* r, uint64_t seed, uint64_t stream) {
+    uint64_t z = seed + (stream + 1) * 0x9E3779B97F4A7C15ull;
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+
+    // xorshift has a single absorbing state
+    r->state = z ? z : 1;
+}
+
+// xorshift64*
+static uint32_t rng_next(rng* r) {
+    r->state ^= r->state >> 12;
+    r->state ^= r->state << 25;
+    r->state ^= r->state >> 27;
+
+    return (uint32_t)((r->state * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+static uint32_t rng_range(rng* r, uint32_t n) {
+    return n ? rng_next(r) % n : 0;
+}
+
+enum rng_stream {
+    STREAM_MAP = 0,
+    STREAM_TILE_LAYER = 1 << 16,
+    STREAM_OBJECT_LAYER = 2 << 16,
+    STREAM_TILESET = 3 << 16,
+    STREAM_TILE_LAYER_PROPERTIES = 4 << 16
+};
+
+/*
+ * String building
+ */
+
+typedef struct strbuf {
+    char* data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} strbuf;
+
+static void sb_printf(strbuf* sb, const char* fmt, ...) {
+    if (sb->failed) {
+        return;
+    }
+
+    va_list args;
+
+    for (;;) {
+        va_start(args, fmt);
+        int n = vsnprintf(sb->data ? sb->data + sb->len : NULL, sb->cap - sb->len, fmt, args);
+        va_end(args);
+
+        if (n < 0) {
+            sb->failed = true;
+
+            return;
+        }
+
+        if ((size_t)n < sb->cap - sb->len) {
+            sb->len += n;
+
+            return;
+        }
+
+        size_t cap = sb->cap ? sb->cap * 2 : 4096;
+
+        while (cap - sb->len <= (size_t)n) {
+            cap *= 2;
+        }
+
+        char* data = realloc(sb->data, cap);
+
+        if (data == NULL) {
+            sb->failed = true;
+
+            return;
+        }
+
+        sb->data = data;
+        sb->cap = cap;
+    }
+}
+
+static char* sb_finish(strbuf* sb, size_t* size) {
+    if (sb->failed) {
+        free(sb->data);
+
+        return NULL;
+    }
+
+    if (size != NULL) {
+        *size = sb->len;
+    }
+
+    return sb->data;
+}
+
+/*
+ * Configuration
+ */
+
+void mapgen_default_config(mapgen_config* config) {
+    memset(config, 0, sizeof(mapgen_config));
+
+    config->seed = 1;
+    config->width = 64;
+    config->height = 64;
+    config->tile_layers = 4;
+    config->object_layers = 1;
+    config->chunk_width = 16;
+    config->chunk_height = 16;
+    config->encoding = MAPGEN_CSV;
+    config->compression = MAPGEN_NONE;
+    config->objects = 64;
+    config->polygon_points = 8;
+    config->properties = 2;
+    config->tilesets = 1;
+    config->tiles = 256;
+}
+
+bool mapgen_compression_supported(mapgen_compression compression) {
+    switch (compression) {
+        case MAPGEN_NONE:
+            return true;
+        case MAPGEN_ZLIB:
+        case MAPGEN_GZIP:
+#ifdef LIBTMJ_ZLIB
+            return true;
+#else
+            return false;
+#endif
+        case MAPGEN_ZSTD:
+#ifdef LIBTMJ_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+
+    return false;
+}
+
+const char* mapgen_compression_name(mapgen_compression compression) {
+    switch (compression) {
+        case MAPGEN_ZLIB:
+            return "zlib";
+        case MAPGEN_GZIP:
+            return "gzip";
+        case MAPGEN_ZSTD:
+            return "zstd";
+        default:
+            return "";
+    }
+}
+
+static bool config_valid(const mapgen_config* config) {
+    if (config->width < 1 || config->height < 1 || config->tile_layers < 0 || config->object_layers < 0) {
+        return false;
+    }
+
+    // Tiled requires at least one layer
+    if (config->tile_layers + config->object_layers < 1) {
+        return false;
+    }
+
+    if (config->infinite && (config->chunk_width < 1 || config->chunk_height < 1)) {
+        return false;
+    }
+
+    if (config->objects < 0 || config->polygon_points < 0 || config->properties < 0) {
+        return false;
+    }
+
+    if (config->tilesets < 1 || config->tiles < 1 || config->animated_tiles < 0 || config->animated_tiles > config->tiles) {
+        return false;
+    }
+
+    if (config->encoding == MAPGEN_CSV && config->compression != MAPGEN_NONE) {
+        return false;
+    }
+
+    return mapgen_compression_supported(config->compression);
+}
+
+/*
+ * Tiles
+ */
+
+void mapgen_layer_tiles(const mapgen_config* config, int layer, uint32_t* tiles) {
+    rng r;
+
+    rng_seed(&r, config->seed, STREAM_TILE_LAYER + layer);
+
+    uint32_t gid_count = (uint32_t)config->tilesets * (uint32_t)config->tiles;
+    uint32_t gid = 1;
+
+    size_t count = (size_t)config->width * config->height;
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t x = rng_next(&r);
+
+        // Start a new run about every eight tiles, one in eight of them empty unless configured otherwise
+        if (x % 8 == 0) {
+            bool empty = config->empty_percent > 0 ? (int)((x >> 8) % 100) < config->empty_percent : (x >> 8) % 8 == 0;
+
+            gid = empty ? 0 : 1 + (x >> 11) % gid_count;
+        }
+
+        tiles[i] = gid;
+
+        if (gid != 0 && x % 97 == 0) {
+            tiles[i] |= 0x80000000u >> ((x >> 24) % 3);
+        }
+    }
+}
+
+static void write_csv(strbuf* sb, const uint32_t* tiles, size_t count) {
+    sb_printf(sb, "[");
+
+    for (size_t i = 0; i < count; i++) {
+        sb_printf(sb, "%s%u", i ? "," : "", tiles[i]);
+    }
+
+    sb_printf(sb, "]");
+}
+
+#ifdef LIBTMJ_ZLIB
+static uint8_t* deflate_buffer(const uint8_t* data, size_t size, bool gzip, size_t* out_size) {
+    z_stream stream = {0};
+
+    // windowBits 15 writes a zlib header, 15 + 16 a gzip header
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, gzip ? 31 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+
+    size_t cap = deflateBound(&stream, size);
+    uint8_t* out = malloc(cap);
+
+    if (out == NULL) {
+        deflateEnd(&stream);
+
+        return NULL;
+    }
+
+    stream.next_in = (uint8_t*)data;
+    stream.avail_in = size;
+    stream.next_out = out;
+    stream.avail_out = cap;
+
+    int ret = deflate(&stream, Z_FINISH);
+
+    *out_size = stream.total_out;
+
+    deflateEnd(&stream);
+
+    if (ret != Z_STREAM_END) {
+        free(out);
+
+        return NULL;
+    }
+
+    return out;
+}
+#endif
+
+static void write_base64(strbuf* sb, const uint32_t* tiles, size_t count, mapgen_compression compression) {
+    // Tiled stores tile IDs as little-endian 32-bit integers
+    uint8_t* raw = malloc(count * 4);
+
+    if (raw == NULL) {
+        sb->failed = true;
+
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        raw[i * 4] = tiles[i] & 0xFF;
+        raw[i * 4 + 1] = (tiles[i] >> 8) & 0xFF;
+        raw[i * 4 + 2] = (tiles[i] >> 16) & 0xFF;
+        raw[i * 4 + 3] = (tiles[i] >> 24) & 0xFF;
+    }
+
+    uint8_t* packed = raw;
+    size_t packed_size = count * 4;
+
+    switch (compression) {
+#ifdef LIBTMJ_ZLIB
+        case MAPGEN_ZLIB:
+        case MAPGEN_GZIP:
+            packed = deflate_buffer(raw, count * 4, compression == MAPGEN_GZIP, &packed_size);
+            break;
+#endif
+#ifdef LIBTMJ_ZSTD
+        case MAPGEN_ZSTD: {
+            size_t cap = ZSTD_compressBound(count * 4);
+
+            packed = malloc(cap);
+
+            if (packed != NULL) {
+                packed_size = ZSTD_compress(packed, cap, raw, count * 4, 3);
+
+                if (ZSTD_isError(packed_size)) {
+                    free(packed);
+                    packed = NULL;
+                }
+            }
+            break;
+        }
+#endif
+        default:
+            break;
+    }
+
+    char* b64 = packed ? tmj_b64_encode(packed, packed_size) : NULL;
+
+    if (b64 == NULL) {
+        sb->failed = true;
+    } else {
+        sb_printf(sb, "\"%s\"", b64);
+    }
+
+    free(b64);
+
+    if (packed != raw) {
+        free(packed);
+    }
+
+    free(raw);
+}
+
+static void write_data(strbuf* sb, const mapgen_config* config, const uint32_t* tiles, size_t count) {
+    if (config->encoding == MAPGEN_CSV) {
+        write_csv(sb, tiles, count);
+    } else {
+        write_base64(sb, tiles, count, config->compression);
+    }
+}
+
+/*
+ * Properties
+ */
+
+static void write_properties(strbuf* sb, rng* r, int count, int object_count) {
+    if (count == 0) {
+        return;
+    }
+
+    sb_printf(sb, ",\"properties\":[");
+
+    for (int i = 0; i < count; i++) {
+        // Object references need something to point at
+        int kinds = object_count > 0 ? 6 : 5;
+
+        sb_printf(sb, "%s{\"name\":\"prop%d\",", i ? "," : "", i);
+
+        switch (rng_range(r, kinds)) {
+            case 0:
+                sb_printf(sb, "\"type\":\"string\",\"value\":\"value%u\"}", rng_range(r, 1000));
+                break;
+            case 1:
+                sb_printf(sb, "\"type\":\"int\",\"value\":%d}", (int)rng_range(r, 20001) - 10000);
+                break;
+            case 2:
+                sb_printf(sb, "\"type\":\"bool\",\"value\":%s}", rng_range(r, 2) ? "true" : "false");
+                break;
+            case 3:
+                sb_printf(sb, "\"type\":\"color\",\"value\":\"#ff%06x\"}", rng_next(r) & 0xFFFFFF);
+                break;
+            case 4:
+                sb_printf(sb, "\"type\":\"file\",\"value\":\"assets/file%u.png\"}", rng_range(r, 100));
+                break;
+            default:
+                sb_printf(sb, "\"type\":\"object\",\"value\":%u}", 1 + rng_range(r, object_count));
+                break;
+        }
+    }
+
+    sb_printf(sb, "]");
+}
+
+/*
+ * Tilesets
+ */
+
+static void write_tileset_body(strbuf* sb, const mapgen_config* config, int index) {
+    rng r;
+
+    rng_seed(&r, config->seed, STREAM_TILESET + index);
+
+    int columns = config->tiles < MAPGEN_COLUMNS ? config->tiles : MAPGEN_COLUMNS;
+    int rows = (config->tiles + columns - 1) / columns;
+
+    sb_printf(sb,
+            "\"type\":\"tileset\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"name\":\"tileset%d\","
+            "\"image\":\"tileset%d.png\",\"imagewidth\":%d,\"imageheight\":%d,\"columns\":%d,\"tilecount\":%d,"
+            "\"tilewidth\":%d,\"tileheight\":%d,\"margin\":0,\"spacing\":0",
+            index,
+            index,
+            columns * MAPGEN_TILE_SIZE,
+            rows * MAPGEN_TILE_SIZE,
+            columns,
+            config->tiles,
+            MAPGEN_TILE_SIZE,
+            MAPGEN_TILE_SIZE);
+
+    // Tile definitions only exist for tiles that carry something
+    int defined = config->properties > 0 ? config->tiles : config->animated_tiles;
+
+    if (defined > 0) {
+        sb_printf(sb, ",\"tiles\":[");
+
+        for (int id = 0; id < defined; id++) {
+            sb_printf(sb, "%s{\"id\":%d,\"type\":\"%s\"", id ? "," : "", id, object_types[rng_range(&r, 8)]);
+
+            if (id < config->animated_tiles) {
+                sb_printf(sb, ",\"animation\":[");
+
+                for (int f = 0; f < 4; f++) {
+                    sb_printf(sb,
+                            "%s{\"tileid\":%u,\"duration\":%u}",
+                            f ? "," : "",
+                            rng_range(&r, config->tiles),
+                            50 + 50 * rng_range(&r, 10));
+                }
+
+                sb_printf(sb, "]");
+            }
+
+            write_properties(sb, &r, config->properties, 0);
+
+            sb_printf(sb, "}");
+        }
+
+        sb_printf(sb, "]");
+    }
+}
+
+char* mapgen_tileset(const mapgen_config* config, int index, size_t* size) {
+    if (!config_valid(config) || index < 0 || index >= config->tilesets) {
+        return NULL;
+    }
+
+    strbuf sb = {0};
+
+    sb_printf(&sb, "{");
+    write_tileset_body(&sb, config, index);
+    sb_printf(&sb, "}");
+
+    return sb_finish(&sb, size);
+}
+
+/*
+ * Layers
+ */
+
+static void write_layer_header(strbuf* sb, int id, const char* name, const char* type) {
+    sb_printf(sb,
+            "{\"id\":%d,\"name\":\"%s\",\"type\":\"%s\",\"visible\":true,\"opacity\":1,\"x\":0,\"y\":0",
+            id,
+            name,
+            type);
+}
+
+static void write_tile_layer(strbuf* sb, const mapgen_config* config, int index, int id) {
+    rng r;
+
+    rng_seed(&r, config->seed, STREAM_TILE_LAYER_PROPERTIES + index);
+
+    size_t count = (size_t)config->width * config->height;
+    uint32_t* tiles = malloc(count * sizeof(uint32_t));
+
+    if (tiles == NULL) {
+        sb->failed = true;
+
+        return;
+    }
+
+    mapgen_layer_tiles(config, index, tiles);
+
+    char name[32];
+    snprintf(name, sizeof(name), "tiles%d", index);
+
+    write_layer_header(sb, id, name, "tilelayer");
+
+    sb_printf(sb, ",\"width\":%d,\"height\":%d", config->width, config->height);
+
+    if (config->encoding == MAPGEN_BASE64) {
+        sb_printf(sb, ",\"encoding\":\"base64\"");
+
+        if (config->compression != MAPGEN_NONE) {
+            sb_printf(sb, ",\"compression\":\"%s\"", mapgen_compression_name(config->compression));
+        }
+    }
+
+    if (config->infinite) {
+        size_t chunk_size = (size_t)config->chunk_width * config->chunk_height;
+        uint32_t* chunk = malloc(chunk_size * sizeof(uint32_t));
+
+        if (chunk == NULL) {
+            sb->failed = true;
+            free(tiles);
+
+            return;
+        }
+
+        sb_printf(sb, ",\"startx\":0,\"starty\":0,\"chunks\":[");
+
+        bool first = true;
+
+        for (int cy = 0; cy < config->height; cy += config->chunk_height) {
+            for (int cx = 0; cx < config->width; cx += config->chunk_width) {
+                for (int y = 0; y < config->chunk_height; y++) {
+                    for (int x = 0; x < config->chunk_width; x++) {
+                        bool inside = cx + x < config->width && cy + y < config->height;
+
+                        chunk[y * config->chunk_width + x] = inside ? tiles[(size_t)(cy + y) * config->width + cx + x] : 0;
+                    }
+                }
+
+                sb_printf(sb,
+                        "%s{\"x\":%d,\"y\":%d,\"width\":%d,\"height\":%d,\"data\":",
+                        first ? "" : ",",
+                        cx,
+                        cy,
+                        config->chunk_width,
+                        config->chunk_height);
+
+                write_data(sb, config, chunk, chunk_size);
+
+                sb_printf(sb, "}");
+
+                first = false;
+            }
+        }
+
+        sb_printf(sb, "]");
+
+        free(chunk);
+    } else {
+        sb_printf(sb, ",\"data\":");
+
+        write_data(sb, config, tiles, count);
+    }
+
+    free(tiles);
+
+    write_properties(sb, &r, config->properties, config->objects * config->object_layers);
+
+    sb_printf(sb, "}");
+}
+
+static void write_points(strbuf* sb, rng* r, const char* key, int count) {
+    sb_printf(sb, ",\"%s\":[", key);
+
+    for (int i = 0; i < count; i++) {
+        sb_printf(sb,
+                "%s{\"x\":%.1f,\"y\":%.1f}",
+                i ? "," : "",
+                (double)rng_range(r, 1281) / 10.0 - 64.0,
+                (double)rng_range(r, 1281) / 10.0 - 64.0);
+    }
+
+    sb_printf(sb, "]");
+}
+
+static void write_object_layer(strbuf* sb, const mapgen_config* config, int index, int id, int first_object_id) {
+    rng r;
+
+    rng_seed(&r, config->seed, STREAM_OBJECT_LAYER + index);
+
+    char name[32];
+    snprintf(name, sizeof(name), "objects%d", index);
+
+    write_layer_header(sb, id, name, "objectgroup");
+
+    sb_printf(sb, ",\"draworder\":\"topdown\",\"objects\":[");
+
+    int object_count = config->objects * config->object_layers;
+    int gid_count = config->tilesets * config->tiles;
+
+    for (int i = 0; i < config->objects; i++) {
+        int object_id = first_object_id + i;
+
+        double x = (double)rng_range(&r, (uint32_t)config->width * MAPGEN_TILE_SIZE * 4) / 4.0;
+        double y = (double)rng_range(&r, (uint32_t)config->height * MAPGEN_TILE_SIZE * 4) / 4.0;
+        double w = (double)(1 + rng_range(&r, 8)) * MAPGEN_TILE_SIZE;
+        double h = (double)(1 + rng_range(&r, 8)) * MAPGEN_TILE_SIZE;
+
+        // Rectangle, ellipse, point, polygon, polyline or tile object
+        uint32_t shape = rng_range(&r, 6);
+
+        if (config->polygon_points == 0 && (shape == 3 || shape == 4)) {
+            shape = 0;
+        }
+
+        if (shape == 2 || shape == 3 || shape == 4) {
+            w = 0;
+            h = 0;
+        }
+
+        sb_printf(sb,
+                "%s{\"id\":%d,\"name\":\"object%d\",\"type\":\"%s\",\"visible\":true,\"x\":%.2f,\"y\":%.2f,"
+                "\"width\":%.1f,\"height\":%.1f,\"rotation\":%d",
+                i ? "," : "",
+                object_id,
+                object_id,
+                object_types[rng_range(&r, 8)],
+                x,
+                y,
+                w,
+                h,
+                rng_range(&r, 4) == 0 ? (int)rng_range(&r, 360) : 0);
+
+        switch (shape) {
+            case 1:
+                sb_printf(sb, ",\"ellipse\":true");
+                break;
+            case 2:
+                sb_printf(sb, ",\"point\":true");
+                break;
+            case 3:
+                write_points(sb, &r, "polygon", config->polygon_points);
+                break;
+            case 4:
+                write_points(sb, &r, "polyline", config->polygon_points);
+                break;
+            case 5:
+                sb_printf(sb, ",\"gid\":%u", 1 + rng_range(&r, gid_count));
+                break;
+            default:
+                break;
+        }
+
+        write_properties(sb, &r, config->properties, object_count);
+
+        sb_printf(sb, "}");
+    }
+
+    sb_printf(sb, "]");
+
+    write_properties(sb, &r, config->properties, object_count);
+
+    sb_printf(sb, "}");
+}
+
+/*
+ * Maps
+ */
+
+char* mapgen_map(const mapgen_config* config, size_t* size) {
+    if (!config_valid(config)) {
+        return NULL;
+    }
+
+    rng r;
+
+    rng_seed(&r, config->seed, STREAM_MAP);
+
+    int layer_count = config->tile_layers + config->object_layers;
+    int object_count = config->objects * config->object_layers;
+
+    strbuf sb = {0};
+
+    sb_printf(&sb,
+            "{\"type\":\"map\",\"version\":\"1.10\",\"tiledversion\":\"1.10.2\",\"orientation\":\"orthogonal\","
+            "\"renderorder\":\"right-down\",\"infinite\":%s,\"compressionlevel\":-1,\"width\":%d,\"height\":%d,"
+            "\"tilewidth\":%d,\"tileheight\":%d,\"nextlayerid\":%d,\"nextobjectid\":%d,\"layers\":[",
+            config->infinite ? "true" : "false",
+            config->width,
+            config->height,
+            MAPGEN_TILE_SIZE,
+            MAPGEN_TILE_SIZE,
+            layer_count + 1,
+            object_count + 1);
+
+    // Tile layers first, then object layers on top, as Tiled would draw them
+    for (int i = 0; i < config->tile_layers; i++) {
+        if (i > 0) {
+            sb_printf(&sb, ",");
+        }
+
+        write_tile_layer(&sb, config, i, i + 1);
+    }
+
+    for (int i = 0; i < config->object_layers; i++) {
+        if (config->tile_layers + i > 0) {
+            sb_printf(&sb, ",");
+        }
+
+        write_object_layer(&sb, config, i, config->tile_layers + i + 1, 1 + i * config->objects);
+    }
+
+    sb_printf(&sb, "],\"tilesets\":[");
+
+    for (int i = 0; i < config->tilesets; i++) {
+        int firstgid = 1 + i * config->tiles;
+
+        if (config->external_tilesets) {
+            sb_printf(&sb, "%s{\"firstgid\":%d,\"source\":\"" MAPGEN_TILESET_SOURCE "\"}", i ? "," : "", firstgid, i);
+        } else {
+            sb_printf(&sb, "%s{\"firstgid\":%d,", i ? "," : "", firstgid);
+            write_tileset_body(&sb, config, i);
+            sb_printf(&sb, "}");
+        }
+    }
+
+    sb_printf(&sb, "]");
+
+    write_properties(&sb, &r, config->properties, object_count);
+
+    sb_printf(&sb, "}");
+
+    return sb_finish(&sb, size);
+}
@@ -0,0 +1,125 @@
+#ifndef LIBTMJ_MAPGEN
+#define LIBTMJ_MAPGEN
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @file
+ *
+ * Deterministic synthetic map generator, used by the benchmarks, the
+ * large-map tests and the tmj_mapgen tool. Given the same configuration
+ * (including the seed), the generator always produces byte-identical output.
+ */
+
+/**
+ * Tile layer data encoding.
+ */
+typedef enum mapgen_encoding {
+    MAPGEN_CSV, // JSON array of global tile IDs
+    MAPGEN_BASE64
+} mapgen_encoding;
+
+/**
+ * Tile layer data compression. Only meaningful with MAPGEN_BASE64.
+ */
+typedef enum mapgen_compression {
+    MAPGEN_NONE,
+    MAPGEN_ZLIB,
+    MAPGEN_GZIP,
+    MAPGEN_ZSTD
+} mapgen_compression;
+
+typedef struct mapgen_config {
+    uint64_t seed;
+
+    int width; // In tiles
+    int height; // In tiles
+
+    int tile_layers;
+    int object_layers;
+    int empty_percent; // Share of runs of tiles left empty, 0 for the default of one in eight
+
+    bool infinite;
+    int chunk_width; // Infinite maps only
+    int chunk_height; // Infinite maps only
+
+    mapgen_encoding encoding;
+    mapgen_compression compression;
+
+    int objects; // Per object layer
+    int polygon_points; // Vertices per polygon/polyline, 0 disables both shapes
+    int properties; // Per map, layer, object and tile definition
+
+    int tilesets;
+    int tiles; // Per tileset
+    int animated_tiles; // Per tileset, each with a four-frame animation
+    bool external_tilesets; // Reference tilesets by source instead of embedding them
+} mapgen_config;
+
+/**
+ * The source path that external tileset number index is referenced by,
+ * relative to the map.
+ */
+#define MAPGEN_TILESET_SOURCE "tileset%d.tsj"
+
+/**
+ * Fills config with the defaults: a 64x64 finite map with four CSV tile
+ * layers, one object layer of 64 objects, and one embedded 256-tile tileset.
+ */
+void mapgen_default_config(mapgen_config* config);
+
+/**
+ * Checks whether the generator was built with support for the given
+ * compression method.
+ */
+bool mapgen_compression_supported(mapgen_compression compression);
+
+/**
+ * Returns the name of the given compression method as used in the "compression"
+ * field of a tile layer, or "" for MAPGEN_NONE.
+ */
+const char* mapgen_compression_name(mapgen_compression compression);
+
+/**
+ * Generates the global tile IDs of one tile layer, row by row over the whole
+ * layer. Infinite maps split this grid into chunks, padding chunks that
+ * overhang the layer with empty tiles. The generated tiles are runs of a few
+ * tile IDs with gaps and occasional flip flags, which compress about as well
+ * as hand-made maps.
+ *
+ * @param config The generator configuration.
+ * @param layer The index of the tile layer.
+ * @param[out] tiles A buffer of at least width * height tile IDs.
+ */
+void mapgen_layer_tiles(const mapgen_config* config, int layer, uint32_t* tiles);
+
+/**
+ * Generates a map.
+ *
+ * @param config The generator configuration.
+ * @param[out] size The length of the returned string, excluding the
+ * terminator. May be NULL.
+ *
+ * @return On success, returns a dynamically-allocated null-terminated JSON
+ * string that must be freed by the caller. Returns NULL if the configuration is
+ * invalid, or asks for a compression method this build does not support.
+ */
+char* mapgen_map(const mapgen_config* config, size_t* size);
+
+/**
+ * Generates the standalone form of one of the map's tilesets, suitable for
+ * writing to MAPGEN_TILESET_SOURCE when the map uses external tilesets.
+ *
+ * @param config The generator configuration.
+ * @param index The index of the tileset.
+ * @param[out] size The length of the returned string, excluding the
+ * terminator. May be NULL.
+ *
+ * @return On success, returns a dynamically-allocated null-terminated JSON
+ * string that must be freed by the caller.
+ */
+char* mapgen_tileset(const mapgen_config* config, int index, size_t* size);
+
+#endif
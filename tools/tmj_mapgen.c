@@ -0,0 +1,205 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mapgen.h"
+
+/*
+ * tmj_mapgen
+ *
+ * Writes a seeded synthetic Tiled map (and its external tilesets, if asked
+ * for) for benchmarking and stress testing. See mapgen.h for what the
+ * generated maps contain.
+ */
+
+void usage(const char* argv0) {
+    printf("Usage: %s [options] OUTPUT.tmj\n"
+           "\n"
+           "Options:\n"
+           "  --seed N             Random seed (default 1)\n"
+           "  --size WxH           Map size in tiles (default 64x64)\n"
+           "  --tile-layers N      Number of tile layers (default 4)\n"
+           "  --object-layers N    Number of object layers (default 1)\n"
+           "  --empty N            Percentage of runs of tiles left empty, 0 for one in eight (default 0)\n"
+           "  --objects N          Objects per object layer (default 64)\n"
+           "  --polygon-points N   Vertices per polygon/polyline, 0 for none (default 8)\n"
+           "  --properties N       Properties per map, layer, object and tile (default 2)\n"
+           "  --infinite           Generate an infinite map\n"
+           "  --chunk WxH          Chunk size for infinite maps (default 16x16)\n"
+           "  --encoding ENC       csv or base64 (default csv)\n"
+           "  --compression COMP   none, zlib, gzip or zstd (default none, implies base64)\n"
+           "  --tilesets N         Number of tilesets (default 1)\n"
+           "  --tiles N            Tiles per tileset (default 256)\n"
+           "  --animated-tiles N   Animated tiles per tileset (default 0)\n"
+           "  --external           Write tilesets to separate files next to the map\n"
+           "  --help               Show this message\n",
+            argv0);
+}
+
+bool parse_size(const char* str, int* w, int* h) {
+    return sscanf(str, "%dx%d", w, h) == 2;
+}
+
+bool parse_compression(const char* str, mapgen_compression* compression) {
+    const mapgen_compression all[] = {MAPGEN_NONE, MAPGEN_ZLIB, MAPGEN_GZIP, MAPGEN_ZSTD};
+
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        const char* name = all[i] == MAPGEN_NONE ? "none" : mapgen_compression_name(all[i]);
+
+        if (strcmp(str, name) == 0) {
+            *compression = all[i];
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int write_file(const char* path, const char* data, size_t size) {
+    FILE* f = fopen(path, "wb");
+
+    if (f == NULL) {
+        fprintf(stderr, "Unable to open '%s' for writing\n", path);
+
+        return -1;
+    }
+
+    if (fwrite(data, 1, size, f) != size) {
+        fprintf(stderr, "Unable to write '%s'\n", path);
+        fclose(f);
+
+        return -1;
+    }
+
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+int main(int argc, char** argv) {
+    mapgen_config config;
+
+    mapgen_default_config(&config);
+
+    const char* output = NULL;
+    bool encoding_set = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* val = i + 1 < argc ? argv[i + 1] : NULL;
+        bool ok = true;
+
+        if (strcmp(arg, "--help") == 0) {
+            usage(argv[0]);
+
+            return EXIT_SUCCESS;
+        } else if (strcmp(arg, "--infinite") == 0) {
+            config.infinite = true;
+        } else if (strcmp(arg, "--external") == 0) {
+            config.external_tilesets = true;
+        } else if (arg[0] != '-') {
+            output = arg;
+        } else if (val == NULL) {
+            ok = false;
+        } else {
+            i++;
+
+            if (strcmp(arg, "--seed") == 0) {
+                config.seed = strtoull(val, NULL, 0);
+            } else if (strcmp(arg, "--size") == 0) {
+                ok = parse_size(val, &config.width, &config.height);
+            } else if (strcmp(arg, "--chunk") == 0) {
+                ok = parse_size(val, &config.chunk_width, &config.chunk_height);
+            } else if (strcmp(arg, "--tile-layers") == 0) {
+                config.tile_layers = atoi(val);
+            } else if (strcmp(arg, "--object-layers") == 0) {
+                config.object_layers = atoi(val);
+            } else if (strcmp(arg, "--empty") == 0) {
+                config.empty_percent = atoi(val);
+            } else if (strcmp(arg, "--objects") == 0) {
+                config.objects = atoi(val);
+            } else if (strcmp(arg, "--polygon-points") == 0) {
+                config.polygon_points = atoi(val);
+            } else if (strcmp(arg, "--properties") == 0) {
+                config.properties = atoi(val);
+            } else if (strcmp(arg, "--tilesets") == 0) {
+                config.tilesets = atoi(val);
+            } else if (strcmp(arg, "--tiles") == 0) {
+                config.tiles = atoi(val);
+            } else if (strcmp(arg, "--animated-tiles") == 0) {
+                config.animated_tiles = atoi(val);
+            } else if (strcmp(arg, "--encoding") == 0) {
+                encoding_set = true;
+
+                if (strcmp(val, "csv") == 0) {
+                    config.encoding = MAPGEN_CSV;
+                } else if (strcmp(val, "base64") == 0) {
+                    config.encoding = MAPGEN_BASE64;
+                } else {
+                    ok = false;
+                }
+            } else if (strcmp(arg, "--compression") == 0) {
+                ok = parse_compression(val, &config.compression);
+            } else {
+                ok = false;
+            }
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Invalid argument '%s'\n\n", arg);
+            usage(argv[0]);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (output == NULL) {
+        usage(argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    // Compressed data is always base64-encoded
+    if (config.compression != MAPGEN_NONE && !encoding_set) {
+        config.encoding = MAPGEN_BASE64;
+    }
+
+    if (!mapgen_compression_supported(config.compression)) {
+        fprintf(stderr, "This build does not support %s compression\n", mapgen_compression_name(config.compression));
+
+        return EXIT_FAILURE;
+    }
+
+    size_t size = 0;
+    char* map = mapgen_map(&config, &size);
+
+    if (map == NULL) {
+        fprintf(stderr, "Unable to generate map, check the options for invalid combinations\n");
+
+        return EXIT_FAILURE;
+    }
+
+    int ret = write_file(output, map, size);
+
+    free(map);
+
+    if (ret == 0 && config.external_tilesets) {
+        // External tilesets live next to the map
+        const char* slash = strrchr(output, '/');
+        int dir_len = slash ? (int)(slash - output + 1) : 0;
+
+        for (int i = 0; i < config.tilesets && ret == 0; i++) {
+            char path[4096];
+            char* tileset = mapgen_tileset(&config, i, &size);
+
+            int n = snprintf(path, sizeof(path), "%.*s", dir_len, output);
+            snprintf(path + n, sizeof(path) - n, MAPGEN_TILESET_SOURCE, i);
+
+            ret = tileset ? write_file(path, tileset, size) : -1;
+
+            free(tileset);
+        }
+    }
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}